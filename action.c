@@ -113,6 +113,7 @@
 #include "ruleset.h"
 #include "parserif.h"
 #include "statsobj.h"
+#include "hashtable.h"
 
 /* AIXPORT : cs renamed to legacy_cs as clashes with libpthreads variable in complete file*/
 #ifdef _AIX
@@ -327,6 +328,16 @@ rsRetVal actionDestruct(action_t * const pThis)
 		FINALIZE;
 	}
 
+	if(pThis->ppPartQueues != NULL) {
+		int i;
+		for(i = 1 ; i < pThis->nPartitions ; ++i) {
+			if(pThis->ppPartQueues[i] != NULL)
+				qqueueDestruct(&pThis->ppPartQueues[i]);
+		}
+		free(pThis->ppPartQueues);
+		msgPropDescrDestruct(&pThis->partitionKey);
+	}
+
 	if(pThis->pQueue != NULL) {
 		qqueueDestruct(&pThis->pQueue);
 	}
@@ -336,6 +347,7 @@ rsRetVal actionDestruct(action_t * const pThis)
 	 */
 	if(pThis->statsobj != NULL)
 		statsobj.Destruct(&pThis->statsobj);
+	statsHistDestruct(&pThis->pHistLatency);
 
 	if(pThis->pModData != NULL)
 		pThis->pMod->freeInstance(pThis->pModData);
@@ -408,6 +420,79 @@ finalize_it:
 }
 
 
+/* create the partition queues for an action whose queue has
+ * queue.partitions set. Each partition is a full action queue of its own
+ * (including its own stats), drained by a single worker. Messages are
+ * assigned to a partition based on the hash of the partition key, so
+ * messages with the same key are always processed in order. The action's
+ * regular queue becomes partition 0.
+ */
+static rsRetVal
+actionConstructPartitions(action_t *__restrict__ const pThis, uchar *const pszAName,
+	struct nvlst *const lst)
+{
+	qqueue_t *const pQueue = pThis->pQueue;
+	qqueue_t *pPart;
+	uchar pszPName[128];
+	uchar *pszPrefix;
+	int lenPrefix;
+	rsRetVal localRet;
+	int i;
+	DEFiRet;
+
+	if(pQueue->qType == QUEUETYPE_DIRECT) {
+		parser_warnmsg("action '%s': queue.partitions has no effect for direct "
+			"queues - ignored", pThis->pszName);
+		FINALIZE;
+	}
+	if(pQueue->pszPartitionKey == NULL) {
+		parser_errmsg("action '%s': queue.partitions requires queue.partitionkey "
+			"- partitioning disabled", pThis->pszName);
+		FINALIZE;
+	}
+	if(pQueue->iNumWorkerThreads > 1) {
+		parser_warnmsg("action '%s': queue.workerthreads is ignored for "
+			"partitioned queues, each partition uses a single worker to "
+			"preserve message order", pThis->pszName);
+	}
+	pQueue->iNumWorkerThreads = 1;
+
+	CHKiRet(msgPropDescrFill(&pThis->partitionKey, pQueue->pszPartitionKey,
+		ustrlen(pQueue->pszPartitionKey)));
+	CHKmalloc(pThis->ppPartQueues = calloc(pQueue->iNumPartitions, sizeof(qqueue_t*)));
+	pThis->ppPartQueues[0] = pQueue;
+	pThis->nPartitions = pQueue->iNumPartitions;
+
+	for(i = 1 ; i < pThis->nPartitions ; ++i) {
+		CHKiRet(qqueueConstruct(&pThis->ppPartQueues[i], pQueue->qType, 1,
+			pQueue->iMaxQueueSize, processBatchMain));
+		pPart = pThis->ppPartQueues[i];
+		snprintf((char*) pszPName, sizeof(pszPName), "%s[%d]", pszAName, i);
+		obj.SetName((obj_t*) pPart, pszPName);
+		qqueueSetpAction(pPart, pThis);
+		qqueueSetDefaultsActionQueue(pPart);
+		qqueueApplyCnfParam(pPart, lst);
+		pPart->iNumWorkerThreads = 1;
+		if(pPart->pszFilePrefix != NULL) {
+			/* each partition needs its own queue files */
+			lenPrefix = pPart->lenFilePrefix + 16;
+			CHKmalloc(pszPrefix = MALLOC(lenPrefix));
+			lenPrefix = snprintf((char*)pszPrefix, lenPrefix, "%s.%d",
+				pPart->pszFilePrefix, i);
+			localRet = qqueueSetFilePrefix(pPart, pszPrefix, lenPrefix);
+			free(pszPrefix);
+			CHKiRet(localRet);
+		}
+		qqueueDbgPrint(pPart);
+	}
+	DBGPRINTF("action '%s': created %d queue partitions, key '%s'\n",
+		pThis->pszName, pThis->nPartitions, pQueue->pszPartitionKey);
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* action construction finalizer
  */
 rsRetVal
@@ -470,6 +555,12 @@ actionConstructFinalize(action_t *__restrict__ const pThis, struct nvlst *lst)
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("resumed"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrResume));
 
+	if(glblLatencyStats) {
+		CHKiRet(statsHistConstruct(&pThis->pHistLatency));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("latency.commit.us"),
+			ctrType_Histogram, CTR_FLAG_RESETTABLE, pThis->pHistLatency));
+	}
+
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
 
 	/* create our queue */
@@ -546,6 +637,8 @@ actionConstructFinalize(action_t *__restrict__ const pThis, struct nvlst *lst)
 		/* we have v6-style config params */
 		qqueueSetDefaultsActionQueue(pThis->pQueue);
 		qqueueApplyCnfParam(pThis->pQueue, lst);
+		if(pThis->pQueue->iNumPartitions > 1)
+			CHKiRet(actionConstructPartitions(pThis, pszAName, lst));
 	}
 
 #	undef setQPROP
@@ -951,6 +1044,17 @@ static rsRetVal actionDbgPrint(action_t *pThis)
 #endif
 
 
+/* record the ingress-to-commit latency of a message. Messages that were
+ * created without an ingress timestamp are not counted.
+ */
+static inline void
+actionRecordLatency(action_t *const pAction, const uint64_t tIngressNs, const uint64_t tNow)
+{
+	if(tIngressNs != 0 && tIngressNs <= tNow)
+		statsHistRecord(pAction->pHistLatency, (tNow - tIngressNs) / 1000);
+}
+
+
 /* prepare the calling parameters for doAction()
  * rgerhards, 2009-05-07
  */
@@ -969,10 +1073,24 @@ prepareDoActionParams(action_t * __restrict__ const pAction,
 	pWrkrInfo = &(pWti->actWrkrInfo[pAction->iActionNbr]);
 	if(pAction->isTransactional) {
 		CHKiRet(wtiNewIParam(pWti, pAction, &iparams));
+		if(pAction->pHistLatency != NULL)
+			pWrkrInfo->p.tx.ingressNs[pWrkrInfo->p.tx.currIParam - 1] = pMsg->tIngressNs;
 		for(i = 0 ; i < pAction->iNumTpls ; ++i) {
-			CHKiRet(tplToString(pAction->ppTpl[i], pMsg, 
-					    &actParam(iparams, pAction->iNumTpls, 0, i),
-				            ttNow));
+			switch(pAction->peParamPassing[i]) {
+			case ACT_MSG_PASSING:
+				/* the message must stay alive until the commit */
+				actParam(iparams, pAction->iNumTpls, 0, i).param = (void*) MsgAddRef(pMsg);
+				break;
+			case ACT_JSON_PASSING:
+				CHKiRet(tplToJSON(pAction->ppTpl[i], pMsg, &json, ttNow));
+				actParam(iparams, pAction->iNumTpls, 0, i).param = (void*) json;
+				break;
+			default:
+				CHKiRet(tplToString(pAction->ppTpl[i], pMsg, 
+						    &actParam(iparams, pAction->iNumTpls, 0, i),
+					            ttNow));
+				break;
+			}
 		}
 	} else {
 		for(i = 0 ; i < pAction->iNumTpls ; ++i) {
@@ -1066,6 +1184,37 @@ releaseDoActionParams(action_t *__restrict__ const pAction, wti_t *__restrict__
 #endif
 
 
+/* release the message and JSON parameters of the current transaction.
+ * String buffers are kept, they are re-used for the next transaction.
+ */
+void
+actionReleaseTxParams(action_t *__restrict__ const pAction, wti_t *__restrict__ const pWti)
+{
+	actWrkrInfo_t *const wrkrInfo = &(pWti->actWrkrInfo[pAction->iActionNbr]);
+	actWrkrIParams_t *iparam;
+	int i, j;
+
+	if(!pAction->isTransactional)
+		return; /* p.tx is not valid, it aliases p.nontx */
+	if(!pAction->bUsesMsgPassingMode && !pAction->bNeedReleaseBatch)
+		return;
+	for(i = 0 ; i < wrkrInfo->p.tx.currIParam ; ++i) {
+		for(j = 0 ; j < pAction->iNumTpls ; ++j) {
+			iparam = &actParam(wrkrInfo->p.tx.iparams, pAction->iNumTpls, i, j);
+			if(iparam->param == NULL)
+				continue;
+			if(pAction->peParamPassing[j] == ACT_MSG_PASSING) {
+				msgDestruct((smsg_t**) &iparam->param);
+				iparam->param = NULL;
+			} else if(pAction->peParamPassing[j] == ACT_JSON_PASSING) {
+				json_object_put((struct json_object*) iparam->param);
+				iparam->param = NULL;
+			}
+		}
+	}
+}
+
+
 /* This is used in resume processing. We only finally know that a resume
  * worked when we have been able to actually process a messages. As such,
  * we need to do some cleanup and status tracking in that case.
@@ -1279,10 +1428,11 @@ actionWriteErrorFile(action_t *__restrict__ const pThis, wti_t *__restrict__ con
 
 	DBGPRINTF("action %d commit failed, writing %u messages to error file\n",
 		pThis->iActionNbr, nMsgs);
+	if(pThis->peParamPassing[0] != ACT_STRING_PASSING)
+		return;
 	for(i = 0 ; i < nMsgs ; ++i) {
-		// TODO: get actual param count!
 		dbgprintf("msg %d: '%s'\n", i,
-			actParam(wrkrInfo->p.tx.iparams, 1, i, 0).param);
+			(char*) actParam(wrkrInfo->p.tx.iparams, pThis->iNumTpls, i, 0).param);
 	}
 }
 
@@ -1344,8 +1494,20 @@ actionCommit(action_t *__restrict__ const pThis, wti_t *__restrict__ const pWti)
 			bDone = 1;
 		}
 	} while(!bDone);
+
+	if(pThis->pHistLatency != NULL && iRet == RS_RET_OK) {
+		const uint64_t tNow = statsHistNowNs();
+		actWrkrInfo_t *const wrkrInfo = &(pWti->actWrkrInfo[pThis->iActionNbr]);
+		int i;
+		for(i = 0 ; i < wrkrInfo->p.tx.currIParam ; ++i)
+			actionRecordLatency(pThis, wrkrInfo->p.tx.ingressNs[i], tNow);
+	}
 finalize_it:
-	pWti->actWrkrInfo[pThis->iActionNbr].p.tx.currIParam = 0; /* reset to beginning */
+	if(pThis->isTransactional) {
+		/* p.tx aliases p.nontx.actParams, so only touch it for tx actions */
+		actionReleaseTxParams(pThis, pWti);
+		pWti->actWrkrInfo[pThis->iActionNbr].p.tx.currIParam = 0; /* reset to beginning */
+	}
 	RETiRet;
 }
 
@@ -1394,6 +1556,8 @@ processMsgMain(action_t *__restrict__ const pAction,
 	iRet = actionProcessMessage(pAction,
 				    pWti->actWrkrInfo[pAction->iActionNbr].p.nontx.actParams,
 				    pWti);
+	if(pAction->pHistLatency != NULL && iRet == RS_RET_OK)
+		actionRecordLatency(pAction, pMsg->tIngressNs, statsHistNowNs());
 	if(pAction->bNeedReleaseBatch)
 		releaseDoActionParams(pAction, pWti, 0);
 finalize_it:
@@ -1431,6 +1595,7 @@ processBatchMain(void *__restrict__ const pVoid,
 	}
 
 	iRet = actionCommit(pAction, pWti);
+	wtiArenaReset(pWti);
 	RETiRet;
 }
 
@@ -1524,6 +1689,27 @@ static rsRetVal setActionQueType(void __attribute__((unused)) *pVal, uchar *pszT
 }
 
 
+/* select the queue to submit a message to. For partitioned actions, this
+ * is the partition that the message's key hashes to.
+ */
+static qqueue_t *
+actionSelectQueue(action_t *const pAction, smsg_t *const pMsg)
+{
+	uchar *pszKey;
+	rs_size_t lenKey;
+	unsigned short bMustBeFreed;
+	unsigned hash;
+
+	if(pAction->nPartitions <= 1)
+		return pAction->pQueue;
+	pszKey = MsgGetProp(pMsg, NULL, &pAction->partitionKey, &lenKey, &bMustBeFreed, NULL);
+	hash = hash_from_string(pszKey);
+	if(bMustBeFreed)
+		free(pszKey);
+	return pAction->ppPartQueues[hash % pAction->nPartitions];
+}
+
+
 /* This submits the message to the action queue in case we do NOT need to handle repeat
  * message processing. That case permits us to gain lots of freedom during processing
  * and thus speed. This is also utilized to submit messages in more complex cases once
@@ -1555,7 +1741,7 @@ doSubmitToActionQ(action_t * const pAction, wti_t * const pWti, smsg_t *pMsg)
 	} else {/* in this case, we do single submits to the queue. 
 		 * TODO: optimize this, we may do at least a multi-submit!
 		 */
-		iRet = qqueueEnqMsg(pAction->pQueue, eFLOWCTL_NO_DELAY,
+		iRet = qqueueEnqMsg(actionSelectQueue(pAction, pMsg), eFLOWCTL_NO_DELAY,
 			pAction->bCopyMsg ? MsgDup(pMsg) : MsgAddRef(pMsg));
 	}
 	pWti->execState.bPrevWasSuspended
@@ -1687,8 +1873,11 @@ DEFFUNC_llExecFunc(doActivateActions)
 {
 	rsRetVal localRet;
 	action_t * const pThis = (action_t*) pData;
+	int i;
 	BEGINfunc
 	localRet = qqueueStart(pThis->pQueue);
+	for(i = 1 ; i < pThis->nPartitions && localRet == RS_RET_OK ; ++i)
+		localRet = qqueueStart(pThis->ppPartQueues[i]);
 	if(localRet != RS_RET_OK) {
 		errmsg.LogError(0, localRet, "error starting up action queue");
 		if(localRet == RS_RET_FILE_PREFIX_MISSING) {
@@ -70,6 +70,9 @@ struct action_s {
 				 * in this order. */
 	paramPassing_t *peParamPassing;	/* mode of parameter passing to action for that template */
 	qqueue_t *pQueue;	/* action queue */
+	int nPartitions;	/* number of partition queues, 0 if not partitioned */
+	qqueue_t **ppPartQueues;/* partition queues, [0] is pQueue (NULL if not partitioned) */
+	msgPropDescr_t partitionKey; /* property whose value selects the partition */
 	pthread_mutex_t mutAction; /* primary action mutex */
 	uchar *pszName;		/* action name */
 	DEF_ATOMIC_HELPER_MUT(mutCAS)
@@ -85,6 +88,7 @@ struct action_s {
 	STATSCOUNTER_DEF(ctrSuspend, mutCtrSuspend)
 	STATSCOUNTER_DEF(ctrSuspendDuration, mutCtrSuspendDuration)
 	STATSCOUNTER_DEF(ctrResume, mutCtrResume)
+	statshist_t *pHistLatency; /* ingress-to-commit latency (us), NULL if latency stats are off */
 };
 
 
@@ -106,6 +110,7 @@ rsRetVal actionProcessCnf(struct cnfobj *o);
 void actionCommitAllDirect(wti_t *pWti);
 void actionRemoveWorker(action_t *const pAction, void *const actWrkrData);
 void releaseDoActionParams(action_t * const pAction, wti_t * const pWti, int action_destruct);
+void actionReleaseTxParams(action_t * const pAction, wti_t * const pWti);
 
 /* external data */
 extern int iActionNbr;
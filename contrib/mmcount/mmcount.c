@@ -39,6 +39,7 @@
 #include "module-template.h"
 #include "errmsg.h"
 #include "hashtable.h"
+#include "hashmap.h"
 
 
 #define JSON_COUNT_NAME "!mmcount"
@@ -60,7 +61,7 @@ typedef struct _instanceData {
 	char *pszKey;
 	char *pszValue;
 	int valueCounter;
-	struct hashtable *ht;
+	hashmap_t *ht;
 	pthread_mutex_t mut;
 } instanceData;
 
@@ -201,7 +202,7 @@ CODESTARTnewActInst
 	}
 
 	if(pData->pszKey != NULL && pData->pszValue == NULL) {
-		if(NULL == (pData->ht = create_hashtable(100, hash_from_key_fn, key_equals_fn, NULL))) {
+		if(NULL == (pData->ht = hashmapNew(100, hash_from_key_fn, key_equals_fn, NULL))) {
 			DBGPRINTF("mmcount: error creating hash table!\n");
 			ABORT_FINALIZE(RS_RET_ERR);
 		}
@@ -221,7 +222,7 @@ CODESTARTtryResume
 ENDtryResume
 
 static int *
-getCounter(struct hashtable *ht, char *str) {
+getCounter(hashmap_t *ht, char *str) {
 	unsigned int key;
 	int *pCounter;
 	unsigned int *pKey;
@@ -229,7 +230,7 @@ getCounter(struct hashtable *ht, char *str) {
 	/* we dont store str as key, instead we store hash of the str
 	   as key to reduce memory usage */
 	key = hash_from_string(str);
-	pCounter = hashtable_search(ht, &key);
+	pCounter = hashmapSearch(ht, &key);
 	if(pCounter) {
 		return pCounter;
 	}
@@ -249,7 +250,7 @@ getCounter(struct hashtable *ht, char *str) {
 	}
 	*pCounter = 0;
 
-	if(!hashtable_insert(ht, pKey, pCounter)) {
+	if(!hashmapInsert(ht, pKey, pCounter)) {
 		DBGPRINTF("mmcount: inserting element into hashtable failed\n");
 		free(pKey);
 		free(pCounter);
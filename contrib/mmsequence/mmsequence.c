@@ -43,7 +43,7 @@
 #include "template.h"
 #include "module-template.h"
 #include "errmsg.h"
-#include "hashtable.h"
+#include "hashmap.h"
 
 #define JSON_VAR_NAME "$!mmsequence"
 
@@ -102,7 +102,7 @@ static struct cnfparamblk actpblk =
 	};
 
 /* table for key-counter pairs */	
-static struct hashtable *ght;
+static hashmap_t *ght;
 static pthread_mutex_t ght_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_mutex_t inst_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -251,7 +251,7 @@ CODESTARTnewActInst
 			ABORT_FINALIZE(RS_RET_ERR);
 		}
 		if (ght == NULL) {
-			if(NULL == (ght = create_hashtable(100, hash_from_string, key_equals_string, NULL))) {
+			if(NULL == (ght = hashmapNewStr(100, NULL))) {
 				pthread_mutex_unlock(&ght_mutex);
 				DBGPRINTF("mmsequence: error creating hash table!\n");
 				ABORT_FINALIZE(RS_RET_ERR);
@@ -279,11 +279,11 @@ CODESTARTtryResume
 ENDtryResume
 
 static int *
-getCounter(struct hashtable *ht, char *str, int initial) {
+getCounter(hashmap_t *ht, char *str, int initial) {
 	int *pCounter;
 	char *pStr;
 
-	pCounter = hashtable_search(ht, str);
+	pCounter = hashmapSearch(ht, str);
 	if(pCounter) {
 		return pCounter;
 	}
@@ -302,7 +302,7 @@ getCounter(struct hashtable *ht, char *str, int initial) {
 	}
 	*pCounter = initial;
 
-	if(!hashtable_insert(ht, pStr, pCounter)) {
+	if(!hashmapInsert(ht, pStr, pCounter)) {
 		DBGPRINTF("mmsequence: inserting element into hashtable failed\n");
 		free(pStr);
 		free(pCounter);
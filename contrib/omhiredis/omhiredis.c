@@ -66,12 +66,16 @@ typedef struct _instanceData {
 	int mode; /* mode constant */
 	uchar *key; /* key for QUEUE and PUBLISH modes */
 	sbool dynaKey; /* Should we treat the key as a template? */
+	sbool useRPush; /* use RPUSH instead of LPUSH in QUEUE mode */
 } instanceData;
 
 typedef struct wrkrInstanceData {
 	instanceData *pData; /* instanc data */
 	redisContext *conn; /* redis connection */
 	int count; /* count of command sent for current batch */
+	const char **argv; /* argument vector for multi-value pushes */
+	size_t *argvlen;
+	unsigned maxArgs; /* allocated size of argv and argvlen */
 } wrkrInstanceData_t;
 
 static struct cnfparamdescr actpdescr[] = {
@@ -81,7 +85,8 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "template", eCmdHdlrGetWord, 0 },
 	{ "mode", eCmdHdlrGetWord, 0 },
 	{ "key", eCmdHdlrGetWord, 0 },
-	{ "dynakey", eCmdHdlrBinary, 0 }
+	{ "dynakey", eCmdHdlrBinary, 0 },
+	{ "userpush", eCmdHdlrBinary, 0 }
 };
 
 static struct cnfparamblk actpblk = {
@@ -125,6 +130,8 @@ ENDfreeInstance
 BEGINfreeWrkrInstance
 CODESTARTfreeWrkrInstance
 	closeHiredis(pWrkrData);
+	free(pWrkrData->argv);
+	free(pWrkrData->argvlen);
 ENDfreeWrkrInstance
 
 BEGINdbgPrintInstInfo
@@ -137,6 +144,7 @@ static rsRetVal initHiredis(wrkrInstanceData_t *pWrkrData, int bSilent)
 {
 	char *server;
 	char *serverpasswd;
+	redisReply *reply;
 	DEFiRet;
 
 	server = (pWrkrData->pData->server == NULL) ? "127.0.0.1" : 
@@ -147,38 +155,42 @@ static rsRetVal initHiredis(wrkrInstanceData_t *pWrkrData, int bSilent)
 	struct timeval timeout = { 1, 500000 }; /* 1.5 seconds */
 	pWrkrData->conn = redisConnectWithTimeout(server, pWrkrData->pData->port,
 			timeout);
-	if (pWrkrData->conn->err) {
+	if (pWrkrData->conn == NULL || pWrkrData->conn->err) {
 		if(!bSilent)
 			errmsg.LogError(0, RS_RET_SUSPENDED,
 				"can not initialize redis handle");
+		closeHiredis(pWrkrData);
 		ABORT_FINALIZE(RS_RET_SUSPENDED);
 	}
 
+	/* authenticate synchronously, so that the AUTH reply does not
+	 * end up in the reply stream of the first batch */
 	if (pWrkrData->pData->serverpassword != NULL) {
 		serverpasswd = (char*) pWrkrData->pData->serverpassword;
-		int rc;
-		rc = redisAppendCommand(pWrkrData->conn, "AUTH %s", serverpasswd);
-		if (rc == REDIS_ERR) {
-			errmsg.LogError(0, NO_ERRCODE, "omhiredis: %s", pWrkrData->conn->errstr);
-			ABORT_FINALIZE(RS_RET_ERR);
-		} else {
-			pWrkrData->count++;
+		reply = redisCommand(pWrkrData->conn, "AUTH %s", serverpasswd);
+		if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+			errmsg.LogError(0, RS_RET_SUSPENDED, "omhiredis: authentication failed: %s",
+				(reply == NULL) ? pWrkrData->conn->errstr : reply->str);
+			if(reply != NULL)
+				freeReplyObject(reply);
+			closeHiredis(pWrkrData);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
 		}
+		freeReplyObject(reply);
 	}
 
 finalize_it:
 	RETiRet;
 }
 
-rsRetVal writeHiredis(uchar* key, uchar *message, wrkrInstanceData_t *pWrkrData)
+/* append the command for a single message to the pipeline. Used for
+ * TEMPLATE and PUBLISH mode, QUEUE mode is handled by appendQueueCmds().
+ */
+static rsRetVal
+writeHiredis(uchar* key, uchar *message, wrkrInstanceData_t *pWrkrData)
 {
 	DEFiRet;
 
-	/* if we do not have a redis connection, call
-	 * initHiredis and try to establish one */
-	if(pWrkrData->conn == NULL)
-		CHKiRet(initHiredis(pWrkrData, 0));
-
 	/* try to append the command to the pipeline. 
 	 * REDIS_ERR reply indicates something bad
 	 * happened, in which case abort. otherwise
@@ -189,9 +201,6 @@ rsRetVal writeHiredis(uchar* key, uchar *message, wrkrInstanceData_t *pWrkrData)
 		case OMHIREDIS_MODE_TEMPLATE:
 			rc = redisAppendCommand(pWrkrData->conn, (char*)message);
 			break;
-		case OMHIREDIS_MODE_QUEUE:
-			rc = redisAppendCommand(pWrkrData->conn, "LPUSH %s %s", key, (char*)message);
-			break;
 		case OMHIREDIS_MODE_PUBLISH:
 			rc = redisAppendCommand(pWrkrData->conn, "PUBLISH %s %s", key, (char*)message);
 			break;
@@ -203,7 +212,7 @@ rsRetVal writeHiredis(uchar* key, uchar *message, wrkrInstanceData_t *pWrkrData)
 	if (rc == REDIS_ERR) {
 		errmsg.LogError(0, NO_ERRCODE, "omhiredis: %s", pWrkrData->conn->errstr);
 		dbgprintf("omhiredis: %s\n", pWrkrData->conn->errstr);
-		ABORT_FINALIZE(RS_RET_ERR);
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
 	} else {
 		pWrkrData->count++;
 	}
@@ -212,6 +221,114 @@ finalize_it:
 	RETiRet;
 }
 
+/* make sure the argument vector can hold nArgs entries */
+static rsRetVal
+growArgs(wrkrInstanceData_t *const pWrkrData, const unsigned nArgs)
+{
+	const char **newArgv;
+	size_t *newArgvlen;
+	DEFiRet;
+
+	if(nArgs > pWrkrData->maxArgs) {
+		CHKmalloc(newArgv = realloc(pWrkrData->argv, nArgs * sizeof(char*)));
+		pWrkrData->argv = newArgv;
+		CHKmalloc(newArgvlen = realloc(pWrkrData->argvlen, nArgs * sizeof(size_t)));
+		pWrkrData->argvlen = newArgvlen;
+		pWrkrData->maxArgs = nArgs;
+	}
+finalize_it:
+	RETiRet;
+}
+
+static rsRetVal
+appendArgv(wrkrInstanceData_t *const pWrkrData, const unsigned nArgs)
+{
+	DEFiRet;
+
+	if(redisAppendCommandArgv(pWrkrData->conn, nArgs, pWrkrData->argv,
+		pWrkrData->argvlen) == REDIS_ERR) {
+		errmsg.LogError(0, NO_ERRCODE, "omhiredis: %s", pWrkrData->conn->errstr);
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+	pWrkrData->count++;
+finalize_it:
+	RETiRet;
+}
+
+/* QUEUE mode: consecutive messages for the same key are pushed with a
+ * single multi-value LPUSH/RPUSH. "LPUSH k a b" leaves the list exactly
+ * as "LPUSH k a" followed by "LPUSH k b" would, so ordering semantics
+ * do not change.
+ */
+static rsRetVal
+appendQueueCmds(wrkrInstanceData_t *const pWrkrData, actWrkrIParams_t *const pParams,
+	const unsigned nParams)
+{
+	instanceData *const pData = pWrkrData->pData;
+	const int nTpls = pData->dynaKey ? 2 : 1;
+	const char *key;
+	unsigned nArgs = 0;
+	unsigned i;
+	DEFiRet;
+
+	CHKiRet(growArgs(pWrkrData, nParams + 2));
+	for(i = 0 ; i < nParams ; ++i) {
+		key = pData->dynaKey ? (char*) actParam(pParams, nTpls, i, 1).param
+				     : (char*) pData->key;
+		if(nArgs > 0 && strcmp(key, pWrkrData->argv[1])) {
+			CHKiRet(appendArgv(pWrkrData, nArgs));
+			nArgs = 0;
+		}
+		if(nArgs == 0) {
+			pWrkrData->argv[0] = pData->useRPush ? "RPUSH" : "LPUSH";
+			pWrkrData->argvlen[0] = 5;
+			pWrkrData->argv[1] = key;
+			pWrkrData->argvlen[1] = strlen(key);
+			nArgs = 2;
+		}
+		pWrkrData->argv[nArgs] = (char*) actParam(pParams, nTpls, i, 0).param;
+		pWrkrData->argvlen[nArgs] = actParam(pParams, nTpls, i, 0).lenStr;
+		++nArgs;
+	}
+	if(nArgs > 0)
+		CHKiRet(appendArgv(pWrkrData, nArgs));
+
+finalize_it:
+	RETiRet;
+}
+
+/* read the replies for all commands of the current batch. A connection
+ * error suspends the action (the batch is then retried). Error replies
+ * are reported, but do not fail the batch, as retrying would not help.
+ */
+static rsRetVal
+getReplies(wrkrInstanceData_t *const pWrkrData)
+{
+	redisReply *reply;
+	int nErrs = 0;
+	int i;
+	DEFiRet;
+
+	for(i = 0 ; i < pWrkrData->count ; ++i) {
+		if(redisGetReply(pWrkrData->conn, (void*)&reply) != REDIS_OK) {
+			dbgprintf("omhiredis: %s\n", pWrkrData->conn->errstr);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+		if(reply->type == REDIS_REPLY_ERROR) {
+			if(nErrs == 0)
+				errmsg.LogError(0, RS_RET_ERR, "omhiredis: redis error: %s", reply->str);
+			++nErrs;
+		}
+		freeReplyObject(reply);
+	}
+	if(nErrs > 1)
+		dbgprintf("omhiredis: %d of %d commands in batch failed\n", nErrs, pWrkrData->count);
+
+finalize_it:
+	pWrkrData->count = 0;
+	RETiRet;
+}
+
 /* called when resuming from suspended state.
  * try to restablish our connection to redis */
 BEGINtryResume
@@ -227,50 +344,42 @@ ENDtryResume
 BEGINbeginTransaction
 CODESTARTbeginTransaction
 	dbgprintf("omhiredis: beginTransaction called\n");
-	pWrkrData->count = 0;
+	if(pWrkrData->conn == NULL)
+		CHKiRet(initHiredis(pWrkrData, 0));
+finalize_it:
 ENDbeginTransaction
 
-/* call writeHiredis for this log line,
- * which appends it as a command to the
- * current pipeline */
-BEGINdoAction
-CODESTARTdoAction
-	if(pWrkrData->pData->dynaKey) { 
-		CHKiRet(writeHiredis(ppString[1], ppString[0], pWrkrData));
-	}
-	else {
-		CHKiRet(writeHiredis(pWrkrData->pData->key, ppString[0], pWrkrData));
-	}
-	iRet = RS_RET_DEFER_COMMIT;
-finalize_it:
-ENDdoAction
-
-/* called when we have reached the end of a
- * batch (queue.dequeuebatchsize).  this
- * iterates over the replies, putting them
- * into the pData->replies buffer. we currently
- * don't really bother to check for errors
- * which should be fixed */
-BEGINendTransaction
-CODESTARTendTransaction
-	dbgprintf("omhiredis: endTransaction called\n");
-	redisReply *reply;
-	int i;
-	for ( i = 0; i < pWrkrData->count; i++ ) {
-		redisGetReply ( pWrkrData->conn, (void*)&reply);
-		if( pWrkrData->conn->err ){
-			dbgprintf("omhiredis: %s\n", pWrkrData->conn->errstr);
-			closeHiredis(pWrkrData);
-			ABORT_FINALIZE(RS_RET_SUSPENDED);
-		}
-		else {
-			freeReplyObject(reply);
+/* called with the complete batch (queue.dequeuebatchsize). All
+ * commands are appended to the pipeline first, the replies are then
+ * collected in one go, so we pay one round trip per batch. If anything
+ * fails, the connection is dropped, which also discards commands that
+ * are still buffered and not yet sent.
+ */
+BEGINcommitTransaction
+	instanceData *const pData = pWrkrData->pData;
+	const int nTpls = pData->dynaKey ? 2 : 1;
+	uchar *key;
+	unsigned i;
+CODESTARTcommitTransaction
+	dbgprintf("omhiredis: commitTransaction called\n");
+	if(pWrkrData->conn == NULL)
+		CHKiRet(initHiredis(pWrkrData, 0));
+
+	pWrkrData->count = 0;
+	if(pData->mode == OMHIREDIS_MODE_QUEUE) {
+		CHKiRet(appendQueueCmds(pWrkrData, pParams, nParams));
+	} else {
+		for(i = 0 ; i < nParams ; ++i) {
+			key = pData->dynaKey ? actParam(pParams, nTpls, i, 1).param : pData->key;
+			CHKiRet(writeHiredis(key, actParam(pParams, nTpls, i, 0).param, pWrkrData));
 		}
 	}
+	CHKiRet(getReplies(pWrkrData));
 
 finalize_it:
-	RETiRet;
-ENDendTransaction
+	if(iRet != RS_RET_OK)
+		closeHiredis(pWrkrData);
+ENDcommitTransaction
 
 /* set defaults. note server is set to NULL 
  * and is set to a default in initHiredis if 
@@ -286,6 +395,7 @@ setInstParamDefaults(instanceData *pData)
 	pData->mode = OMHIREDIS_MODE_TEMPLATE;
 	pData->modeDescription = "template";
 	pData->key = NULL;
+	pData->useRPush = 0;
 }
 
 /* here is where the work to set up a new instance
@@ -317,6 +427,8 @@ CODESTARTnewActInst
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "dynakey")) {
 			pData->dynaKey = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "userpush")) {
+			pData->useRPush = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "mode")) {
 			pData->modeDescription = es_str2cstr(pvals[i].val.d.estr, NULL);
 			if (!strcmp(pData->modeDescription, "template")) {
@@ -400,10 +512,9 @@ ENDmodExit
  * with the rsyslog core engine */
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES /*  supports transaction interface */
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
-CODEqueryEtryPt_TXIF_OMOD_QUERIES /*  supports transaction interface */ 
 ENDqueryEtryPt
 
 /* note we do not support rsyslog v5 syntax */
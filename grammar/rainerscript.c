@@ -58,6 +58,7 @@
 
 DEFobjCurrIf(obj)
 DEFobjCurrIf(regexp)
+DEFobjCurrIf(prop)
 
 struct cnfexpr* cnfexprOptimize(struct cnfexpr *expr);
 static void cnfstmtOptimizePRIFilt(struct cnfstmt *stmt);
@@ -1359,6 +1360,48 @@ var2CString(struct svar *__restrict__ const r, int *__restrict__ const bMustFree
 	return cstr;
 }
 
+/* Same as var2CString(), but intended for temporaries that are only needed
+ * while the current function call is evaluated. If the calling thread runs
+ * inside a worker instance, the string is placed into the worker's arena,
+ * which saves malloc()/free() per call. In that case bMustFree is set to 0,
+ * as the memory is reclaimed when the batch has been processed. If no arena
+ * is available (e.g. during config processing), we fall back to var2CString().
+ */
+static uchar*
+var2CStringTmp(struct svar *__restrict__ const r, int *__restrict__ const bMustFree)
+{
+	wtiArena_t *const arena = wtiGetArena();
+	const char *src;
+	size_t len;
+	uchar *cstr;
+
+	if(arena == NULL)
+		return var2CString(r, bMustFree);
+
+	if(r->datatype == 'N') {
+		/* 21 bytes is sufficient for any 64 bit number including sign and '\0' */
+		if((cstr = wtiArenaAlloc(arena, 21)) == NULL)
+			return var2CString(r, bMustFree);
+		snprintf((char*)cstr, 21, "%lld", r->d.n);
+		*bMustFree = 0;
+		return cstr;
+	}
+
+	if(r->datatype == 'J') {
+		src = (r->d.json == NULL) ? "" : json_object_get_string(r->d.json);
+		len = strlen(src);
+	} else {
+		src = (char*) es_getBufAddr(r->d.estr);
+		len = es_strlen(r->d.estr);
+	}
+	if((cstr = wtiArenaAlloc(arena, len + 1)) == NULL)
+		return var2CString(r, bMustFree);
+	memcpy(cstr, src, len);
+	cstr[len] = '\0';
+	*bMustFree = 0;
+	return cstr;
+}
+
 /* frees struct svar members, but not the struct itself. This is because
  * it usually is allocated on the stack. Callers why dynamically allocate
  * struct svar need to free the struct themselfes!
@@ -1384,13 +1427,14 @@ varFreeMembers(const struct svar *r)
 }
 
 
+/* locate field number matchnbr inside str. On success, *pFldStart points to
+ * the start of the field inside str and *pLenFld is its length. No copy is
+ * made, so the caller can construct the result string directly from str.
+ */
 static rsRetVal
-doExtractFieldByChar(uchar *str, uchar delim, const int matchnbr, uchar **resstr)
+doExtractFieldByChar(uchar *str, uchar delim, const int matchnbr, uchar **pFldStart, int *pLenFld)
 {
 	int iCurrFld;
-    int allocLen;
-	int iLen;
-	uchar *pBuf;
 	uchar *pFld;
 	uchar *pFldEnd;
 	DEFiRet;
@@ -1410,25 +1454,12 @@ doExtractFieldByChar(uchar *str, uchar delim, const int matchnbr, uchar **resstr
 	DBGPRINTF("field() field requested %d, field found %d\n", matchnbr, iCurrFld);
 	
 	if(iCurrFld == matchnbr) {
-		/* field found, now extract it */
-		/* first of all, we need to find the end */
+		/* field found, now we need to find the end */
 		pFldEnd = pFld;
 		while(*pFldEnd && *pFldEnd != delim)
 			++pFldEnd;
-		--pFldEnd; /* we are already at the delimiter - so we need to
-			    * step back a little not to copy it as part of the field. */
-		/* we got our end pointer, now do the copy */
-		iLen = pFldEnd - pFld + 1; /* the +1 is for an actual char, NOT \0! */
-		allocLen = iLen + 1;
-#		ifdef VALGRIND
-		allocLen += (3 - (iLen % 4));
-        	/*older versions of valgrind have a problem with strlen inspecting 4-bytes at a time*/
-#		endif
-		CHKmalloc(pBuf = MALLOC(allocLen));
-		/* now copy */
-		memcpy(pBuf, pFld, iLen);
-		pBuf[iLen] = '\0'; /* terminate it */
-		*resstr = pBuf;
+		*pFldStart = pFld;
+		*pLenFld = pFldEnd - pFld;
 	} else {
 		ABORT_FINALIZE(RS_RET_FIELD_NOT_FOUND);
 	}
@@ -1437,12 +1468,12 @@ finalize_it:
 }
 
 
+/* string-delimiter version of doExtractFieldByChar(), same interface */
 static rsRetVal
-doExtractFieldByStr(uchar *str, char *delim, const rs_size_t lenDelim, const int matchnbr, uchar **resstr)
+doExtractFieldByStr(uchar *str, char *delim, const rs_size_t lenDelim, const int matchnbr,
+	uchar **pFldStart, int *pLenFld)
 {
 	int iCurrFld;
-	int iLen;
-	uchar *pBuf;
 	uchar *pFld;
 	uchar *pFldEnd;
 	DEFiRet;
@@ -1462,21 +1493,15 @@ doExtractFieldByStr(uchar *str, char *delim, const rs_size_t lenDelim, const int
 	DBGPRINTF("field() field requested %d, field found %d\n", matchnbr, iCurrFld);
 	
 	if(iCurrFld == matchnbr) {
-		/* field found, now extract it */
-		/* first of all, we need to find the end */
+		/* field found, now we need to find the end */
 		pFldEnd = (uchar*) strstr((char*)pFld, delim);
 		if(pFldEnd == NULL) {
-			iLen = strlen((char*) pFld);
+			*pLenFld = strlen((char*) pFld);
 		} else { /* found delmiter!  Note that pFldEnd *is* already on 
 			  * the first delmi char, we don't need that. */
-			iLen = pFldEnd - pFld;
+			*pLenFld = pFldEnd - pFld;
 		}
-		/* we got our end pointer, now do the copy */
-		CHKmalloc(pBuf = MALLOC(iLen + 1));
-		/* now copy */
-		memcpy(pBuf, pFld, iLen);
-		pBuf[iLen] = '\0'; /* terminate it */
-		*resstr = pBuf;
+		*pFldStart = pFld;
 	} else {
 		ABORT_FINALIZE(RS_RET_FIELD_NOT_FOUND);
 	}
@@ -1507,7 +1532,7 @@ doFunc_re_extract(struct cnffunc *func, struct svar *ret, void* usrptr)
 	 */
 	cnfexprEval(func->expr[2], &r[2], usrptr);
 	cnfexprEval(func->expr[3], &r[3], usrptr);
-	str = (char*) var2CString(&r[0], &bMustFree);
+	str = (char*) var2CStringTmp(&r[0], &bMustFree);
 	matchnbr = (short) var2Number(&r[2], NULL);
 	submatchnbr = (size_t) var2Number(&r[3], NULL);
 	if(submatchnbr >= sizeof(pmatch)/sizeof(regmatch_t)) {
@@ -1722,7 +1747,7 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 	es_str_t *estr;
 	char *str;
 	uchar *resStr;
-	int retval;
+	int lenRes;
 	struct svar r[CNFFUNC_MAX_ARGS];
 	int delim;
 	int matchnbr;
@@ -1782,8 +1807,7 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 		 * string following.
 		 */
 		cnfexprEval(func->expr[0], &r[0], usrptr);
-		estr = var2String(&r[0], &bMustFree);
-		str = (char*) es_str2cstr(estr, NULL);
+		str = (char*) var2CStringTmp(&r[0], &bMustFree);
 		envvar = getenv(str);
 		if(envvar == NULL) {
 			ret->d.estr = es_newStr(0);
@@ -1791,9 +1815,8 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 			ret->d.estr = es_newStrFromCStr(envvar, strlen(envvar));
 		}
 		ret->datatype = 'S';
-		if(bMustFree) es_deleteStr(estr);
+		if(bMustFree) free(str);
 		varFreeMembers(&r[0]);
-		free(str);
 		break;
 	case CNFFUNC_TOLOWER:
 		cnfexprEval(func->expr[0], &r[0], usrptr);
@@ -1830,16 +1853,8 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 		break;
 	case CNFFUNC_RE_MATCH:
 		cnfexprEval(func->expr[0], &r[0], usrptr);
-		str = (char*) var2CString(&r[0], &bMustFree);
-		retval = regexp.regexec(func->funcdata, str, 0, NULL, 0);
-		if(retval == 0)
-			ret->d.n = 1;
-		else {
-			ret->d.n = 0;
-			if(retval != REG_NOMATCH) {
-				DBGPRINTF("re_match: regexec returned error %d\n", retval);
-			}
-		}
+		str = (char*) var2CStringTmp(&r[0], &bMustFree);
+		ret->d.n = (func->funcdata != NULL) && regexp.match(func->funcdata, str);
 		ret->datatype = 'N';
 		if(bMustFree) free(str);
 		varFreeMembers(&r[0]);
@@ -1854,21 +1869,21 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 		cnfexprEval(func->expr[0], &r[0], usrptr);
 		cnfexprEval(func->expr[1], &r[1], usrptr);
 		cnfexprEval(func->expr[2], &r[2], usrptr);
-		str = (char*) var2CString(&r[0], &bMustFree);
+		str = (char*) var2CStringTmp(&r[0], &bMustFree);
 		matchnbr = var2Number(&r[2], NULL);
 		if(r[1].datatype == 'S') {
 			char *delimstr;
-			delimstr = (char*) es_str2cstr(r[1].d.estr, NULL);
+			int bMustFreeDelim;
+			delimstr = (char*) var2CStringTmp(&r[1], &bMustFreeDelim);
 			localRet = doExtractFieldByStr((uchar*)str, delimstr, es_strlen(r[1].d.estr),
-							matchnbr, &resStr);
-			free(delimstr);
+							matchnbr, &resStr, &lenRes);
+			if(bMustFreeDelim) free(delimstr);
 		} else {
 			delim = var2Number(&r[1], NULL);
-			localRet = doExtractFieldByChar((uchar*)str, (char) delim, matchnbr, &resStr);
+			localRet = doExtractFieldByChar((uchar*)str, (char) delim, matchnbr, &resStr, &lenRes);
 		}
 		if(localRet == RS_RET_OK) {
-			ret->d.estr = es_newStrFromCStr((char*)resStr, strlen((char*)resStr));
-			free(resStr);
+			ret->d.estr = es_newStrFromBuf((char*)resStr, lenRes);
 		} else if(localRet == RS_RET_FIELD_NOT_FOUND) {
 			ret->d.estr = es_newStrFromCStr("***FIELD NOT FOUND***",
 					sizeof("***FIELD NOT FOUND***")-1);
@@ -1904,7 +1919,7 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 			lookup_key_type = lookup_table->key_type;
 			bMustFree = 0;
 			if (lookup_key_type == LOOKUP_KEY_TYPE_STRING) {
-				key.k_str = (uchar*) var2CString(&r[1], &bMustFree);
+				key.k_str = (uchar*) var2CStringTmp(&r[1], &bMustFree);
 			} else if (lookup_key_type == LOOKUP_KEY_TYPE_UINT) {
 				key.k_uint = var2Number(&r[1], NULL);
 			} else {
@@ -1926,7 +1941,7 @@ doFuncCall(struct cnffunc *__restrict__ const func, struct svar *__restrict__ co
 			break;
 		}
 		cnfexprEval(func->expr[1], &r[1], usrptr);
-		str = (char*) var2CString(&r[1], &bMustFree);
+		str = (char*) var2CStringTmp(&r[1], &bMustFree);
 		ret->d.n = dynstats_inc(func->funcdata, (uchar*)str);
 		if(bMustFree) free(str);
 		varFreeMembers(&r[1]);
@@ -2577,6 +2592,10 @@ cnffuncDestruct(struct cnffunc *func)
 	/* some functions require special destruction */
 	switch(func->fID) {
 		case CNFFUNC_RE_MATCH:
+			/* NULL if regexp could not be loaded */
+			if(func->funcdata != NULL)
+				regexp.freeMatcher(func->funcdata);
+			break;
 		case CNFFUNC_RE_EXTRACT:
 			if(func->funcdata != NULL)
 				regexp.regfree(func->funcdata);
@@ -2589,6 +2608,55 @@ cnffuncDestruct(struct cnffunc *func)
 	free(func->fname);
 }
 
+/* check if an expression (or any of its sub-expressions) accesses a
+ * global variable. The result of such expressions may depend on the
+ * order in which messages are processed.
+ */
+int
+cnfexprUsesGlobalVar(struct cnfexpr *const expr)
+{
+	struct cnffunc *func;
+	unsigned short i;
+
+	if(expr == NULL)
+		return 0;
+	switch(expr->nodetype) {
+	case CMP_NE:
+	case CMP_EQ:
+	case CMP_LE:
+	case CMP_GE:
+	case CMP_LT:
+	case CMP_GT:
+	case CMP_STARTSWITH:
+	case CMP_STARTSWITHI:
+	case CMP_CONTAINS:
+	case CMP_CONTAINSI:
+	case OR:
+	case AND:
+	case '&':
+	case '+':
+	case '-':
+	case '*':
+	case '/':
+	case '%': /* binary */
+		return cnfexprUsesGlobalVar(expr->l) || cnfexprUsesGlobalVar(expr->r);
+	case NOT: 
+	case 'M': /* unary */
+		return cnfexprUsesGlobalVar(expr->r);
+	case 'V':
+		return ((struct cnfvar*)expr)->prop.id == PROP_GLOBAL_VAR;
+	case 'F':
+		func = (struct cnffunc*) expr;
+		for(i = 0 ; i < func->nParams ; ++i) {
+			if(cnfexprUsesGlobalVar(func->expr[i]))
+				return 1;
+		}
+		return 0;
+	default:
+		return 0;
+	}
+}
+
 /* Destruct an expression and all sub-expressions contained in it.
  */
 void
@@ -2952,6 +3020,14 @@ cnfstmtPrintOnly(struct cnfstmt *stmt, int indent, sbool subtree)
 			doIndent(indent); dbgprintf("END PROPFILT\n");
 		}
 		break;
+	case S_PRITABLE:
+		doIndent(indent); dbgprintf("PRITABLE [%d filters]\n",
+			stmt->d.s_pritable.table->nFilt);
+		if(subtree) {
+			cnfstmtPrint(stmt->d.s_pritable.stmts, indent+1);
+			doIndent(indent); dbgprintf("END PRITABLE\n");
+		}
+		break;
 	default:
 		dbgprintf("error: unknown stmt type %u\n",
 			(unsigned) stmt->nodetype);
@@ -3111,8 +3187,16 @@ cnfstmtDestruct(struct cnfstmt *stmt)
 			rsCStrRegexDestruct(&stmt->d.s_propfilt.regex_cache);
 		if(stmt->d.s_propfilt.pCSCompValue != NULL)
 			cstrDestruct(&stmt->d.s_propfilt.pCSCompValue);
+		if(stmt->d.s_propfilt.pCompProp != NULL)
+			prop.Destruct(&stmt->d.s_propfilt.pCompProp);
 		cnfstmtDestructLst(stmt->d.s_propfilt.t_then);
 		break;
+	case S_PRITABLE:
+		cnfstmtDestructLst(stmt->d.s_pritable.stmts);
+		free(stmt->d.s_pritable.table->filt);
+		free(stmt->d.s_pritable.table->filtIdx);
+		free(stmt->d.s_pritable.table);
+		break;
     case S_RELOAD_LOOKUP_TABLE:
         if (stmt->d.s_reload_lookup_table.table_name != NULL) {
 			free(stmt->d.s_reload_lookup_table.table_name);
@@ -3283,6 +3367,8 @@ cnfstmtNewPROPFILT(char *propfilt, struct cnfstmt *t_then)
 		cnfstmt->d.s_propfilt.t_then = t_then;
 		cnfstmt->d.s_propfilt.regex_cache = NULL;
 		cnfstmt->d.s_propfilt.pCSCompValue = NULL;
+		cnfstmt->d.s_propfilt.pCompProp = NULL;
+		cnfstmt->d.s_propfilt.bSamePropAsPrev = 0;
 		if(DecodePropFilter((uchar*)propfilt, cnfstmt) != RS_RET_OK) {
 			cnfstmt->nodetype = S_NOP; /* disable action! */
 			cnfstmtDestructLst(t_then); /* we do no longer need this */
@@ -3819,6 +3905,42 @@ cnfstmtOptimizePRIFilt(struct cnfstmt *stmt)
 done:	return;
 }
 
+/* regex property filters are compiled here, so that this is done once
+ * during config load and not by the first message that hits the filter.
+ * For isequal on fromhost(-ip), we obtain an interned prop for the value.
+ * Received host names are interned, too, so matching messages usually
+ * carry this very object and can be checked by pointer.
+ */
+static void
+cnfstmtOptimizePROPFILT(struct cnfstmt *stmt)
+{
+	const int op = stmt->d.s_propfilt.operation;
+
+	stmt->d.s_propfilt.t_then = removeNOPs(stmt->d.s_propfilt.t_then);
+	cnfstmtOptimize(stmt->d.s_propfilt.t_then);
+	if(op == FIOP_REGEX || op == FIOP_EREREGEX) {
+		if(rsCStrRegexCompile(stmt->d.s_propfilt.pCSCompValue, (op == FIOP_EREREGEX) ? 1 : 0,
+				      &stmt->d.s_propfilt.regex_cache) != RS_RET_OK) {
+			/* a filter that can never be evaluated is disabled, so that
+			 * nothing needs to be done for it at runtime.
+			 */
+			parser_errmsg("cannot compile regex '%s' in property filter, "
+				"filter disabled",
+				rsCStrGetSzStrNoNULL(stmt->d.s_propfilt.pCSCompValue));
+			cnfstmtDestructLst(stmt->d.s_propfilt.t_then);
+			stmt->d.s_propfilt.t_then = NULL;
+		}
+	}
+	if(op == FIOP_ISEQUAL
+	   && (stmt->d.s_propfilt.prop.id == PROP_FROMHOST || stmt->d.s_propfilt.prop.id == PROP_FROMHOST_IP)
+	   && objUse(prop, CORE_COMPONENT) == RS_RET_OK) {
+		/* on failure, we simply do string compares only */
+		prop.CreateInternedStringProp(&stmt->d.s_propfilt.pCompProp,
+			rsCStrGetSzStrNoNULL(stmt->d.s_propfilt.pCSCompValue),
+			cstrLen(stmt->d.s_propfilt.pCSCompValue));
+	}
+}
+
 static void
 cnfstmtOptimizeReloadLookupTable(struct cnfstmt *stmt) {
 	if((stmt->d.s_reload_lookup_table.table = lookupFindTable(stmt->d.s_reload_lookup_table.table_name)) == NULL) {
@@ -3826,6 +3948,127 @@ cnfstmtOptimizeReloadLookupTable(struct cnfstmt *stmt) {
 	}
 }
 
+/* check if two property filters access the very same property */
+static int
+propfiltSameProp(struct cnfstmt *const s1, struct cnfstmt *const s2)
+{
+	const msgPropDescr_t *const p1 = &s1->d.s_propfilt.prop;
+	const msgPropDescr_t *const p2 = &s2->d.s_propfilt.prop;
+
+	if(p1->id != p2->id || p1->id == PROP_INVALID)
+		return 0;
+	if(p1->id == PROP_CEE || p1->id == PROP_LOCAL_VAR || p1->id == PROP_GLOBAL_VAR)
+		return p1->nameLen == p2->nameLen && !memcmp(p1->name, p2->name, p1->nameLen);
+	return 1;
+}
+
+/* convert a run of nFilt sibling PRIFILTs (without else part), starting at
+ * stmt, into a single PRITABLE statement. The conversion is done in place,
+ * so that pointers to stmt (e.g. the ruleset root) stay valid. The PRIFILTs
+ * are kept as a list below the new statement. If we run out of memory, we
+ * simply leave the filters alone.
+ */
+static void
+cnfstmtMakePRITable(struct cnfstmt *const stmt, const int nFilt)
+{
+	struct cnfpritable *table = NULL;
+	struct cnfstmt *first = NULL;
+	struct cnfstmt *filt;
+	unsigned nIdx;
+	int slot;
+	int fac, sev;
+	int i;
+
+	if(   (table = calloc(1, sizeof(struct cnfpritable))) == NULL
+	   || (table->filt = malloc(nFilt * sizeof(struct cnfstmt*))) == NULL
+	   || (first = malloc(sizeof(struct cnfstmt))) == NULL)
+		goto fail;
+
+	/* count the matching filters of all slots to size the index */
+	nIdx = 0;
+	for(slot = 0 ; slot < PRITABLE_NSLOTS ; ++slot) {
+		fac = slot / 8;
+		sev = slot % 8;
+		for(i = 0, filt = stmt ; i < nFilt ; ++i, filt = filt->next) {
+			if(filt->d.s_prifilt.pmask[fac] & (1<<sev))
+				++nIdx;
+		}
+	}
+	if(nIdx > 0 && (table->filtIdx = malloc(nIdx * sizeof(unsigned short))) == NULL)
+		goto fail;
+
+	/* the original first PRIFILT moves to a new node, stmt becomes the table */
+	memcpy(first, stmt, sizeof(struct cnfstmt));
+	for(i = 0, filt = first ; i < nFilt ; ++i) {
+		table->filt[i] = filt;
+		if(i == nFilt - 1) {
+			stmt->next = filt->next;
+			filt->next = NULL;
+		}
+		filt = filt->next;
+	}
+	table->nFilt = nFilt;
+
+	nIdx = 0;
+	for(slot = 0 ; slot < PRITABLE_NSLOTS ; ++slot) {
+		fac = slot / 8;
+		sev = slot % 8;
+		table->slotOff[slot] = nIdx;
+		for(i = 0 ; i < nFilt ; ++i) {
+			if(table->filt[i]->d.s_prifilt.pmask[fac] & (1<<sev))
+				table->filtIdx[nIdx++] = (unsigned short) i;
+		}
+	}
+	table->slotOff[PRITABLE_NSLOTS] = nIdx;
+
+	DBGPRINTF("optimizer: merged %d PRIFILTs into PRITABLE %p\n", nFilt, stmt);
+	stmt->nodetype = S_PRITABLE;
+	stmt->printable = NULL;
+	stmt->d.s_pritable.stmts = first;
+	stmt->d.s_pritable.table = table;
+	return;
+
+fail:
+	if(table != NULL) {
+		free(table->filt);
+		free(table);
+	}
+	free(first);
+}
+
+/* optimizations that work on a list of sibling statements:
+ * - runs of (else-less) PRIFILTs are merged into a PRITABLE, so that only
+ *   the filters matching a message's PRI need to be looked at. This is very
+ *   common with legacy configs, which consist of many selector lines.
+ * - PROPFILTs that check the same property as their predecessor are flagged,
+ *   so that the executor can re-use the property value it already fetched.
+ */
+static void
+cnfstmtOptimizeSiblings(struct cnfstmt *const root)
+{
+	struct cnfstmt *stmt;
+	struct cnfstmt *filt;
+	struct cnfstmt *prev = NULL;
+	int nFilt;
+
+	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
+		if(stmt->nodetype == S_PROPFILT) {
+			stmt->d.s_propfilt.bSamePropAsPrev = prev != NULL
+				&& prev->nodetype == S_PROPFILT && propfiltSameProp(prev, stmt);
+		} else if(stmt->nodetype == S_PRIFILT) {
+			nFilt = 0;
+			for(filt = stmt ; filt != NULL && nFilt < PRITABLE_MAX_FILTERS ; filt = filt->next) {
+				if(filt->nodetype != S_PRIFILT || filt->d.s_prifilt.t_else != NULL)
+					break;
+				++nFilt;
+			}
+			if(nFilt >= PRITABLE_MIN_FILTERS)
+				cnfstmtMakePRITable(stmt, nFilt);
+		}
+		prev = stmt;
+	}
+}
+
 /* we abuse "optimize" a bit. Actually, we obtain a ruleset pointer, as
  * all rulesets are only known later in the process (now!).
  */
@@ -3875,8 +4118,7 @@ cnfstmtOptimize(struct cnfstmt *root)
 			cnfstmtOptimizePRIFilt(stmt);
 			break;
 		case S_PROPFILT:
-			stmt->d.s_propfilt.t_then = removeNOPs(stmt->d.s_propfilt.t_then);
-			cnfstmtOptimize(stmt->d.s_propfilt.t_then);
+			cnfstmtOptimizePROPFILT(stmt);
 			break;
 		case S_SET:
 			stmt->d.s_set.expr = cnfexprOptimize(stmt->d.s_set.expr);
@@ -3899,12 +4141,15 @@ cnfstmtOptimize(struct cnfstmt *root)
 		case S_NOP:
 			DBGPRINTF("optimizer error: we see a NOP, how come?\n");
 			break;
+		case S_PRITABLE: /* already optimized */
+			break;
 		default:
 			DBGPRINTF("error: unknown stmt type %u during optimizer run\n",
 				(unsigned) stmt->nodetype);
 			break;
 		}
 	}
+	cnfstmtOptimizeSiblings(root);
 done:	return;
 }
 
@@ -4018,16 +4263,28 @@ initFunc_re_match(struct cnffunc *func)
 		FINALIZE;
 	}
 
-	CHKmalloc(re = malloc(sizeof(regex_t)));
-	func->funcdata = re;
-
 	regex = es_str2cstr(((struct cnfstringval*) func->expr[1])->estr, NULL);
 	
 	if((localRet = objUse(regexp, LM_REGEXP_FILENAME)) == RS_RET_OK) {
+		if(func->fID == CNFFUNC_RE_MATCH) {
+			/* re_match() only needs a yes/no answer, so it can use the
+			 * engine selected by regex.engine. A failed regex leaves
+			 * funcdata NULL, which never matches.
+			 */
+			func->destructable_funcdata = 0;
+			if(regexp.compileMatcher((rsRegex_t**) &func->funcdata, regex, 1) != RS_RET_OK) {
+				parser_errmsg("cannot compile regex '%s'", regex);
+				ABORT_FINALIZE(RS_RET_ERR);
+			}
+			FINALIZE;
+		}
+		CHKmalloc(re = malloc(sizeof(regex_t)));
 		if(regexp.regcomp(re, (char*) regex, REG_EXTENDED) != 0) {
+			free(re);
 			parser_errmsg("cannot compile regex '%s'", regex);
 			ABORT_FINALIZE(RS_RET_ERR);
 		}
+		func->funcdata = re;
 	} else { /* regexp object could not be loaded */
 		parser_errmsg("could not load regex support - regex ignored");
 		ABORT_FINALIZE(RS_RET_ERR);
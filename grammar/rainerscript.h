@@ -118,6 +118,7 @@ struct nvlst {
 #define S_FOREACH 4009
 #define S_RELOAD_LOOKUP_TABLE 4010
 #define S_CALL_INDIRECT 4011
+#define S_PRITABLE 4012	/* optimizer result: dispatch table for a sequence of PRIFILTs */
 
 enum cnfFiltType { CNFFILT_NONE, CNFFILT_PRI, CNFFILT_PROP, CNFFILT_SCRIPT };
 const char* cnfFiltType2str(const enum cnfFiltType filttype);
@@ -156,13 +157,19 @@ struct cnfstmt {
 		} s_prifilt;
 		struct {
 			fiop_t operation;
-			regex_t *regex_cache;/* cache for compiled REs, if used */
+			rsRegex_t *regex_cache;/* compiled regex, filled during config load */
 			struct cstr_s *pCSCompValue;/* value to "compare" against */
+			prop_t *pCompProp;	/* interned compare value (fromhost(-ip) isequal only) */
 			sbool isNegated;
 			msgPropDescr_t prop; /* requested property */
+			sbool bSamePropAsPrev; /* previous sibling is PROPFILT on same property */
 			struct cnfstmt *t_then;
 			struct cnfstmt *t_else;
 		} s_propfilt;
+		struct {
+			struct cnfstmt *stmts;	/* the merged PRIFILTs, still linked via next */
+			struct cnfpritable *table;
+		} s_pritable;
 		struct action_s *act;
         struct {
 			struct cnfitr *iter;
@@ -289,6 +296,21 @@ struct funcData_prifilt {
 	uchar pmask[LOG_NFACILITIES+1];	/* priority mask */
 };
 
+/* dispatch table for S_PRITABLE. For each facility/severity combination
+ * (the slot), it holds the list of merged PRIFILTs which match, in config
+ * order. The lists of all slots are stored consecutively in filtIdx.
+ */
+#define PRITABLE_NSLOTS ((LOG_NFACILITIES+1) * 8)
+#define PRITABLE_SLOT(fac, sev) ((fac) * 8 + (sev))
+#define PRITABLE_MIN_FILTERS 4	/* below that, checking the filters one by one is as fast */
+#define PRITABLE_MAX_FILTERS 65535	/* filter indexes are unsigned short */
+struct cnfpritable {
+	int nFilt;
+	struct cnfstmt **filt;		/* merged PRIFILTs, index is config order */
+	unsigned short *filtIdx;	/* per slot lists of matching filt[] indexes */
+	unsigned slotOff[PRITABLE_NSLOTS+1]; /* start of each slot's list in filtIdx */
+};
+
 
 int cnfParseBuffer(char *buf, unsigned lenBuf);
 void readConfFile(FILE *fp, es_str_t **str);
@@ -311,6 +333,7 @@ void cnfexprEval(const struct cnfexpr *const expr, struct svar *ret, void *pusr)
 int cnfexprEvalBool(struct cnfexpr *expr, void *usrptr);
 struct json_object* cnfexprEvalCollection(struct cnfexpr * const expr, void * const usrptr);
 void cnfexprDestruct(struct cnfexpr *expr);
+int cnfexprUsesGlobalVar(struct cnfexpr *expr);
 struct cnfnumval* cnfnumvalNew(long long val);
 struct cnfstringval* cnfstringvalNew(es_str_t *estr);
 struct cnfvar* cnfvarNew(char *name);
@@ -110,7 +110,7 @@ typedef struct lstn_s {
 	sbool hasWildcard;
 	uint8_t readMode;	/* which mode to use in ReadMulteLine call? */
 	uchar *startRegex;	/* regex that signifies end of message (NULL if unset) */
-	regex_t end_preg;	/* compiled version of startRegex */
+	strmStartRegex_t end_preg;	/* compiled version of startRegex */
 	uchar *prevLineSegment;	/* previous line segment (in regex mode) */
 	sbool escapeLF;	/* escape LF inside the MSG content? */
 	sbool reopenOnTruncate;
@@ -923,7 +923,7 @@ lstnDel(lstn_t *pLstn)
 	free(pLstn->pszStateFile);
 	free(pLstn->pszBaseName);
 	if(pLstn->startRegex != NULL)
-		regfree(&pLstn->end_preg);
+		strmStartRegexFree(&pLstn->end_preg);
 
 	if(pLstn == runModConf->pRootLstn)
 		runModConf->pRootLstn = pLstn->next;
@@ -985,10 +985,7 @@ addListner(instanceConf_t *inst)
 	pThis->readMode = inst->readMode;
 	pThis->startRegex = inst->startRegex; /* no strdup, as it is read-only */
 	if(pThis->startRegex != NULL)
-		if(regcomp(&pThis->end_preg, (char*)pThis->startRegex, REG_EXTENDED)) {
-			DBGPRINTF("imfile: error regex compile\n");
-			ABORT_FINALIZE(RS_RET_ERR);
-		}
+		CHKiRet(strmStartRegexCompile(&pThis->end_preg, pThis->startRegex));
 	pThis->bRMStateOnDel = inst->bRMStateOnDel;
 	pThis->escapeLF = inst->escapeLF;
 	pThis->reopenOnTruncate = inst->reopenOnTruncate;
@@ -1598,11 +1595,8 @@ lstnDup(lstn_t **ppExisting, uchar *const __restrict__ newname)
 	pThis->iPersistStateInterval = existing->iPersistStateInterval;
 	pThis->readMode = existing->readMode;
 	pThis->startRegex = existing->startRegex; /* no strdup, as it is read-only */
-	if(pThis->startRegex != NULL) // TODO: make this a single function with better error handling
-		if(regcomp(&pThis->end_preg, (char*)pThis->startRegex, REG_EXTENDED)) {
-			DBGPRINTF("imfile: error regex compile\n");
-			ABORT_FINALIZE(RS_RET_ERR);
-		}
+	if(pThis->startRegex != NULL)
+		CHKiRet(strmStartRegexCompile(&pThis->end_preg, pThis->startRegex));
 	pThis->bRMStateOnDel = existing->bRMStateOnDel;
 	pThis->hasWildcard = existing->hasWildcard;
 	pThis->escapeLF = existing->escapeLF;
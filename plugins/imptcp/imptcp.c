@@ -138,6 +138,10 @@ struct instanceConf_s {
 	sbool bUnlink;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitTokenRate;		/* per-source token bucket, 0 = off */
+	int ratelimitTokenBurst;
+	int ratelimitMaxSources;
+	int ratelimitGlobalRate;	/* token bucket for the listener as a whole, 0 = off */
 	struct instanceConf_s *next;
 };
 
@@ -183,7 +187,11 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "keepalive.interval", eCmdHdlrInt, 0 },
 	{ "addtlframedelimiter", eCmdHdlrInt, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
-	{ "ratelimit.burst", eCmdHdlrInt, 0 }
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.tokenrate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.tokenburst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.maxsources", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.globalrate", eCmdHdlrNonNegInt, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -642,13 +650,11 @@ getPeerNames(prop_t **peerName, prop_t **peerIP, struct sockaddr *pAddr, sbool b
 		}
 	}
 
-	/* We now have the names, so now let's allocate memory and store them permanently. */
-	CHKiRet(prop.Construct(peerName));
-	CHKiRet(prop.SetString(*peerName, szHname, ustrlen(szHname)));
-	CHKiRet(prop.ConstructFinalize(*peerName));
-	CHKiRet(prop.Construct(peerIP));
-	CHKiRet(prop.SetString(*peerIP, szIP, ustrlen(szIP)));
-	CHKiRet(prop.ConstructFinalize(*peerIP));
+	/* We now have the names, so now let's store them permanently. Peers usually
+	 * open many sessions, so the props are shared via the interning table.
+	 */
+	CHKiRet(prop.CreateInternedStringProp(peerName, szHname, ustrlen(szHname)));
+	CHKiRet(prop.CreateInternedStringProp(peerIP, szIP, ustrlen(szIP)));
 
 finalize_it:
 	if(iRet != RS_RET_OK) {
@@ -1372,6 +1378,10 @@ createInstance(instanceConf_t **pinst)
 	inst->pBindRuleset = NULL;
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitTokenRate = 0; /* off */
+	inst->ratelimitTokenBurst = 0; /* same as rate */
+	inst->ratelimitMaxSources = 10000;
+	inst->ratelimitGlobalRate = 0; /* off */
 	inst->compressionMode = COMPRESS_SINGLE_MSG;
 
 	/* node created, let's add to config */
@@ -1482,6 +1492,8 @@ addListner(modConfData_t __attribute__((unused)) *modConf, instanceConf_t *inst)
 	CHKiRet(ratelimitNew(&pSrv->ratelimiter, "imptcp", (char*) pSrv->port));
 	ratelimitSetLinuxLike(pSrv->ratelimiter, inst->ratelimitInterval, inst->ratelimitBurst);
 	ratelimitSetThreadSafe(pSrv->ratelimiter);
+	CHKiRet(ratelimitSetTokenBucket(pSrv->ratelimiter, inst->ratelimitTokenRate,
+		inst->ratelimitTokenBurst, inst->ratelimitMaxSources, inst->ratelimitGlobalRate));
 	/* add to linked list */
 	pSrv->pNext = pSrvRoot;
 	pSrvRoot = pSrv;
@@ -1902,6 +1914,14 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenrate")) {
+			inst->ratelimitTokenRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenburst")) {
+			inst->ratelimitTokenBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxsources")) {
+			inst->ratelimitMaxSources = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.globalrate")) {
+			inst->ratelimitGlobalRate = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imptcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -115,6 +115,10 @@ struct instanceConf_s {
 	sbool bSPFramingFix;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitTokenRate;		/* per-source token bucket, 0 = off */
+	int ratelimitTokenBurst;
+	int ratelimitMaxSources;
+	int ratelimitGlobalRate;	/* token bucket for the listener as a whole, 0 = off */
 	int bSuppOctetFram;
 	struct instanceConf_s *next;
 };
@@ -179,7 +183,11 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "supportoctetcountedframing", eCmdHdlrBinary, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "framingfix.cisco.asa", eCmdHdlrBinary, 0 },
-	{ "ratelimit.burst", eCmdHdlrInt, 0 }
+	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.tokenrate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.tokenburst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.maxsources", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.globalrate", eCmdHdlrNonNegInt, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -280,6 +288,10 @@ createInstance(instanceConf_t **pinst)
 	inst->bSPFramingFix = 0;
 	inst->ratelimitInterval = 0;
 	inst->ratelimitBurst = 10000;
+	inst->ratelimitTokenRate = 0;
+	inst->ratelimitTokenBurst = 0;
+	inst->ratelimitMaxSources = 10000;
+	inst->ratelimitGlobalRate = 0;
 
 	/* node created, let's add to config */
 	if(loadModConf->tail == NULL) {
@@ -379,6 +391,8 @@ addListner(modConfData_t *modConf, instanceConf_t *inst)
 	CHKiRet(tcpsrv.SetDfltTZ(pOurTcpsrv, (inst->dfltTZ == NULL) ? (uchar*)"" : inst->dfltTZ));
 	CHKiRet(tcpsrv.SetbSPFramingFix(pOurTcpsrv, inst->bSPFramingFix));
 	CHKiRet(tcpsrv.SetLinuxLikeRatelimiters(pOurTcpsrv, inst->ratelimitInterval, inst->ratelimitBurst));
+	CHKiRet(tcpsrv.SetTokenBucketRatelimiters(pOurTcpsrv, inst->ratelimitTokenRate,
+		inst->ratelimitTokenBurst, inst->ratelimitMaxSources, inst->ratelimitGlobalRate));
 	tcpsrv.configureTCPListen(pOurTcpsrv, inst->pszBindPort, inst->bSuppOctetFram, inst->pszBindAddr);
 
 finalize_it:
@@ -431,6 +445,14 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenrate")) {
+			inst->ratelimitTokenRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenburst")) {
+			inst->ratelimitTokenBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxsources")) {
+			inst->ratelimitMaxSources = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.globalrate")) {
+			inst->ratelimitGlobalRate = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imtcp: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -117,6 +117,10 @@ struct instanceConf_s {
 	uchar *dfltTZ;
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitTokenRate;		/* per-source token bucket, 0 = off */
+	int ratelimitTokenBurst;
+	int ratelimitMaxSources;
+	int ratelimitGlobalRate;	/* token bucket for the listener as a whole, 0 = off */
 	int rcvbuf;			/* 0 means: do not set, keep OS default */
 	/*  0 means:  IP_FREEBIND is disabled
 	1 means:  IP_FREEBIND enabled + warning disabled
@@ -185,6 +189,10 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "device", eCmdHdlrString, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "ratelimit.burst", eCmdHdlrInt, 0 },
+	{ "ratelimit.tokenrate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.tokenburst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.maxsources", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.globalrate", eCmdHdlrNonNegInt, 0 },
 	{ "rcvbufsize", eCmdHdlrSize, 0 },
 	{ "ipfreebind", eCmdHdlrInt, 0 },
 	{ "ruleset", eCmdHdlrString, 0 }
@@ -218,6 +226,10 @@ createInstance(instanceConf_t **pinst)
 	inst->bAppendPortToInpname = 0;
 	inst->ratelimitBurst = 10000; /* arbitrary high limit */
 	inst->ratelimitInterval = 0; /* off */
+	inst->ratelimitTokenRate = 0; /* off */
+	inst->ratelimitTokenBurst = 0; /* same as rate */
+	inst->ratelimitMaxSources = 10000;
+	inst->ratelimitGlobalRate = 0; /* off */
 	inst->rcvbuf = 0;
 	inst->ipfreebind = IPFREEBIND_ENABLED_WITH_LOG;
 	inst->dfltTZ = NULL;
@@ -331,6 +343,8 @@ addListner(instanceConf_t *inst)
 			CHKiRet(prop.ConstructFinalize(newlcnfinfo->pInputName));
 			ratelimitSetLinuxLike(newlcnfinfo->ratelimiter, inst->ratelimitInterval,
 					      inst->ratelimitBurst);
+			CHKiRet(ratelimitSetTokenBucket(newlcnfinfo->ratelimiter, inst->ratelimitTokenRate,
+				inst->ratelimitTokenBurst, inst->ratelimitMaxSources, inst->ratelimitGlobalRate));
 			/* support statistics gathering */
 			CHKiRet(statsobj.Construct(&(newlcnfinfo->stats)));
 			CHKiRet(statsobj.SetName(newlcnfinfo->stats, dispname));
@@ -950,6 +964,14 @@ createListner(es_str_t *port, struct cnfparamvals *pvals)
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.interval")) {
 			inst->ratelimitInterval = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenrate")) {
+			inst->ratelimitTokenRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenburst")) {
+			inst->ratelimitTokenBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxsources")) {
+			inst->ratelimitMaxSources = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.globalrate")) {
+			inst->ratelimitGlobalRate = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "rcvbufsize")) {
 			const uint64_t val = pvals[i].val.d.n;
 			if(val > 1024 * 1024 * 1024) {
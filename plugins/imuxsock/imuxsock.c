@@ -55,7 +55,7 @@
 #include "sd-daemon.h"
 #include "statsobj.h"
 #include "datetime.h"
-#include "hashtable.h"
+#include "hashmap.h"
 #include "ratelimit.h"
 
 #if !defined(_AIX)
@@ -114,6 +114,11 @@ statsobj_t *modStats;
 STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
 STATSCOUNTER_DEF(ctrLostRatelimit, mutCtrLostRatelimit)
 STATSCOUNTER_DEF(ctrNumRatelimiters, mutCtrNumRatelimiters)
+#ifdef HAVE_RECVMMSG
+STATSCOUNTER_DEF(ctrCallRecvmmsg, mutCtrCallRecvmmsg)
+STATSCOUNTER_DEF(ctrRcvdRecvmmsg, mutCtrRcvdRecvmmsg)
+STATSCOUNTER_DEF(ctrFullRecvmmsg, mutCtrFullRecvmmsg)
+#endif
 
 
 /* a very simple "hash function" for process IDs - we simply use the
@@ -146,7 +151,8 @@ typedef struct lstn_s {
 	int ratelimitBurst;
 	ratelimit_t *dflt_ratelimiter;/*ratelimiter to apply if none else is to be used */
 	intTiny ratelimitSev;	/* severity level (and below) for which rate-limiting shall apply */
-	struct hashtable *ht;	/* our hashtable for rate-limiting */
+	hashmap_t *ht;		/* our hashmap for rate-limiting */
+	tbratelimit_t *tbRatelimiter;	/* per-PID token buckets, NULL if not in use */
 	sbool bParseHost;	/* should parser parse host name?  read-only after startup */
 	sbool bCreatePath;	/* auto-creation of socket directory? */
 	sbool bUseCreds;	/* pull original creator credentials from socket */
@@ -170,11 +176,24 @@ static int startIndexUxLocalSockets; /* process fd from that index on (used to
 static int nfd = 1; /* number of active unix sockets  (socket 0 is always reserved for the system 
                         socket, even if it is not enabled. */
 static int sd_fds = 0;			/* number of systemd activated sockets */
+#ifdef HAVE_RECVMMSG
+/* receive buffers for recvmmsg(), shared by all listeners (only the
+ * input thread reads). Allocated on activation.
+ */
+#define LEN_RCVAUX 128 /* room for SCM_CREDENTIALS and SO_TIMESTAMP */
+static struct mmsghdr *rcvMmh = NULL;
+static struct iovec *rcvIov = NULL;
+static uchar *rcvBuf = NULL;
+static char *rcvAux = NULL;
+static int iMaxLine;
+#endif
 
 #define DFLT_bCreatePath 0
 #define DFLT_ratelimitInterval 0
 #define DFLT_ratelimitBurst 200
 #define DFLT_ratelimitSeverity 1			/* do not rate-limit emergency messages */
+#define DFLT_ratelimitMaxSources 10000
+#define DFLT_batchSize 32			/* max nbr of datagrams per recvmmsg() call */
 /* config vars for the legacy config system */
 static struct configSettings_s {
 	int bOmitLocalLogging;
@@ -212,6 +231,10 @@ struct instanceConf_s {
 	int ratelimitInterval;		/* interval in seconds, 0 = off */
 	int ratelimitBurst;		/* max nbr of messages in interval */
 	int ratelimitSeverity;
+	int ratelimitTokenRate;		/* per-PID token bucket, 0 = off */
+	int ratelimitTokenBurst;
+	int ratelimitMaxSources;
+	int ratelimitGlobalRate;	/* token bucket for the socket as a whole, 0 = off */
 	int bAnnotate;			/* annotate trusted properties */
 	int bParseTrusted;		/* parse trusted properties */
 	sbool bDiscardOwnMsgs;		/* discard messages that originated from our own pid? */
@@ -230,6 +253,10 @@ struct modConfData_s {
 	int ratelimitIntervalSysSock;
 	int ratelimitBurstSysSock;
 	int ratelimitSeveritySysSock;
+	int ratelimitTokenRateSysSock;
+	int ratelimitTokenBurstSysSock;
+	int ratelimitMaxSourcesSysSock;
+	int ratelimitGlobalRateSysSock;
 	int bAnnotateSysSock;
 	int bParseTrusted;
 	int bUseSpecialParser;
@@ -242,6 +269,7 @@ struct modConfData_s {
 	sbool bDiscardOwnMsgs;
 	sbool configSetViaV2Method;
 	sbool bUnlink;
+	int batchSize;			/* max nbr of datagrams read by one recvmmsg() */
 };
 static modConfData_t *loadModConf = NULL;/* modConf ptr to use for the current load process */
 static modConfData_t *runModConf = NULL;/* modConf ptr to use for the current load process */
@@ -262,7 +290,12 @@ static struct cnfparamdescr modpdescr[] = {
 	{ "syssock.usepidfromsystem", eCmdHdlrBinary, 0 },
 	{ "syssock.ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "syssock.ratelimit.burst", eCmdHdlrInt, 0 },
-	{ "syssock.ratelimit.severity", eCmdHdlrInt, 0 }
+	{ "syssock.ratelimit.severity", eCmdHdlrInt, 0 },
+	{ "syssock.ratelimit.tokenrate", eCmdHdlrNonNegInt, 0 },
+	{ "syssock.ratelimit.tokenburst", eCmdHdlrNonNegInt, 0 },
+	{ "syssock.ratelimit.maxsources", eCmdHdlrNonNegInt, 0 },
+	{ "syssock.ratelimit.globalrate", eCmdHdlrNonNegInt, 0 },
+	{ "batchsize", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk modpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -288,7 +321,11 @@ static struct cnfparamdescr inppdescr[] = {
 	{ "ruleset", eCmdHdlrString, 0 },
 	{ "ratelimit.interval", eCmdHdlrInt, 0 },
 	{ "ratelimit.burst", eCmdHdlrInt, 0 },
-	{ "ratelimit.severity", eCmdHdlrInt, 0 }
+	{ "ratelimit.severity", eCmdHdlrInt, 0 },
+	{ "ratelimit.tokenrate", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.tokenburst", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.maxsources", eCmdHdlrNonNegInt, 0 },
+	{ "ratelimit.globalrate", eCmdHdlrNonNegInt, 0 }
 };
 static struct cnfparamblk inppblk =
 	{ CNFPARAMBLK_VERSION,
@@ -317,6 +354,10 @@ createInstance(instanceConf_t **pinst)
 	inst->ratelimitInterval = DFLT_ratelimitInterval;
 	inst->ratelimitBurst = DFLT_ratelimitBurst;
 	inst->ratelimitSeverity = DFLT_ratelimitSeverity;
+	inst->ratelimitTokenRate = 0;
+	inst->ratelimitTokenBurst = 0;
+	inst->ratelimitMaxSources = DFLT_ratelimitMaxSources;
+	inst->ratelimitGlobalRate = 0;
 	inst->bUseFlowCtl = 0;
 	inst->bUseSpecialParser = 1;
 	inst->bParseHost = UNSET;
@@ -386,6 +427,29 @@ finalize_it:
 }
 
 
+/* set up the per-PID token-bucket ratelimiter for a listener, if configured.
+ * Unlike the per-PID hash of classic ratelimiters, the number of PIDs we
+ * track is bounded (least recently seen ones are evicted).
+ */
+static rsRetVal
+createTbRatelimiter(lstn_t *pLstn, int rate, int burst, int maxSources, int globalRate)
+{
+	char namebuf[256];
+	DEFiRet;
+
+	pLstn->tbRatelimiter = NULL;
+	if(rate == 0 && globalRate == 0)
+		FINALIZE;
+	snprintf(namebuf, sizeof(namebuf), "imuxsock(%s)",
+		 (pLstn->sockName == NULL) ? "*" : (char*) pLstn->sockName);
+	namebuf[sizeof(namebuf)-1] = '\0'; /* to be on safe side */
+	CHKiRet(tbratelimitNew(&pLstn->tbRatelimiter, namebuf, rate, burst,
+		maxSources, globalRate, 0));
+finalize_it:
+	RETiRet;
+}
+
+
 /* add an additional listen socket. 
  * added capability to specify hostname for socket -- rgerhards, 2008-08-01
  */
@@ -411,7 +475,7 @@ addListner(instanceConf_t *inst)
 		CHKiRet(prop.ConstructFinalize(listeners[nfd].hostName));
 	}
 	if(inst->ratelimitInterval > 0) {
-		if((listeners[nfd].ht = create_hashtable(100, hash_from_key_fn, key_equals_fn,
+		if((listeners[nfd].ht = hashmapNew(100, hash_from_key_fn, key_equals_fn,
 			(void(*)(void*))ratelimitDestruct)) == NULL) {
 			/* in this case, we simply turn off rate-limiting */
 			DBGPRINTF("imuxsock: turning off rate limiting because we could not "
@@ -428,7 +492,7 @@ addListner(instanceConf_t *inst)
 	listeners[nfd].flags = inst->bIgnoreTimestamp ? IGNDATE : NOFLAG;
 	listeners[nfd].bCreatePath = inst->bCreatePath;
 	listeners[nfd].sockName = ustrdup(inst->sockName);
-	listeners[nfd].bUseCreds = (inst->bDiscardOwnMsgs || inst->bWritePid || inst->ratelimitInterval || inst->bAnnotate || inst->bUseSysTimeStamp) ? 1 : 0;
+	listeners[nfd].bUseCreds = (inst->bDiscardOwnMsgs || inst->bWritePid || inst->ratelimitInterval || inst->ratelimitTokenRate || inst->bAnnotate || inst->bUseSysTimeStamp) ? 1 : 0;
 	listeners[nfd].bAnnotate = inst->bAnnotate;
 	listeners[nfd].bParseTrusted = inst->bParseTrusted;
 	listeners[nfd].bDiscardOwnMsgs = inst->bDiscardOwnMsgs;
@@ -443,6 +507,8 @@ addListner(instanceConf_t *inst)
 			      listeners[nfd].ratelimitBurst);
 	ratelimitSetSeverity(listeners[nfd].dflt_ratelimiter,
 			     listeners[nfd].ratelimitSev);
+	CHKiRet(createTbRatelimiter(&listeners[nfd], inst->ratelimitTokenRate, inst->ratelimitTokenBurst,
+		inst->ratelimitMaxSources, inst->ratelimitGlobalRate));
 	nfd++;
 
 finalize_it:
@@ -458,9 +524,11 @@ static rsRetVal discardLogSockets(void)
 	if(startIndexUxLocalSockets == 0) {
 		/* Clean up rate limiting data for the system socket */
 		if(listeners[0].ht != NULL) {
-			hashtable_destroy(listeners[0].ht, 1); /* 1 => free all values automatically */
+			hashmapDestroy(listeners[0].ht, 1); /* 1 => free all values automatically */
 		}
 		ratelimitDestruct(listeners[0].dflt_ratelimiter);
+		if(listeners[0].tbRatelimiter != NULL)
+			tbratelimitDestruct(listeners[0].tbRatelimiter);
 	}
 
 	/* Clean up all other sockets */
@@ -473,9 +541,11 @@ static rsRetVal discardLogSockets(void)
 			prop.Destruct(&(listeners[i].hostName));
 		}
 		if(listeners[i].ht != NULL) {
-			hashtable_destroy(listeners[i].ht, 1); /* 1 => free all values automatically */
+			hashmapDestroy(listeners[i].ht, 1); /* 1 => free all values automatically */
 		}
 		ratelimitDestruct(listeners[i].dflt_ratelimiter);
+		if(listeners[i].tbRatelimiter != NULL)
+			tbratelimitDestruct(listeners[i].tbRatelimiter);
 	}
 
 	return RS_RET_OK;
@@ -609,7 +679,7 @@ findRatelimiter(lstn_t *pLstn, struct ucred *cred, ratelimit_t **prl)
 		FINALIZE;
 	}
 
-	rl = hashtable_search(pLstn->ht, &cred->pid);
+	rl = hashmapSearch(pLstn->ht, &cred->pid);
 	if(rl == NULL) {
 		/* we need to add a new ratelimiter, process not seen before! */
 		DBGPRINTF("imuxsock: no ratelimiter for pid %lu, creating one\n",
@@ -623,9 +693,11 @@ findRatelimiter(lstn_t *pLstn, struct ucred *cred, ratelimit_t **prl)
 		ratelimitSetSeverity(rl, pLstn->ratelimitSev);
 		CHKmalloc(keybuf = malloc(sizeof(pid_t)));
 		*keybuf = cred->pid;
-		r = hashtable_insert(pLstn->ht, keybuf, rl);
-		if(r == 0)
+		r = hashmapInsert(pLstn->ht, keybuf, rl);
+		if(r == 0) {
+			free(keybuf);
 			ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+		}
 	}
 
 	*prl = rl;
@@ -765,9 +837,12 @@ copyescaped(uchar *dstbuf, uchar *inbuf, int inlen)
 /* submit received message to the queue engine
  * We now parse the message according to expected format so that we
  * can also mangle it if necessary.
+ * If pMultiSub is given, the message is added to that batch, which the
+ * caller must flush.
  */
 static rsRetVal
-SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct timeval *ts)
+SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct timeval *ts,
+	multi_submit_t *pMultiSub)
 {
 	smsg_t *pMsg = NULL;
 	int lenMsg;
@@ -803,6 +878,15 @@ SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct tim
 		++offs;
 	} 
 
+	/* token buckets are checked before we construct the message, so that
+	 * a flooding process costs us as little as possible.
+	 */
+	if(pLstn->tbRatelimiter != NULL && (int) (pri & 0x07) >= pLstn->ratelimitSev
+	   && !tbratelimitAllow(pLstn->tbRatelimiter, (cred == NULL) ? NULL : &cred->pid, sizeof(pid_t))) {
+		STATSCOUNTER_INC(ctrLostRatelimit, mutCtrLostRatelimit);
+		FINALIZE;
+	}
+
 	findRatelimiter(pLstn, cred, &ratelimiter); /* ignore error, better so than others... */
 
 	if(ts == NULL) {
@@ -978,7 +1062,7 @@ SubmitMsg(uchar *pRcv, int lenRcv, lstn_t *pLstn, struct ucred *cred, struct tim
 	MsgSetRcvFrom(pMsg, pLstn->hostName == NULL ? glbl.GetLocalHostNameProp() : pLstn->hostName);
 	CHKiRet(MsgSetRcvFromIP(pMsg, pLocalHostIP));
 	MsgSetRuleset(pMsg, pLstn->pRuleset);
-	ratelimitAddMsg(ratelimiter, NULL, pMsg);
+	ratelimitAddMsg(ratelimiter, pMultiSub, pMsg);
 	STATSCOUNTER_INC(ctrSubmit, mutCtrSubmit);
 finalize_it:
 	if(iRet != RS_RET_OK) {
@@ -989,18 +1073,124 @@ finalize_it:
 }
 
 
+/* obtain the sender credentials and the system timestamp from the control
+ * data of a received datagram. Both are set to NULL if not present or not
+ * configured.
+ */
+static void
+getCtlData(lstn_t *pLstn, struct msghdr *msgh, struct ucred **cred, struct timeval **ts)
+{
+	*cred = NULL;
+	*ts = NULL;
+#	if defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP)
+	if(pLstn->bUseCreds) {
+		struct cmsghdr *cm;
+		for(cm = CMSG_FIRSTHDR(msgh); cm; cm = CMSG_NXTHDR(msgh, cm)) {
+#			ifdef HAVE_SCM_CREDENTIALS
+			if(   pLstn->bUseCreds
+			   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_CREDENTIALS) {
+				*cred = (struct ucred*) CMSG_DATA(cm);
+			}
+#			endif /* HAVE_SCM_CREDENTIALS */
+#			if HAVE_SO_TIMESTAMP
+			if(   pLstn->bUseSysTimeStamp 
+			   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
+				*ts = (struct timeval *)CMSG_DATA(cm);
+			}
+#			endif /* HAVE_SO_TIMESTAMP */
+		}
+	}
+#	endif /* defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP) */
+}
+
+
 /* This function receives data from a socket indicated to be ready
  * to receive and submits the message received for processing.
  * rgerhards, 2007-12-20
  * Interface changed so that this function is passed the array index
  * of the socket which is to be processed. This eases access to the
  * growing number of properties. -- rgerhards, 2008-08-01
+ * Depending on whether or not we have recvmmsg(), an appropriate version
+ * is compiled (as such we need to maintain both!). The recvmmsg() version
+ * reads up to batchSize datagrams per call and submits them as a batch.
  */
 #if !defined(_AIX)
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-align" /* TODO: how can we fix these warnings? */
 #endif
 /* Problem with the warnings: they seem to stem back from the way the API is structured */
+#ifdef HAVE_RECVMMSG
+static rsRetVal readSocket(lstn_t *pLstn)
+{
+	DEFiRet;
+	const int batchSize = runModConf->batchSize;
+	struct ucred *cred;
+	struct timeval *ts;
+	smsg_t *pMsgs[CONF_NUM_MULTISUB];
+	multi_submit_t multiSub;
+	char errStr[1024];
+	int nelem;
+	int i;
+
+	assert(pLstn->fd >= 0);
+
+	multiSub.ppMsgs = pMsgs;
+	multiSub.maxElem = CONF_NUM_MULTISUB;
+	multiSub.nElem = 0;
+	DBGPRINTF("Message from UNIX socket: #%d\n", pLstn->fd);
+	do {
+		memset(rcvMmh, 0, batchSize * sizeof(struct mmsghdr));
+		for(i = 0 ; i < batchSize ; ++i) {
+			rcvIov[i].iov_base = (char*) rcvBuf + i * (iMaxLine + 1);
+			rcvIov[i].iov_len = iMaxLine;
+			rcvMmh[i].msg_hdr.msg_iov = &rcvIov[i];
+			rcvMmh[i].msg_hdr.msg_iovlen = 1;
+#			ifdef HAVE_SCM_CREDENTIALS
+			if(pLstn->bUseCreds) {
+				memset(rcvAux + i * LEN_RCVAUX, 0, LEN_RCVAUX);
+				rcvMmh[i].msg_hdr.msg_control = rcvAux + i * LEN_RCVAUX;
+				rcvMmh[i].msg_hdr.msg_controllen = LEN_RCVAUX;
+			}
+#			endif
+		}
+		nelem = recvmmsg(pLstn->fd, rcvMmh, batchSize, MSG_DONTWAIT, NULL);
+		STATSCOUNTER_INC(ctrCallRecvmmsg, mutCtrCallRecvmmsg);
+		if(nelem < 0 && errno == ENOSYS) {
+			/* be careful: some versions of valgrind do not support recvmmsg()! */
+			DBGPRINTF("imuxsock: error ENOSYS on call to recvmmsg() - fall back to recvmsg\n");
+			nelem = recvmsg(pLstn->fd, &rcvMmh[0].msg_hdr, MSG_DONTWAIT);
+			if(nelem >= 0) {
+				rcvMmh[0].msg_len = nelem;
+				nelem = 1;
+			}
+		}
+		if(nelem < 0) {
+			if(errno != EINTR && errno != EAGAIN) {
+				rs_strerror_r(errno, errStr, sizeof(errStr));
+				DBGPRINTF("UNIX socket error: %d = %s.\n", errno, errStr);
+				errmsg.LogError(errno, NO_ERRCODE, "imuxsock: recvfrom UNIX");
+			}
+			FINALIZE;
+		}
+		STATSCOUNTER_ADD(ctrRcvdRecvmmsg, mutCtrRcvdRecvmmsg, nelem);
+		if(nelem == batchSize)
+			STATSCOUNTER_INC(ctrFullRecvmmsg, mutCtrFullRecvmmsg);
+
+		for(i = 0 ; i < nelem ; ++i) {
+			if(rcvMmh[i].msg_len == 0)
+				continue;
+			getCtlData(pLstn, &rcvMmh[i].msg_hdr, &cred, &ts);
+			SubmitMsg(rcvMmh[i].msg_hdr.msg_iov->iov_base, rcvMmh[i].msg_len,
+				  pLstn, cred, ts, &multiSub);
+		}
+		/* a full batch means there is probably more data waiting */
+	} while(nelem == batchSize && glbl.GetGlobalInputTermState() == 0);
+
+finalize_it:
+	multiSubmitFlush(&multiSub);
+	RETiRet;
+}
+#else /* we do not have recvmmsg() */
 static rsRetVal readSocket(lstn_t *pLstn)
 {
 	DEFiRet;
@@ -1053,28 +1243,8 @@ static rsRetVal readSocket(lstn_t *pLstn)
  
 	DBGPRINTF("Message from UNIX socket: #%d\n", pLstn->fd);
 	if(iRcvd > 0) {
-		cred = NULL;
-		ts = NULL;
-#		if defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP)
-		if(pLstn->bUseCreds) {
-			struct cmsghdr *cm;
-			for(cm = CMSG_FIRSTHDR(&msgh); cm; cm = CMSG_NXTHDR(&msgh, cm)) {
-#				ifdef HAVE_SCM_CREDENTIALS
-				if(   pLstn->bUseCreds
-				   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_CREDENTIALS) {
-					cred = (struct ucred*) CMSG_DATA(cm);
-				}
-#				endif /* HAVE_SCM_CREDENTIALS */
-#				if HAVE_SO_TIMESTAMP
-				if(   pLstn->bUseSysTimeStamp 
-				   && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
-					ts = (struct timeval *)CMSG_DATA(cm);
-				}
-#				endif /* HAVE_SO_TIMESTAMP */
-			}
-		}
-#		endif /* defined(HAVE_SCM_CREDENTIALS) || defined(HAVE_SO_TIMESTAMP) */
-		CHKiRet(SubmitMsg(pRcv, iRcvd, pLstn, cred, ts));
+		getCtlData(pLstn, &msgh, &cred, &ts);
+		CHKiRet(SubmitMsg(pRcv, iRcvd, pLstn, cred, ts, NULL));
 	} else if(iRcvd < 0 && errno != EINTR && errno != EAGAIN) {
 		char errStr[1024];
 		rs_strerror_r(errno, errStr, sizeof(errStr));
@@ -1088,6 +1258,7 @@ finalize_it:
 
 	RETiRet;
 }
+#endif /* #ifdef HAVE_RECVMMSG */
 #if  !defined(_AIX)
 #pragma GCC diagnostic pop
 #endif
@@ -1114,7 +1285,7 @@ activateListeners(void)
 			}
 		}
 		if(runModConf->ratelimitIntervalSysSock > 0) {
-			if((listeners[0].ht = create_hashtable(100, hash_from_key_fn, key_equals_fn, NULL)) == NULL) {
+			if((listeners[0].ht = hashmapNew(100, hash_from_key_fn, key_equals_fn, NULL)) == NULL) {
 				/* in this case, we simply turn of rate-limiting */
 				errmsg.LogError(0, NO_ERRCODE, "imuxsock: turning off rate limiting because we could not "
 					  "create hash table\n");
@@ -1131,7 +1302,7 @@ activateListeners(void)
 		listeners[0].ratelimitInterval = runModConf->ratelimitIntervalSysSock;
 		listeners[0].ratelimitBurst = runModConf->ratelimitBurstSysSock;
 		listeners[0].ratelimitSev = runModConf->ratelimitSeveritySysSock;
-		listeners[0].bUseCreds = (runModConf->bWritePidSysSock || runModConf->ratelimitIntervalSysSock || runModConf->bAnnotateSysSock || runModConf->bDiscardOwnMsgs || runModConf->bUseSysTimeStamp) ? 1 : 0;
+		listeners[0].bUseCreds = (runModConf->bWritePidSysSock || runModConf->ratelimitIntervalSysSock || runModConf->ratelimitTokenRateSysSock || runModConf->bAnnotateSysSock || runModConf->bDiscardOwnMsgs || runModConf->bUseSysTimeStamp) ? 1 : 0;
 		listeners[0].bWritePid = runModConf->bWritePidSysSock;
 		listeners[0].bAnnotate = runModConf->bAnnotateSysSock;
 		listeners[0].bParseTrusted = runModConf->bParseTrusted;
@@ -1147,6 +1318,9 @@ activateListeners(void)
 			listeners[0].ratelimitInterval,
 			listeners[0].ratelimitBurst);
 		ratelimitSetSeverity(listeners[0].dflt_ratelimiter,listeners[0].ratelimitSev);
+		CHKiRet(createTbRatelimiter(&listeners[0], runModConf->ratelimitTokenRateSysSock,
+			runModConf->ratelimitTokenBurstSysSock, runModConf->ratelimitMaxSourcesSysSock,
+			runModConf->ratelimitGlobalRateSysSock));
 	}
 
 	sd_fds = sd_listen_fds(0);
@@ -1199,6 +1373,11 @@ CODESTARTbeginCnfLoad
 	pModConf->ratelimitIntervalSysSock = DFLT_ratelimitInterval;
 	pModConf->ratelimitBurstSysSock = DFLT_ratelimitBurst;
 	pModConf->ratelimitSeveritySysSock = DFLT_ratelimitSeverity;
+	pModConf->ratelimitTokenRateSysSock = 0;
+	pModConf->ratelimitTokenBurstSysSock = 0;
+	pModConf->ratelimitMaxSourcesSysSock = DFLT_ratelimitMaxSources;
+	pModConf->ratelimitGlobalRateSysSock = 0;
+	pModConf->batchSize = DFLT_batchSize;
 	bLegacyCnfModGlobalsPermitted = 1;
 	/* reset legacy config vars */
 	resetConfigVariables(NULL, NULL);
@@ -1254,6 +1433,16 @@ CODESTARTsetModCnf
 			loadModConf->ratelimitBurstSysSock = (int) pvals[i].val.d.n;
 		} else if(!strcmp(modpblk.descr[i].name, "syssock.ratelimit.severity")) {
 			loadModConf->ratelimitSeveritySysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "syssock.ratelimit.tokenrate")) {
+			loadModConf->ratelimitTokenRateSysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "syssock.ratelimit.tokenburst")) {
+			loadModConf->ratelimitTokenBurstSysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "syssock.ratelimit.maxsources")) {
+			loadModConf->ratelimitMaxSourcesSysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "syssock.ratelimit.globalrate")) {
+			loadModConf->ratelimitGlobalRateSysSock = (int) pvals[i].val.d.n;
+		} else if(!strcmp(modpblk.descr[i].name, "batchsize")) {
+			loadModConf->batchSize = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imuxsock: program error, non-handled "
 			  "param '%s' in beginCnfLoad\n", modpblk.descr[i].name);
@@ -1328,6 +1517,14 @@ CODESTARTnewInpInst
 			inst->ratelimitBurst = (int) pvals[i].val.d.n;
 		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.severity")) {
 			inst->ratelimitSeverity = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenrate")) {
+			inst->ratelimitTokenRate = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.tokenburst")) {
+			inst->ratelimitTokenBurst = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.maxsources")) {
+			inst->ratelimitMaxSources = (int) pvals[i].val.d.n;
+		} else if(!strcmp(inppblk.descr[i].name, "ratelimit.globalrate")) {
+			inst->ratelimitGlobalRate = (int) pvals[i].val.d.n;
 		} else {
 			dbgprintf("imuxsock: program error, non-handled "
 			  "param '%s'\n", inppblk.descr[i].name);
@@ -1424,6 +1621,15 @@ ENDactivateCnfPrePrivDrop
 
 BEGINactivateCnf
 CODESTARTactivateCnf
+#	ifdef HAVE_RECVMMSG
+	iMaxLine = glbl.GetMaxLine();
+	CHKmalloc(rcvMmh = MALLOC(runModConf->batchSize * sizeof(struct mmsghdr)));
+	CHKmalloc(rcvIov = MALLOC(runModConf->batchSize * sizeof(struct iovec)));
+	CHKmalloc(rcvBuf = MALLOC(runModConf->batchSize * (iMaxLine + 1)));
+	CHKmalloc(rcvAux = MALLOC(runModConf->batchSize * LEN_RCVAUX));
+	DBGPRINTF("imuxsock: recvmmsg batch size %d, iMaxLine %d\n", runModConf->batchSize, iMaxLine);
+finalize_it:
+#	endif
 ENDactivateCnf
 
 
@@ -1520,6 +1726,16 @@ BEGINafterRun
 	int i;
 CODESTARTafterRun
 	/* do cleanup here */
+#	ifdef HAVE_RECVMMSG
+	free(rcvMmh);
+	free(rcvIov);
+	free(rcvBuf);
+	free(rcvAux);
+	rcvMmh = NULL;
+	rcvIov = NULL;
+	rcvBuf = NULL;
+	rcvAux = NULL;
+#	endif
         if(startIndexUxLocalSockets == 1 && nfd == 1) {
                 /* No sockets were configured, no cleanup needed. */
                 return RS_RET_OK;
@@ -1716,6 +1932,18 @@ CODEmodInit_QueryRegCFSLineHdlr
 	STATSCOUNTER_INIT(ctrNumRatelimiters, mutCtrNumRatelimiters);
 	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("ratelimit.numratelimiters"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrNumRatelimiters));
+#	ifdef HAVE_RECVMMSG
+	/* batch fill ratio is recvmmsg.datagrams / (called.recvmmsg * batchsize) */
+	STATSCOUNTER_INIT(ctrCallRecvmmsg, mutCtrCallRecvmmsg);
+	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("called.recvmmsg"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrCallRecvmmsg));
+	STATSCOUNTER_INIT(ctrRcvdRecvmmsg, mutCtrRcvdRecvmmsg);
+	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("recvmmsg.datagrams"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrRcvdRecvmmsg));
+	STATSCOUNTER_INIT(ctrFullRecvmmsg, mutCtrFullRecvmmsg);
+	CHKiRet(statsobj.AddCounter(modStats, UCHAR_CONSTANT("recvmmsg.batchfull"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrFullRecvmmsg));
+#	endif
 	CHKiRet(statsobj.ConstructFinalize(modStats));
 
 ENDmodInit
@@ -63,6 +63,13 @@ STATSCOUNTER_DEF(ctrCacheSkip, mutCtrCacheSkip);
 
 #define NO_FIXED_PARTITION -1	/* signifies that no fixed partition config exists */
 
+/* librdkafka 0.8.4 brought rd_kafka_produce_batch() and per-message delivery
+ * reports. Older versions are served by producing message by message.
+ */
+#if RD_KAFKA_VERSION >= 0x00080400
+#	define HAVE_RD_KAFKA_PRODUCE_BATCH
+#endif
+
 struct kafka_params {
 	const char *name;
 	const char *val;
@@ -99,6 +106,13 @@ struct s_dynaTopicCacheEntry {
 };
 typedef struct s_dynaTopicCacheEntry dynaTopicCacheEntry;
 
+/* per-partition statistics */
+typedef struct kafka_partstats_s {
+	STATSCOUNTER_DEF(ctrSubmit, mutCtrSubmit)
+	STATSCOUNTER_DEF(ctrAcked, mutCtrAcked)
+	STATSCOUNTER_DEF(ctrFailed, mutCtrFailed)
+} kafka_partstats_t;
+
 typedef struct _instanceData {
 	uchar *topic;
 	sbool dynaTopic;
@@ -121,6 +135,13 @@ typedef struct _instanceData {
 	struct kafka_params *topicConfParams;
 	uchar *errorFile;
 	uchar *key;
+	sbool dynaKey;		/* key is a template name */
+	sbool partitionByKey;	/* select partition by key (librdkafka consistent partitioner) */
+	int iNumTpls;
+	int iTplTopic;		/* template index of dynamic topic */
+	int iTplKey;		/* template index of dynamic key */
+	statsobj_t *stats;	/* per-partition stats */
+	kafka_partstats_t *partStats; /* nPartitions entries */
 	int fdErrFile;		/* error file fd or -1 if not open */
 	pthread_mutex_t mutErrFile;
 	int bIsOpen;
@@ -132,6 +153,9 @@ typedef struct _instanceData {
 
 typedef struct wrkrInstanceData {
 	instanceData *pData;
+	rd_kafka_message_t *batch;	/* messages handed to librdkafka in one go */
+	unsigned *batchIdx;		/* index into the transaction's params for each batch entry */
+	unsigned maxBatch;
 } wrkrInstanceData_t;
 
 
@@ -149,6 +173,8 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "topicconfparam", eCmdHdlrArray, 0 },
 	{ "errorfile", eCmdHdlrGetWord, 0 },
 	{ "key", eCmdHdlrGetWord, 0 },
+	{ "dynakey", eCmdHdlrBinary, 0 },
+	{ "partitions.bykey", eCmdHdlrBinary, 0 },
 	{ "template", eCmdHdlrGetWord, 0 },
 	{ "closeTimeout", eCmdHdlrPositiveInt, 0 },
 	{ "reopenOnHup", eCmdHdlrBinary, 0 }
@@ -163,10 +189,13 @@ BEGINinitConfVars		/* (re)set config variables to default values */
 CODESTARTinitConfVars 
 ENDinitConfVars
 
-static uint32_t
+static int32_t
 getPartition(instanceData *const __restrict__ pData)
 {
-	if (pData->autoPartition) {
+	if (pData->autoPartition || pData->partitionByKey) {
+		/* with partitions.bykey, librdkafka's consistent partitioner picks
+		 * the partition from the key and the topic's real partition count
+		 */
 		return RD_KAFKA_PARTITION_UA;
 	} else {
 		return (pData->fixedPartition == NO_FIXED_PARTITION) ?
@@ -268,6 +297,10 @@ createTopic(instanceData *__restrict__ const pData, const uchar *__restrict__ co
 						rd_kafka_err2str(rd_kafka_errno2err(errno)));
 		ABORT_FINALIZE(RS_RET_KAFKA_ERROR);
 	}
+	if(pData->partitionByKey) {
+		/* set first, so that a "partitioner" topic param can override it */
+		rd_kafka_topic_conf_set_partitioner_cb(topicconf, rd_kafka_msg_partitioner_consistent);
+	}
 	for(int i = 0 ; i < pData->nTopicConfParams ; ++i) {
 		if(rd_kafka_topic_conf_set(topicconf,
 								   pData->topicConfParams[i].name,
@@ -502,6 +535,29 @@ finalize_it:
 	RETiRet;
 }
 
+#ifdef HAVE_RD_KAFKA_PRODUCE_BATCH
+static void
+deliveryCallback(rd_kafka_t __attribute__((unused)) *rk,
+	   const rd_kafka_message_t *rkmessage,
+	   void *opaque)
+{
+	instanceData *const pData = (instanceData *) opaque;
+	kafka_partstats_t *partStats = NULL;
+
+	if(rkmessage->partition >= 0 && rkmessage->partition < pData->nPartitions)
+		partStats = &pData->partStats[rkmessage->partition];
+	/* with librdkafka partitioning, the partition is only known now */
+	if(partStats != NULL && (pData->autoPartition || pData->partitionByKey))
+		STATSCOUNTER_INC(partStats->ctrSubmit, partStats->mutCtrSubmit);
+	if(rkmessage->err != 0) {
+		writeDataError(pData, (char*) rkmessage->payload, rkmessage->len, rkmessage->err);
+		if(partStats != NULL)
+			STATSCOUNTER_INC(partStats->ctrFailed, partStats->mutCtrFailed);
+	} else if(partStats != NULL) {
+		STATSCOUNTER_INC(partStats->ctrAcked, partStats->mutCtrAcked);
+	}
+}
+#else
 static void
 deliveryCallback(rd_kafka_t __attribute__((unused)) *rk,
 	   void *payload, size_t len,
@@ -512,6 +568,7 @@ deliveryCallback(rd_kafka_t __attribute__((unused)) *rk,
 	if(error_code != 0)
 		writeDataError(pData, (char*) payload, len, error_code);
 }
+#endif
 
 static void
 kafkaLogger(const rd_kafka_t __attribute__((unused)) *rk, int level,
@@ -635,7 +692,11 @@ openKafka(instanceData *const __restrict__ pData)
 		}
 	} 
 	rd_kafka_conf_set_opaque(conf, (void *) pData);
+#ifdef HAVE_RD_KAFKA_PRODUCE_BATCH
+	rd_kafka_conf_set_dr_msg_cb(conf, deliveryCallback);
+#else
 	rd_kafka_conf_set_dr_cb(conf, deliveryCallback);
+#endif
 	rd_kafka_conf_set_error_cb(conf, errorCallback);
 # if RD_KAFKA_VERSION >= 0x00090001
 	rd_kafka_conf_set_log_cb(conf, kafkaLogger);
@@ -725,6 +786,9 @@ ENDcreateInstance
 
 BEGINcreateWrkrInstance
 CODESTARTcreateWrkrInstance
+	pWrkrData->batch = NULL;
+	pWrkrData->batchIdx = NULL;
+	pWrkrData->maxBatch = 0;
 ENDcreateWrkrInstance
 
 
@@ -739,6 +803,7 @@ CODESTARTfreeInstance
 	free(pData->topic);
 	free(pData->brokers);
 	free(pData->tplName);
+	free(pData->key);
 	for(int i = 0 ; i < pData->nConfParams ; ++i) {
 		free((void*) pData->confParams[i].name);
 		free((void*) pData->confParams[i].val);
@@ -756,6 +821,9 @@ CODESTARTfreeInstance
 		pData->dynCache = NULL;
 	}
 	pthread_rwlock_unlock(&pData->rkLock);
+	if(pData->stats != NULL)
+		statsobj.Destruct(&pData->stats);
+	free(pData->partStats);
 	pthread_rwlock_destroy(&pData->rkLock);
 	pthread_mutex_destroy(&pData->mutErrFile);
 	pthread_mutex_destroy(&pData->mutDynCache);
@@ -763,6 +831,8 @@ ENDfreeInstance
 
 BEGINfreeWrkrInstance
 CODESTARTfreeWrkrInstance
+	free(pWrkrData->batch);
+	free(pWrkrData->batchIdx);
 ENDfreeWrkrInstance
 
 
@@ -794,49 +864,139 @@ finalize_it:
 ENDtryResume
 
 
-/* must be called with read(rkLock) */
+/* hand a batch of messages to librdkafka. Payload ownership passes to
+ * librdkafka (RD_KAFKA_MSG_F_FREE) for each message with err == 0 on return,
+ * those not accepted are still owned by the caller.
+ */
+static void
+produceBatch(rd_kafka_topic_t *const rkt, rd_kafka_message_t *const msgs, const unsigned nMsgs)
+{
+	unsigned i;
+#ifdef HAVE_RD_KAFKA_PRODUCE_BATCH
+#	ifdef RD_KAFKA_MSG_F_PARTITION
+	for(i = 0 ; i < nMsgs ; ++i)
+		msgs[i].err = RD_KAFKA_RESP_ERR_NO_ERROR;
+	rd_kafka_produce_batch(rkt, RD_KAFKA_PARTITION_UA,
+		RD_KAFKA_MSG_F_FREE | RD_KAFKA_MSG_F_PARTITION, msgs, nMsgs);
+#	else
+	/* the partition is per call, so we need to split into runs */
+	unsigned iStart;
+	for(i = 0 ; i < nMsgs ; ++i)
+		msgs[i].err = RD_KAFKA_RESP_ERR_NO_ERROR;
+	for(iStart = 0, i = 1 ; i <= nMsgs ; ++i) {
+		if(i == nMsgs || msgs[i].partition != msgs[iStart].partition) {
+			rd_kafka_produce_batch(rkt, msgs[iStart].partition, RD_KAFKA_MSG_F_FREE,
+				msgs + iStart, i - iStart);
+			iStart = i;
+		}
+	}
+#	endif
+#else
+	for(i = 0 ; i < nMsgs ; ++i) {
+		if(rd_kafka_produce(rkt, msgs[i].partition, RD_KAFKA_MSG_F_FREE,
+				    msgs[i].payload, msgs[i].len, msgs[i].key, msgs[i].key_len,
+				    NULL) == -1) {
+			msgs[i].err = rd_kafka_errno2err(errno);
+		} else {
+			msgs[i].err = RD_KAFKA_RESP_ERR_NO_ERROR;
+		}
+	}
+#endif
+}
+
+
+/* write messages iStart..iStart+nMsgs-1 of the transaction, which must all
+ * go to the same topic. Messages whose payload param is NULL have already
+ * been handed to librdkafka by an earlier, partially failed, try of this
+ * transaction and are skipped.
+ * must be called with read(rkLock)
+ */
 static rsRetVal
-writeKafka(instanceData *pData, uchar *msg, uchar *topic)
+writeKafka(wrkrInstanceData_t *const pWrkrData, actWrkrIParams_t *const pParams,
+	const unsigned iStart, const unsigned nMsgs)
 {
-	DEFiRet;
-	const int partition = getPartition(pData);
+	instanceData *const pData = pWrkrData->pData;
 	rd_kafka_topic_t *rkt = NULL;
 	pthread_rwlock_t *dynTopicLock = NULL;
-	int msg_enqueue_status = 0;
+	rd_kafka_message_t *msgs;
+	actWrkrIParams_t *payload;
+	uchar *key;
+	unsigned nBatch = 0;
+	unsigned nFailed = 0;
+	unsigned *batchIdx;
+	unsigned i;
+	int partition;
+	DEFiRet;
 
-	DBGPRINTF("omkafka: trying to send: key:'%s', msg:'%s'\n", pData->key, msg);
+	if(nMsgs > pWrkrData->maxBatch) {
+		CHKmalloc(msgs = realloc(pWrkrData->batch, nMsgs * sizeof(rd_kafka_message_t)));
+		pWrkrData->batch = msgs;
+		CHKmalloc(batchIdx = realloc(pWrkrData->batchIdx, nMsgs * sizeof(unsigned)));
+		pWrkrData->batchIdx = batchIdx;
+		pWrkrData->maxBatch = nMsgs; /* only now both buffers are large enough */
+	}
+	msgs = pWrkrData->batch;
 
 	if(pData->dynaTopic) {
+		const uchar *const topic = actParam(pParams, pData->iNumTpls, iStart, pData->iTplTopic).param;
 		DBGPRINTF("omkafka: topic to insert to: %s\n", topic);
 		CHKiRet(prepareDynTopic(pData, topic, &rkt, &dynTopicLock));
 	} else {
 		rkt = pData->pTopic;
 	}
 
-	msg_enqueue_status = rd_kafka_produce(rkt, partition, RD_KAFKA_MSG_F_COPY,
-										  msg, strlen((char*)msg), pData->key,
-										  pData->key == NULL ? 0 : strlen((char*)pData->key),
-										  NULL);
-	if(msg_enqueue_status == -1) {
-		errmsg.LogError(0, RS_RET_KAFKA_PRODUCE_ERR,
-			"omkafka: Failed to produce to topic '%s' "
-			"partition %d: %s\n",
-			rd_kafka_topic_name(rkt), partition,
-			rd_kafka_err2str(rd_kafka_errno2err(errno)));
+	for(i = iStart ; i < iStart + nMsgs ; ++i) {
+		payload = &actParam(pParams, pData->iNumTpls, i, 0);
+		if(payload->param == NULL)
+			continue;
+		key = pData->dynaKey ? actParam(pParams, pData->iNumTpls, i, pData->iTplKey).param
+				     : pData->key;
+		DBGPRINTF("omkafka: trying to send: key:'%s', msg:'%s'\n", key, payload->param);
+		memset(&msgs[nBatch], 0, sizeof(rd_kafka_message_t));
+		msgs[nBatch].payload = payload->param;
+		msgs[nBatch].len = strlen((char*)payload->param);
+		msgs[nBatch].key = key;
+		msgs[nBatch].key_len = (key == NULL) ? 0 : strlen((char*)key);
+		msgs[nBatch].partition = getPartition(pData);
+		pWrkrData->batchIdx[nBatch++] = i;
 	}
+
+	produceBatch(rkt, msgs, nBatch);
+
+	for(i = 0 ; i < nBatch ; ++i) {
+		if(msgs[i].err == RD_KAFKA_RESP_ERR_NO_ERROR) {
+			/* librdkafka owns the buffer now, the engine allocates a new one */
+			payload = &actParam(pParams, pData->iNumTpls, pWrkrData->batchIdx[i], 0);
+			payload->param = NULL;
+			payload->lenBuf = 0;
+			STATSCOUNTER_INC(ctrTopicSubmit, mutCtrTopicSubmit);
+			/* RD_KAFKA_PARTITION_UA is counted in deliveryCallback() */
+			partition = msgs[i].partition;
+			if(partition >= 0 && partition < pData->nPartitions) {
+				STATSCOUNTER_INC(pData->partStats[partition].ctrSubmit,
+					pData->partStats[partition].mutCtrSubmit);
+			}
+		} else {
+			if(nFailed++ == 0) {
+				errmsg.LogError(0, RS_RET_KAFKA_PRODUCE_ERR,
+					"omkafka: Failed to produce to topic '%s' "
+					"partition %d: %s\n",
+					rd_kafka_topic_name(rkt), (int) msgs[i].partition,
+					rd_kafka_err2str(msgs[i].err));
+			}
+			STATSCOUNTER_INC(ctrKafkaFail, mutCtrKafkaFail);
+		}
+	}
+
 	const int callbacksCalled = rd_kafka_poll(pData->rk, 0); /* call callbacks */
 	if (pData->dynaTopic) {
 		pthread_rwlock_unlock(dynTopicLock);/* dynamic topic can't be used beyond this pt */
 	}
-	DBGPRINTF("omkafka: kafka outqueue length: %d, callbacks called %d\n",
-			  rd_kafka_outq_len(pData->rk), callbacksCalled);
+	DBGPRINTF("omkafka: produced %u of %u messages, kafka outqueue length: %d, callbacks called %d\n",
+		  nBatch - nFailed, nBatch, rd_kafka_outq_len(pData->rk), callbacksCalled);
 
-	if (msg_enqueue_status == -1) {
-		STATSCOUNTER_INC(ctrKafkaFail, mutCtrKafkaFail);
+	if(nFailed > 0) {
 		ABORT_FINALIZE(RS_RET_KAFKA_PRODUCE_ERR);
-		/* ABORT_FINALIZE isn't absolutely necessary as of now,
-		   because this is the last line anyway, but its useful to ensure
-		   correctness in case we add more stuff below this line at some point*/
 	}
 
 finalize_it:
@@ -844,29 +1004,43 @@ finalize_it:
 	if(iRet != RS_RET_OK) {
 		iRet = RS_RET_SUSPENDED;
 	}
-    STATSCOUNTER_SETMAX_NOMUT(ctrQueueSize, rd_kafka_outq_len(pData->rk));
-	STATSCOUNTER_INC(ctrTopicSubmit, mutCtrTopicSubmit);
+	STATSCOUNTER_SETMAX_NOMUT(ctrQueueSize, rd_kafka_outq_len(pData->rk));
 	RETiRet;
 }
 
 
-BEGINdoAction
-CODESTARTdoAction
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+ENDbeginTransaction
+
+
+/* The batch is split into runs of messages for the same topic, each of
+ * which is handed to librdkafka in a single produce call.
+ */
+BEGINcommitTransaction
 	instanceData *const pData = pWrkrData->pData;
+	const uchar *topic;
+	unsigned iStart;
+	unsigned i;
+CODESTARTcommitTransaction
 	if (! pData->bIsOpen)
 		CHKiRet(setupKafkaHandle(pData, 0));
 
 	pthread_rwlock_rdlock(&pData->rkLock);
-
-	/* support dynamic topic */
-	if(pData->dynaTopic)
-		iRet = writeKafka(pData, ppString[0], ppString[1]);
-	else
-		iRet = writeKafka(pData, ppString[0], pData->topic);
-		
+	for(iStart = 0, i = 1 ; i <= nParams && iRet == RS_RET_OK ; ++i) {
+		if(i < nParams && pData->dynaTopic) {
+			topic = actParam(pParams, pData->iNumTpls, iStart, pData->iTplTopic).param;
+			if(!ustrcmp(topic, actParam(pParams, pData->iNumTpls, i, pData->iTplTopic).param))
+				continue;
+		} else if(i < nParams) {
+			continue;
+		}
+		iRet = writeKafka(pWrkrData, pParams, iStart, i - iStart);
+		iStart = i;
+	}
 	pthread_rwlock_unlock(&pData->rkLock);
 finalize_it:
-ENDdoAction
+ENDcommitTransaction
 
 
 static void
@@ -885,9 +1059,47 @@ setInstParamDefaults(instanceData *pData)
 	pData->topicConfParams = NULL;
 	pData->errorFile = NULL;
 	pData->key = NULL;
+	pData->dynaKey = 0;
+	pData->partitionByKey = 0;
+	pData->stats = NULL;
+	pData->partStats = NULL;
 	pData->closeTimeout = 2000;
 }
 
+/* per-partition statistics, covering the configured number of partitions */
+static rsRetVal
+setupPartitionStats(instanceData *const pData)
+{
+	uchar ctrName[128];
+	kafka_partstats_t *partStats;
+	DEFiRet;
+
+	CHKmalloc(pData->partStats = calloc(pData->nPartitions, sizeof(kafka_partstats_t)));
+	CHKiRet(statsobj.Construct(&pData->stats));
+	snprintf((char*) ctrName, sizeof(ctrName), "omkafka(%s)", pData->topic);
+	ctrName[sizeof(ctrName)-1] = '\0';
+	CHKiRet(statsobj.SetName(pData->stats, ctrName));
+	CHKiRet(statsobj.SetOrigin(pData->stats, (uchar*) "omkafka"));
+	for(int i = 0 ; i < pData->nPartitions ; ++i) {
+		partStats = &pData->partStats[i];
+		STATSCOUNTER_INIT(partStats->ctrSubmit, partStats->mutCtrSubmit);
+		snprintf((char*) ctrName, sizeof(ctrName), "partition.%d.produced", i);
+		CHKiRet(statsobj.AddCounter(pData->stats, ctrName,
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &partStats->ctrSubmit));
+		STATSCOUNTER_INIT(partStats->ctrAcked, partStats->mutCtrAcked);
+		snprintf((char*) ctrName, sizeof(ctrName), "partition.%d.acked", i);
+		CHKiRet(statsobj.AddCounter(pData->stats, ctrName,
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &partStats->ctrAcked));
+		STATSCOUNTER_INIT(partStats->ctrFailed, partStats->mutCtrFailed);
+		snprintf((char*) ctrName, sizeof(ctrName), "partition.%d.failed", i);
+		CHKiRet(statsobj.AddCounter(pData->stats, ctrName,
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &partStats->ctrFailed));
+	}
+	CHKiRet(statsobj.ConstructFinalize(pData->stats));
+finalize_it:
+	RETiRet;
+}
+
 static rsRetVal
 processKafkaParam(char *const param,
 	const char **const name,
@@ -974,6 +1186,10 @@ CODESTARTnewActInst
 			pData->errorFile = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "key")) {
 			pData->key = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "dynakey")) {
+			pData->dynaKey = pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "partitions.bykey")) {
+			pData->partitionByKey = pvals[i].val.d.n;
 		} else if(!strcmp(actpblk.descr[i].name, "template")) {
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "reopenOnHup")) {
@@ -993,8 +1209,22 @@ CODESTARTnewActInst
         ABORT_FINALIZE(RS_RET_CONFIG_ERROR);
 	}
 
+	if(pData->dynaKey && pData->key == NULL) {
+		errmsg.LogError(0, RS_RET_CONFIG_ERROR,
+			"omkafka: requested dynamic key, but no "
+			"name for key template given - action definition invalid");
+		ABORT_FINALIZE(RS_RET_CONFIG_ERROR);
+	}
+	if(pData->partitionByKey && pData->key == NULL) {
+		errmsg.LogError(0, RS_RET_CONFIG_ERROR,
+			"omkafka: partitions.bykey requires a key - action definition invalid");
+		ABORT_FINALIZE(RS_RET_CONFIG_ERROR);
+	}
+
 	iNumTpls = 1;
-	if(pData->dynaTopic) ++iNumTpls;
+	if(pData->dynaTopic) pData->iTplTopic = iNumTpls++;
+	if(pData->dynaKey) pData->iTplKey = iNumTpls++;
+	pData->iNumTpls = iNumTpls;
 	CODE_STD_STRING_REQUESTnewActInst(iNumTpls);
 	CHKiRet(OMSRsetEntry(*ppOMSR, 0, (uchar*)strdup((pData->tplName == NULL) ? 
 						"RSYSLOG_FileFormat" : (char*)pData->tplName),
@@ -1006,6 +1236,11 @@ CODESTARTnewActInst
 			calloc(pData->iDynaTopicCacheSize, sizeof(dynaTopicCacheEntry*)));
         pData->iCurrElt = -1;
 	}
+	if(pData->dynaKey) {
+		CHKiRet(OMSRsetEntry(*ppOMSR, pData->iTplKey, ustrdup(pData->key),
+			OMSR_NO_RQD_TPL_OPTS));
+	}
+	CHKiRet(setupPartitionStats(pData));
 	pthread_mutex_lock(&closeTimeoutMut);
 	if (closeTimeout < pData->closeTimeout) {
 		closeTimeout = pData->closeTimeout;
@@ -1051,7 +1286,7 @@ ENDmodExit
 
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_CNFNAME_QUERIES 
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
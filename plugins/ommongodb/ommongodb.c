@@ -49,6 +49,7 @@
 #include "errmsg.h"
 #include "cfsysline.h"
 #include "unicode-helper.h"
+#include "statsobj.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -58,10 +59,9 @@ MODULE_CNFNAME("ommongodb")
 DEF_OMOD_STATIC_DATA
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(datetime)
+DEFobjCurrIf(statsobj)
 
 typedef struct _instanceData {
-	mongo_sync_connection *conn;
-	struct json_tokener *json_tokener; /* only if (tplName != NULL) */
 	uchar *server;
 	int port;
         uchar *db;
@@ -70,11 +70,19 @@ typedef struct _instanceData {
 	uchar *pwd;
 	uchar *dbNcoll;
 	uchar *tplName;
-	int bErrMsgPermitted;	/* only one errmsg permitted per connection */
+	statsobj_t *stats;
+	STATSCOUNTER_DEF(ctrBatches, mutCtrBatches)
+	STATSCOUNTER_DEF(ctrInserted, mutCtrInserted)
+	STATSCOUNTER_DEF(ctrFailed, mutCtrFailed)
+	statshist_t *pHistBatchLatency;	/* per-batch insert latency, in us */
 } instanceData;
 
 typedef struct wrkrInstanceData {
 	instanceData *pData;
+	mongo_sync_connection *conn;
+	int bErrMsgPermitted;	/* only one errmsg permitted per connection */
+	const bson **docs;	/* documents of the current batch */
+	unsigned maxDocs;	/* allocated size of docs */
 } wrkrInstanceData_t;
 
 
@@ -95,8 +103,6 @@ static struct cnfparamblk actpblk =
 	  actpdescr
 	};
 
-static pthread_mutex_t mutDoAct = PTHREAD_MUTEX_INITIALIZER;
-
 BEGINcreateInstance
 CODESTARTcreateInstance
 ENDcreateInstance
@@ -115,20 +121,20 @@ CODESTARTisCompatibleWithFeature
 		iRet = RS_RET_OK;
 ENDisCompatibleWithFeature
 
-static void closeMongoDB(instanceData *pData)
+static void closeMongoDB(wrkrInstanceData_t *pWrkrData)
 {
-	if(pData->conn != NULL) {
-                mongo_sync_disconnect(pData->conn);
-		pData->conn = NULL;
+	if(pWrkrData->conn != NULL) {
+                mongo_sync_disconnect(pWrkrData->conn);
+		pWrkrData->conn = NULL;
 	}
 }
 
 
 BEGINfreeInstance
 CODESTARTfreeInstance
-	closeMongoDB(pData);
-	if (pData->json_tokener != NULL)
-		json_tokener_free(pData->json_tokener);
+	if(pData->stats != NULL)
+		statsobj.Destruct(&pData->stats);
+	statsHistDestruct(&pData->pHistBatchLatency);
 	free(pData->server);
 	free(pData->db);
 	free(pData->collection);
@@ -140,6 +146,8 @@ ENDfreeInstance
 
 BEGINfreeWrkrInstance
 CODESTARTfreeWrkrInstance
+	closeMongoDB(pWrkrData);
+	free(pWrkrData->docs);
 ENDfreeWrkrInstance
 
 
@@ -153,15 +161,15 @@ ENDdbgPrintInstInfo
 /* report error that occured during *last* operation
  */
 static void
-reportMongoError(instanceData *pData)
+reportMongoError(wrkrInstanceData_t *pWrkrData)
 {
 	char errStr[1024];
 	gchar *err;
 	int eno;
 
-	if(pData->bErrMsgPermitted) {
+	if(pWrkrData->bErrMsgPermitted) {
 		eno = errno;
-		if(mongo_sync_cmd_get_last_error(pData->conn, (gchar*)pData->db, &err) == TRUE) {
+		if(mongo_sync_cmd_get_last_error(pWrkrData->conn, (gchar*)pWrkrData->pData->db, &err) == TRUE) {
 			errmsg.LogError(0, RS_RET_ERR, "ommongodb: error: %s", err);
 		} else {
 			DBGPRINTF("ommongodb: we had an error, but can not obtain specifics, "
@@ -169,7 +177,7 @@ reportMongoError(instanceData *pData)
 			errmsg.LogError(0, RS_RET_ERR, "ommongodb: error: %s",
 				rs_strerror_r(eno, errStr, sizeof(errStr)));
 		}
-		pData->bErrMsgPermitted = 0;
+		pWrkrData->bErrMsgPermitted = 0;
 	}
 }
 
@@ -178,18 +186,19 @@ reportMongoError(instanceData *pData)
  * MongoDB connection.
  * Initially added 2004-10-28 mmeckelein
  */
-static rsRetVal initMongoDB(instanceData *pData, int bSilent)
+static rsRetVal initMongoDB(wrkrInstanceData_t *pWrkrData, int bSilent)
 {
+	instanceData *const pData = pWrkrData->pData;
 	const char *server;
 	DEFiRet;
 
 	server = (pData->server == NULL) ? "127.0.0.1" : (const char*) pData->server;
 	DBGPRINTF("ommongodb: trying connect to '%s' at port %d\n", server, pData->port);
 
-	pData->conn = mongo_sync_connect(server, pData->port, TRUE);
-	if(pData->conn == NULL) {
+	pWrkrData->conn = mongo_sync_connect(server, pData->port, TRUE);
+	if(pWrkrData->conn == NULL) {
 		if(!bSilent) {
-			reportMongoError(pData);
+			reportMongoError(pWrkrData);
 			dbgprintf("ommongodb: can not initialize MongoDB handle");
 		}
                 ABORT_FINALIZE(RS_RET_SUSPENDED);
@@ -202,15 +211,15 @@ static rsRetVal initMongoDB(instanceData *pData, int bSilent)
 	  if(!pData->uid || !pData->pwd) {
 	    dbgprintf("ommongodb: authentication requires uid and pwd attributes set; skipping");
 	  }
-	  else if(!mongo_sync_cmd_authenticate(pData->conn, (const gchar*)pData->db,
+	  else if(!mongo_sync_cmd_authenticate(pWrkrData->conn, (const gchar*)pData->db,
 	  	  			(const gchar*)pData->uid, (const gchar*)pData->pwd)) {
 	    if(!bSilent) {
-	      reportMongoError(pData);
+	      reportMongoError(pWrkrData);
 	      dbgprintf("ommongodb: could not authenticate %s against '%s'", pData->uid, pData->db);
 	    }
 
 	    /* no point in continuing with an unauthenticated connection */
-	    closeMongoDB(pData);
+	    closeMongoDB(pWrkrData);
 	    ABORT_FINALIZE(RS_RET_SUSPENDED);
 	  }
 	  else {
@@ -496,47 +505,91 @@ error:
 
 BEGINtryResume
 CODESTARTtryResume
-	if(pWrkrData->pData->conn == NULL) {
-		iRet = initMongoDB(pWrkrData->pData, 1);
+	if(pWrkrData->conn == NULL) {
+		iRet = initMongoDB(pWrkrData, 1);
 	}
 ENDtryResume
 
-BEGINdoAction_NoStrings
-	bson *doc = NULL;
-	instanceData *pData;
-CODESTARTdoAction
-	pthread_mutex_lock(&mutDoAct);
-	pData = pWrkrData->pData;
-	/* see if we are ready to proceed */
-	if(pData->conn == NULL) {
-		CHKiRet(initMongoDB(pData, 0));
-	}
 
-	if(pData->tplName == NULL) {
-		doc = getDefaultBSON(*(smsg_t**)pMsgData);
-	} else {
-		doc = BSONFromJSONObject(*(struct json_object **)pMsgData);
+/* make sure the worker's document array can hold nDocs entries */
+static rsRetVal
+growDocs(wrkrInstanceData_t *const pWrkrData, const unsigned nDocs)
+{
+	const bson **newDocs;
+	DEFiRet;
+
+	if(nDocs > pWrkrData->maxDocs) {
+		CHKmalloc(newDocs = realloc(pWrkrData->docs, nDocs * sizeof(bson*)));
+		pWrkrData->docs = newDocs;
+		pWrkrData->maxDocs = nDocs;
 	}
-	if(doc == NULL) {
-		dbgprintf("ommongodb: error creating BSON doc\n");
-		/* FIXME: is this a correct return code? */
-		ABORT_FINALIZE(RS_RET_ERR);
+finalize_it:
+	RETiRet;
+}
+
+
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+	if(pWrkrData->conn == NULL)
+		CHKiRet(initMongoDB(pWrkrData, 0));
+finalize_it:
+ENDbeginTransaction
+
+
+/* The whole batch is sent as a single OP_INSERT message. Documents we
+ * cannot convert are dropped (as before), they must not hold back the
+ * rest of the batch. An insert failure suspends the action, the core
+ * then retries the complete batch once we are resumed.
+ */
+BEGINcommitTransaction
+	instanceData *const pData = pWrkrData->pData;
+	void *param;
+	bson *doc;
+	uint64_t tStart;
+	unsigned nDocs = 0;
+	unsigned i;
+CODESTARTcommitTransaction
+	if(pWrkrData->conn == NULL)
+		CHKiRet(initMongoDB(pWrkrData, 0));
+	CHKiRet(growDocs(pWrkrData, nParams));
+
+	for(i = 0 ; i < nParams ; ++i) {
+		param = actParam(pParams, 1, i, 0).param;
+		if(param == NULL) {
+			doc = NULL;
+		} else if(pData->tplName == NULL) {
+			doc = getDefaultBSON((smsg_t*) param);
+		} else {
+			doc = BSONFromJSONObject((struct json_object*) param);
+		}
+		if(doc == NULL) {
+			dbgprintf("ommongodb: error creating BSON doc, message discarded\n");
+			STATSCOUNTER_INC(pData->ctrFailed, pData->mutCtrFailed);
+			continue;
+		}
+		pWrkrData->docs[nDocs++] = doc;
 	}
-	if(mongo_sync_cmd_insert(pData->conn, (char*)pData->dbNcoll, doc, NULL)) {
-		pData->bErrMsgPermitted = 1;
+	if(nDocs == 0)
+		FINALIZE;
+
+	tStart = statsHistNowNs();
+	if(mongo_sync_cmd_insert_n(pWrkrData->conn, (char*)pData->dbNcoll, nDocs, pWrkrData->docs)) {
+		pWrkrData->bErrMsgPermitted = 1;
 	} else {
-		dbgprintf("ommongodb: insert error\n");
-		reportMongoError(pData);
+		dbgprintf("ommongodb: bulk insert of %u documents failed\n", nDocs);
+		reportMongoError(pWrkrData);
 		/* close on insert error to permit resume */
-		closeMongoDB(pData);
+		closeMongoDB(pWrkrData);
 		ABORT_FINALIZE(RS_RET_SUSPENDED);
 	}
+	statsHistRecord(pData->pHistBatchLatency, (statsHistNowNs() - tStart) / 1000);
+	STATSCOUNTER_INC(pData->ctrBatches, pData->mutCtrBatches);
+	STATSCOUNTER_ADD(pData->ctrInserted, pData->mutCtrInserted, nDocs);
 
 finalize_it:
-	pthread_mutex_unlock(&mutDoAct);
-	if(doc != NULL)
-		bson_free(doc);
-ENDdoAction
+	for(i = 0 ; i < nDocs ; ++i)
+		bson_free((bson*) pWrkrData->docs[i]);
+ENDcommitTransaction
 
 
 static void
@@ -549,6 +602,37 @@ setInstParamDefaults(instanceData *pData)
 	pData->uid = NULL;
 	pData->pwd = NULL;
 	pData->tplName = NULL;
+	pData->stats = NULL;
+	pData->pHistBatchLatency = NULL;
+}
+
+
+static rsRetVal
+setupStats(instanceData *const pData)
+{
+	uchar ctrName[256];
+	DEFiRet;
+
+	CHKiRet(statsobj.Construct(&pData->stats));
+	snprintf((char*) ctrName, sizeof(ctrName), "ommongodb(%s)", pData->dbNcoll);
+	ctrName[sizeof(ctrName)-1] = '\0';
+	CHKiRet(statsobj.SetName(pData->stats, ctrName));
+	CHKiRet(statsobj.SetOrigin(pData->stats, (uchar*) "ommongodb"));
+	STATSCOUNTER_INIT(pData->ctrBatches, pData->mutCtrBatches);
+	CHKiRet(statsobj.AddCounter(pData->stats, (uchar*) "batches",
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pData->ctrBatches));
+	STATSCOUNTER_INIT(pData->ctrInserted, pData->mutCtrInserted);
+	CHKiRet(statsobj.AddCounter(pData->stats, (uchar*) "inserted",
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pData->ctrInserted));
+	STATSCOUNTER_INIT(pData->ctrFailed, pData->mutCtrFailed);
+	CHKiRet(statsobj.AddCounter(pData->stats, (uchar*) "failed",
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pData->ctrFailed));
+	CHKiRet(statsHistConstruct(&pData->pHistBatchLatency));
+	CHKiRet(statsobj.AddCounter(pData->stats, (uchar*) "batch.latency.us",
+		ctrType_Histogram, CTR_FLAG_RESETTABLE, pData->pHistBatchLatency));
+	CHKiRet(statsobj.ConstructFinalize(pData->stats));
+finalize_it:
+	RETiRet;
 }
 
 BEGINnewActInst
@@ -592,7 +676,6 @@ CODESTARTnewActInst
 	} else {
 		CHKiRet(OMSRsetEntry(*ppOMSR, 0, ustrdup(pData->tplName),
 				     OMSR_TPL_AS_JSON));
-		CHKmalloc(pData->json_tokener = json_tokener_new());
 	}
 
 	if(pData->db == NULL)
@@ -611,6 +694,7 @@ CODESTARTnewActInst
 	pData->dbNcoll[lendb] = '.';
 	/* lencoll+1 => copy \0! */
 	memcpy(pData->dbNcoll+lendb+1, pData->collection, lencoll+1);
+	CHKiRet(setupStats(pData));
 
 CODE_STD_FINALIZERnewActInst
 	cnfparamvalsDestruct(pvals, &actpblk);
@@ -634,12 +718,13 @@ BEGINmodExit
 CODESTARTmodExit
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(datetime, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 ENDmodExit
 
 
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
 ENDqueryEtryPt
@@ -654,6 +739,7 @@ CODESTARTmodInit
 CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 	INITChkCoreFeature(bCoreSupportsBatching, CORE_FEATURE_BATCHING);
 	DBGPRINTF("ommongodb: module compiled with rsyslog version %s.\n", VERSION);
 
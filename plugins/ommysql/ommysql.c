@@ -29,6 +29,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 #include <signal.h>
 #include <errno.h>
@@ -63,12 +64,16 @@ typedef struct _instanceData {
 	uchar   *configfile;			/* MySQL Client Configuration File */
 	uchar   *configsection;		/* MySQL Client Configuration Section */
 	uchar	*tplName;			/* format template to use */
+	size_t	maxbytes;			/* max size of a multi-row INSERT, 0 = do not merge */
 } instanceData;
 
 typedef struct wrkrInstanceData {
 	instanceData *pData;
 	MYSQL	*hmysql;			/* handle to MySQL */
 	unsigned uLastMySQLErrno;		/* last errno returned by MySQL or 0 if all is well */
+	char	*stmt;				/* buffer for building multi-row INSERTs */
+	size_t	lenStmt;
+	size_t	sizeStmt;
 } wrkrInstanceData_t;
 
 typedef struct configSettings_s {
@@ -88,7 +93,8 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "serverport", eCmdHdlrInt, 0 },
 	{ "mysqlconfig.file", eCmdHdlrGetWord, 0 },
 	{ "mysqlconfig.section", eCmdHdlrGetWord, 0 },
-	{ "template", eCmdHdlrGetWord, 0 }
+	{ "template", eCmdHdlrGetWord, 0 },
+	{ "maxbytes", eCmdHdlrSize, 0 }
 };
 static struct cnfparamblk actpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -111,6 +117,9 @@ ENDcreateInstance
 BEGINcreateWrkrInstance
 CODESTARTcreateWrkrInstance
 	pWrkrData->hmysql = NULL;
+	pWrkrData->stmt = NULL;
+	pWrkrData->lenStmt = 0;
+	pWrkrData->sizeStmt = 0;
 ENDcreateWrkrInstance
 
 
@@ -145,6 +154,7 @@ BEGINfreeWrkrInstance
 CODESTARTfreeWrkrInstance
 	closeMySQL(pWrkrData);
 	mysql_thread_end();
+	free(pWrkrData->stmt);
 ENDfreeWrkrInstance
 
 
@@ -233,36 +243,235 @@ finalize_it:
 }
 
 
-/* The following function writes the current log entry
- * to an established MySQL session.
- * Initially added 2004-10-28 mmeckelein
+/* execute a single SQL statement on the current connection. Does not
+ * retry; the caller handles connection loss for the batch as a whole.
+ * Client errors (CR_*, 2000..2999) mean the connection is unusable and
+ * return RS_RET_SUSPENDED; server errors refer to the statement itself
+ * and return RS_RET_DATAFAIL.
  */
-static rsRetVal writeMySQL(wrkrInstanceData_t *pWrkrData, uchar *psz)
+static rsRetVal
+execMySQL(wrkrInstanceData_t *pWrkrData, const char *stmt, const size_t len)
 {
+	unsigned uMySQLErrno;
 	DEFiRet;
 
-	/* see if we are ready to proceed */
-	if(pWrkrData->hmysql == NULL) {
-		CHKiRet(initMySQL(pWrkrData, 0));
-		
+	if(mysql_real_query(pWrkrData->hmysql, stmt, len)) {
+		uMySQLErrno = mysql_errno(pWrkrData->hmysql);
+		dbgprintf("ommysql: query failed (%u): %s\n", uMySQLErrno, mysql_error(pWrkrData->hmysql));
+		ABORT_FINALIZE((uMySQLErrno >= 2000 && uMySQLErrno < 3000) ? RS_RET_SUSPENDED : RS_RET_DATAFAIL);
 	}
 
-	/* try insert */
-	if(mysql_query(pWrkrData->hmysql, (char*)psz)) {
-		/* error occured, try to re-init connection and retry */
-		closeMySQL(pWrkrData); /* close the current handle */
-		CHKiRet(initMySQL(pWrkrData, 0)); /* try to re-open */
-		if(mysql_query(pWrkrData->hmysql, (char*)psz)) { /* re-try insert */
-			/* we failed, giving up for now */
-			reportDBError(pWrkrData, 0);
-			closeMySQL(pWrkrData); /* free ressources */
-			ABORT_FINALIZE(RS_RET_SUSPENDED);
+finalize_it:
+	RETiRet;
+}
+
+
+/* Check if a statement is a single-row "INSERT ... VALUES (...)" which can be
+ * merged with others of the same prefix into a multi-row INSERT. On success,
+ * *lenPrefix is the length up to and including the VALUES keyword and
+ * [*offsRow, *offsRow + *lenRow) is the parenthesized row. Anything else
+ * (INSERT ... SELECT, ON DUPLICATE KEY UPDATE, non-INSERT statements) is
+ * reported as not mergeable and executed unmodified.
+ */
+static int
+splitInsert(const uchar *const psz, size_t len, size_t *const lenPrefix,
+	size_t *const offsRow, size_t *const lenRow)
+{
+	size_t i;
+	int depth;
+	int inQuote;
+
+	while(len > 0 && (isspace(psz[len-1]) || psz[len-1] == ';'))
+		--len;
+	for(i = 0 ; i < len && isspace(psz[i]) ; ++i)
+		/* skip leading whitespace */;
+	if(len - i < sizeof("insert ") - 1 || strncasecmp((char*)psz+i, "insert", 6) || !isspace(psz[i+6]))
+		return 0;
+
+	/* find the VALUES keyword; there must be no literals before it */
+	for(i += 6 ; i + 6 <= len ; ++i) {
+		if(psz[i] == '\'' || psz[i] == '"')
+			return 0;
+		if(   (isspace(psz[i-1]) || psz[i-1] == ')')
+		   && !strncasecmp((char*)psz+i, "values", 6)
+		   && (i + 6 < len && (isspace(psz[i+6]) || psz[i+6] == '(')))
+			break;
+	}
+	if(i + 6 > len)
+		return 0;
+	*lenPrefix = i + 6;
+
+	for(i = *lenPrefix ; i < len && isspace(psz[i]) ; ++i)
+		/* skip whitespace */;
+	if(i == len || psz[i] != '(')
+		return 0;
+	*offsRow = i;
+
+	/* the row must end exactly where the statement ends */
+	depth = 0;
+	inQuote = 0;
+	for( ; i < len ; ++i) {
+		if(inQuote) {
+			if(psz[i] == '\\')
+				++i;
+			else if(psz[i] == '\'')
+				inQuote = 0;
+		} else if(psz[i] == '\'') {
+			inQuote = 1;
+		} else if(psz[i] == '"') {
+			return 0;
+		} else if(psz[i] == '(') {
+			++depth;
+		} else if(psz[i] == ')') {
+			if(--depth == 0)
+				break;
 		}
 	}
+	if(i + 1 != len)
+		return 0;
+	*lenRow = len - *offsRow;
+	return 1;
+}
+
+
+static rsRetVal
+appendStmt(wrkrInstanceData_t *pWrkrData, const uchar *const psz, const size_t len)
+{
+	char *newbuf;
+	size_t newsize;
+	DEFiRet;
+
+	if(pWrkrData->lenStmt + len > pWrkrData->sizeStmt) {
+		newsize = pWrkrData->sizeStmt ? pWrkrData->sizeStmt : 4096;
+		while(newsize < pWrkrData->lenStmt + len)
+			newsize *= 2;
+		CHKmalloc(newbuf = realloc(pWrkrData->stmt, newsize));
+		pWrkrData->stmt = newbuf;
+		pWrkrData->sizeStmt = newsize;
+	}
+	memcpy(pWrkrData->stmt + pWrkrData->lenStmt, psz, len);
+	pWrkrData->lenStmt += len;
 
 finalize_it:
-	if(iRet == RS_RET_OK) {
-		pWrkrData->uLastMySQLErrno = 0; /* reset error for error supression */
+	RETiRet;
+}
+
+
+static rsRetVal
+flushStmt(wrkrInstanceData_t *pWrkrData)
+{
+	DEFiRet;
+
+	if(pWrkrData->lenStmt == 0)
+		FINALIZE;
+	iRet = execMySQL(pWrkrData, pWrkrData->stmt, pWrkrData->lenStmt);
+	pWrkrData->lenStmt = 0;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Write a whole batch inside a single transaction. Consecutive single-row
+ * INSERTs with an identical prefix are folded into one multi-row INSERT of
+ * at most maxbytes, so a batch usually takes a handful of round trips
+ * instead of one per message.
+ */
+static rsRetVal
+writeBatch(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
+{
+	const size_t maxbytes = pWrkrData->pData->maxbytes;
+	const uchar *psz;
+	size_t len;
+	const uchar *currPrefix = NULL;
+	size_t lenCurrPrefix = 0;
+	size_t lenPrefix, offsRow, lenRow;
+	unsigned i;
+	DEFiRet;
+
+	pWrkrData->lenStmt = 0;
+	CHKiRet(execMySQL(pWrkrData, "START TRANSACTION", sizeof("START TRANSACTION")-1));
+	for(i = 0 ; i < nParams ; ++i) {
+		psz = actParam(pParams, 1, i, 0).param;
+		len = actParam(pParams, 1, i, 0).lenStr;
+		if(maxbytes == 0 || !splitInsert(psz, len, &lenPrefix, &offsRow, &lenRow)) {
+			CHKiRet(flushStmt(pWrkrData));
+			currPrefix = NULL;
+			CHKiRet(execMySQL(pWrkrData, (char*)psz, len));
+			continue;
+		}
+		if(   currPrefix != NULL
+		   && lenPrefix == lenCurrPrefix
+		   && !memcmp(psz, currPrefix, lenPrefix)
+		   && pWrkrData->lenStmt + 1 + lenRow <= maxbytes) {
+			CHKiRet(appendStmt(pWrkrData, (uchar*)",", 1));
+		} else {
+			CHKiRet(flushStmt(pWrkrData));
+			currPrefix = psz;
+			lenCurrPrefix = lenPrefix;
+			CHKiRet(appendStmt(pWrkrData, psz, lenPrefix));
+			CHKiRet(appendStmt(pWrkrData, (uchar*)" ", 1));
+		}
+		CHKiRet(appendStmt(pWrkrData, psz + offsRow, lenRow));
+	}
+	CHKiRet(flushStmt(pWrkrData));
+	if(mysql_commit(pWrkrData->hmysql) != 0) {
+		dbgprintf("mysql server error: transaction not committed\n");
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Execute the statements of a batch one by one, each in its own
+ * transaction. This is used after the batch failed with a statement error,
+ * so that only the bad statements are discarded instead of the whole batch
+ * being retried over and over again.
+ */
+static rsRetVal
+writeSingle(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
+{
+	unsigned i;
+	unsigned nFailed = 0;
+	rsRetVal localRet;
+	DEFiRet;
+
+	for(i = 0 ; i < nParams ; ++i) {
+		localRet = execMySQL(pWrkrData, (char*)actParam(pParams, 1, i, 0).param,
+			actParam(pParams, 1, i, 0).lenStr);
+		if(localRet == RS_RET_DATAFAIL) {
+			errmsg.LogError(0, RS_RET_DATAFAIL, "ommysql: db error (%u): %s - statement "
+				"discarded: %s", mysql_errno(pWrkrData->hmysql),
+				mysql_error(pWrkrData->hmysql), actParam(pParams, 1, i, 0).param);
+			mysql_rollback(pWrkrData->hmysql);
+			++nFailed;
+			continue;
+		}
+		CHKiRet(localRet);
+		if(mysql_commit(pWrkrData->hmysql) != 0)
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+	dbgprintf("ommysql: batch written one by one, %u of %u statements failed\n", nFailed, nParams);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* write a batch; if it fails due to a bad statement, roll it back and
+ * isolate the bad statement(s) by writing one by one
+ */
+static rsRetVal
+writeBatchOrSingle(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
+{
+	DEFiRet;
+
+	iRet = writeBatch(pWrkrData, pParams, nParams);
+	if(iRet == RS_RET_DATAFAIL) {
+		mysql_rollback(pWrkrData->hmysql);
+		iRet = writeSingle(pWrkrData, pParams, nParams);
 	}
 
 	RETiRet;
@@ -278,25 +487,36 @@ ENDtryResume
 
 BEGINbeginTransaction
 CODESTARTbeginTransaction
-	CHKiRet(writeMySQL(pWrkrData, (uchar*)"START TRANSACTION"));
+	if(pWrkrData->hmysql == NULL)
+		CHKiRet(initMySQL(pWrkrData, 0));
 finalize_it:
 ENDbeginTransaction
 
-BEGINdoAction
-CODESTARTdoAction
-	dbgprintf("\n");
-	CHKiRet(writeMySQL(pWrkrData, ppString[0]));
-	iRet = RS_RET_DEFER_COMMIT;
-finalize_it:
-ENDdoAction
+/* If the batch fails due to a bad statement, the statements are written
+ * one by one and the bad ones discarded. On any other failure, the
+ * connection is dropped (which rolls back the transaction) and the whole
+ * batch retried once on a fresh connection before we suspend the action.
+ */
+BEGINcommitTransaction
+CODESTARTcommitTransaction
+	if(pWrkrData->hmysql == NULL)
+		CHKiRet(initMySQL(pWrkrData, 0));
 
-BEGINendTransaction
-CODESTARTendTransaction
-	if(mysql_commit(pWrkrData->hmysql) != 0)	{	
-		dbgprintf("mysql server error: transaction not committed\n");		
-		iRet = RS_RET_SUSPENDED;
+	if(writeBatchOrSingle(pWrkrData, pParams, nParams) != RS_RET_OK) {
+		closeMySQL(pWrkrData);
+		CHKiRet(initMySQL(pWrkrData, 0));
+		if(writeBatchOrSingle(pWrkrData, pParams, nParams) != RS_RET_OK) {
+			reportDBError(pWrkrData, 0);
+			closeMySQL(pWrkrData);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+	}
+
+finalize_it:
+	if(iRet == RS_RET_OK) {
+		pWrkrData->uLastMySQLErrno = 0; /* reset error for error supression */
 	}
-ENDendTransaction
+ENDcommitTransaction
 
 
 static inline void
@@ -306,6 +526,7 @@ setInstParamDefaults(instanceData *pData)
 	pData->configfile = NULL;
 	pData->configsection = NULL;
 	pData->tplName = NULL;
+	pData->maxbytes = 1024 * 1024;
 }
 
 
@@ -352,6 +573,8 @@ CODESTARTnewActInst
 			pData->configsection = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
 		} else if(!strcmp(actpblk.descr[i].name, "template")) {
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "maxbytes")) {
+			pData->maxbytes = (size_t) pvals[i].val.d.n;
 		} else {
 			dbgprintf("ommysql: program error, non-handled "
 			  "param '%s'\n", actpblk.descr[i].name);
@@ -393,6 +616,7 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 
 	/* ok, if we reach this point, we have something for us */
 	CHKiRet(createInstance(&pData));
+	setInstParamDefaults(pData);
 
 	/* rger 2004-10-28: added support for MySQL
 	 * >server,dbname,userid,password
@@ -452,10 +676,9 @@ ENDmodExit
 
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
-CODEqueryEtryPt_TXIF_OMOD_QUERIES /* we support the transactional interface! */
 ENDqueryEtryPt
 
 
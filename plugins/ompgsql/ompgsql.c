@@ -35,6 +35,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 #include <signal.h>
 #include <errno.h>
@@ -57,17 +58,20 @@ DEF_OMOD_STATIC_DATA
 DEFobjCurrIf(errmsg)
 
 typedef struct _instanceData {
-	PGconn	*f_hpgsql;			/* handle to PgSQL */
 	char	f_dbsrv[MAXHOSTNAMELEN+1];	/* IP or hostname of DB server*/ 
 	char	f_dbname[_DB_MAXDBLEN+1];	/* DB name */
 	char	f_dbuid[_DB_MAXUNAMELEN+1];	/* DB user */
 	char	f_dbpwd[_DB_MAXPWDLEN+1];	/* DB user's password */
-	ConnStatusType	eLastPgSQLStatus; 	/* last status from postgres */
         uchar   *tplName;                       /* format template to use */
 } instanceData;
 
 typedef struct wrkrInstanceData {
 	instanceData *pData;
+	PGconn	*f_hpgsql;			/* handle to PgSQL */
+	ConnStatusType	eLastPgSQLStatus; 	/* last status from postgres */
+	char	*row;				/* current row in COPY text format */
+	size_t	lenRow;
+	size_t	sizeRow;
 } wrkrInstanceData_t;
 
 typedef struct configSettings_s {
@@ -75,21 +79,21 @@ typedef struct configSettings_s {
 } configSettings_t;
 static configSettings_t __attribute__((unused)) cs;
 
-static pthread_mutex_t mutDoAct = PTHREAD_MUTEX_INITIALIZER;
-
 BEGINinitConfVars		/* (re)set config variables to default values */
 CODESTARTinitConfVars 
 ENDinitConfVars
 
 
-static rsRetVal writePgSQL(uchar *psz, instanceData *pData);
-
 BEGINcreateInstance
 CODESTARTcreateInstance
 ENDcreateInstance
 
 BEGINcreateWrkrInstance
 CODESTARTcreateWrkrInstance
+	pWrkrData->f_hpgsql = NULL;
+	pWrkrData->row = NULL;
+	pWrkrData->lenRow = 0;
+	pWrkrData->sizeRow = 0;
 ENDcreateWrkrInstance
 
 
@@ -103,24 +107,25 @@ ENDisCompatibleWithFeature
 /* The following function is responsible for closing a
  * PgSQL connection.
  */
-static void closePgSQL(instanceData *pData)
+static void closePgSQL(wrkrInstanceData_t *pWrkrData)
 {
-	assert(pData != NULL);
+	assert(pWrkrData != NULL);
 
-	if(pData->f_hpgsql != NULL) {	/* just to be on the safe side... */
-		PQfinish(pData->f_hpgsql);
-		pData->f_hpgsql = NULL;
+	if(pWrkrData->f_hpgsql != NULL) {	/* just to be on the safe side... */
+		PQfinish(pWrkrData->f_hpgsql);
+		pWrkrData->f_hpgsql = NULL;
 	}
 }
 
 BEGINfreeInstance
 CODESTARTfreeInstance
-	closePgSQL(pData);
         free(pData->tplName);
 ENDfreeInstance
 
 BEGINfreeWrkrInstance
 CODESTARTfreeWrkrInstance
+	closePgSQL(pWrkrData);
+	free(pWrkrData->row);
 ENDfreeWrkrInstance
 
 BEGINdbgPrintInstInfo
@@ -133,26 +138,26 @@ ENDdbgPrintInstInfo
  * We check if we have a valid handle. If not, we simply
  * report an error, but can not be specific. RGerhards, 2007-01-30
  */
-static void reportDBError(instanceData *pData, int bSilent)
+static void reportDBError(wrkrInstanceData_t *pWrkrData, int bSilent)
 {
 	char errMsg[512];
 	ConnStatusType ePgSQLStatus;
 
-	assert(pData != NULL);
+	assert(pWrkrData != NULL);
 	bSilent=0;
 
 	/* output log message */
 	errno = 0;
-	if(pData->f_hpgsql == NULL) {
+	if(pWrkrData->f_hpgsql == NULL) {
 		errmsg.LogError(0, NO_ERRCODE, "unknown DB error occured - could not obtain PgSQL handle");
 	} else { /* we can ask pgsql for the error description... */
-		ePgSQLStatus = PQstatus(pData->f_hpgsql);
+		ePgSQLStatus = PQstatus(pWrkrData->f_hpgsql);
 		snprintf(errMsg, sizeof(errMsg), "db error (%d): %s\n", ePgSQLStatus,
-				PQerrorMessage(pData->f_hpgsql));
-		if(bSilent || ePgSQLStatus == pData->eLastPgSQLStatus)
+				PQerrorMessage(pWrkrData->f_hpgsql));
+		if(bSilent || ePgSQLStatus == pWrkrData->eLastPgSQLStatus)
 			dbgprintf("pgsql, DBError(silent): %s\n", errMsg);
 		else {
-			pData->eLastPgSQLStatus = ePgSQLStatus;
+			pWrkrData->eLastPgSQLStatus = ePgSQLStatus;
 			errmsg.LogError(0, NO_ERRCODE, "%s", errMsg);
 		}
 	}
@@ -164,12 +169,14 @@ static void reportDBError(instanceData *pData, int bSilent)
 /* The following function is responsible for initializing a
  * PgSQL connection.
  */
-static rsRetVal initPgSQL(instanceData *pData, int bSilent)
+static rsRetVal initPgSQL(wrkrInstanceData_t *pWrkrData, int bSilent)
 {
+	instanceData *pData;
 	DEFiRet;
 
-	assert(pData != NULL);
-	assert(pData->f_hpgsql == NULL);
+	assert(pWrkrData != NULL);
+	assert(pWrkrData->f_hpgsql == NULL);
+	pData = pWrkrData->pData;
 
 	dbgprintf("host=%s dbname=%s uid=%s\n",pData->f_dbsrv,pData->f_dbname,pData->f_dbuid);
 
@@ -179,10 +186,11 @@ static rsRetVal initPgSQL(instanceData *pData, int bSilent)
 	const char *PgConnectionOptions = "-c standard_conforming_strings=on";
 
 	/* Connect to database */
-	if((pData->f_hpgsql=PQsetdbLogin(pData->f_dbsrv, NULL, PgConnectionOptions, NULL,
-				pData->f_dbname, pData->f_dbuid, pData->f_dbpwd)) == NULL) {
-		reportDBError(pData, bSilent);
-		closePgSQL(pData); /* ignore any error we may get */
+	if((pWrkrData->f_hpgsql=PQsetdbLogin(pData->f_dbsrv, NULL, PgConnectionOptions, NULL,
+				pData->f_dbname, pData->f_dbuid, pData->f_dbpwd)) == NULL
+	   || PQstatus(pWrkrData->f_hpgsql) != CONNECTION_OK) {
+		reportDBError(pWrkrData, bSilent);
+		closePgSQL(pWrkrData); /* ignore any error we may get */
 		iRet = RS_RET_SUSPENDED;
 	}
 
@@ -195,14 +203,14 @@ static rsRetVal initPgSQL(instanceData *pData, int bSilent)
  * rgerhards, 2009-04-17
  */
 static int
-tryExec(uchar *pszCmd, instanceData *pData)
+tryExec(uchar *pszCmd, wrkrInstanceData_t *pWrkrData)
 {
 	PGresult *pgRet;
 	ExecStatusType execState;
 	int bHadError = 0;
 
 	/* try insert */
-	pgRet = PQexec(pData->f_hpgsql, (char*)pszCmd);
+	pgRet = PQexec(pWrkrData->f_hpgsql, (char*)pszCmd);
 	execState = PQresultStatus(pgRet);
 	if(execState != PGRES_COMMAND_OK && execState != PGRES_TUPLES_OK) {
 		dbgprintf("postgres query execution failed: %s\n", PQresStatus(PQresultStatus(pgRet)));
@@ -222,56 +230,343 @@ tryExec(uchar *pszCmd, instanceData *pData)
  * before my patch. -- rgerhards, 2009-04-17
  */
 static rsRetVal
-writePgSQL(uchar *psz, instanceData *pData)
+writePgSQL(uchar *psz, wrkrInstanceData_t *pWrkrData)
 {
 	int bHadError = 0;
 	DEFiRet;
 
 	assert(psz != NULL);
-	assert(pData != NULL);
+	assert(pWrkrData != NULL);
 
 	dbgprintf("writePgSQL: %s\n", psz);
 
-	bHadError = tryExec(psz, pData); /* try insert */
+	bHadError = tryExec(psz, pWrkrData); /* try insert */
 
-	if(bHadError || (PQstatus(pData->f_hpgsql) != CONNECTION_OK)) {
-#if 0		/* re-enable once we have transaction support */
+	if(bHadError || (PQstatus(pWrkrData->f_hpgsql) != CONNECTION_OK)) {
 		/* error occured, try to re-init connection and retry */
-		int inTransaction = 0;
-		if(pData->f_hpgsql != NULL) {
-			PGTransactionStatusType xactStatus = PQtransactionStatus(pData->f_hpgsql);
-			if((xactStatus == PQTRANS_INTRANS) || (xactStatus == PQTRANS_ACTIVE)) {
-				inTransaction = 1;
-			}
-		}
-		if ( inTransaction == 0 )
-#endif
-		{
-			closePgSQL(pData); /* close the current handle */
-			CHKiRet(initPgSQL(pData, 0)); /* try to re-open */
-			bHadError = tryExec(psz, pData); /* retry */
-		}
-		if(bHadError || (PQstatus(pData->f_hpgsql) != CONNECTION_OK)) {
+		closePgSQL(pWrkrData); /* close the current handle */
+		CHKiRet(initPgSQL(pWrkrData, 0)); /* try to re-open */
+		bHadError = tryExec(psz, pWrkrData); /* retry */
+		if(bHadError || (PQstatus(pWrkrData->f_hpgsql) != CONNECTION_OK)) {
 			/* we failed, giving up for now */
-			reportDBError(pData, 0);
-			closePgSQL(pData); /* free ressources */
+			reportDBError(pWrkrData, 0);
+			closePgSQL(pWrkrData); /* free ressources */
 			ABORT_FINALIZE(RS_RET_SUSPENDED);
 		}
 	}
 
 finalize_it:
 	if(iRet == RS_RET_OK) {
-		pData->eLastPgSQLStatus = CONNECTION_OK; /* reset error for error supression */
+		pWrkrData->eLastPgSQLStatus = CONNECTION_OK; /* reset error for error supression */
+	}
+
+	RETiRet;
+}
+
+
+/* Check if a statement is a single-row "INSERT INTO <target> VALUES (...)".
+ * On success, *lenPrefix is the length up to and including the VALUES
+ * keyword (statements with the same prefix go into the same COPY),
+ * [*offsTarget, *offsTarget + *lenTarget) is the table and optional column
+ * list and [*offsRow, *offsRow + *lenRow) the parenthesized row.
+ */
+static int
+splitInsert(const uchar *const psz, size_t len, size_t *const lenPrefix,
+	size_t *const offsTarget, size_t *const lenTarget,
+	size_t *const offsRow, size_t *const lenRow)
+{
+	size_t i;
+
+	while(len > 0 && (isspace(psz[len-1]) || psz[len-1] == ';'))
+		--len;
+	for(i = 0 ; i < len && isspace(psz[i]) ; ++i)
+		/* skip leading whitespace */;
+	if(len - i < sizeof("insert into ") - 1 || strncasecmp((char*)psz+i, "insert", 6) || !isspace(psz[i+6]))
+		return 0;
+	for(i += 6 ; i < len && isspace(psz[i]) ; ++i)
+		/* skip whitespace */;
+	if(len - i < sizeof("into ") - 1 || strncasecmp((char*)psz+i, "into", 4) || !isspace(psz[i+4]))
+		return 0;
+	for(i += 4 ; i < len && isspace(psz[i]) ; ++i)
+		/* skip whitespace */;
+	*offsTarget = i;
+
+	/* find the VALUES keyword; there must be no literals before it */
+	for( ; i + 6 <= len ; ++i) {
+		if(psz[i] == '\'')
+			return 0;
+		if(   i > *offsTarget
+		   && (isspace(psz[i-1]) || psz[i-1] == ')')
+		   && !strncasecmp((char*)psz+i, "values", 6)
+		   && (i + 6 < len && (isspace(psz[i+6]) || psz[i+6] == '(')))
+			break;
 	}
+	if(i + 6 > len)
+		return 0;
+	*lenTarget = i - *offsTarget;
+	*lenPrefix = i + 6;
+
+	for(i = *lenPrefix ; i < len && isspace(psz[i]) ; ++i)
+		/* skip whitespace */;
+	if(i == len || psz[i] != '(')
+		return 0;
+	*offsRow = i;
+	*lenRow = len - i;
+	return 1;
+}
+
 
+static rsRetVal
+appendRow(wrkrInstanceData_t *pWrkrData, const char *const psz, const size_t len)
+{
+	char *newbuf;
+	size_t newsize;
+	DEFiRet;
+
+	if(pWrkrData->lenRow + len > pWrkrData->sizeRow) {
+		newsize = pWrkrData->sizeRow ? pWrkrData->sizeRow : 1024;
+		while(newsize < pWrkrData->lenRow + len)
+			newsize *= 2;
+		CHKmalloc(newbuf = realloc(pWrkrData->row, newsize));
+		pWrkrData->row = newbuf;
+		pWrkrData->sizeRow = newsize;
+	}
+	memcpy(pWrkrData->row + pWrkrData->lenRow, psz, len);
+	pWrkrData->lenRow += len;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Convert a VALUES row into a line of COPY text format. Only plain string
+ * literals, numbers and NULL can be converted; anything else (function
+ * calls, casts, E'' strings, ...) makes us return 0 and the statement is
+ * then executed as-is. Strings are expected in standard conforming form,
+ * which is what STDSQL templates and our connection options guarantee.
+ */
+static int
+rowToCopy(wrkrInstanceData_t *pWrkrData, const uchar *const psz, const size_t len)
+{
+	size_t i, iTok;
+	char c;
+
+	pWrkrData->lenRow = 0;
+	i = 1; /* skip '(' */
+	while(1) {
+		while(i < len && isspace(psz[i]))
+			++i;
+		if(i == len)
+			return 0;
+		if(psz[i] == '\'') {
+			for(++i ; ; ++i) {
+				if(i == len)
+					return 0;
+				c = psz[i];
+				if(c == '\'') {
+					if(i + 1 < len && psz[i+1] == '\'') {
+						++i;
+					} else {
+						++i;
+						break;
+					}
+				}
+				if(c == '\\') {
+					if(appendRow(pWrkrData, "\\\\", 2) != RS_RET_OK) return 0;
+				} else if(c == '\t') {
+					if(appendRow(pWrkrData, "\\t", 2) != RS_RET_OK) return 0;
+				} else if(c == '\n') {
+					if(appendRow(pWrkrData, "\\n", 2) != RS_RET_OK) return 0;
+				} else if(c == '\r') {
+					if(appendRow(pWrkrData, "\\r", 2) != RS_RET_OK) return 0;
+				} else {
+					if(appendRow(pWrkrData, &c, 1) != RS_RET_OK) return 0;
+				}
+			}
+		} else {
+			for(iTok = i ; i < len && psz[i] != ',' && psz[i] != ')' && !isspace(psz[i]) ; ++i)
+				/* find end of token */;
+			if(i - iTok == 4 && !strncasecmp((char*)psz+iTok, "null", 4)) {
+				if(appendRow(pWrkrData, "\\N", 2) != RS_RET_OK) return 0;
+			} else {
+				if(i == iTok || strspn((char*)psz+iTok, "0123456789+-.eE") < i - iTok)
+					return 0;
+				if(appendRow(pWrkrData, (char*)psz+iTok, i - iTok) != RS_RET_OK) return 0;
+			}
+		}
+		while(i < len && isspace(psz[i]))
+			++i;
+		if(i == len)
+			return 0;
+		if(psz[i] == ')')
+			break;
+		if(psz[i] != ',')
+			return 0;
+		if(appendRow(pWrkrData, "\t", 1) != RS_RET_OK) return 0;
+		++i;
+	}
+	if(i + 1 != len)
+		return 0;
+	return appendRow(pWrkrData, "\n", 1) == RS_RET_OK;
+}
+
+
+static rsRetVal
+beginCopy(wrkrInstanceData_t *pWrkrData, const uchar *const target, const size_t lenTarget)
+{
+	char *stmt = NULL;
+	PGresult *pgRet;
+	ExecStatusType execState;
+	DEFiRet;
+
+	CHKmalloc(stmt = malloc(lenTarget + sizeof("COPY  FROM STDIN")));
+	snprintf(stmt, lenTarget + sizeof("COPY  FROM STDIN"), "COPY %.*s FROM STDIN",
+		(int) lenTarget, target);
+	dbgprintf("ompgsql: %s\n", stmt);
+	pgRet = PQexec(pWrkrData->f_hpgsql, stmt);
+	execState = PQresultStatus(pgRet);
+	PQclear(pgRet);
+	if(execState != PGRES_COPY_IN) {
+		dbgprintf("ompgsql: COPY failed: %s\n", PQresStatus(execState));
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	}
+
+finalize_it:
+	free(stmt);
+	RETiRet;
+}
+
+
+static rsRetVal
+endCopy(wrkrInstanceData_t *pWrkrData)
+{
+	PGresult *pgRet;
+	DEFiRet;
+
+	if(PQputCopyEnd(pWrkrData->f_hpgsql, NULL) != 1)
+		iRet = RS_RET_SUSPENDED;
+	/* all results must be consumed before the connection can be used again */
+	while((pgRet = PQgetResult(pWrkrData->f_hpgsql)) != NULL) {
+		if(PQresultStatus(pgRet) != PGRES_COMMAND_OK) {
+			dbgprintf("ompgsql: COPY failed: %s\n", PQresStatus(PQresultStatus(pgRet)));
+			iRet = RS_RET_SUSPENDED;
+		}
+		PQclear(pgRet);
+	}
+
+	RETiRet;
+}
+
+
+/* Write a whole batch inside a single transaction. Runs of single-row
+ * INSERTs into the same target are streamed to the server via
+ * COPY ... FROM STDIN, which avoids parsing and planning each row as a
+ * separate statement. Other statements are executed one by one.
+ */
+static rsRetVal
+writeBatch(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
+{
+	uchar *psz;
+	size_t len;
+	const uchar *currPrefix = NULL;
+	size_t lenCurrPrefix = 0;
+	size_t lenPrefix, offsTarget, lenTarget, offsRow, lenRow;
+	unsigned i;
+	DEFiRet;
+
+	if(tryExec((uchar*)"begin", pWrkrData))
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+	for(i = 0 ; i < nParams ; ++i) {
+		psz = actParam(pParams, 1, i, 0).param;
+		len = actParam(pParams, 1, i, 0).lenStr;
+		if(   splitInsert(psz, len, &lenPrefix, &offsTarget, &lenTarget, &offsRow, &lenRow)
+		   && rowToCopy(pWrkrData, psz + offsRow, lenRow)) {
+			if(   currPrefix == NULL
+			   || lenPrefix != lenCurrPrefix
+			   || memcmp(psz, currPrefix, lenPrefix)) {
+				if(currPrefix != NULL)
+					CHKiRet(endCopy(pWrkrData));
+				currPrefix = NULL;
+				CHKiRet(beginCopy(pWrkrData, psz + offsTarget, lenTarget));
+				currPrefix = psz;
+				lenCurrPrefix = lenPrefix;
+			}
+			if(PQputCopyData(pWrkrData->f_hpgsql, pWrkrData->row, pWrkrData->lenRow) != 1)
+				ABORT_FINALIZE(RS_RET_SUSPENDED);
+		} else {
+			if(currPrefix != NULL)
+				CHKiRet(endCopy(pWrkrData));
+			currPrefix = NULL;
+			dbgprintf("writePgSQL: %s\n", psz);
+			if(tryExec(psz, pWrkrData))
+				ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+	}
+	if(currPrefix != NULL)
+		CHKiRet(endCopy(pWrkrData));
+	if(tryExec((uchar*)"commit", pWrkrData))
+		ABORT_FINALIZE(RS_RET_SUSPENDED);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* Execute the statements of a batch one by one, outside of a transaction
+ * block (so each is committed on its own). This is used after the batch
+ * failed with a statement error, so that only the bad statements are
+ * discarded instead of the whole batch being retried over and over again.
+ */
+static rsRetVal
+writeSingle(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
+{
+	uchar *psz;
+	unsigned i;
+	unsigned nFailed = 0;
+	DEFiRet;
+
+	for(i = 0 ; i < nParams ; ++i) {
+		psz = actParam(pParams, 1, i, 0).param;
+		if(tryExec(psz, pWrkrData)) {
+			if(PQstatus(pWrkrData->f_hpgsql) != CONNECTION_OK)
+				ABORT_FINALIZE(RS_RET_SUSPENDED);
+			errmsg.LogError(0, RS_RET_DATAFAIL, "ompgsql: db error: %s - statement "
+				"discarded: %s", PQerrorMessage(pWrkrData->f_hpgsql), psz);
+			++nFailed;
+		}
+	}
+	dbgprintf("ompgsql: batch written one by one, %u of %u statements failed\n", nFailed, nParams);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* write a batch; if it fails while the connection is still fine, a
+ * statement (or COPY row) was bad: roll back and isolate the bad
+ * statement(s) by writing one by one
+ */
+static rsRetVal
+writeBatchOrSingle(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
+{
+	DEFiRet;
+
+	iRet = writeBatch(pWrkrData, pParams, nParams);
+	if(iRet != RS_RET_OK && PQstatus(pWrkrData->f_hpgsql) == CONNECTION_OK) {
+		if(tryExec((uchar*)"rollback", pWrkrData))
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		iRet = writeSingle(pWrkrData, pParams, nParams);
+	}
+
+finalize_it:
 	RETiRet;
 }
 
 
 BEGINtryResume
 CODESTARTtryResume
-	if(pWrkrData->pData->f_hpgsql == NULL) {
-		iRet = initPgSQL(pWrkrData->pData, 1);
+	if(pWrkrData->f_hpgsql == NULL) {
+		iRet = initPgSQL(pWrkrData, 1);
 		if(iRet == RS_RET_OK) {
 			/* the code above seems not to actually connect to the database. As such, we do a
 			 * dummy statement (a pointless select...) to verify the connection and return
@@ -279,42 +574,47 @@ CODESTARTtryResume
 			 * PostgreSQL expert, so any patch that does the desired result in a more
 			 * intelligent way is highly welcome. -- rgerhards, 2009-12-16
 			 */
-			iRet = writePgSQL((uchar*)"select 'a' as a", pWrkrData->pData);
+			iRet = writePgSQL((uchar*)"select 'a' as a", pWrkrData);
 		}
 
 	}
 ENDtryResume
 
 
-#if 0 /* re-enable when TX support is added again */
 BEGINbeginTransaction
 CODESTARTbeginTransaction
 	dbgprintf("ompgsql: beginTransaction\n");
-	if(pWrkrData->pData->f_hpgsql == NULL)
-	       initPgSQL(pWrkrData->pData, 0);
-	iRet = writePgSQL((uchar*) "begin", pWrkrData->pData); /* TODO: make user-configurable */
+	if(pWrkrData->f_hpgsql == NULL)
+		CHKiRet(initPgSQL(pWrkrData, 0));
+finalize_it:
 ENDbeginTransaction
-#endif
 
 
-BEGINdoAction
-CODESTARTdoAction
-	pthread_mutex_lock(&mutDoAct);
-	dbgprintf("\n");
-	CHKiRet(writePgSQL(ppString[0], pWrkrData->pData));
-	if(bCoreSupportsBatching)
-		iRet = RS_RET_DEFER_COMMIT;
-finalize_it:
-	pthread_mutex_unlock(&mutDoAct);
-ENDdoAction
-
+/* If the batch fails due to a bad statement, the statements are written
+ * one by one and the bad ones discarded. On connection loss, the
+ * connection is dropped and the whole batch retried once on a fresh
+ * connection before we suspend the action.
+ */
+BEGINcommitTransaction
+CODESTARTcommitTransaction
+	if(pWrkrData->f_hpgsql == NULL)
+		CHKiRet(initPgSQL(pWrkrData, 0));
+
+	if(writeBatchOrSingle(pWrkrData, pParams, nParams) != RS_RET_OK) {
+		closePgSQL(pWrkrData);
+		CHKiRet(initPgSQL(pWrkrData, 0));
+		if(writeBatchOrSingle(pWrkrData, pParams, nParams) != RS_RET_OK) {
+			reportDBError(pWrkrData, 0);
+			closePgSQL(pWrkrData);
+			ABORT_FINALIZE(RS_RET_SUSPENDED);
+		}
+	}
 
-#if 0 /* re-enable when TX support is added again */
-BEGINendTransaction
-CODESTARTendTransaction
-	iRet = writePgSQL((uchar*) "commit;", pWrkrData->pData); /* TODO: make user-configurable */
-ENDendTransaction
-#endif
+finalize_it:
+	if(iRet == RS_RET_OK) {
+		pWrkrData->eLastPgSQLStatus = CONNECTION_OK; /* reset error for error supression */
+	}
+ENDcommitTransaction
 
 
 BEGINparseSelectorAct
@@ -394,9 +694,8 @@ ENDmodExit
 
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
-/* CODEqueryEtryPt_TXIF_OMOD_QUERIES currently no TX support! */ /* we support the transactional interface! */
 ENDqueryEtryPt
 
 
@@ -406,14 +705,8 @@ INITLegCnfVars
 	*ipIFVersProvided = CURR_MOD_IF_VERSION; /* we only support the current interface specification */
 CODEmodInit_QueryRegCFSLineHdlr
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
-	INITChkCoreFeature(bCoreSupportsBatching, CORE_FEATURE_BATCHING);
-
-	/* TODO: transaction support missing for v8 */
-	bCoreSupportsBatching= 0;
-	DBGPRINTF("ompgsql: transactions are not yet supported on v8\n");
 
 	DBGPRINTF("ompgsql: module compiled with rsyslog version %s.\n", VERSION);
-	DBGPRINTF("ompgsql: %susing transactional output interface.\n", bCoreSupportsBatching ? "" : "not ");
 ENDmodInit
 /* vi:set ai:
  */
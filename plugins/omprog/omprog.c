@@ -36,6 +36,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/uio.h>
 #if defined(__FreeBSD__)
 #include <sys/wait.h>
 #else
@@ -53,6 +56,7 @@
 #include "module-template.h"
 #include "errmsg.h"
 #include "cfsysline.h"
+#include "hashtable.h"
 
 MODULE_TYPE_OUTPUT
 MODULE_TYPE_NOKEEP
@@ -66,6 +70,24 @@ DEFobjCurrIf(errmsg)
 #define NO_HUP_FORWARD -1	/* indicates that HUP should NOT be forwarded */
 /* linux specific: how long to wait for process to terminate gracefully before issuing SIGKILL */
 #define DEFAULT_FORCED_TERMINATION_TIMEOUT_MS 5000
+#define DEFAULT_CONFIRM_TIMEOUT_MS 10000
+#define MAX_OCTET_PREFIX 12	/* "4294967295 " plus '\0' */
+#define MAX_CONFIRM_LEN 64	/* max length of a confirmation line we accept */
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* With framing "octet-counted", each batch a child receives is preceded by
+ * a line holding the number of messages in it, and every message is sent
+ * as "<length> <data>" (like octet-counted syslog framing). If
+ * confirmBatches is on, the child must reply "OK\n" on its stdout once it
+ * has processed the batch; anything else fails (and later retries) it.
+ */
+typedef enum {
+	FRAMING_NONE = 0,
+	FRAMING_OCTET_COUNTED = 1
+} omprogFraming_t;
+
 typedef struct _instanceData {
 	uchar *szBinary;	/* name of binary to call */
 	char **aParams;		/* Optional Parameters for binary command */
@@ -75,16 +97,42 @@ typedef struct _instanceData {
 	int iHUPForward;	/* signal to forward on HUP (or NO_HUP_FORWARD) */
 	uchar *outputFileName;	/* name of file for std[out/err] or NULL if to discard */
 	int bSignalOnClose;  /* should signal process at shutdown */
+	int nProcesses;		/* number of child processes per worker */
+	uchar *keyTplName;	/* template for key-based dispatch, NULL for round-robin */
+	omprogFraming_t framing;
+	int bConfirmBatches;	/* wait for the program to acknowledge each batch? */
+	long confirmTimeout;	/* ms to wait for the acknowledgement */
 	pthread_mutex_t mut;	/* make sure only one instance is active */
 } instanceData;
 
-typedef struct wrkrInstanceData {
-	instanceData *pData;
+typedef struct childProcess_s {
 	pid_t pid;		/* pid of currently running process */
-	int fdOutput;		/* it's fd (-1 if closed) */
 	int fdPipeOut;		/* file descriptor to write to */
 	int fdPipeIn;		/* fd we receive messages from the program (if we want to) */
 	int bIsRunning;		/* is binary currently running? 0-no, 1-yes */
+	/* state of the batch currently being written */
+	struct iovec *iov;
+	char *prefixes;		/* octet-count prefixes, MAX_OCTET_PREFIX bytes per message */
+	unsigned maxMsgs;	/* capacity of iov and prefixes */
+	unsigned nMsgs;
+	int nIov;
+	int iIov;		/* first iov not completely written */
+	size_t offsIov;		/* bytes of iov[iIov] already written */
+	char batchHdr[MAX_OCTET_PREFIX];
+	char confirm[MAX_CONFIRM_LEN];
+	int lenConfirm;
+	int bConfirmed;
+} childProcess_t;
+
+typedef struct wrkrInstanceData {
+	instanceData *pData;
+	int fdOutput;		/* it's fd (-1 if closed) */
+	childProcess_t *children;
+	struct pollfd *pfds;	/* 2 per child */
+	int *pfdChild;		/* child index of each pfds entry */
+	unsigned *msgChild;	/* child selected for each message of a batch */
+	unsigned maxMsgChild;
+	unsigned nextChild;	/* next child for round-robin dispatch */
 } wrkrInstanceData_t;
 
 typedef struct configSettings_s {
@@ -101,7 +149,12 @@ static struct cnfparamdescr actpdescr[] = {
 	{ "forcesingleinstance", eCmdHdlrBinary, 0 },
 	{ "hup.signal", eCmdHdlrGetWord, 0 },
 	{ "template", eCmdHdlrGetWord, 0 },
-	{ "signalOnClose", eCmdHdlrBinary, 0 }
+	{ "signalOnClose", eCmdHdlrBinary, 0 },
+	{ "processes", eCmdHdlrPositiveInt, 0 },
+	{ "keytemplate", eCmdHdlrGetWord, 0 },
+	{ "framing", eCmdHdlrGetWord, 0 },
+	{ "confirmBatches", eCmdHdlrBinary, 0 },
+	{ "confirmTimeout", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk actpblk =
 	{ CNFPARAMBLK_VERSION,
@@ -122,11 +175,28 @@ CODESTARTcreateInstance
 ENDcreateInstance
 
 BEGINcreateWrkrInstance
+	int i;
 CODESTARTcreateWrkrInstance
-	pWrkrData->fdPipeIn = -1;
-	pWrkrData->fdPipeOut = -1;
 	pWrkrData->fdOutput = -1;
-	pWrkrData->bIsRunning = 0;
+	pWrkrData->nextChild = 0;
+	pWrkrData->msgChild = NULL;
+	pWrkrData->maxMsgChild = 0;
+	CHKmalloc(pWrkrData->children = calloc(pData->nProcesses, sizeof(childProcess_t)));
+	CHKmalloc(pWrkrData->pfds = calloc(2 * pData->nProcesses, sizeof(struct pollfd)));
+	CHKmalloc(pWrkrData->pfdChild = calloc(2 * pData->nProcesses, sizeof(int)));
+	for(i = 0 ; i < pData->nProcesses ; ++i) {
+		pWrkrData->children[i].fdPipeIn = -1;
+		pWrkrData->children[i].fdPipeOut = -1;
+		pWrkrData->children[i].bIsRunning = 0;
+	}
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		free(pWrkrData->children);
+		free(pWrkrData->pfds);
+		free(pWrkrData->pfdChild);
+		free(pWrkrData);
+		pWrkrData = NULL;
+	}
 ENDcreateWrkrInstance
 
 
@@ -144,6 +214,7 @@ CODESTARTfreeInstance
 	free(pData->szBinary);
 	free(pData->outputFileName);
 	free(pData->tplName);
+	free(pData->keyTplName);
 	if(pData->aParams != NULL) {
 		for (i = 0; i < pData->iParams; i++) {
 			free(pData->aParams[i]);
@@ -201,16 +272,18 @@ done:	return;
  * if so, properly handle it.
  */
 static void
-checkProgramOutput(wrkrInstanceData_t *__restrict__ const pWrkrData)
+checkProgramOutput(wrkrInstanceData_t *__restrict__ const pWrkrData,
+	childProcess_t *__restrict__ const child)
 {
 	char buf[4096];
 	ssize_t r;
 
-	if(pWrkrData->fdPipeIn == -1)
+	/* in confirm mode, the program's stdout carries acknowledgements */
+	if(child->fdPipeIn == -1 || pWrkrData->pData->bConfirmBatches)
 		goto done;
 
 	do {
-		r = read(pWrkrData->fdPipeIn, buf, sizeof(buf));
+		r = read(child->fdPipeIn, buf, sizeof(buf));
 		if(r > 0)
 			writeProgramOutput(pWrkrData, buf, r);
 	} while(r > 0);
@@ -224,7 +297,7 @@ done:	return;
  * after fork).
  */
 static __attribute__((noreturn)) void
-execBinary(wrkrInstanceData_t *pWrkrData, int fdStdin, int fdStdOutErr)
+execBinary(instanceData *pData, int fdStdin, int fdStdOutErr)
 {
 	int i, iRet;
 	struct sigaction sigAct;
@@ -239,7 +312,18 @@ execBinary(wrkrInstanceData_t *pWrkrData, int fdStdin, int fdStdOutErr)
 		 * gets some more widespread use...
 		 */
 	}
-	if(pWrkrData->pData->outputFileName == NULL) {
+	if(pData->bConfirmBatches) {
+		/* stdout goes back to us, stderr to the output file (if any) */
+		close(1);
+		if(dup(fdStdOutErr) == -1) {
+			DBGPRINTF("omprog: dup() stdout failed\n");
+		}
+		close(2);
+		if(open((pData->outputFileName == NULL) ? "/dev/null" : (char*)pData->outputFileName,
+			O_WRONLY | O_APPEND | O_CREAT, 0600) == -1) {
+			DBGPRINTF("omprog: opening stderr failed\n");
+		}
+	} else if(pData->outputFileName == NULL) {
 		close(fdStdOutErr);
 	} else {
 		close(1);
@@ -277,7 +361,7 @@ execBinary(wrkrInstanceData_t *pWrkrData, int fdStdin, int fdStdOutErr)
 	alarm(0);
 
 	/* finally exec child */
-	iRet = execve((char*)pWrkrData->pData->szBinary, pWrkrData->pData->aParams, newenviron);
+	iRet = execve((char*)pData->szBinary, pData->aParams, newenviron);
 	if(iRet == -1) {
 		/* Note: this will go to stdout of the **child**, so rsyslog will never
 		 * see it except when stdout is captured. If we use the plugin interface,
@@ -285,10 +369,10 @@ execBinary(wrkrInstanceData_t *pWrkrData, int fdStdin, int fdStdOutErr)
 		 */
 		rs_strerror_r(errno, errStr, sizeof(errStr));
 		DBGPRINTF("omprog: failed to execute binary '%s': %s\n",
-			  pWrkrData->pData->szBinary, errStr);
+			  pData->szBinary, errStr);
 		openlog("rsyslogd", 0, LOG_SYSLOG);
 		syslog(LOG_ERR, "omprog: failed to execute binary '%s': %s\n",
-			  pWrkrData->pData->szBinary, errStr);
+			  pData->szBinary, errStr);
 	}
 	
 	/* we should never reach this point, but if we do, we terminate */
@@ -300,7 +384,7 @@ execBinary(wrkrInstanceData_t *pWrkrData, int fdStdin, int fdStdOutErr)
  * rgerhards, 2009-04-01
  */
 static rsRetVal
-openPipe(wrkrInstanceData_t *pWrkrData)
+openPipe(wrkrInstanceData_t *pWrkrData, childProcess_t *child)
 {
 	int pipestdin[2];
 	int pipestdout[2];
@@ -324,32 +408,36 @@ openPipe(wrkrInstanceData_t *pWrkrData)
 	if(cpid == -1) {
 		ABORT_FINALIZE(RS_RET_ERR_FORK);
 	}
-	pWrkrData->pid = cpid;
+	child->pid = cpid;
 
 	if(cpid == 0) {    
 		/* we are now the child, just exec the binary. */
 		close(pipestdin[1]); /* close those pipe "ports" that */
 		close(pipestdout[0]); /* we don't need */
-		execBinary(pWrkrData, pipestdin[0], pipestdout[1]);
+		execBinary(pWrkrData->pData, pipestdin[0], pipestdout[1]);
 		/*NO CODE HERE - WILL NEVER BE REACHED!*/
 	}
 
 	DBGPRINTF("omprog: child has pid %d\n", (int) cpid);
-	if(pWrkrData->pData->outputFileName != NULL) {
-		pWrkrData->fdPipeIn = pipestdout[0];
+	if(pWrkrData->pData->outputFileName != NULL || pWrkrData->pData->bConfirmBatches) {
+		child->fdPipeIn = pipestdout[0];
 		/* we need to set our fd to be non-blocking! */
-		flags = fcntl(pWrkrData->fdPipeIn, F_GETFL);
+		flags = fcntl(child->fdPipeIn, F_GETFL);
 		flags |= O_NONBLOCK;
-		fcntl(pWrkrData->fdPipeIn, F_SETFL, flags);
+		fcntl(child->fdPipeIn, F_SETFL, flags);
 	} else {
-		pWrkrData->fdPipeIn = -1;
+		child->fdPipeIn = -1;
 		close(pipestdout[0]);
 	}
 	close(pipestdin[0]);
 	close(pipestdout[1]);
-	pWrkrData->pid = cpid;
-	pWrkrData->fdPipeOut = pipestdin[1];
-	pWrkrData->bIsRunning = 1;
+	child->pid = cpid;
+	child->fdPipeOut = pipestdin[1];
+	/* writes are non-blocking so that one slow child cannot stall the others */
+	flags = fcntl(child->fdPipeOut, F_GETFL);
+	flags |= O_NONBLOCK;
+	fcntl(child->fdPipeOut, F_SETFL, flags);
+	child->bIsRunning = 1;
 finalize_it:
 	RETiRet;
 }
@@ -433,7 +521,7 @@ doForceKillSubprocess(subprocess_timeout_desc_t *subpTimeOut, int do_kill, pid_t
 #endif
 
 static void
-waitForChild(wrkrInstanceData_t *pWrkrData, long timeout_ms)
+waitForChild(wrkrInstanceData_t *pWrkrData, childProcess_t *child, long timeout_ms)
 {
 	int status;
 	int ret;
@@ -446,23 +534,23 @@ waitForChild(wrkrInstanceData_t *pWrkrData, long timeout_ms)
 	if (timeout_ms > 0) timeoutSetupStatus = setupSubprocessTimeout(&subpTimeOut, timeout_ms);
 #endif
 
-	ret = waitpid(pWrkrData->pid, &status, 0);
+	ret = waitpid(child->pid, &status, 0);
 
 #if defined(__linux__) && defined(_GNU_SOURCE)
-	waitpid_interrupted = (ret != pWrkrData->pid) && (errno == EINTR);
-	if ((timeout_ms > 0) && (timeoutSetupStatus == RS_RET_OK)) doForceKillSubprocess(&subpTimeOut, waitpid_interrupted, pWrkrData->pid);
+	waitpid_interrupted = (ret != child->pid) && (errno == EINTR);
+	if ((timeout_ms > 0) && (timeoutSetupStatus == RS_RET_OK)) doForceKillSubprocess(&subpTimeOut, waitpid_interrupted, child->pid);
 	if (waitpid_interrupted) {
-		waitForChild(pWrkrData, -1);
+		waitForChild(pWrkrData, child, -1);
 		return;
 	}
 #endif
 
-	if(ret != pWrkrData->pid) {
+	if(ret != child->pid) {
 		if (errno == ECHILD) {
 			errmsg.LogError(errno, RS_RET_OK_WARN, "Child %d doesn't seem to exist, "
-							"hence couldn't be reaped (reaped by main-loop?)", pWrkrData->pid);
+							"hence couldn't be reaped (reaped by main-loop?)", child->pid);
 		} else {
-			errmsg.LogError(errno, RS_RET_SYS_ERR, "Cleanup failed for child %d", pWrkrData->pid);
+			errmsg.LogError(errno, RS_RET_SYS_ERR, "Cleanup failed for child %d", child->pid);
 		}
 	} else {
 		/* check if we should print out some diagnostic information */
@@ -481,121 +569,438 @@ waitForChild(wrkrInstanceData_t *pWrkrData, long timeout_ms)
 /* clean up after a terminated child
  */
 static rsRetVal
-cleanup(wrkrInstanceData_t *pWrkrData, long timeout_ms)
+cleanup(wrkrInstanceData_t *pWrkrData, childProcess_t *child, long timeout_ms)
 {
 	DEFiRet;
 
-	assert(pWrkrData->bIsRunning == 1);
+	assert(child->bIsRunning == 1);
 
 	if (pWrkrData->pData->bSignalOnClose) {
-		waitForChild(pWrkrData, timeout_ms);
+		waitForChild(pWrkrData, child, timeout_ms);
 	}
 
-	checkProgramOutput(pWrkrData); /* try to catch any late messages */
+	checkProgramOutput(pWrkrData, child); /* try to catch any late messages */
 
 	if(pWrkrData->fdOutput != -1) {
 		close(pWrkrData->fdOutput);
 		pWrkrData->fdOutput = -1;
 	}
-	if(pWrkrData->fdPipeIn != -1) {
-		close(pWrkrData->fdPipeIn);
-		pWrkrData->fdPipeIn = -1;
+	if(child->fdPipeIn != -1) {
+		close(child->fdPipeIn);
+		child->fdPipeIn = -1;
 	}
-	if(pWrkrData->fdPipeOut != -1) {
-		close(pWrkrData->fdPipeOut);
-		pWrkrData->fdPipeOut = -1;
+	if(child->fdPipeOut != -1) {
+		close(child->fdPipeOut);
+		child->fdPipeOut = -1;
 	}
-	pWrkrData->bIsRunning = 0;
-	pWrkrData->bIsRunning = 0;
+	child->bIsRunning = 0;
 	RETiRet;
 }
 
 BEGINfreeWrkrInstance
+	int i;
+	childProcess_t *child;
 CODESTARTfreeWrkrInstance
-	if (pWrkrData->bIsRunning) {
-		if (pWrkrData->pData->bSignalOnClose) {
-			kill(pWrkrData->pid, SIGTERM);
+	for(i = 0 ; i < pWrkrData->pData->nProcesses ; ++i) {
+		child = &pWrkrData->children[i];
+		if (child->bIsRunning) {
+			if (pWrkrData->pData->bSignalOnClose) {
+				kill(child->pid, SIGTERM);
+			}
+			cleanup(pWrkrData, child, DEFAULT_FORCED_TERMINATION_TIMEOUT_MS);
 		}
-		CHKiRet(cleanup(pWrkrData, DEFAULT_FORCED_TERMINATION_TIMEOUT_MS));
+		free(child->iov);
+		free(child->prefixes);
 	}
-finalize_it:
+	free(pWrkrData->children);
+	free(pWrkrData->pfds);
+	free(pWrkrData->pfdChild);
+	free(pWrkrData->msgChild);
 ENDfreeWrkrInstance
 
 /* try to restart the binary when it has stopped.
  */
 static rsRetVal
-tryRestart(wrkrInstanceData_t *pWrkrData)
+tryRestart(wrkrInstanceData_t *pWrkrData, childProcess_t *child)
+{
+	DEFiRet;
+	assert(child->bIsRunning == 0);
+
+	iRet = openPipe(pWrkrData, child);
+	RETiRet;
+}
+
+
+static void
+addIov(childProcess_t *child, void *buf, size_t len)
+{
+	if(len > 0) { /* empty entries would stall progress tracking */
+		child->iov[child->nIov].iov_base = buf;
+		child->iov[child->nIov].iov_len = len;
+		++child->nIov;
+	}
+}
+
+
+/* Distribute the messages of a transaction to the children and build the
+ * iovec each child receives. Messages are dispatched round-robin or, if a
+ * key template is configured, by hash of the key, so that all messages
+ * with the same key go to the same process. The message buffers are
+ * referenced, not copied.
+ */
+static rsRetVal
+prepareBatch(wrkrInstanceData_t *pWrkrData, actWrkrIParams_t *const pParams, const unsigned nParams)
 {
+	instanceData *const pData = pWrkrData->pData;
+	const int nTpls = (pData->keyTplName == NULL) ? 1 : 2;
+	childProcess_t *child;
+	actWrkrIParams_t *param;
+	unsigned *newMsgChild;
+	struct iovec *newIov;
+	char *newPrefixes;
+	char *prefix;
+	uchar *key;
+	unsigned i;
+	int c;
 	DEFiRet;
-	assert(pWrkrData->bIsRunning == 0);
 
-	iRet = openPipe(pWrkrData);
+	if(nParams > pWrkrData->maxMsgChild) {
+		CHKmalloc(newMsgChild = realloc(pWrkrData->msgChild, nParams * sizeof(unsigned)));
+		pWrkrData->msgChild = newMsgChild;
+		pWrkrData->maxMsgChild = nParams;
+	}
+
+	for(c = 0 ; c < pData->nProcesses ; ++c)
+		pWrkrData->children[c].nMsgs = 0;
+	for(i = 0 ; i < nParams ; ++i) {
+		if(pData->keyTplName == NULL) {
+			c = pWrkrData->nextChild++ % pData->nProcesses;
+		} else {
+			key = actParam(pParams, nTpls, i, 1).param;
+			c = hash_from_string(key) % pData->nProcesses;
+		}
+		pWrkrData->msgChild[i] = c;
+		++pWrkrData->children[c].nMsgs;
+	}
+
+	for(c = 0 ; c < pData->nProcesses ; ++c) {
+		child = &pWrkrData->children[c];
+		if(child->nMsgs > child->maxMsgs) {
+			CHKmalloc(newIov = realloc(child->iov, (1 + 2 * child->nMsgs) * sizeof(struct iovec)));
+			child->iov = newIov;
+			CHKmalloc(newPrefixes = realloc(child->prefixes, child->nMsgs * MAX_OCTET_PREFIX));
+			child->prefixes = newPrefixes;
+			child->maxMsgs = child->nMsgs;
+		}
+		child->nIov = 0;
+		child->iIov = 0;
+		child->offsIov = 0;
+		child->lenConfirm = 0;
+		child->bConfirmed = (child->nMsgs == 0);
+		if(pData->framing == FRAMING_OCTET_COUNTED && child->nMsgs > 0) {
+			addIov(child, child->batchHdr,
+				snprintf(child->batchHdr, sizeof(child->batchHdr), "%u\n", child->nMsgs));
+		}
+		child->nMsgs = 0; /* now counts messages added */
+	}
+
+	for(i = 0 ; i < nParams ; ++i) {
+		child = &pWrkrData->children[pWrkrData->msgChild[i]];
+		param = &actParam(pParams, nTpls, i, 0);
+		if(pData->framing == FRAMING_OCTET_COUNTED) {
+			prefix = child->prefixes + child->nMsgs * MAX_OCTET_PREFIX;
+			addIov(child, prefix, snprintf(prefix, MAX_OCTET_PREFIX, "%u ", (unsigned) param->lenStr));
+		}
+		addIov(child, param->param, param->lenStr);
+		++child->nMsgs;
+	}
+
+finalize_it:
 	RETiRet;
 }
 
-/* write to pipe
- * note that we do not try to run block-free. If the users fears something
- * may block (and this not be acceptable), the action should be run on its
- * own action queue.
+
+/* write as much of the child's pending data as the pipe accepts without
+ * blocking. The pipe is O_NONBLOCK: on a short write or EAGAIN we just
+ * record how far we got, writeChildren() poll()s until the child has read
+ * more and calls us again.
  */
 static rsRetVal
-writePipe(wrkrInstanceData_t *pWrkrData, uchar *szMsg)
+writeChild(wrkrInstanceData_t *pWrkrData, childProcess_t *child)
 {
-	int lenWritten;
-	int lenWrite;
-	int writeOffset;
+	struct iovec *const iov = child->iov + child->iIov;
+	const int nIov = (child->nIov - child->iIov > IOV_MAX) ? IOV_MAX : child->nIov - child->iIov;
+	void *const base = iov[0].iov_base;
+	const size_t len = iov[0].iov_len;
+	ssize_t lenWritten;
+	size_t lenRemain;
 	char errStr[1024];
 	DEFiRet;
-	
-	lenWrite = strlen((char*)szMsg);
-	writeOffset = 0;
 
-	do {
-		checkProgramOutput(pWrkrData);
-		lenWritten = write(pWrkrData->fdPipeOut, ((char*)szMsg)+writeOffset, lenWrite);
-		if(lenWritten == -1) {
-			switch(errno) {
-			case EPIPE:
-				DBGPRINTF("omprog: program '%s' terminated, trying to restart\n",
-					  pWrkrData->pData->szBinary);
-				CHKiRet(cleanup(pWrkrData, 0));
-				CHKiRet(tryRestart(pWrkrData));
-				break;
-			default:
-				DBGPRINTF("omprog: error %d writing to pipe: %s\n", errno,
-					   rs_strerror_r(errno, errStr, sizeof(errStr)));
-				ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
-				break;
-			}
+	iov[0].iov_base = (char*) base + child->offsIov;
+	iov[0].iov_len = len - child->offsIov;
+	lenWritten = writev(child->fdPipeOut, iov, nIov);
+	iov[0].iov_base = base;
+	iov[0].iov_len = len;
+
+	if(lenWritten == -1) {
+		switch(errno) {
+		case EAGAIN:
+		case EINTR:
+			break;
+		case EPIPE:
+			DBGPRINTF("omprog: program '%s' terminated, trying to restart\n",
+				  pWrkrData->pData->szBinary);
+			CHKiRet(cleanup(pWrkrData, child, 0));
+			CHKiRet(tryRestart(pWrkrData, child));
+			/* a framed batch must be resent as a whole, otherwise we
+			 * restart with the message that was interrupted */
+			if(pWrkrData->pData->framing == FRAMING_OCTET_COUNTED)
+				child->iIov = 0;
+			child->offsIov = 0;
+			break;
+		default:
+			DBGPRINTF("omprog: error %d writing to pipe: %s\n", errno,
+				   rs_strerror_r(errno, errStr, sizeof(errStr)));
+			ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
+			break;
+		}
+		FINALIZE;
+	}
+
+	while(lenWritten > 0) {
+		lenRemain = child->iov[child->iIov].iov_len - child->offsIov;
+		if((size_t) lenWritten >= lenRemain) {
+			lenWritten -= lenRemain;
+			++child->iIov;
+			child->offsIov = 0;
 		} else {
-			writeOffset += lenWritten;
+			child->offsIov += lenWritten;
+			lenWritten = 0;
 		}
-	} while(lenWritten != lenWrite);
+	}
+
+finalize_it:
+	RETiRet;
+}
 
-	checkProgramOutput(pWrkrData);
+
+/* Write the prepared batch to all children. We poll for whichever pipe can
+ * take more data, so the children work on their share in parallel. Program
+ * output is drained while waiting, as a child blocked on its stdout would
+ * otherwise never read its stdin again.
+ */
+static rsRetVal
+writeChildren(wrkrInstanceData_t *pWrkrData)
+{
+	instanceData *const pData = pWrkrData->pData;
+	struct pollfd *const pfds = pWrkrData->pfds;
+	childProcess_t *child;
+	int nfds;
+	int c, i;
+	char errStr[1024];
+	DEFiRet;
+
+	while(1) {
+		nfds = 0;
+		for(c = 0 ; c < pData->nProcesses ; ++c) {
+			child = &pWrkrData->children[c];
+			if(child->iIov == child->nIov)
+				continue;
+			pfds[nfds].fd = child->fdPipeOut;
+			pfds[nfds].events = POLLOUT;
+			pWrkrData->pfdChild[nfds++] = c;
+			if(child->fdPipeIn != -1 && !pData->bConfirmBatches) {
+				pfds[nfds].fd = child->fdPipeIn;
+				pfds[nfds].events = POLLIN;
+				pWrkrData->pfdChild[nfds++] = c;
+			}
+		}
+		if(nfds == 0)
+			break; /* all written */
+
+		if(poll(pfds, nfds, -1) == -1) {
+			if(errno == EINTR)
+				continue;
+			DBGPRINTF("omprog: poll() failed: %s\n", rs_strerror_r(errno, errStr, sizeof(errStr)));
+			ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
+		}
+
+		for(i = 0 ; i < nfds ; ++i) {
+			if(pfds[i].revents == 0)
+				continue;
+			child = &pWrkrData->children[pWrkrData->pfdChild[i]];
+			if(pfds[i].events == POLLIN) {
+				checkProgramOutput(pWrkrData, child);
+			} else if(child->bIsRunning && child->fdPipeOut == pfds[i].fd) {
+				CHKiRet(writeChild(pWrkrData, child));
+			}
+		}
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* read a chunk of the child's confirmation line; sets bConfirmed once the
+ * complete line has been received and was "OK".
+ */
+static rsRetVal
+readConfirmation(wrkrInstanceData_t *pWrkrData, childProcess_t *child)
+{
+	ssize_t r;
+	char *lf;
+	DEFiRet;
+
+	r = read(child->fdPipeIn, child->confirm + child->lenConfirm,
+		 sizeof(child->confirm) - 1 - child->lenConfirm);
+	if(r == -1 && (errno == EAGAIN || errno == EINTR))
+		FINALIZE;
+	if(r <= 0) {
+		errmsg.LogError(0, RS_RET_ERR_WRITE_PIPE, "omprog: program '%s' (pid %d) "
+			"terminated before confirming batch", pWrkrData->pData->szBinary, (int) child->pid);
+		cleanup(pWrkrData, child, 0);
+		ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
+	}
+	child->lenConfirm += r;
+	child->confirm[child->lenConfirm] = '\0';
+	if((lf = strchr(child->confirm, '\n')) == NULL) {
+		if(child->lenConfirm == sizeof(child->confirm) - 1) {
+			errmsg.LogError(0, RS_RET_ERR_WRITE_PIPE, "omprog: program '%s' (pid %d) "
+				"sent overlong confirmation", pWrkrData->pData->szBinary, (int) child->pid);
+			ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
+		}
+		FINALIZE; /* need more data */
+	}
+	*lf = '\0';
+	if(lf + 1 != child->confirm + child->lenConfirm || strcmp(child->confirm, "OK")) {
+		errmsg.LogError(0, RS_RET_ERR_WRITE_PIPE, "omprog: program '%s' (pid %d) "
+			"did not confirm batch: '%s'", pWrkrData->pData->szBinary,
+			(int) child->pid, child->confirm);
+		ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
+	}
+	child->bConfirmed = 1;
 
 finalize_it:
 	RETiRet;
 }
 
 
-BEGINdoAction
+/* wait until every child that received a part of the batch confirmed it
+ * or confirmTimeout expires.
+ */
+static rsRetVal
+waitConfirmations(wrkrInstanceData_t *pWrkrData)
+{
+	instanceData *const pData = pWrkrData->pData;
+	struct pollfd *const pfds = pWrkrData->pfds;
+	struct timespec timeout;
+	childProcess_t *child;
+	long msRemain;
+	int nfds;
+	int c, i, r;
+	DEFiRet;
+
+	CHKiRet(timeoutComp(&timeout, pData->confirmTimeout));
+	while(1) {
+		nfds = 0;
+		for(c = 0 ; c < pData->nProcesses ; ++c) {
+			child = &pWrkrData->children[c];
+			if(child->bConfirmed)
+				continue;
+			pfds[nfds].fd = child->fdPipeIn;
+			pfds[nfds].events = POLLIN;
+			pWrkrData->pfdChild[nfds++] = c;
+		}
+		if(nfds == 0)
+			break; /* all confirmed */
+
+		msRemain = timeoutVal(&timeout);
+		r = (msRemain > 0) ? poll(pfds, nfds, msRemain) : 0;
+		if(r == -1 && errno == EINTR)
+			continue;
+		if(r <= 0) {
+			for(i = 0 ; i < nfds ; ++i) {
+				child = &pWrkrData->children[pWrkrData->pfdChild[i]];
+				errmsg.LogError(0, RS_RET_ERR_WRITE_PIPE, "omprog: program '%s' (pid %d) "
+					"did not confirm batch within %ld ms",
+					pData->szBinary, (int) child->pid, pData->confirmTimeout);
+			}
+			ABORT_FINALIZE(RS_RET_ERR_WRITE_PIPE);
+		}
+
+		for(i = 0 ; i < nfds ; ++i) {
+			if(pfds[i].revents != 0)
+				CHKiRet(readConfirmation(pWrkrData,
+					&pWrkrData->children[pWrkrData->pfdChild[i]]));
+		}
+	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* After a failed transaction, a child may hold a partial batch or still
+ * owe us a confirmation, so it is out of sync with the framing protocol.
+ * Such children are terminated; they are restarted by the retry.
+ */
+static void
+terminateUnconfirmed(wrkrInstanceData_t *pWrkrData)
+{
+	childProcess_t *child;
+	int c;
+
+	for(c = 0 ; c < pWrkrData->pData->nProcesses ; ++c) {
+		child = &pWrkrData->children[c];
+		if(child->bIsRunning && !child->bConfirmed) {
+			DBGPRINTF("omprog: terminating out-of-sync child %d\n", (int) child->pid);
+			kill(child->pid, SIGTERM);
+			cleanup(pWrkrData, child, DEFAULT_FORCED_TERMINATION_TIMEOUT_MS);
+		}
+	}
+}
+
+
+BEGINbeginTransaction
+CODESTARTbeginTransaction
+ENDbeginTransaction
+
+
+BEGINcommitTransaction
 	instanceData *pData;
-CODESTARTdoAction
+	childProcess_t *child;
+	int c;
+CODESTARTcommitTransaction
 	pData = pWrkrData->pData;
 	if(pData->bForceSingleInst)
 		pthread_mutex_lock(&pData->mut);
-	if(pWrkrData->bIsRunning == 0) {
-		openPipe(pWrkrData);
+	for(c = 0 ; c < pData->nProcesses ; ++c) {
+		child = &pWrkrData->children[c];
+		if(child->bIsRunning == 0) {
+			CHKiRet(openPipe(pWrkrData, child));
+		}
+	}
+
+	CHKiRet(prepareBatch(pWrkrData, pParams, nParams));
+	CHKiRet(writeChildren(pWrkrData));
+	if(pData->bConfirmBatches) {
+		CHKiRet(waitConfirmations(pWrkrData));
+	} else {
+		for(c = 0 ; c < pData->nProcesses ; ++c)
+			checkProgramOutput(pWrkrData, &pWrkrData->children[c]);
 	}
-	
-	iRet = writePipe(pWrkrData, ppString[0]);
 
-	if(iRet != RS_RET_OK)
+finalize_it:
+	if(iRet != RS_RET_OK) {
+		if(pData->framing == FRAMING_OCTET_COUNTED)
+			terminateUnconfirmed(pWrkrData);
 		iRet = RS_RET_SUSPENDED;
+	}
 	if(pData->bForceSingleInst)
 		pthread_mutex_unlock(&pData->mut);
-ENDdoAction
+ENDcommitTransaction
 
 
 static void
@@ -608,6 +1013,11 @@ setInstParamDefaults(instanceData *pData)
 	pData->bForceSingleInst = 0;
 	pData->bSignalOnClose = 0;
 	pData->iHUPForward = NO_HUP_FORWARD;
+	pData->nProcesses = 1;
+	pData->keyTplName = NULL;
+	pData->framing = FRAMING_NONE;
+	pData->bConfirmBatches = 0;
+	pData->confirmTimeout = DEFAULT_CONFIRM_TIMEOUT_MS;
 }
 
 BEGINnewActInst
@@ -629,7 +1039,6 @@ CODESTARTnewActInst
 	CHKiRet(createInstance(&pData));
 	setInstParamDefaults(pData);
 
-	CODE_STD_STRING_REQUESTnewActInst(1)
 	for(i = 0 ; i < actpblk.nParams ; ++i) {
 		if(!pvals[i].bUsed)
 			continue;
@@ -739,15 +1148,47 @@ CODESTARTnewActInst
 			free((void*)sig);
 		} else if(!strcmp(actpblk.descr[i].name, "template")) {
 			pData->tplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "processes")) {
+			pData->nProcesses = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "keytemplate")) {
+			pData->keyTplName = (uchar*)es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(actpblk.descr[i].name, "framing")) {
+			if(!es_strbufcmp(pvals[i].val.d.estr, (uchar*)"none", sizeof("none")-1)) {
+				pData->framing = FRAMING_NONE;
+			} else if(!es_strbufcmp(pvals[i].val.d.estr, (uchar*)"octet-counted", sizeof("octet-counted")-1)) {
+				pData->framing = FRAMING_OCTET_COUNTED;
+			} else {
+				char *cstr = es_str2cstr(pvals[i].val.d.estr, NULL);
+				errmsg.LogError(0, RS_RET_CONF_PARAM_INVLD,
+					"omprog: invalid framing '%s', must be 'none' or 'octet-counted'", cstr);
+				free(cstr);
+				ABORT_FINALIZE(RS_RET_CONF_PARAM_INVLD);
+			}
+		} else if(!strcmp(actpblk.descr[i].name, "confirmBatches")) {
+			pData->bConfirmBatches = (int) pvals[i].val.d.n;
+		} else if(!strcmp(actpblk.descr[i].name, "confirmTimeout")) {
+			pData->confirmTimeout = (long) pvals[i].val.d.n;
 		} else {
 			DBGPRINTF("omprog: program error, non-handled param '%s'\n", actpblk.descr[i].name);
 		}
 	}
 
+	if(pData->bConfirmBatches && pData->framing != FRAMING_OCTET_COUNTED) {
+		errmsg.LogError(0, RS_RET_CONF_PARAM_INVLD,
+			"omprog: confirmBatches requires framing=\"octet-counted\"");
+		ABORT_FINALIZE(RS_RET_CONF_PARAM_INVLD);
+	}
+
+	CODE_STD_STRING_REQUESTnewActInst((pData->keyTplName == NULL) ? 1 : 2)
 	CHKiRet(OMSRsetEntry(*ppOMSR, 0, (uchar*)strdup((pData->tplName == NULL) ? 
 						"RSYSLOG_FileFormat" : (char*)pData->tplName),
 						OMSR_NO_RQD_TPL_OPTS));
-	DBGPRINTF("omprog: bForceSingleInst %d\n", pData->bForceSingleInst);
+	if(pData->keyTplName != NULL) {
+		CHKiRet(OMSRsetEntry(*ppOMSR, 1, (uchar*)strdup((char*)pData->keyTplName),
+							OMSR_NO_RQD_TPL_OPTS));
+	}
+	DBGPRINTF("omprog: bForceSingleInst %d, processes %d\n", pData->bForceSingleInst,
+		  pData->nProcesses);
 CODE_STD_FINALIZERnewActInst
 	cnfparamvalsDestruct(pvals, &actpblk);
 ENDnewActInst
@@ -769,6 +1210,7 @@ CODE_STD_STRING_REQUESTparseSelectorAct(1)
 	}
 
 	CHKiRet(createInstance(&pData));
+	setInstParamDefaults(pData);
 
 	if(cs.szBinary == NULL) {
 		errmsg.LogError(0, RS_RET_CONF_RQRD_PARAM_MISSING,
@@ -786,11 +1228,16 @@ ENDparseSelectorAct
 
 
 BEGINdoHUPWrkr
+	int i;
 CODESTARTdoHUPWrkr
-	DBGPRINTF("omprog: processing HUP for work instance %p, pid %d, forward: %d\n",
-		pWrkrData, (int) pWrkrData->pid, pWrkrData->pData->iHUPForward);
-	if(pWrkrData->pData->iHUPForward != NO_HUP_FORWARD)
-		kill(pWrkrData->pid, pWrkrData->pData->iHUPForward);
+	DBGPRINTF("omprog: processing HUP for work instance %p, forward: %d\n",
+		pWrkrData, pWrkrData->pData->iHUPForward);
+	if(pWrkrData->pData->iHUPForward != NO_HUP_FORWARD) {
+		for(i = 0 ; i < pWrkrData->pData->nProcesses ; ++i) {
+			if(pWrkrData->children[i].bIsRunning)
+				kill(pWrkrData->children[i].pid, pWrkrData->pData->iHUPForward);
+		}
+	}
 ENDdoHUPWrkr
 
 
@@ -805,7 +1252,7 @@ ENDmodExit
 
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
-CODEqueryEtryPt_STD_OMOD_QUERIES
+CODEqueryEtryPt_STD_OMODTX_QUERIES
 CODEqueryEtryPt_STD_OMOD8_QUERIES
 CODEqueryEtryPt_STD_CONF2_CNFNAME_QUERIES 
 CODEqueryEtryPt_STD_CONF2_OMOD_QUERIES
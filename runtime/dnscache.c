@@ -7,6 +7,14 @@
  * In any case, even the initial implementaton is far faster than what we had
  * before. -- rgerhards, 2011-06-06
  *
+ * The cache is split into shards, each with its own lock, hash table and
+ * LRU list, so lookups for different addresses rarely contend. If
+ * dnscache.ttl is set, entries expire after a positive or negative TTL;
+ * otherwise they are kept until evicted. Optionally (dnscache.async),
+ * misses and expired entries are resolved by a small pool of resolver
+ * threads, and the lookup returns the IP address (or the stale entry)
+ * right away instead of waiting for DNS.
+ *
  * Copyright 2011-2016 by Rainer Gerhards and Adiscon GmbH.
  *
  * This file is part of the rsyslog runtime library.
@@ -34,6 +42,8 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "syslogd-types.h"
 #include "glbl.h"
@@ -43,8 +53,13 @@
 #include "net.h"
 #include "hashtable.h"
 #include "prop.h"
+#include "statsobj.h"
+#include "atomic.h"
 #include "dnscache.h"
 
+/* number of cache shards, must be a power of 2 */
+#define DNSCACHE_NSHARDS 16
+
 /* module data structures */
 struct dnscache_entry_s {
 	struct sockaddr_storage addr;
@@ -52,15 +67,45 @@ struct dnscache_entry_s {
 	prop_t *fqdnLowerCase;
 	prop_t *localName; /* only local name, without domain part (if configured so) */
 	prop_t *ip;
-	struct dnscache_entry_s *next;
+	struct dnscache_entry_s *lruPrev;
+	struct dnscache_entry_s *lruNext;
 	unsigned nUsed;
+	time_t validUntil;	/* entry needs to be re-resolved after this time, 0 - never */
+	rsRetVal rslvRet;	/* result of resolution, reported on lookup */
+	sbool bPending;		/* a resolver thread is working on this entry */
 };
 typedef struct dnscache_entry_s dnscache_entry_t;
-struct dnscache_s {
-	pthread_rwlock_t rwlock;
+struct dnscache_shard_s {
+	pthread_mutex_t mut;
 	struct hashtable *ht;
+	dnscache_entry_t *lruHead; /* most recently used */
+	dnscache_entry_t *lruTail;
 	unsigned nEntries;
 };
+typedef struct dnscache_shard_s dnscache_shard_t;
+/* address waiting for a resolver thread */
+struct dnscache_req_s {
+	struct sockaddr_storage addr;
+	struct dnscache_req_s *next;
+};
+typedef struct dnscache_req_s dnscache_req_t;
+struct dnscache_s {
+	dnscache_shard_t shards[DNSCACHE_NSHARDS];
+	pthread_mutex_t mutRslv;	/* guards the request list and resolver threads */
+	pthread_cond_t condRslv;
+	dnscache_req_t *reqRoot;
+	dnscache_req_t *reqLast;
+	pthread_t *rslvThrds;
+	int nRslvThrds;
+	sbool bStop;
+	int nPending;			/* requests not yet resolved */
+	statsobj_t *stats;
+	STATSCOUNTER_DEF(ctrHits, mutCtrHits)
+	STATSCOUNTER_DEF(ctrMisses, mutCtrMisses)
+	STATSCOUNTER_DEF(ctrExpired, mutCtrExpired)
+	STATSCOUNTER_DEF(ctrEvicted, mutCtrEvicted)
+	STATSCOUNTER_DEF(ctrResolved, mutCtrResolved)
+};
 typedef struct dnscache_s dnscache_t;
 
 
@@ -69,6 +114,7 @@ DEFobjStaticHelpers
 DEFobjCurrIf(glbl)
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(prop)
+DEFobjCurrIf(statsobj)
 static dnscache_t dnsCache;
 static prop_t *staticErrValue;
 
@@ -114,26 +160,70 @@ entryDestruct(dnscache_entry_t *etry)
 	free(etry);
 }
 
+/* the shard an address belongs to. We use the upper hash bits, as the
+ * shard hash tables use the lower ones.
+ */
+static inline dnscache_shard_t *
+getShard(struct sockaddr_storage *addr)
+{
+	const unsigned h = hash_from_key_fn(addr) * 2654435761u;
+	return &dnsCache.shards[(h >> 24) & (DNSCACHE_NSHARDS - 1)];
+}
+
 /* init function (must be called once) */
 rsRetVal
 dnscacheInit(void)
 {
+	int i;
 	DEFiRet;
-	if((dnsCache.ht = create_hashtable(100, hash_from_key_fn, key_equals_fn,
-				(void(*)(void*))entryDestruct)) == NULL) {
-		DBGPRINTF("dnscache: error creating hash table!\n");
-		ABORT_FINALIZE(RS_RET_ERR); // TODO: make this degrade, but run!
+	for(i = 0 ; i < DNSCACHE_NSHARDS ; ++i) {
+		if((dnsCache.shards[i].ht = create_hashtable(100, hash_from_key_fn, key_equals_fn,
+					(void(*)(void*))entryDestruct)) == NULL) {
+			DBGPRINTF("dnscache: error creating hash table!\n");
+			ABORT_FINALIZE(RS_RET_ERR); // TODO: make this degrade, but run!
+		}
+		dnsCache.shards[i].lruHead = dnsCache.shards[i].lruTail = NULL;
+		dnsCache.shards[i].nEntries = 0;
+		pthread_mutex_init(&dnsCache.shards[i].mut, NULL);
 	}
-	dnsCache.nEntries = 0;
-	pthread_rwlock_init(&dnsCache.rwlock, NULL);
+	pthread_mutex_init(&dnsCache.mutRslv, NULL);
+	pthread_cond_init(&dnsCache.condRslv, NULL);
+	dnsCache.reqRoot = dnsCache.reqLast = NULL;
+	dnsCache.rslvThrds = NULL;
+	dnsCache.nRslvThrds = 0;
+	dnsCache.bStop = 0;
+	dnsCache.nPending = 0;
 	CHKiRet(objGetObjInterface(&obj)); /* this provides the root pointer for all other queries */
 	CHKiRet(objUse(glbl, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(prop, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
 	prop.Construct(&staticErrValue);
 	prop.SetString(staticErrValue, (uchar*)"???", 3);
 	prop.ConstructFinalize(staticErrValue);
+
+	CHKiRet(statsobj.Construct(&dnsCache.stats));
+	CHKiRet(statsobj.SetName(dnsCache.stats, (uchar*)"dnscache"));
+	CHKiRet(statsobj.SetOrigin(dnsCache.stats, (uchar*)"core.dnscache"));
+	STATSCOUNTER_INIT(dnsCache.ctrHits, dnsCache.mutCtrHits);
+	CHKiRet(statsobj.AddCounter(dnsCache.stats, UCHAR_CONSTANT("hits"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &dnsCache.ctrHits));
+	STATSCOUNTER_INIT(dnsCache.ctrMisses, dnsCache.mutCtrMisses);
+	CHKiRet(statsobj.AddCounter(dnsCache.stats, UCHAR_CONSTANT("misses"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &dnsCache.ctrMisses));
+	STATSCOUNTER_INIT(dnsCache.ctrExpired, dnsCache.mutCtrExpired);
+	CHKiRet(statsobj.AddCounter(dnsCache.stats, UCHAR_CONSTANT("expired"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &dnsCache.ctrExpired));
+	STATSCOUNTER_INIT(dnsCache.ctrEvicted, dnsCache.mutCtrEvicted);
+	CHKiRet(statsobj.AddCounter(dnsCache.stats, UCHAR_CONSTANT("evicted"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &dnsCache.ctrEvicted));
+	STATSCOUNTER_INIT(dnsCache.ctrResolved, dnsCache.mutCtrResolved);
+	CHKiRet(statsobj.AddCounter(dnsCache.stats, UCHAR_CONSTANT("resolved.async"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &dnsCache.ctrResolved));
+	CHKiRet(statsobj.AddCounter(dnsCache.stats, UCHAR_CONSTANT("pending"),
+		ctrType_Int, CTR_FLAG_NONE, &dnsCache.nPending));
+	CHKiRet(statsobj.ConstructFinalize(dnsCache.stats));
 finalize_it:
 	RETiRet;
 }
@@ -142,21 +232,66 @@ finalize_it:
 rsRetVal
 dnscacheDeinit(void)
 {
+	dnscache_req_t *req;
+	int i;
 	DEFiRet;
+
+	/* stop the resolver threads first, they access the cache */
+	pthread_mutex_lock(&dnsCache.mutRslv);
+	dnsCache.bStop = 1;
+	pthread_cond_broadcast(&dnsCache.condRslv);
+	pthread_mutex_unlock(&dnsCache.mutRslv);
+	for(i = 0 ; i < dnsCache.nRslvThrds ; ++i)
+		pthread_join(dnsCache.rslvThrds[i], NULL);
+	free(dnsCache.rslvThrds);
+	while(dnsCache.reqRoot != NULL) {
+		req = dnsCache.reqRoot;
+		dnsCache.reqRoot = req->next;
+		free(req);
+	}
+	pthread_cond_destroy(&dnsCache.condRslv);
+	pthread_mutex_destroy(&dnsCache.mutRslv);
+
+	if(dnsCache.stats != NULL)
+		statsobj.Destruct(&dnsCache.stats);
 	prop.Destruct(&staticErrValue);
-	hashtable_destroy(dnsCache.ht, 1); /* 1 => free all values automatically */
-	pthread_rwlock_destroy(&dnsCache.rwlock);
+	for(i = 0 ; i < DNSCACHE_NSHARDS ; ++i) {
+		hashtable_destroy(dnsCache.shards[i].ht, 1); /* 1 => free all values automatically */
+		pthread_mutex_destroy(&dnsCache.shards[i].mut);
+	}
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(prop, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 	RETiRet;
 }
 
 
-static inline dnscache_entry_t*
-findEntry(struct sockaddr_storage *addr)
+/* LRU list handling, the shard mutex must be locked */
+static void
+lruUnlink(dnscache_shard_t *const shard, dnscache_entry_t *const etry)
 {
-	return((dnscache_entry_t*) hashtable_search(dnsCache.ht, addr));
+	if(etry->lruPrev == NULL)
+		shard->lruHead = etry->lruNext;
+	else
+		etry->lruPrev->lruNext = etry->lruNext;
+	if(etry->lruNext == NULL)
+		shard->lruTail = etry->lruPrev;
+	else
+		etry->lruNext->lruPrev = etry->lruPrev;
+	etry->lruPrev = etry->lruNext = NULL;
+}
+
+static void
+lruPushHead(dnscache_shard_t *const shard, dnscache_entry_t *const etry)
+{
+	etry->lruPrev = NULL;
+	etry->lruNext = shard->lruHead;
+	if(shard->lruHead == NULL)
+		shard->lruTail = etry;
+	else
+		shard->lruHead->lruPrev = etry;
+	shard->lruHead = etry;
 }
 
 
@@ -215,7 +350,7 @@ setLocalHostName(dnscache_entry_t *etry)
 		count=0;
 		while(glbl.GetStripDomains()[count]) {
 			if(strcmp((char*)(p + 1), glbl.GetStripDomains()[count]) == 0) {
-				prop.CreateStringProp(&etry->localName, hostbuf, i);
+				prop.CreateInternedStringProp(&etry->localName, hostbuf, i);
 				goto done;
 			}
 			count++;
@@ -232,7 +367,7 @@ setLocalHostName(dnscache_entry_t *etry)
 		count=0;
 		while(glbl.GetLocalHosts()[count]) {
 			if(!strcmp((char*)fqdnLower, (char*)glbl.GetLocalHosts()[count])) {
-				prop.CreateStringProp(&etry->localName, hostbuf, i);
+				prop.CreateInternedStringProp(&etry->localName, hostbuf, i);
 				goto done;
 			}
 			count++;
@@ -256,9 +391,11 @@ done:	return;
  * there is a user-configurabel option that will tell us if
  * we should abort. For this, the return value tells the caller if the
  * message should be processed (1) or discarded (0).
+ * If bWithDNS is not set, only the IP address is filled in and used as name
+ * (this never blocks).
  */
 static rsRetVal
-resolveAddr(struct sockaddr_storage *addr, dnscache_entry_t *etry)
+resolveAddr(struct sockaddr_storage *addr, dnscache_entry_t *etry, const int bWithDNS)
 {
 	DEFiRet;
 	int error;
@@ -276,7 +413,7 @@ resolveAddr(struct sockaddr_storage *addr, dnscache_entry_t *etry)
 		ABORT_FINALIZE(RS_RET_INVALID_SOURCE);
 	}
 
-	if(!glbl.GetDisableDNS()) {
+	if(bWithDNS && !glbl.GetDisableDNS()) {
 		sigemptyset(&nmask);
 		sigaddset(&nmask, SIGHUP);
 		pthread_sigmask(SIG_BLOCK, &nmask, &omask);
@@ -329,10 +466,10 @@ resolveAddr(struct sockaddr_storage *addr, dnscache_entry_t *etry)
 				error = 1; /* that will trigger using IP address below. */
 			} else {/* we have a valid entry, so let's create the respective properties */
 				fqdnLen = strlen(fqdnBuf);
-				prop.CreateStringProp(&etry->fqdn, (uchar*)fqdnBuf, fqdnLen);
+				prop.CreateInternedStringProp(&etry->fqdn, (uchar*)fqdnBuf, fqdnLen);
 				for(i = 0 ; i < fqdnLen ; ++i)
 					fqdnBuf[i] = tolower(fqdnBuf[i]);
-				prop.CreateStringProp(&etry->fqdnLowerCase, (uchar*)fqdnBuf, fqdnLen);
+				prop.CreateInternedStringProp(&etry->fqdnLowerCase, (uchar*)fqdnBuf, fqdnLen);
 			}
 		}
 		pthread_sigmask(SIG_SETMASK, &omask, NULL);
@@ -346,9 +483,9 @@ finalize_it:
 	}
 
 	/* we need to create the inputName property (only once during our lifetime) */
-	prop.CreateStringProp(&etry->ip, (uchar*)szIP, strlen(szIP));
+	prop.CreateInternedStringProp(&etry->ip, (uchar*)szIP, strlen(szIP));
 
-        if(error || glbl.GetDisableDNS()) {
+        if(error || !bWithDNS || glbl.GetDisableDNS()) {
                 dbgprintf("Host name for your address (%s) unknown\n", szIP);
 		prop.AddRef(etry->ip);
 		etry->fqdn = etry->ip;
@@ -362,49 +499,232 @@ finalize_it:
 }
 
 
-static rsRetVal
-addEntry(struct sockaddr_storage *addr, dnscache_entry_t **pEtry)
+/* expiry time for an entry with the given TTL; a TTL of 0 means the entry
+ * never expires.
+ */
+static time_t
+expiryTime(const int ttl)
+{
+	return (ttl == 0) ? 0 : time(NULL) + ttl;
+}
+
+
+/* store a freshly resolved entry in the cache. If the address is already
+ * cached, the existing entry is updated with the new names (readers hold
+ * their own references to the old props); otherwise pNew is inserted if
+ * bInsert is set and dropped if not (e.g. evicted while being resolved).
+ * Takes ownership of pNew, returns the cache entry or NULL.
+ * The shard mutex must be locked.
+ */
+static dnscache_entry_t *
+storeEntry(dnscache_shard_t *const shard, struct sockaddr_storage *addr, dnscache_entry_t *pNew,
+	const rsRetVal rslvRet, const int bInsert)
 {
-	int r;
+	dnscache_entry_t *etry;
+	dnscache_entry_t *victim;
 	struct sockaddr_storage *keybuf;
-	dnscache_entry_t *etry = NULL;
-	DEFiRet;
+	prop_t *tmp;
+	const unsigned maxEntries = (glblDnscacheMaxEntries == 0) ? 0
+			: (glblDnscacheMaxEntries + DNSCACHE_NSHARDS - 1) / DNSCACHE_NSHARDS;
+
+	/* if we could not get a name, we retry earlier */
+	pNew->validUntil = expiryTime((rslvRet == RS_RET_OK && pNew->fqdn != pNew->ip)
+				? glblDnscacheTTL : glblDnscacheNegTTL);
+	pNew->rslvRet = rslvRet;
+
+	etry = (dnscache_entry_t*) hashtable_search(shard->ht, addr);
+	if(etry != NULL) {
+#		define SWAPPROP(name) tmp = etry->name; etry->name = pNew->name; pNew->name = tmp
+		SWAPPROP(fqdn);
+		SWAPPROP(fqdnLowerCase);
+		SWAPPROP(localName);
+		SWAPPROP(ip);
+#		undef SWAPPROP
+		etry->validUntil = pNew->validUntil;
+		etry->rslvRet = pNew->rslvRet;
+		etry->bPending = 0;
+		entryDestruct(pNew); /* now holds the old props */
+		return etry;
+	}
 
-	CHKmalloc(etry = MALLOC(sizeof(dnscache_entry_t)));
-	CHKiRet(resolveAddr(addr, etry));
-	memcpy(&etry->addr, addr, SALEN((struct sockaddr*) addr));
-	etry->nUsed = 0;
-	*pEtry = etry;
+	if(!bInsert) {
+		entryDestruct(pNew);
+		return NULL;
+	}
 
-	CHKmalloc(keybuf = malloc(sizeof(struct sockaddr_storage)));
-	memcpy(keybuf, addr, sizeof(struct sockaddr_storage));
+	while(maxEntries > 0 && shard->nEntries >= maxEntries && shard->lruTail != NULL) {
+		victim = shard->lruTail;
+		lruUnlink(shard, victim);
+		hashtable_remove(shard->ht, &victim->addr); /* frees key, not value */
+		entryDestruct(victim);
+		--shard->nEntries;
+		STATSCOUNTER_INC(dnsCache.ctrEvicted, dnsCache.mutCtrEvicted);
+	}
 
-	pthread_rwlock_unlock(&dnsCache.rwlock); /* release read lock */
-	pthread_rwlock_wrlock(&dnsCache.rwlock); /* and re-aquire for writing */
-	r = hashtable_insert(dnsCache.ht, keybuf, *pEtry);
-	if(r == 0) {
+	memcpy(&pNew->addr, addr, SALEN((struct sockaddr*) addr));
+	if((keybuf = malloc(sizeof(struct sockaddr_storage))) == NULL) {
+		entryDestruct(pNew);
+		return NULL;
+	}
+	memcpy(keybuf, addr, sizeof(struct sockaddr_storage));
+	if(hashtable_insert(shard->ht, keybuf, pNew) == 0) {
 		DBGPRINTF("dnscache: inserting element failed\n");
+		free(keybuf);
+		entryDestruct(pNew);
+		return NULL;
 	}
-	pthread_rwlock_unlock(&dnsCache.rwlock);
-	pthread_rwlock_rdlock(&dnsCache.rwlock); /* we need this again */
+	lruPushHead(shard, pNew);
+	++shard->nEntries;
+	return pNew;
+}
+
+
+/* resolve an address synchronously and store the result. We do not hold the
+ * shard lock during the DNS query, so lookups of other addresses in the same
+ * shard can proceed. The shard mutex must be locked on entry and is locked
+ * again on exit.
+ */
+static rsRetVal
+addEntry(dnscache_shard_t *const shard, struct sockaddr_storage *addr, dnscache_entry_t **pEtry)
+{
+	dnscache_entry_t *etry;
+	rsRetVal localRet;
+	DEFiRet;
+
+	CHKmalloc(etry = calloc(1, sizeof(dnscache_entry_t)));
+	pthread_mutex_unlock(&shard->mut);
+	localRet = resolveAddr(addr, etry, 1);
+	pthread_mutex_lock(&shard->mut);
+	if((*pEtry = storeEntry(shard, addr, etry, localRet, 1)) == NULL)
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 
 finalize_it:
-	if(iRet != RS_RET_OK && etry != NULL) {
-		/* Note: sub-fields cannot be populated in this case */
-		free(etry);
+	RETiRet;
+}
+
+
+/* background resolver thread: resolves queued addresses and updates the
+ * cache entries, which were created with the IP address as name.
+ */
+static void *
+rslvThrd(void __attribute__((unused)) *arg)
+{
+	dnscache_req_t *req;
+	dnscache_entry_t *etry;
+	dnscache_shard_t *shard;
+	rsRetVal localRet;
+	sigset_t sigSet;
+
+	sigfillset(&sigSet);
+	pthread_sigmask(SIG_BLOCK, &sigSet, NULL);
+
+	pthread_mutex_lock(&dnsCache.mutRslv);
+	while(1) {
+		while(dnsCache.reqRoot == NULL && !dnsCache.bStop)
+			pthread_cond_wait(&dnsCache.condRslv, &dnsCache.mutRslv);
+		if(dnsCache.bStop)
+			break;
+		req = dnsCache.reqRoot;
+		dnsCache.reqRoot = req->next;
+		if(dnsCache.reqRoot == NULL)
+			dnsCache.reqLast = NULL;
+		pthread_mutex_unlock(&dnsCache.mutRslv);
+
+		shard = getShard(&req->addr);
+		if((etry = calloc(1, sizeof(dnscache_entry_t))) != NULL) {
+			localRet = resolveAddr(&req->addr, etry, 1);
+			pthread_mutex_lock(&shard->mut);
+			storeEntry(shard, &req->addr, etry, localRet, 0);
+			pthread_mutex_unlock(&shard->mut);
+		} else {
+			/* let the next lookup try again */
+			pthread_mutex_lock(&shard->mut);
+			etry = (dnscache_entry_t*) hashtable_search(shard->ht, &req->addr);
+			if(etry != NULL)
+				etry->bPending = 0;
+			pthread_mutex_unlock(&shard->mut);
+		}
+		free(req);
+		STATSCOUNTER_INC(dnsCache.ctrResolved, dnsCache.mutCtrResolved);
+
+		pthread_mutex_lock(&dnsCache.mutRslv);
+		--dnsCache.nPending;
 	}
+	pthread_mutex_unlock(&dnsCache.mutRslv);
+	return NULL;
+}
+
+
+/* queue an entry for background resolution, starting the resolver threads
+ * on first use. If we have no resolver, an error is returned and the caller
+ * must resolve synchronously. The shard mutex must be locked.
+ */
+static rsRetVal
+queueResolve(dnscache_entry_t *const etry)
+{
+	dnscache_req_t *req = NULL;
+	int i;
+	DEFiRet;
+
+	pthread_mutex_lock(&dnsCache.mutRslv);
+	if(dnsCache.bStop)
+		ABORT_FINALIZE(RS_RET_ERR);
+	if(dnsCache.rslvThrds == NULL) {
+		CHKmalloc(dnsCache.rslvThrds = calloc(glblDnscacheResolvers, sizeof(pthread_t)));
+		for(i = 0 ; i < glblDnscacheResolvers ; ++i) {
+			if(pthread_create(&dnsCache.rslvThrds[dnsCache.nRslvThrds], NULL, rslvThrd, NULL) == 0)
+				++dnsCache.nRslvThrds;
+		}
+		DBGPRINTF("dnscache: started %d resolver threads\n", dnsCache.nRslvThrds);
+	}
+	if(dnsCache.nRslvThrds == 0)
+		ABORT_FINALIZE(RS_RET_ERR);
+
+	CHKmalloc(req = malloc(sizeof(dnscache_req_t)));
+	memcpy(&req->addr, &etry->addr, sizeof(struct sockaddr_storage));
+	req->next = NULL;
+	if(dnsCache.reqLast == NULL)
+		dnsCache.reqRoot = req;
+	else
+		dnsCache.reqLast->next = req;
+	dnsCache.reqLast = req;
+	++dnsCache.nPending;
+	etry->bPending = 1;
+	pthread_cond_signal(&dnsCache.condRslv);
+
+finalize_it:
+	pthread_mutex_unlock(&dnsCache.mutRslv);
 	RETiRet;
 }
 
 
-/* validate if an entry is still valid and, if not, re-query it.
- * In the initial implementation, this is a dummy!
- * TODO: implement!
+/* async mode: add an entry that uses the IP address as name for now, and
+ * have a resolver thread fill in the real name. The shard mutex must be
+ * locked (and is not released).
  */
-static inline rsRetVal
-validateEntry(dnscache_entry_t __attribute__((unused)) *etry, struct sockaddr_storage __attribute__((unused)) *addr)
+static rsRetVal
+addPendingEntry(dnscache_shard_t *const shard, struct sockaddr_storage *addr, dnscache_entry_t **pEtry)
 {
-	return RS_RET_OK;
+	dnscache_entry_t *etry;
+	rsRetVal localRet;
+	DEFiRet;
+
+	CHKmalloc(etry = calloc(1, sizeof(dnscache_entry_t)));
+	localRet = resolveAddr(addr, etry, 0);
+	if((etry = storeEntry(shard, addr, etry, localRet, 1)) == NULL)
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	if(localRet == RS_RET_OK && !glbl.GetDisableDNS()) {
+		if(queueResolve(etry) == RS_RET_OK) {
+			/* keep the placeholder until the resolver is done */
+			etry->validUntil = expiryTime(glblDnscacheNegTTL);
+		} else {
+			CHKiRet(addEntry(shard, addr, &etry));
+		}
+	}
+	*pEtry = etry;
+
+finalize_it:
+	RETiRet;
 }
 
 
@@ -418,16 +738,32 @@ dnscacheLookup(struct sockaddr_storage *addr, prop_t **fqdn, prop_t **fqdnLowerC
 	       prop_t **localName, prop_t **ip)
 {
 	dnscache_entry_t *etry;
+	dnscache_shard_t *const shard = getShard(addr);
 	DEFiRet;
 
-	pthread_rwlock_rdlock(&dnsCache.rwlock); /* TODO: optimize this! */
-	etry = findEntry(addr);
+	pthread_mutex_lock(&shard->mut);
+	etry = (dnscache_entry_t*) hashtable_search(shard->ht, addr);
 	dbgprintf("dnscache: entry %p found\n", etry);
 	if(etry == NULL) {
-		CHKiRet(addEntry(addr, &etry));
+		STATSCOUNTER_INC(dnsCache.ctrMisses, dnsCache.mutCtrMisses);
+		if(glblDnscacheAsync) {
+			CHKiRet(addPendingEntry(shard, addr, &etry));
+		} else {
+			CHKiRet(addEntry(shard, addr, &etry));
+		}
+	} else if(!etry->bPending && etry->validUntil != 0 && etry->validUntil <= time(NULL)) {
+		STATSCOUNTER_INC(dnsCache.ctrExpired, dnsCache.mutCtrExpired);
+		/* in async mode, the stale names are used until the refresh is done */
+		if(!glblDnscacheAsync || queueResolve(etry) != RS_RET_OK)
+			CHKiRet(addEntry(shard, addr, &etry));
 	} else {
-		CHKiRet(validateEntry(etry, addr));
+		STATSCOUNTER_INC(dnsCache.ctrHits, dnsCache.mutCtrHits);
 	}
+	++etry->nUsed;
+	lruUnlink(shard, etry);
+	lruPushHead(shard, etry);
+	if(etry->rslvRet != RS_RET_OK)
+		ABORT_FINALIZE(etry->rslvRet);
 	prop.AddRef(etry->ip);
 	*ip = etry->ip;
 	if(fqdn != NULL) {
@@ -444,7 +780,7 @@ dnscacheLookup(struct sockaddr_storage *addr, prop_t **fqdn, prop_t **fqdnLowerC
 	}
 
 finalize_it:
-	pthread_rwlock_unlock(&dnsCache.rwlock);
+	pthread_mutex_unlock(&shard->mut);
 	if(iRet != RS_RET_OK && iRet != RS_RET_ADDRESS_UNKNOWN) {
 		DBGPRINTF("dnscacheLookup failed with iRet %d\n", iRet);
 		prop.AddRef(staticErrValue);
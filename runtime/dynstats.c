@@ -80,7 +80,7 @@ static void /* assumes exclusive access to bucket */
 dynstats_destroyCountersIn(dynstats_bucket_t *b, htable *table, dynstats_ctr_t *ctrs) {
 	dynstats_ctr_t *ctr;
 	int ctrs_purged = 0;
-	hashtable_destroy(table, 0);
+	hashmapDestroy(table, 0);
 	while (ctrs != NULL) {
 		ctr = ctrs;
 		ctrs = ctrs->next;
@@ -208,9 +208,9 @@ dynstats_rebuildSurvivorTable(dynstats_bucket_t *b) {
 	
 	htab_sz = (size_t) (DYNSTATS_HASHTABLE_SIZE_OVERPROVISIONING * b->maxCardinality + 1);
 	if (b->table == NULL) {
-		CHKmalloc(survivor_table = create_hashtable(htab_sz, hash_from_string, key_equals_string, no_op_free));
+		CHKmalloc(survivor_table = hashmapNewStr(htab_sz, no_op_free));
 	}
-	CHKmalloc(new_table = create_hashtable(htab_sz, hash_from_string, key_equals_string, no_op_free));
+	CHKmalloc(new_table = hashmapNewStr(htab_sz, no_op_free));
 	statsobj.UnlinkAllCounters(b->stats);
 	if (b->survivor_table != NULL) {
 		dynstats_destroyCountersIn(b, b->survivor_table, b->survivor_ctrs);
@@ -225,13 +225,13 @@ finalize_it:
 		if (new_table == NULL) {
 			errmsg.LogError(errno, RS_RET_INTERNAL_ERROR, "error trying to initialize hash-table for dyn-stats bucket named: %s", b->name);
 		} else {
-			hashtable_destroy(new_table, 0);
+			hashmapDestroy(new_table, 0);
 		}
 		if (b->table == NULL) {
 			if (survivor_table == NULL) {
 				errmsg.LogError(errno, RS_RET_INTERNAL_ERROR, "error trying to initialize ttl-survivor hash-table for dyn-stats bucket named: %s", b->name);
 			} else {
-				hashtable_destroy(survivor_table, 0);
+				hashmapDestroy(survivor_table, 0);
 			}
 		}
 	}
@@ -498,7 +498,7 @@ dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialI
 	CHKiRet(dynstats_createCtr(b, metric, &ctr));
 
 	pthread_rwlock_wrlock(&b->lock);
-	found_ctr = (dynstats_ctr_t*) hashtable_search(b->table, ctr->metric);
+	found_ctr = (dynstats_ctr_t*) hashmapSearch(b->table, ctr->metric);
 	if (found_ctr != NULL) {
 		if (doInitialIncrement) {
 			STATSCOUNTER_INC(found_ctr->ctr, found_ctr->mutCtr);
@@ -506,7 +506,7 @@ dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialI
 	} else {
 		copy_of_key = ustrdup(ctr->metric);
 		if (copy_of_key != NULL) {
-			survivor_ctr = (dynstats_ctr_t*) hashtable_search(b->survivor_table, ctr->metric);
+			survivor_ctr = (dynstats_ctr_t*) hashmapSearch(b->survivor_table, ctr->metric);
 			if (survivor_ctr == NULL) {
 				effective_ctr = ctr;
 			} else {
@@ -521,7 +521,7 @@ dynstats_addNewCtr(dynstats_bucket_t *b, const uchar* metric, uint8_t doInitialI
 					b->survivor_ctrs = survivor_ctr->next;
 				}
 			}
-			if ((created = hashtable_insert(b->table, copy_of_key, effective_ctr))) {
+			if ((created = hashmapInsert(b->table, copy_of_key, effective_ctr))) {
 				statsobj.AddPreCreatedCtr(b->stats, effective_ctr->pCtr);
 			}
 		}
@@ -573,7 +573,7 @@ dynstats_inc(dynstats_bucket_t *b, uchar* metric) {
 	}
 
 	if (pthread_rwlock_tryrdlock(&b->lock) == 0) {
-		ctr = (dynstats_ctr_t *) hashtable_search(b->table, metric);
+		ctr = (dynstats_ctr_t *) hashmapSearch(b->table, metric);
 		if (ctr != NULL) {
 			STATSCOUNTER_INC(ctr->ctr, ctr->mutCtr);
 		}
@@ -18,9 +18,9 @@
 #ifndef INCLUDED_DYNSTATS_H
 #define INCLUDED_DYNSTATS_H
 
-#include "hashtable.h"
+#include "hashmap.h"
 
-typedef struct hashtable htable;
+typedef hashmap_t htable;
 
 struct dynstats_ctr_s {
 	STATSCOUNTER_DEF(ctr, mutCtr);
@@ -119,6 +119,13 @@ int glblReportGoneAwaySenders = 0;
 int glblSenderStatsTimeout = 12 * 60 * 60; /* 12 hr timeout for senders */
 int glblSenderKeepTrack = 0;  /* keep track of known senders? */
 int glblUnloadModules = 1;
+int glblLatencyStats = 0;	/* keep latency histograms (needs a monotonic ingress timestamp per msg)? */
+int glblRegexEngine = REGEX_ENGINE_POSIX;	/* engine for extended regex yes/no matching */
+int glblDnscacheTTL = 0;	/* lifetime of resolved dnscache entries (seconds), 0 - no expiry */
+int glblDnscacheNegTTL = 0;	/* lifetime of dnscache entries that could not be resolved */
+int glblDnscacheMaxEntries = 100000;	/* max dnscache size, 0 - unlimited */
+int glblDnscacheAsync = 0;		/* resolve dnscache misses in the background? */
+int glblDnscacheResolvers = 2;		/* nbr of background resolver threads */
 
 pid_t glbl_ourpid;
 #ifndef HAVE_ATOMIC_BUILTINS
@@ -170,7 +177,14 @@ static struct cnfparamdescr cnfparamdescr[] = {
 	{ "net.enabledns", eCmdHdlrBinary, 0 },
 	{ "net.permitACLwarning", eCmdHdlrBinary, 0 },
 	{ "environment", eCmdHdlrArray, 0 },
-	{ "processinternalmessages", eCmdHdlrBinary, 0 }
+	{ "processinternalmessages", eCmdHdlrBinary, 0 },
+	{ "latencystats", eCmdHdlrBinary, 0 },
+	{ "regex.engine", eCmdHdlrGetWord, 0 },
+	{ "dnscache.ttl", eCmdHdlrPositiveInt, 0 },
+	{ "dnscache.negativettl", eCmdHdlrPositiveInt, 0 },
+	{ "dnscache.maxentries", eCmdHdlrNonNegInt, 0 },
+	{ "dnscache.async", eCmdHdlrBinary, 0 },
+	{ "dnscache.resolvers", eCmdHdlrPositiveInt, 0 }
 };
 static struct cnfparamblk paramblk =
 	{ CNFPARAMBLK_VERSION,
@@ -971,6 +985,27 @@ glblProcessCnf(struct cnfobj *o)
 			continue;
 		if(!strcmp(paramblk.descr[i].name, "processinternalmessages")) {
 			bProcessInternalMessages = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "latencystats")) {
+			/* must be known before queues and actions are created */
+			glblLatencyStats = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "regex.engine")) {
+			/* must be known before the first regex is compiled */
+			char *const engine = es_str2cstr(cnfparamvals[i].val.d.estr, NULL);
+			if(!strcmp(engine, "posix")) {
+				glblRegexEngine = REGEX_ENGINE_POSIX;
+			} else if(!strcmp(engine, "pcre2")) {
+#ifdef HAVE_PCRE2
+				glblRegexEngine = REGEX_ENGINE_PCRE2;
+#else
+				errmsg.LogError(0, RS_RET_ERR, "rsyslog wasn't "
+					"compiled with PCRE2 support. regex.engine "
+					"\"pcre2\" is ignored, POSIX regex is used.");
+#endif
+			} else {
+				errmsg.LogError(0, RS_RET_INVALID_VALUE, "invalid regex.engine "
+					"\"%s\", must be \"posix\" or \"pcre2\"", engine);
+			}
+			free(engine);
 		} else if(!strcmp(paramblk.descr[i].name, "stdlog.channelspec")) {
 #ifndef HAVE_LIBLOGGING_STDLOG
 			errmsg.LogError(0, RS_RET_ERR, "rsyslog wasn't "
@@ -1073,6 +1108,7 @@ void
 glblDoneLoadCnf(void)
 {
 	int i;
+	int bDnscacheNegTTLSet = 0;
 	unsigned char *cstr;
 
 	qsort(tzinfos, ntzinfos, sizeof(tzinfo_t), qs_arrcmp_tzinfo);
@@ -1181,6 +1217,17 @@ glblDoneLoadCnf(void)
 		        *(net.pACLDontResolve) = !((int) cnfparamvals[i].val.d.n);
 		} else if(!strcmp(paramblk.descr[i].name, "net.enabledns")) {
 		        setDisableDNS(!((int) cnfparamvals[i].val.d.n));
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.ttl")) {
+		        glblDnscacheTTL = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.negativettl")) {
+		        glblDnscacheNegTTL = (int) cnfparamvals[i].val.d.n;
+			bDnscacheNegTTLSet = 1;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.maxentries")) {
+		        glblDnscacheMaxEntries = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.async")) {
+		        glblDnscacheAsync = (int) cnfparamvals[i].val.d.n;
+		} else if(!strcmp(paramblk.descr[i].name, "dnscache.resolvers")) {
+		        glblDnscacheResolvers = (int) cnfparamvals[i].val.d.n;
 		} else if(!strcmp(paramblk.descr[i].name, "net.permitwarning")) {
 		        setOption_DisallowWarning(!((int) cnfparamvals[i].val.d.n));
 		} else if(!strcmp(paramblk.descr[i].name, "environment")) {
@@ -1196,6 +1243,12 @@ glblDoneLoadCnf(void)
 		}
 	}
 
+	/* entries never expire unless dnscache.ttl is given; in that case,
+	 * failed lookups are retried after 5 minutes at most by default
+	 */
+	if(glblDnscacheTTL != 0 && !bDnscacheNegTTLSet)
+		glblDnscacheNegTTL = (glblDnscacheTTL < 5 * 60) ? glblDnscacheTTL : 5 * 60;
+
 	if(glblDebugOnShutdown && Debug != DEBUG_FULL) {
 		Debug = DEBUG_ONDEMAND;
 		stddbg = -1;
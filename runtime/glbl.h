@@ -114,8 +114,19 @@ extern int glblReportGoneAwaySenders;
 extern int glblSenderStatsTimeout;
 extern int glblSenderKeepTrack;
 extern int glblUnloadModules;
+extern int glblLatencyStats;
+extern int glblRegexEngine;
+extern int glblDnscacheTTL;
+extern int glblDnscacheNegTTL;
+extern int glblDnscacheMaxEntries;
+extern int glblDnscacheAsync;
+extern int glblDnscacheResolvers;
 extern short janitorInterval;
 
+/* values for glblRegexEngine (global regex.engine parameter) */
+#define REGEX_ENGINE_POSIX 0
+#define REGEX_ENGINE_PCRE2 1
+
 #define glblGetOurPid() glbl_ourpid
 #define glblSetOurPid(pid) { glbl_ourpid = (pid); }
 
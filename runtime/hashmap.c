@@ -0,0 +1,291 @@
+/* hashmap.c
+ * An open-addressing hash map for hot lookup paths. It uses Robin Hood
+ * hashing: on insert, an entry that is further away from its home slot
+ * takes the place of one that is closer to its own, which keeps probe
+ * sequences short and lets a failed lookup stop early. Removal shifts
+ * the following entries back, so no tombstones are needed.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hashmap.h"
+
+#define HASHMAP_MINSIZE 16
+#define HASHMAP_MAXSIZE (1u << 31)
+
+/* an empty slot has h == 0, real hashes are never 0 */
+struct hashmap_slot_s {
+	unsigned h;
+	void *k;
+	void *v;
+};
+typedef struct hashmap_slot_s hashmap_slot_t;
+
+struct hashmap_s {
+	hashmap_slot_t *slots;
+	unsigned mask;		/* nbr of slots - 1, size is a power of 2 */
+	unsigned count;
+	unsigned loadlimit;	/* grow when count would exceed this */
+	unsigned (*hashfn)(void*);
+	int (*eqfn)(void*, void*);
+	void (*dest)(void*);
+	int bStrKeys;
+};
+
+/* we use a load factor of 0.7; higher factors work with Robin Hood hashing,
+ * but the benchmark (tests/hashmap_bench.c) shows slower lookups.
+ */
+static inline unsigned
+getLoadLimit(const unsigned size)
+{
+	return (unsigned) (((unsigned long long) size * 7) / 10);
+}
+
+/* string hash, same scheme as hash_from_string(); getHash() mixes it */
+static inline unsigned
+strHash(const char *s)
+{
+	unsigned h = 5381;
+	while(*s)
+		h = h * 33 + (unsigned char) *s++;
+	return h;
+}
+
+/* mix the user hash, as we use its low bits as index and many key hash
+ * functions (e.g. for pids) are not well distributed. This is the
+ * murmur3 finalizer.
+ */
+static inline unsigned
+getHash(hashmap_t *const map, void *const k)
+{
+	unsigned h = map->bStrKeys ? strHash(k) : map->hashfn(k);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return (h == 0) ? 1 : h;
+}
+
+static inline int
+keyEquals(hashmap_t *const map, void *const k1, void *const k2)
+{
+	return map->bStrKeys ? !strcmp(k1, k2) : map->eqfn(k1, k2);
+}
+
+/* distance of a slot from the home slot of the hash stored in it */
+static inline unsigned
+probeDist(hashmap_t *const map, const unsigned h, const unsigned idx)
+{
+	return (idx - (h & map->mask)) & map->mask;
+}
+
+static hashmap_t *
+construct(unsigned minsize, unsigned (*hashfn)(void*), int (*eqfn)(void*, void*),
+	void (*dest)(void*), const int bStrKeys)
+{
+	hashmap_t *map;
+	unsigned size = HASHMAP_MINSIZE;
+
+	while(getLoadLimit(size) < minsize) {
+		if(size == HASHMAP_MAXSIZE)
+			return NULL;
+		size <<= 1;
+	}
+	if((map = malloc(sizeof(hashmap_t))) == NULL)
+		return NULL;
+	if((map->slots = calloc(size, sizeof(hashmap_slot_t))) == NULL) {
+		free(map);
+		return NULL;
+	}
+	map->mask = size - 1;
+	map->count = 0;
+	map->loadlimit = getLoadLimit(size);
+	map->hashfn = hashfn;
+	map->eqfn = eqfn;
+	map->dest = dest;
+	map->bStrKeys = bStrKeys;
+	return map;
+}
+
+hashmap_t *
+hashmapNew(unsigned minsize, unsigned (*hashfn)(void*), int (*eqfn)(void*, void*), void (*dest)(void*))
+{
+	return construct(minsize, hashfn, eqfn, dest, 0);
+}
+
+hashmap_t *
+hashmapNewStr(unsigned minsize, void (*dest)(void*))
+{
+	return construct(minsize, NULL, NULL, dest, 1);
+}
+
+/* place an entry, the caller must make sure there is a free slot */
+static void
+placeEntry(hashmap_t *const map, hashmap_slot_t ent)
+{
+	hashmap_slot_t *slot;
+	hashmap_slot_t tmp;
+	unsigned idx = ent.h & map->mask;
+	unsigned dist = 0;
+	unsigned slotDist;
+
+	while(1) {
+		slot = &map->slots[idx];
+		if(slot->h == 0) {
+			*slot = ent;
+			return;
+		}
+		slotDist = probeDist(map, slot->h, idx);
+		if(slotDist < dist) {
+			/* the resident is closer to home, so it makes room */
+			tmp = *slot;
+			*slot = ent;
+			ent = tmp;
+			dist = slotDist;
+		}
+		idx = (idx + 1) & map->mask;
+		++dist;
+	}
+}
+
+static int
+expand(hashmap_t *const map)
+{
+	hashmap_slot_t *oldSlots = map->slots;
+	const unsigned oldSize = map->mask + 1;
+	unsigned i;
+
+	if(oldSize == HASHMAP_MAXSIZE)
+		return 0;
+	if((map->slots = calloc(oldSize * 2, sizeof(hashmap_slot_t))) == NULL) {
+		map->slots = oldSlots;
+		return 0;
+	}
+	map->mask = oldSize * 2 - 1;
+	map->loadlimit = getLoadLimit(oldSize * 2);
+	for(i = 0 ; i < oldSize ; ++i) {
+		if(oldSlots[i].h != 0)
+			placeEntry(map, oldSlots[i]);
+	}
+	free(oldSlots);
+	return 1;
+}
+
+int
+hashmapInsert(hashmap_t *map, void *k, void *v)
+{
+	hashmap_slot_t ent;
+
+	if(map->count + 1 > map->loadlimit) {
+		/* if we cannot grow, we carry on as long as there is room */
+		if(!expand(map) && map->count == map->mask)
+			return 0;
+	}
+	ent.h = getHash(map, k);
+	ent.k = k;
+	ent.v = v;
+	placeEntry(map, ent);
+	++map->count;
+	return 1;
+}
+
+/* returns the slot index of k or -1 if not found */
+static long long
+findSlot(hashmap_t *const map, void *const k)
+{
+	const unsigned h = getHash(map, k);
+	unsigned idx = h & map->mask;
+	unsigned dist = 0;
+	hashmap_slot_t *slot;
+
+	while(1) {
+		slot = &map->slots[idx];
+		/* an entry with a shorter probe distance means k would have been
+		 * placed before it, so k is not present.
+		 */
+		if(slot->h == 0 || probeDist(map, slot->h, idx) < dist)
+			return -1;
+		if(slot->h == h && keyEquals(map, k, slot->k))
+			return idx;
+		idx = (idx + 1) & map->mask;
+		++dist;
+	}
+}
+
+void *
+hashmapSearch(hashmap_t *map, void *k)
+{
+	const long long idx = findSlot(map, k);
+	return (idx < 0) ? NULL : map->slots[idx].v;
+}
+
+void *
+hashmapRemove(hashmap_t *map, void *k)
+{
+	long long found;
+	unsigned idx;
+	unsigned next;
+	void *v;
+
+	if((found = findSlot(map, k)) < 0)
+		return NULL;
+	idx = (unsigned) found;
+	v = map->slots[idx].v;
+	free(map->slots[idx].k);
+	/* shift following entries back until one is at its home slot */
+	next = (idx + 1) & map->mask;
+	while(map->slots[next].h != 0 && probeDist(map, map->slots[next].h, next) > 0) {
+		map->slots[idx] = map->slots[next];
+		idx = next;
+		next = (next + 1) & map->mask;
+	}
+	map->slots[idx].h = 0;
+	map->slots[idx].k = NULL;
+	map->slots[idx].v = NULL;
+	--map->count;
+	return v;
+}
+
+unsigned
+hashmapCount(hashmap_t *map)
+{
+	return map->count;
+}
+
+void
+hashmapDestroy(hashmap_t *map, int bFreeValues)
+{
+	unsigned i;
+
+	if(map == NULL)
+		return;
+	for(i = 0 ; i <= map->mask ; ++i) {
+		if(map->slots[i].h == 0)
+			continue;
+		free(map->slots[i].k);
+		if(bFreeValues) {
+			if(map->dest == NULL)
+				free(map->slots[i].v);
+			else
+				map->dest(map->slots[i].v);
+		}
+	}
+	free(map->slots);
+	free(map);
+}
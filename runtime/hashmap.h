@@ -0,0 +1,48 @@
+/* header for hashmap.c
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_HASHMAP_H
+#define INCLUDED_HASHMAP_H
+
+/* Open-addressing hash map (Robin Hood hashing). Entries live in one flat
+ * array together with their full hash, so a lookup usually touches a
+ * single cache line and compares keys only on a hash match.
+ * Ownership rules are the same as for hashtable.c: the map owns the keys
+ * (they are free()d on remove and destroy); values are only freed by
+ * hashmapDestroy() if requested. The map is not thread-safe.
+ */
+typedef struct hashmap_s hashmap_t;
+
+/* generic map, keys are hashed and compared via callbacks. dest is the
+ * value destructor, if NULL, free() is used.
+ */
+hashmap_t *hashmapNew(unsigned minsize, unsigned (*hashfn)(void*),
+	int (*eqfn)(void*, void*), void (*dest)(void*));
+/* map with C string keys, hashed and compared without callbacks */
+hashmap_t *hashmapNewStr(unsigned minsize, void (*dest)(void*));
+/* returns 1 on success, 0 if out of memory (the map does not take
+ * ownership of k in that case). The key must not already be present.
+ */
+int hashmapInsert(hashmap_t *map, void *k, void *v);
+void *hashmapSearch(hashmap_t *map, void *k);
+/* removes an entry, frees its key and returns its value (or NULL) */
+void *hashmapRemove(hashmap_t *map, void *k);
+unsigned hashmapCount(hashmap_t *map);
+void hashmapDestroy(hashmap_t *map, int bFreeValues);
+
+#endif /* #ifndef INCLUDED_HASHMAP_H */
@@ -1158,6 +1158,30 @@ static rsRetVal parse2(instanceConf_t *const pInst, smsg_t *pMsg)\
 }
 
 
+/* parseBatch() - optional entry point of parser modules, parses an array of
+ * messages in one call. The result for each message must be stored in the
+ * corresponding pRet[] slot, with the same semantics as for parse()/parse2().
+ * pInst is NULL for parsers using the v1 config interface.
+ */
+#define CODEqueryEtryPt_parseBatch \
+	else if(!strcmp((char*) name, "parseBatch")) {\
+		*pEtryPoint = parseBatch;\
+	}
+#define BEGINparseBatch \
+static rsRetVal parseBatch(instanceConf_t __attribute__((unused)) *const pInst, \
+	smsg_t **const ppMsg, rsRetVal *const pRet, const int nMsgs)\
+{\
+	DEFiRet;
+
+#define CODESTARTparseBatch \
+	assert(ppMsg != NULL);\
+	assert(pRet != NULL);
+
+#define ENDparseBatch \
+	RETiRet;\
+}
+
+
 /* strgen() - main entry point of parser modules
  * Note that we do NOT use size_t as this permits us to store the
  * values directly into optimized heap structures.
@@ -779,6 +779,13 @@ doModInit(rsRetVal (*modInit)(int, int*, rsRetVal(**)(), rsRetVal(*)(), modInfo_
 			} else {
 				ABORT_FINALIZE(localRet);
 			}
+			localRet = (*pNew->modQueryEtryPt)((uchar*)"parseBatch",
+				   &pNew->mod.pm.parseBatch);
+			if(localRet == RS_RET_MODULE_ENTRY_POINT_NOT_FOUND) {
+				pNew->mod.pm.parseBatch = NULL;
+			} else if(localRet != RS_RET_OK) {
+				ABORT_FINALIZE(localRet);
+			}
 			CHKiRet((*pNew->modQueryEtryPt)((uchar*)"GetParserName", &GetName));
 			CHKiRet(GetName(&pName));
 			CHKiRet(parserConstructViaModAndName(pNew, pName, NULL));
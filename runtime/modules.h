@@ -154,6 +154,8 @@ struct modInfo_s {
 			rsRetVal (*freeParserInst)(void *pinst);
 			rsRetVal (*parse2)(instanceConf_t *const, smsg_t*);
 			rsRetVal (*parse)(smsg_t*);
+			/* optional, NULL if not supported by the parser */
+			rsRetVal (*parseBatch)(instanceConf_t *const, smsg_t**, rsRetVal*, int);
 		} pm;
 		struct { /* data for strgen modules */
 			rsRetVal (*strgen)(const smsg_t*const, actWrkrIParams_t *const iparam);
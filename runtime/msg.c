@@ -55,6 +55,7 @@
 #include "msg.h"
 #include "datetime.h"
 #include "glbl.h"
+#include "statsobj.h"
 #include "regexp.h"
 #include "atomic.h"
 #include "unicode-helper.h"
@@ -479,6 +480,24 @@ MsgSetRulesetByName(smsg_t * const pMsg, cstr_t *rulesetName)
 	rulesetGetRuleset(runConf, &(pMsg->pRuleset), rsCStrGetSzStrNoNULL(rulesetName));
 }
 
+/* check if the regexp interface is available, loading it if needed. Once
+ * loaded, it stays loaded for the rest of the run. So we remember that fact
+ * and avoid calling objUse() (which acquires the global object mutex) for
+ * each template regex evaluation.
+ */
+static int bRegexpLoaded = 0;
+static DEF_ATOMIC_HELPER_MUT(mutRegexpLoaded);
+static int
+regexpIsLoaded(void)
+{
+	if(ATOMIC_FETCH_32BIT(&bRegexpLoaded, &mutRegexpLoaded))
+		return 1;
+	if(objUse(regexp, LM_REGEXP_FILENAME) != RS_RET_OK)
+		return 0;
+	ATOMIC_STORE_1_TO_INT(&bRegexpLoaded, &mutRegexpLoaded);
+	return 1;
+}
+
 /* do a DNS reverse resolution, if not already done, reflect status
  * rgerhards, 2009-11-16
  */
@@ -847,6 +866,7 @@ msgBaseConstruct(smsg_t **ppThis)
 	pM->localvars = NULL;
 	pM->dfltTZ[0] = '\0';
 	memset(&pM->tRcvdAt, 0, sizeof(pM->tRcvdAt));
+	pM->tIngressNs = glblLatencyStats ? statsHistNowNs() : 0;
 	memset(&pM->tTIMESTAMP, 0, sizeof(pM->tTIMESTAMP));
 	pM->TAG.pszTAG = NULL;
 	pM->pszTimestamp3164[0] = '\0';
@@ -1080,6 +1100,7 @@ smsg_t* MsgDup(smsg_t* pOld)
 	pNew->msgFlags = pOld->msgFlags;
 	pNew->iProtocolVersion = pOld->iProtocolVersion;
 	pNew->ttGenTime = pOld->ttGenTime;
+	pNew->tIngressNs = pOld->tIngressNs;
 	pNew->offMSG = pOld->offMSG;
 	pNew->iLenRawMsg = pOld->iLenRawMsg;
 	pNew->iLenMSG = pOld->iLenMSG;
@@ -2759,6 +2780,26 @@ finalize_it:
 }
 
 
+/* check if fromhost or fromhost-ip of the message is the given prop
+ * object. This does neither resolve nor copy the name. If it is the same
+ * object, the names are equal; if not, they may still be (callers must
+ * then compare the strings).
+ */
+int
+MsgRcvFromPropIs(smsg_t *const pMsg, const propid_t id, prop_t *const pProp)
+{
+	int bRet = 0;
+
+	MsgLock(pMsg);
+	if(id == PROP_FROMHOST_IP)
+		bRet = (pMsg->pRcvFromIP == pProp);
+	else if(id == PROP_FROMHOST && !(pMsg->msgFlags & NEEDS_DNSRESOL))
+		bRet = (pMsg->rcvFrom.pRcvFrom == pProp);
+	MsgUnlock(pMsg);
+	return bRet;
+}
+
+
 /* rgerhards 2004-11-09: set HOSTNAME in msg object
  * rgerhards, 2007-06-21:
  * Does not return anything. If an error occurs, the hostname is
@@ -3825,7 +3866,7 @@ uchar *MsgGetProp(smsg_t *__restrict__ const pMsg, struct templateEntry *__restr
 
 			dbgprintf("string to match for regex is: %s\n", pRes);
 
-			if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
+			if(regexpIsLoaded()) {
 				short iTry = 0;
 				uchar bFound = 0;
 				iOffs = 0;
@@ -5076,6 +5117,7 @@ static rsRetVal msgQueryInterface(void) { return RS_RET_NOT_IMPLEMENTED; }
  */
 BEGINObjClassInit(msg, 1, OBJ_IS_CORE_MODULE)
 	pthread_mutex_init(&glblVars_lock, NULL);
+	INIT_ATOMIC_HELPER_MUT(mutRegexpLoaded);
 
 	/* request objects we use */
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
@@ -107,6 +107,7 @@ struct msg {
 				   enough to reliable, but I prefer to leave the subtle things to the OS, where
 				   it obviously is solved in way or another...). */
 	struct syslogTime tRcvdAt;/* time the message entered this program */
+	uint64_t tIngressNs;	/* monotonic time (ns) the msg was created, 0 if latency stats are off */
 	struct syslogTime tTIMESTAMP;/* (parsed) value of the timestamp */
 	struct json_object *json;
 	struct json_object *localvars;
@@ -179,6 +180,7 @@ void MsgSetRcvFrom(smsg_t *pMsg, prop_t*);
 void MsgSetRcvFromStr(smsg_t *const pMsg, const uchar* pszRcvFrom, const int, prop_t **);
 rsRetVal MsgSetRcvFromIP(smsg_t *pMsg, prop_t*);
 rsRetVal MsgSetRcvFromIPStr(smsg_t *const pThis, const uchar *psz, const int len, prop_t **ppProp);
+int MsgRcvFromPropIs(smsg_t *const pMsg, const propid_t id, prop_t *const pProp);
 void MsgSetHOSTNAME(smsg_t *pMsg, const uchar* pszHOSTNAME, const int lenHOSTNAME);
 rsRetVal MsgSetAfterPRIOffs(smsg_t *pMsg, short offs);
 void MsgSetMSGoffs(smsg_t *pMsg, short offs);
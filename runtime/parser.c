@@ -26,6 +26,7 @@
  */
 #include "config.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
@@ -34,6 +35,7 @@
 #include "rsyslog.h"
 #include "dirty.h"
 #include "msg.h"
+#include "batch.h"
 #include "obj.h"
 #include "datetime.h"
 #include "errmsg.h"
@@ -42,6 +44,7 @@
 #include "unicode-helper.h"
 #include "dirty.h"
 #include "cfsysline.h"
+#include "sanitize.h"
 
 /* some defines */
 #define DEFUPRI		(LOG_USER|LOG_NOTICE)
@@ -55,10 +58,6 @@ DEFobjCurrIf(ruleset)
 
 /* static data */
 
-static char hexdigit[16] =
-	{'0', '1', '2', '3', '4', '5', '6', '7', '8',
-	 '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-
 /* This is the list of all parsers known to us.
  * This is also used to unload all modules on shutdown.
  */
@@ -383,13 +382,21 @@ SanitizeMsg(smsg_t *pMsg)
 	uchar *pszMsg;
 	uchar *pDst; /* destination for copy job */
 	size_t lenMsg;
-	size_t iSrc;
 	size_t iDst;
 	size_t iMaxLine;
 	size_t maxDest;
-	uchar pc;
 	sbool bUpdatedLen = RSFALSE;
 	uchar szSanBuf[32*1024]; /* buffer used for sanitizing a string */
+	size_t iFirstDirty; /* first character that needs to be escaped */
+	sanitizeOpts_t opts;
+
+	/* config settings, fetched once per message and not once per character */
+	opts.bEscapeCC = glbl.GetParserEscapeControlCharactersOnReceive();
+	opts.bEscape8Bit = glbl.GetParserEscape8BitCharactersOnReceive();
+	opts.bSpaceLF = glbl.GetParserSpaceLFOnReceive();
+	opts.bEscapeTab = glbl.GetParserEscapeControlCharacterTab();
+	opts.bCStyle = glbl.GetParserEscapeControlCharactersCStyle();
+	opts.cEscapePrefix = glbl.GetParserControlCharacterEscapePrefix();
 
 	assert(pMsg != NULL);
 	assert(pMsg->iLenRawMsg > 0);
@@ -429,31 +436,18 @@ SanitizeMsg(smsg_t *pMsg)
 	 * like to pay the performance penalty. So the penalty is only with those
 	 * that actually use it, because we may call the sanitizer without actual
 	 * need below (but it then still will work perfectly well!). -- rgerhards, 2009-11-27
+	 * Clean messages are checked eight bytes at a time, we only look at individual
+	 * bytes for words that contain a candidate character.
 	 */
-	int bNeedSanitize = 0;
-	for(iSrc = 0 ; iSrc < lenMsg ; iSrc++) {
-		if(pszMsg[iSrc] < 32) {
-			if(glbl.GetParserSpaceLFOnReceive() && pszMsg[iSrc] == '\n') {
-				pszMsg[iSrc] = ' ';
-			} else if(pszMsg[iSrc] == '\0' || glbl.GetParserEscapeControlCharactersOnReceive()) {
-				bNeedSanitize = 1;
-				if (!glbl.GetParserSpaceLFOnReceive()) {
-					break;
-			    }
-			}
-		} else if(pszMsg[iSrc] > 127 && glbl.GetParserEscape8BitCharactersOnReceive()) {
-			bNeedSanitize = 1;
-			break;
-		}
-	}
+	iFirstDirty = sanitizeCheck(pszMsg, lenMsg, &opts);
 
-	if(!bNeedSanitize) {
+	if(iFirstDirty == lenMsg) {
 		if(bUpdatedLen == RSTRUE)
 			MsgSetRawMsgSize(pMsg, lenMsg);
 		FINALIZE;
 	}
 
-	/* now copy over the message and sanitize it. Note that up to iSrc-1 there was
+	/* now copy over the message and sanitize it. Note that up to iFirstDirty-1 there was
 	 * obviously no need to sanitize, so we can go over that quickly...
 	 */
 	iMaxLine = glbl.GetMaxLine();
@@ -465,94 +459,7 @@ SanitizeMsg(smsg_t *pMsg)
 		pDst = szSanBuf;
 	else 
 		CHKmalloc(pDst = MALLOC(iMaxLine + 1));
-	if(iSrc > 0) {
-		iSrc--; /* go back to where everything is OK */
-		memcpy(pDst, pszMsg, iSrc); /* fast copy known good */
-	}
-	iDst = iSrc;
-	while(iSrc < lenMsg && iDst < maxDest - 3) { /* leave some space if last char must be escaped */
-		if((pszMsg[iSrc] < 32) && (pszMsg[iSrc] != '\t' || glbl.GetParserEscapeControlCharacterTab())) {
-			/* note: \0 must always be escaped, the rest of the code currently
-			 * can not handle it! -- rgerhards, 2009-08-26
-			 */
-			if(pszMsg[iSrc] == '\0' || glbl.GetParserEscapeControlCharactersOnReceive()) {
-				/* we are configured to escape control characters. Please note
-				 * that this most probably break non-western character sets like
-				 * Japanese, Korean or Chinese. rgerhards, 2007-07-17
-				 */
-				if (glbl.GetParserEscapeControlCharactersCStyle()) {
-					pDst[iDst++] = '\\';
-
-					switch (pszMsg[iSrc]) {
-					case '\0':
-						pDst[iDst++] = '0';
-						break;
-					case '\a':
-						pDst[iDst++] = 'a';
-						break;
-					case '\b':
-						pDst[iDst++] = 'b';
-						break;
-					case '\e':
-						pDst[iDst++] = 'e';
-						break;
-					case '\f':
-						pDst[iDst++] = 'f';
-						break;
-					case '\n':
-						pDst[iDst++] = 'n';
-						break;
-					case '\r':
-						pDst[iDst++] = 'r';
-						break;
-					case '\t':
-						pDst[iDst++] = 't';
-						break;
-					case '\v':
-						pDst[iDst++] = 'v';
-						break;
-					default:
-						pDst[iDst++] = 'x';
-
-						pc = pszMsg[iSrc];
-						pDst[iDst++] = hexdigit[(pc & 0xF0) >> 4];
-						pDst[iDst++] = hexdigit[pc & 0xF];
-
-						break;
-					}
-
-				} else {
-					pDst[iDst++] = glbl.GetParserControlCharacterEscapePrefix();
-					pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0300) >> 6);
-					pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0070) >> 3);
-					pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0007));
-				}
-			}
-
-		} else if(pszMsg[iSrc] > 127 && glbl.GetParserEscape8BitCharactersOnReceive()) {
-			if (glbl.GetParserEscapeControlCharactersCStyle()) {
-				pDst[iDst++] = '\\';
-				pDst[iDst++] = 'x';
-
-				pc = pszMsg[iSrc];
-				pDst[iDst++] = hexdigit[(pc & 0xF0) >> 4];
-				pDst[iDst++] = hexdigit[pc & 0xF];
-
-			} else {
-				/* In this case, we also do the conversion. Note that this most
-				 * probably breaks European languages. -- rgerhards, 2010-01-27
-				 */
-				pDst[iDst++] = glbl.GetParserControlCharacterEscapePrefix();
-				pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0300) >> 6);
-				pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0070) >> 3);
-				pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0007));
-			}
-		} else {
-			pDst[iDst++] = pszMsg[iSrc];
-		}
-		++iSrc;
-	}
-	pDst[iDst] = '\0';
+	iDst = sanitizeEscape(pszMsg, lenMsg, iFirstDirty, pDst, maxDest, &opts);
 
 	MsgSetRawMsg(pMsg, (char*)pDst, iDst); /* save sanitized string */
 
@@ -603,20 +510,12 @@ ParsePRI(smsg_t *pMsg)
 }
 
 
-/* Parse a received message. The object's rawmsg property is taken and
- * parsed according to the relevant standards. This can later be
- * extended to support configured parsers.
- * rgerhards, 2008-10-09
+/* prepare a message for the parsers: reject empty messages and
+ * uncompress it, if needed. Shared by ParseMsg() and ParseBatch().
  */
 static rsRetVal
-ParseMsg(smsg_t *pMsg)
+prepareMsgForParsing(smsg_t *const pMsg)
 {
-	rsRetVal localRet = RS_RET_ERR;
-	parserList_t *pParserList;
-	parser_t *pParser;
-	sbool bIsSanitized;
-	sbool bPRIisParsed;
-	static int iErrMsgRateLimiter = 0;
 	DEFiRet;
 
 	if(pMsg->iLenRawMsg == 0)
@@ -631,15 +530,77 @@ ParseMsg(smsg_t *pMsg)
 		  (pMsg->msgFlags & NEEDS_DNSRESOL) ? UCHAR_CONSTANT("~NOTRESOLVED~") : getRcvFrom(pMsg),
 		  pMsg->pszRawMsg);
 
+finalize_it:
+	RETiRet;
+}
+
+
+/* obtain the parser list to use for a message */
+static parserList_t *
+getParserList(smsg_t *const pMsg)
+{
+	parserList_t *const pParserList = ruleset.GetParserList(ourConf, pMsg);
+	return (pParserList == NULL) ? pDfltParsLst : pParserList;
+}
+
+
+/* call a parser's regular (single message) entry point */
+static rsRetVal
+callParser(parser_t *const pParser, smsg_t *const pMsg)
+{
+	rsRetVal localRet;
+
+	if(pParser->pModule->mod.pm.parse2 == NULL)
+		localRet = pParser->pModule->mod.pm.parse(pMsg);
+	else
+		localRet = pParser->pModule->mod.pm.parse2(pParser->pInst, pMsg);
+	DBGPRINTF("Parser '%s' returned %d\n", pParser->pName, localRet);
+	return localRet;
+}
+
+
+/* We need to log a warning message and drop the message if we did not find a parser.
+ * Note that we log at most the first 1000 message, as this may very well be a problem
+ * that causes a message generation loop. We do not synchronize that counter, it doesn't
+ * matter if we log a handful messages more than we should...
+ */
+static void
+reportNoParser(smsg_t *const pMsg, const rsRetVal localRet)
+{
+	static int iErrMsgRateLimiter = 0;
+
+	if(++iErrMsgRateLimiter > 1000) {
+		errmsg.LogError(0, localRet, "Error: one message could not be processed by "
+			"any parser, message is being discarded (start of raw msg: '%.50s')", 
+			pMsg->pszRawMsg);
+	}
+	DBGPRINTF("No parser could process the message (state %d), we need to discard it.\n", localRet);
+}
+
+
+/* Parse a received message. The object's rawmsg property is taken and
+ * parsed according to the relevant standards. This can later be
+ * extended to support configured parsers.
+ * rgerhards, 2008-10-09
+ */
+static rsRetVal
+ParseMsg(smsg_t *pMsg)
+{
+	rsRetVal localRet = RS_RET_ERR;
+	parserList_t *pParserList;
+	parser_t *pParser;
+	sbool bIsSanitized;
+	sbool bPRIisParsed;
+	DEFiRet;
+
+	CHKiRet(prepareMsgForParsing(pMsg));
+
 	/* we now need to go through our list of parsers and see which one is capable of
 	 * parsing the message. Note that the first parser that requires message sanitization
 	 * will cause it to happen. After that, access to the unsanitized message is no
 	 * loger possible.
 	 */
-	pParserList = ruleset.GetParserList(ourConf, pMsg);
-	if(pParserList == NULL) {
-		pParserList = pDfltParsLst;
-	}
+	pParserList = getParserList(pMsg);
 	DBGPRINTF("parse using parser list %p%s.\n", pParserList,
 		  (pParserList == pDfltParsLst) ? " (the default list)" : "");
 
@@ -655,28 +616,14 @@ ParseMsg(smsg_t *pMsg)
 			}
 			bIsSanitized = RSTRUE;
 		}
-		if(pParser->pModule->mod.pm.parse2 == NULL)
-			localRet = pParser->pModule->mod.pm.parse(pMsg);
-		else
-			localRet = pParser->pModule->mod.pm.parse2(pParser->pInst, pMsg);
-		DBGPRINTF("Parser '%s' returned %d\n", pParser->pName, localRet);
+		localRet = callParser(pParser, pMsg);
 		if(localRet != RS_RET_COULD_NOT_PARSE)
 			break;
 		pParserList = pParserList->pNext;
 	}
 
-	/* We need to log a warning message and drop the message if we did not find a parser.
-	 * Note that we log at most the first 1000 message, as this may very well be a problem
-	 * that causes a message generation loop. We do not synchronize that counter, it doesn't
-	 * matter if we log a handful messages more than we should...
-	 */
 	if(localRet != RS_RET_OK) {
-		if(++iErrMsgRateLimiter > 1000) {
-			errmsg.LogError(0, localRet, "Error: one message could not be processed by "
-			 	"any parser, message is being discarded (start of raw msg: '%.50s')", 
-				pMsg->pszRawMsg);
-		}
-		DBGPRINTF("No parser could process the message (state %d), we need to discard it.\n", localRet);
+		reportNoParser(pMsg, localRet);
 		ABORT_FINALIZE(localRet);
 	}
 
@@ -686,6 +633,131 @@ ParseMsg(smsg_t *pMsg)
 finalize_it:
 	RETiRet;
 }
+
+
+/* Parse all messages of a batch that still need parsing. This does the
+ * same as calling ParseMsg() for each message, but runs of consecutive
+ * messages which use the same parser list are processed together: each
+ * parser of the list is called once for all messages of the run it has
+ * not yet parsed. Parsers that provide the parseBatch() entry point
+ * receive them in a single call, for all others we call the regular entry
+ * point in a tight loop. Messages that cannot be parsed are flagged as
+ * discarded inside the batch.
+ */
+static rsRetVal
+ParseBatch(batch_t *const pBatch, int *const pbShutdownImmediate)
+{
+	smsg_t **ppMsg;
+	int *pIdx;
+	rsRetVal *pRet;
+	parserList_t *pParserList;
+	parserList_t *pRunList;
+	parser_t *pParser;
+	smsg_t *pMsg;
+	sbool bIsSanitized;
+	int nPending;
+	int nStillPending;
+	int i, j;
+	DEFiRet;
+
+	ppMsg = malloc(pBatch->nElem * sizeof(smsg_t*));
+	pIdx = malloc(pBatch->nElem * sizeof(int));
+	pRet = malloc(pBatch->nElem * sizeof(rsRetVal));
+	if(ppMsg == NULL || pIdx == NULL || pRet == NULL) {
+		/* out of memory, fall back to parsing one message at a time */
+		for(i = 0 ; i < pBatch->nElem && !*pbShutdownImmediate ; ++i) {
+			pMsg = pBatch->pElem[i].pMsg;
+			if(pBatch->eltState[i] != BATCH_STATE_DISC && (pMsg->msgFlags & NEEDS_PARSING)
+			   && ParseMsg(pMsg) != RS_RET_OK)
+				pBatch->eltState[i] = BATCH_STATE_DISC;
+		}
+		FINALIZE;
+	}
+
+	i = 0;
+	while(i < pBatch->nElem && !*pbShutdownImmediate) {
+		/* collect the next run of messages sharing the same parser list */
+		nPending = 0;
+		pRunList = NULL;
+		for( ; i < pBatch->nElem ; ++i) {
+			pMsg = pBatch->pElem[i].pMsg;
+			if(pBatch->eltState[i] == BATCH_STATE_DISC || !(pMsg->msgFlags & NEEDS_PARSING))
+				continue;
+			pParserList = getParserList(pMsg);
+			if(nPending > 0 && pParserList != pRunList)
+				break; /* this message starts the next run */
+			if(prepareMsgForParsing(pMsg) != RS_RET_OK) {
+				DBGPRINTF("Message discarded, could not be prepared for parsing\n");
+				pBatch->eltState[i] = BATCH_STATE_DISC;
+				continue;
+			}
+			pRunList = pParserList;
+			ppMsg[nPending] = pMsg;
+			pIdx[nPending] = i;
+			++nPending;
+		}
+		DBGPRINTF("parse batch run of %d messages using parser list %p%s.\n", nPending,
+			  pRunList, (pRunList == pDfltParsLst) ? " (the default list)" : "");
+
+		bIsSanitized = RSFALSE;
+		for(pParserList = pRunList ; pParserList != NULL && nPending > 0 ;
+		    pParserList = pParserList->pNext) {
+			pParser = pParserList->pParser;
+			if(pParser->bDoSanitazion && bIsSanitized == RSFALSE) {
+				nStillPending = 0;
+				for(j = 0 ; j < nPending ; ++j) {
+					pRet[j] = SanitizeMsg(ppMsg[j]);
+					if(pRet[j] == RS_RET_OK && pParser->bDoPRIParsing)
+						pRet[j] = ParsePRI(ppMsg[j]);
+					if(pRet[j] == RS_RET_OK) {
+						ppMsg[nStillPending] = ppMsg[j];
+						pIdx[nStillPending] = pIdx[j];
+						++nStillPending;
+					} else {
+						pBatch->eltState[pIdx[j]] = BATCH_STATE_DISC;
+					}
+				}
+				nPending = nStillPending;
+				bIsSanitized = RSTRUE;
+			}
+
+			if(pParser->pModule->mod.pm.parseBatch != NULL) {
+				pParser->pModule->mod.pm.parseBatch(pParser->pInst, ppMsg, pRet, nPending);
+			} else {
+				for(j = 0 ; j < nPending ; ++j)
+					pRet[j] = callParser(pParser, ppMsg[j]);
+			}
+
+			/* keep only those messages the parser could not handle */
+			nStillPending = 0;
+			for(j = 0 ; j < nPending ; ++j) {
+				if(pRet[j] == RS_RET_COULD_NOT_PARSE) {
+					ppMsg[nStillPending] = ppMsg[j];
+					pIdx[nStillPending] = pIdx[j];
+					++nStillPending;
+				} else if(pRet[j] == RS_RET_OK) {
+					ppMsg[j]->msgFlags &= ~NEEDS_PARSING; /* this message is now parsed */
+				} else {
+					reportNoParser(ppMsg[j], pRet[j]);
+					pBatch->eltState[pIdx[j]] = BATCH_STATE_DISC;
+				}
+			}
+			nPending = nStillPending;
+		}
+
+		/* whatever is left could not be parsed by any of the parsers */
+		for(j = 0 ; j < nPending ; ++j) {
+			reportNoParser(ppMsg[j], RS_RET_COULD_NOT_PARSE);
+			pBatch->eltState[pIdx[j]] = BATCH_STATE_DISC;
+		}
+	}
+
+finalize_it:
+	free(ppMsg);
+	free(pIdx);
+	free(pRet);
+	RETiRet;
+}
 /* queryInterface function-- rgerhards, 2009-11-03
  */
 BEGINobjQueryInterface(parser)
@@ -706,6 +778,7 @@ CODESTARTobjQueryInterface(parser)
 	pIf->SetModPtr = SetModPtr;
 	pIf->SetDoPRIParsing = SetDoPRIParsing;
 	pIf->ParseMsg = ParseMsg;
+	pIf->ParseBatch = ParseBatch;
 	pIf->SanitizeMsg = SanitizeMsg;
 	pIf->InitParserList = InitParserList;
 	pIf->DestructParserList = DestructParserList;
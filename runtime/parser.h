@@ -56,12 +56,14 @@ BEGINinterface(parser) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*AddParserToList)(parserList_t **pListRoot, parser_t *pParser);
 	/* static functions */
 	rsRetVal (*ParseMsg)(smsg_t *pMsg);
+	rsRetVal (*ParseBatch)(batch_t *pBatch, int *pbShutdownImmediate);
 	rsRetVal (*SanitizeMsg)(smsg_t *pMsg);
 	rsRetVal (*AddDfltParser)(uchar *);
 ENDinterface(parser)
-#define parserCURR_IF_VERSION 2 /* increment whenever you change the interface above! */
+#define parserCURR_IF_VERSION 3 /* increment whenever you change the interface above! */
 /* version changes 
    2       SetDoSanitization removed, no longer needed
+   3       ParseBatch added
 */
 
 void printParserList(parserList_t *pList);
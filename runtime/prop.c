@@ -35,16 +35,32 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "rsyslog.h"
 #include "obj.h"
 #include "obj-types.h"
 #include "unicode-helper.h"
 #include "atomic.h"
+#include "hashmap.h"
 #include "prop.h"
 
+/* The interning table maps strings to shared props. It is split into
+ * shards with their own lock to keep contention low. The table does not
+ * hold a reference: the prop removes itself when the last reference is
+ * dropped. To make this safe against concurrent lookups, refcount changes
+ * that involve zero are only done with the shard locked.
+ */
+#define PROP_INTERN_NSHARDS 16	/* must be a power of 2 */
+#define PROP_INTERN_MAXLEN 255	/* longer strings are not interned (hostnames are max 255) */
+struct internShard_s {
+	pthread_mutex_t mut;
+	hashmap_t *map;
+};
+
 /* static data */
 DEFobjStaticHelpers
+static struct internShard_s internTab[PROP_INTERN_NSHARDS];
 
 //extern uchar *propGetSzStr(prop_t *pThis); /* expand inline function here */
 
@@ -56,11 +72,52 @@ BEGINobjConstruct(prop) /* be sure to specify the object type also in END macro!
 ENDobjConstruct(prop)
 
 
+static inline struct internShard_s *
+getInternShard(const uchar *psz)
+{
+	unsigned h = 5381;
+	while(*psz)
+		h = h * 33 + *psz++;
+	return &internTab[(h * 2654435761u) >> 28 & (PROP_INTERN_NSHARDS - 1)];
+}
+
+
+/* drop a reference to an interned prop. Returns the remaining refcount;
+ * if it is 0, the prop has been removed from the interning table and must
+ * be destructed.
+ */
+static int
+internRelease(prop_t *pThis)
+{
+	struct internShard_s *shard;
+	int currRefCount;
+
+	/* fast path: we are not the last one, so no lookup can race with us */
+	currRefCount = ATOMIC_FETCH_32BIT(&pThis->iRefCount, &pThis->mutRefCount);
+	while(currRefCount > 1) {
+		if(ATOMIC_CAS(&pThis->iRefCount, currRefCount, currRefCount - 1, &pThis->mutRefCount))
+			return currRefCount - 1;
+		currRefCount = ATOMIC_FETCH_32BIT(&pThis->iRefCount, &pThis->mutRefCount);
+	}
+
+	shard = getInternShard(propGetSzStr(pThis));
+	pthread_mutex_lock(&shard->mut);
+	currRefCount = ATOMIC_DEC_AND_FETCH(&pThis->iRefCount, &pThis->mutRefCount);
+	if(currRefCount == 0)
+		hashmapRemove(shard->map, propGetSzStr(pThis));
+	pthread_mutex_unlock(&shard->mut);
+	return currRefCount;
+}
+
+
 /* destructor for the prop object */
 BEGINobjDestruct(prop) /* be sure to specify the object type also in END and CODESTART macros! */
 	int currRefCount;
 CODESTARTobjDestruct(prop)
-	currRefCount = ATOMIC_DEC_AND_FETCH(&pThis->iRefCount, &pThis->mutRefCount);
+	if(pThis->bInterned)
+		currRefCount = internRelease(pThis);
+	else
+		currRefCount = ATOMIC_DEC_AND_FETCH(&pThis->iRefCount, &pThis->mutRefCount);
 	if(currRefCount == 0) {
 		/* (only) in this case we need to actually destruct the object */
 		if(pThis->len >= CONF_PROP_BUFSIZE)
@@ -161,6 +218,46 @@ finalize_it:
 	RETiRet;
 }
 
+/* create a string property via the interning table: if a prop with the
+ * same string exists, a new reference to it is returned, else a new prop
+ * is created and added to the table. Strings that cannot be used as key
+ * (too long or with embedded NUL) result in a regular, private prop.
+ */
+static rsRetVal CreateInternedStringProp(prop_t **ppThis, const uchar *psz, const int len)
+{
+	struct internShard_s *shard = NULL;
+	prop_t *pThis = NULL;
+	uchar *key;
+	DEFiRet;
+
+	if(len > PROP_INTERN_MAXLEN || ustrlen(psz) != (size_t) len) {
+		CHKiRet(CreateStringProp(ppThis, psz, len));
+		FINALIZE;
+	}
+
+	shard = getInternShard(psz);
+	pthread_mutex_lock(&shard->mut);
+	pThis = hashmapSearch(shard->map, (void*) psz);
+	if(pThis != NULL) {
+		AddRef(pThis);
+	} else {
+		CHKiRet(CreateStringProp(&pThis, psz, len));
+		/* if we cannot add it to the table, we still have a usable prop */
+		if((key = ustrdup(psz)) != NULL) {
+			if(hashmapInsert(shard->map, key, pThis))
+				pThis->bInterned = 1;
+			else
+				free(key);
+		}
+	}
+	*ppThis = pThis;
+
+finalize_it:
+	if(shard != NULL)
+		pthread_mutex_unlock(&shard->mut);
+	RETiRet;
+}
+
 /* another one-stop function, quite useful: it takes a property pointer and
  * a string. If the string is already contained in the property, nothing happens.
  * If the string is different (or the pointer NULL), the current property
@@ -170,6 +267,8 @@ finalize_it:
  * which case we save us all the creation overhead by just reusing the already
  * existing property).
  * rgerhards, 2009-07-01
+ * New props are now interned, so equal names received on different
+ * sessions share the same object.
  */
 static rsRetVal CreateOrReuseStringProp(prop_t **ppThis, const uchar *psz, const int len)
 {
@@ -180,14 +279,14 @@ static rsRetVal CreateOrReuseStringProp(prop_t **ppThis, const uchar *psz, const
 
 	if(*ppThis == NULL) {
 		/* we need to create a property */ 
-		CHKiRet(CreateStringProp(ppThis, psz, len));
+		CHKiRet(CreateInternedStringProp(ppThis, psz, len));
 	} else {
 		/* already exists, check if we can re-use it */
 		GetString(*ppThis, &pszPrev, &lenPrev);
 		if(len != lenPrev || ustrcmp(psz, pszPrev)) {
 			/* different, need to discard old & create new one */
 			propDestruct(ppThis);
-			CHKiRet(CreateStringProp(ppThis, psz, len));
+			CHKiRet(CreateInternedStringProp(ppThis, psz, len));
 		} /* else we can re-use the existing one! */
 	}
 
@@ -203,6 +302,36 @@ CODESTARTobjDebugPrint(prop)
 ENDobjDebugPrint(prop)
 
 
+static rsRetVal
+internTabInit(void)
+{
+	int i;
+	DEFiRet;
+
+	for(i = 0 ; i < PROP_INTERN_NSHARDS ; ++i) {
+		pthread_mutex_init(&internTab[i].mut, NULL);
+		CHKmalloc(internTab[i].map = hashmapNewStr(64, NULL));
+	}
+finalize_it:
+	RETiRet;
+}
+
+static void
+internTabExit(void)
+{
+	int i;
+
+	/* if interned props are still alive, they need their shard on release */
+	for(i = 0 ; i < PROP_INTERN_NSHARDS ; ++i) {
+		if(internTab[i].map != NULL && hashmapCount(internTab[i].map) == 0) {
+			hashmapDestroy(internTab[i].map, 0);
+			internTab[i].map = NULL;
+			pthread_mutex_destroy(&internTab[i].mut);
+		}
+	}
+}
+
+
 /* queryInterface function
  * rgerhards, 2008-02-21
  */
@@ -227,6 +356,7 @@ CODESTARTobjQueryInterface(prop)
 	pIf->AddRef = AddRef;
 	pIf->CreateStringProp = CreateStringProp;
 	pIf->CreateOrReuseStringProp = CreateOrReuseStringProp;
+	pIf->CreateInternedStringProp = CreateInternedStringProp;
 
 finalize_it:
 ENDobjQueryInterface(prop)
@@ -236,7 +366,9 @@ ENDobjQueryInterface(prop)
  * rgerhards, 2009-04-06
  */
 BEGINObjClassExit(prop, OBJ_IS_CORE_MODULE) /* class, version */
+CODESTARTObjClassExit(prop)
 //	objRelease(errmsg, CORE_COMPONENT);
+	internTabExit();
 ENDObjClassExit(prop)
 
 
@@ -245,6 +377,7 @@ ENDObjClassExit(prop)
  * rgerhards, 2008-02-19
  */
 BEGINObjClassInit(prop, 1, OBJ_IS_CORE_MODULE) /* class, version */
+	CHKiRet(internTabInit());
 	/* request objects we use */
 //	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 
@@ -33,6 +33,7 @@ struct prop_s {
 		uchar sz[CONF_PROP_BUFSIZE];
 	} szVal;
 	int len;		/* we use int intentionally, otherwise we may get some troubles... */
+	sbool bInterned;	/* prop is in the interning table (and thus shared) */
 	DEF_ATOMIC_HELPER_MUT(mutRefCount)
 };
 
@@ -48,8 +49,13 @@ BEGINinterface(prop) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*AddRef)(prop_t *pThis);
 	rsRetVal (*CreateStringProp)(prop_t **ppThis, const uchar* psz, const int len);
 	rsRetVal (*CreateOrReuseStringProp)(prop_t **ppThis, const uchar *psz, const int len);
+	/* v2 */
+	rsRetVal (*CreateInternedStringProp)(prop_t **ppThis, const uchar *psz, const int len);
 ENDinterface(prop)
-#define propCURR_IF_VERSION 1 /* increment whenever you change the interface structure! */
+#define propCURR_IF_VERSION 2 /* increment whenever you change the interface structure! */
+/* interface changes:
+ * v2 - added CreateInternedStringProp()
+ */
 
 
 /* get classic c-style string */
@@ -67,6 +73,17 @@ propGetSzStr(prop_t *pThis)
 	return(pThis->len < CONF_PROP_BUFSIZE) ? pThis->szVal.sz : pThis->szVal.psz;
 }
 
+/* Interned props are shared process-wide: for the same string, the same
+ * object is returned (as long as someone holds a reference). So if two
+ * interned props are the same pointer, their strings are equal. Note that
+ * the reverse does not hold, as not all props are interned.
+ */
+static inline int __attribute__((unused))
+propIsInterned(prop_t *pThis)
+{
+	return pThis->bInterned;
+}
+
 /* prototypes */
 PROTOTYPEObj(prop);
 
@@ -100,6 +100,13 @@ static rsRetVal qConstructDirect(qqueue_t __attribute__((unused)) *pThis);
 static rsRetVal qDestructDisk(qqueue_t *pThis);
 rsRetVal qqueueSetSpoolDir(qqueue_t *pThis, uchar *pszSpoolDir, int lenSpoolDir);
 
+/* home shard assignment for sharded queues: each enqueuing thread gets a
+ * fixed index on first use, handed out round-robin.
+ */
+static pthread_key_t thrd_shard_key;
+static unsigned nextHomeShard = 0;
+DEF_ATOMIC_HELPER_MUT(mutNextHomeShard)
+
 /* some constants for queuePersist () */
 #define QUEUE_CHECKPOINT	1
 #define QUEUE_NO_CHECKPOINT	0
@@ -132,7 +139,20 @@ static struct cnfparamdescr cnfpdescr[] = {
 	{ "queue.dequeuetimebegin", eCmdHdlrInt, 0 },
 	{ "queue.dequeuetimeend", eCmdHdlrInt, 0 },
 	{ "queue.cry.provider", eCmdHdlrGetWord, 0 },
-	{ "queue.samplinginterval", eCmdHdlrInt, 0 }
+	{ "queue.samplinginterval", eCmdHdlrInt, 0 },
+	{ "queue.partitions", eCmdHdlrPositiveInt, 0 },
+	{ "queue.partitionkey", eCmdHdlrGetWord, 0 },
+	{ "queue.shards", eCmdHdlrPositiveInt, 0 },
+	{ "queue.workerscaling", eCmdHdlrGetWord, 0 },
+	{ "queue.targetlatency", eCmdHdlrPositiveInt, 0 },
+	{ "queue.batchsizing", eCmdHdlrGetWord, 0 },
+	{ "queue.mindequeuebatchsize", eCmdHdlrPositiveInt, 0 },
+	{ "queue.batchmaxlatency", eCmdHdlrPositiveInt, 0 },
+	{ "queue.groupcommit", eCmdHdlrBinary, 0 },
+	{ "queue.groupcommitdelay", eCmdHdlrNonNegInt, 0 },
+	{ "queue.readahead", eCmdHdlrBinary, 0 },
+	{ "queue.readaheadsize", eCmdHdlrPositiveInt, 0 },
+	{ "queue.journalfile", eCmdHdlrGetWord, 0 }
 };
 static struct cnfparamblk pblk =
 	{ CNFPARAMBLK_VERSION,
@@ -296,6 +316,21 @@ qqueueDbgPrint(qqueue_t *pThis)
 	dbgoprint((obj_t*) pThis, "queue.dequeueslowdown: %d\n", pThis->iDeqSlowdown);
 	dbgoprint((obj_t*) pThis, "queue.dequeuetimebegin: %d\n", pThis->iDeqtWinFromHr);
 	dbgoprint((obj_t*) pThis, "queue.dequeuetimeend: %d\n", pThis->iDeqtWinToHr);
+	dbgoprint((obj_t*) pThis, "queue.partitions: %d\n", pThis->iNumPartitions);
+	dbgoprint((obj_t*) pThis, "queue.partitionkey: %s\n",
+		(pThis->pszPartitionKey == NULL) ? "[NONE]" : (char*)pThis->pszPartitionKey);
+	dbgoprint((obj_t*) pThis, "queue.shards: %d\n", pThis->iNumShards);
+	dbgoprint((obj_t*) pThis, "queue.workerscaling: %s\n", pThis->bAdaptiveWrkrs ? "adaptive" : "size");
+	dbgoprint((obj_t*) pThis, "queue.targetlatency: %d\n", pThis->iTargetLatency);
+	dbgoprint((obj_t*) pThis, "queue.batchsizing: %s\n", pThis->bAdaptiveBatch ? "adaptive" : "static");
+	dbgoprint((obj_t*) pThis, "queue.mindequeuebatchsize: %d\n", pThis->iDeqBatchSizeMin);
+	dbgoprint((obj_t*) pThis, "queue.batchmaxlatency: %d\n", pThis->iBatchMaxLatency);
+	dbgoprint((obj_t*) pThis, "queue.groupcommit: %d\n", pThis->bGroupCommit);
+	dbgoprint((obj_t*) pThis, "queue.groupcommitdelay: %d\n", pThis->iGroupCommitDelay);
+	dbgoprint((obj_t*) pThis, "queue.readahead: %d\n", pThis->bReadAhead);
+	dbgoprint((obj_t*) pThis, "queue.readaheadsize: %d\n", pThis->iReadAheadSize);
+	dbgoprint((obj_t*) pThis, "queue.journalfile: '%s'\n",
+		(pThis->pszJrnlPrefix == NULL) ? "[NONE]" : (char*)pThis->pszJrnlPrefix);
 }
 
 
@@ -321,6 +356,51 @@ getLogicalQueueSize(qqueue_t *pThis)
 }
 
 
+/* for sharded queues, the root queue keeps the size of the whole shard set
+ * (iShardSetSize). This is updated along with each shard's own iQueueSize.
+ */
+static inline int
+qqueueIsSharded(qqueue_t *const pThis)
+{
+	return pThis->iNumShards > 1 || pThis->pShardRoot != NULL;
+}
+
+static inline void
+shardSetSizeInc(qqueue_t *const pThis)
+{
+	qqueue_t *const pRoot = (pThis->pShardRoot == NULL) ? pThis : pThis->pShardRoot;
+
+	if(qqueueIsSharded(pThis))
+		ATOMIC_INC(&pRoot->iShardSetSize, &pRoot->mutShardSetSize);
+}
+
+static inline void
+shardSetSizeSub(qqueue_t *const pThis, const int n)
+{
+	qqueue_t *const pRoot = (pThis->pShardRoot == NULL) ? pThis : pThis->pShardRoot;
+
+	if(qqueueIsSharded(pThis))
+		ATOMIC_SUB(&pRoot->iShardSetSize, n, &pRoot->mutShardSetSize);
+}
+
+
+/* the queue size the flow control and discard marks are checked against.
+ * The marks of a shard are its share of the configured marks, so we use
+ * its share of the shard set size. That way, a backlog in one shard does
+ * not throttle its inputs while the siblings (which steal from it) have
+ * room, and the configured marks apply to the queue as a whole.
+ */
+static inline int
+getMarkQueueSize(qqueue_t *const pThis)
+{
+	qqueue_t *const pRoot = (pThis->pShardRoot == NULL) ? pThis : pThis->pShardRoot;
+
+	if(!qqueueIsSharded(pThis) || pThis->ppShards == NULL)
+		return pThis->iQueueSize;
+	return pRoot->iShardSetSize / pRoot->iNumShards;
+}
+
+
 
 /* This function drains the queue in cases where this needs to be done. The most probable
  * reason is a HUP which needs to discard data (because the queue is configured to be lossy).
@@ -334,13 +414,15 @@ getLogicalQueueSize(qqueue_t *pThis)
 static void queueDrain(qqueue_t *pThis)
 {
 	smsg_t *pMsg;
+	uint64_t tEnqNs;
 	ASSERT(pThis != NULL);
 
 	BEGINfunc
 	DBGOPRINT((obj_t*) pThis, "queue (type %d) will lose %d messages, destroying...\n", pThis->qType, pThis->iQueueSize);
 	/* iQueueSize is not decremented by qDel(), so we need to do it ourselves */
 	while(ATOMIC_DEC_AND_FETCH(&pThis->iQueueSize, &pThis->mutQueueSize) > 0) {
-		pThis->qDeq(pThis, &pMsg);
+		shardSetSizeSub(pThis, 1);
+		pThis->qDeq(pThis, &pMsg, &tEnqNs);
 		if(pMsg != NULL) {
 			msgDestruct(&pMsg);
 		}
@@ -353,6 +435,99 @@ static void queueDrain(qqueue_t *pThis)
 /* --------------- code for disk-assisted (DA) queue modes -------------------- */
 
 
+/* adaptive worker scaling: control window length and the number of
+ * consecutive windows that must ask for fewer workers before we scale down.
+ */
+#define WRKR_CTL_INTERVAL_NS	(100 * 1000000ull)
+#define WRKR_CTL_DOWN_VOTES	5
+
+/* run the adaptive worker controller, at most once per control window.
+ * The worker target is the larger of
+ *  - the workers needed to keep up with the incoming rate at the measured
+ *    per-message service time (plus 25% headroom), and
+ *  - if the backlog is older than queue.targetlatency, the workers needed
+ *    to drain it within that latency.
+ * Scale up is immediate, scale down happens one worker at a time and only
+ * after WRKR_CTL_DOWN_VOTES consecutive windows asked for it.
+ * Must be called with the queue mutex locked.
+ */
+static void
+qqueueAdaptWorkers(qqueue_t *const pThis)
+{
+	const uint64_t tNow = statsHistNowNs();
+	const uint64_t dt = tNow - pThis->tCtlLast;
+	const int iQueueSize = getLogicalQueueSize(pThis);
+	const uint64_t targetNs = (uint64_t) pThis->iTargetLatency * 1000000;
+	uint64_t rate;
+	uint64_t need;
+	int desired;
+
+	if(dt < WRKR_CTL_INTERVAL_NS)
+		return;
+
+	if(pThis->tCtlLast == 0) {
+		/* first call, just open the first window */
+		pThis->tCtlLast = tNow;
+		return;
+	}
+
+	rate = (uint64_t) pThis->nCtlEnq * 1000000000ull / dt;
+	pThis->enqRate = (3 * pThis->enqRate + rate) / 4;
+	rate = (uint64_t) pThis->nCtlDeq * 1000000000ull / dt;
+	pThis->deqRate = (3 * pThis->deqRate + rate) / 4;
+	if(pThis->nCtlSvcMsgs > 0) {
+		const uint64_t svc = pThis->nCtlSvcNs / pThis->nCtlSvcMsgs;
+		pThis->svcNsPerMsg = (pThis->svcNsPerMsg == 0) ? svc : (3 * pThis->svcNsPerMsg + svc) / 4;
+	}
+
+	/* utilization: workers busy at the rate we need to sustain */
+	rate = (pThis->enqRate > pThis->deqRate) ? pThis->enqRate : pThis->deqRate;
+	need = (rate * pThis->svcNsPerMsg * 5 / 4 + 999999999ull) / 1000000000ull;
+
+	/* backlog age: estimated from queue size and drain rate */
+	if(iQueueSize > 0 && targetNs > 0) {
+		if(pThis->deqRate == 0 || (uint64_t) iQueueSize * 1000000000ull / pThis->deqRate > targetNs) {
+			const uint64_t drain = ((uint64_t) iQueueSize * pThis->svcNsPerMsg + targetNs - 1) / targetNs;
+			if(pThis->svcNsPerMsg == 0) {
+				/* nothing measured yet, so we can only add one worker */
+				if(need < (uint64_t) pThis->iWrkrTarget + 1)
+					need = pThis->iWrkrTarget + 1;
+			} else if(drain > need) {
+				need = drain;
+			}
+		}
+	}
+
+	desired = (need > (uint64_t) pThis->iNumWorkerThreads) ? pThis->iNumWorkerThreads : (int) need;
+	if(desired < 1)
+		desired = 1;
+
+	if(desired > pThis->iWrkrTarget) {
+		DBGOPRINT((obj_t*) pThis, "adaptive workers: scale up %d -> %d (enq %llu/s, deq %llu/s, "
+			"svc %llu ns/msg, size %d)\n", pThis->iWrkrTarget, desired,
+			(unsigned long long) pThis->enqRate, (unsigned long long) pThis->deqRate,
+			(unsigned long long) pThis->svcNsPerMsg, iQueueSize);
+		pThis->iWrkrTarget = desired;
+		pThis->nScaleDownVotes = 0;
+		STATSCOUNTER_INC(pThis->ctrScaleUp, pThis->mutCtrScaleUp);
+	} else if(desired < pThis->iWrkrTarget) {
+		if(++pThis->nScaleDownVotes >= WRKR_CTL_DOWN_VOTES) {
+			DBGOPRINT((obj_t*) pThis, "adaptive workers: scale down %d -> %d\n",
+				pThis->iWrkrTarget, pThis->iWrkrTarget - 1);
+			--pThis->iWrkrTarget;
+			pThis->nScaleDownVotes = 0;
+			STATSCOUNTER_INC(pThis->ctrScaleDown, pThis->mutCtrScaleDown);
+		}
+	} else {
+		pThis->nScaleDownVotes = 0;
+	}
+
+	pThis->nCtlEnq = pThis->nCtlDeq = pThis->nCtlSvcMsgs = 0;
+	pThis->nCtlSvcNs = 0;
+	pThis->tCtlLast = tNow;
+}
+
+
 /* returns the number of workers that should be advised at
  * this point in time. The mutex must be locked when
  * ths function is called. -- rgerhards, 2008-01-25
@@ -372,8 +547,11 @@ qqueueAdviseMaxWorkers(qqueue_t *pThis)
 		}
 		if(getLogicalQueueSize(pThis) == 0) {
 			iMaxWorkers = 0;
-		} else if(pThis->qType == QUEUETYPE_DISK || pThis->iMinMsgsPerWrkr == 0) {
+		} else if((pThis->qType == QUEUETYPE_DISK && !pThis->bReadAhead) || pThis->iMinMsgsPerWrkr == 0) {
 			iMaxWorkers = 1;
+		} else if(pThis->bAdaptiveWrkrs) {
+			qqueueAdaptWorkers(pThis);
+			iMaxWorkers = pThis->iWrkrTarget;
 		} else {
 			iMaxWorkers = getLogicalQueueSize(pThis) / pThis->iMinMsgsPerWrkr + 1;
 		}
@@ -439,6 +617,8 @@ StartDA(qqueue_t *pThis)
 	CHKiRet(qqueueSetSpoolDir(pThis->pqDA, pThis->pszSpoolDir, pThis->lenSpoolDir));
 	CHKiRet(qqueueSetiPersistUpdCnt(pThis->pqDA, pThis->iPersistUpdCnt));
 	CHKiRet(qqueueSetbSyncQueueFiles(pThis->pqDA, pThis->bSyncQueueFiles));
+	pThis->pqDA->bGroupCommit = pThis->bGroupCommit;
+	pThis->pqDA->iGroupCommitDelay = pThis->iGroupCommitDelay;
 	CHKiRet(qqueueSettoActShutdown(pThis->pqDA, pThis->toActShutdown));
 	CHKiRet(qqueueSettoEnq(pThis->pqDA, pThis->toEnq));
 	CHKiRet(qqueueSetiDeqtWinFromHr(pThis->pqDA, pThis->iDeqtWinFromHr));
@@ -541,6 +721,9 @@ static rsRetVal qConstructFixedArray(qqueue_t *pThis)
 	if((pThis->tVars.farray.pBuf = MALLOC(sizeof(void *) * pThis->iMaxQueueSize)) == NULL) {
 		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
 	}
+	if(glblLatencyStats) {
+		CHKmalloc(pThis->tVars.farray.pEnqNs = calloc(pThis->iMaxQueueSize, sizeof(uint64_t)));
+	}
 
 	pThis->tVars.farray.deqhead = 0;
 	pThis->tVars.farray.head = 0;
@@ -561,6 +744,7 @@ static rsRetVal qDestructFixedArray(qqueue_t *pThis)
 
 	queueDrain(pThis); /* discard any remaining queue entries */
 	free(pThis->tVars.farray.pBuf);
+	free(pThis->tVars.farray.pEnqNs);
 
 	RETiRet;
 }
@@ -572,6 +756,8 @@ static rsRetVal qAddFixedArray(qqueue_t *pThis, smsg_t* in)
 
 	ASSERT(pThis != NULL);
 	pThis->tVars.farray.pBuf[pThis->tVars.farray.tail] = in;
+	if(pThis->tVars.farray.pEnqNs != NULL)
+		pThis->tVars.farray.pEnqNs[pThis->tVars.farray.tail] = statsHistNowNs();
 	pThis->tVars.farray.tail++;
 	if (pThis->tVars.farray.tail == pThis->iMaxQueueSize)
 		pThis->tVars.farray.tail = 0;
@@ -580,12 +766,14 @@ static rsRetVal qAddFixedArray(qqueue_t *pThis, smsg_t* in)
 }
 
 
-static rsRetVal qDeqFixedArray(qqueue_t *pThis, smsg_t **out)
+static rsRetVal qDeqFixedArray(qqueue_t *pThis, smsg_t **out, uint64_t *pEnqNs)
 {
 	DEFiRet;
 
 	ASSERT(pThis != NULL);
 	*out = (void*) pThis->tVars.farray.pBuf[pThis->tVars.farray.deqhead];
+	*pEnqNs = (pThis->tVars.farray.pEnqNs == NULL) ? 0
+		: pThis->tVars.farray.pEnqNs[pThis->tVars.farray.deqhead];
 
 	pThis->tVars.farray.deqhead++;
 	if (pThis->tVars.farray.deqhead == pThis->iMaxQueueSize)
@@ -650,6 +838,7 @@ static rsRetVal qAddLinkedList(qqueue_t *pThis, smsg_t* pMsg)
 
 	pEntry->pNext = NULL;
 	pEntry->pMsg = pMsg;
+	pEntry->tEnqNs = (pThis->pHistLatency == NULL) ? 0 : statsHistNowNs();
 
 	if(pThis->tVars.linklist.pDelRoot == NULL) {
 		pThis->tVars.linklist.pDelRoot = pThis->tVars.linklist.pDeqRoot = pThis->tVars.linklist.pLast = pEntry;
@@ -667,13 +856,14 @@ finalize_it:
 }
 
 
-static rsRetVal qDeqLinkedList(qqueue_t *pThis, smsg_t **ppMsg)
+static rsRetVal qDeqLinkedList(qqueue_t *pThis, smsg_t **ppMsg, uint64_t *pEnqNs)
 {
 	qLinkedList_t *pEntry;
 	DEFiRet;
 
 	pEntry = pThis->tVars.linklist.pDeqRoot;
 	*ppMsg = pEntry->pMsg;
+	*pEnqNs = pEntry->tEnqNs;
 	pThis->tVars.linklist.pDeqRoot = pEntry->pNext;
 
 	RETiRet;
@@ -909,6 +1099,12 @@ static rsRetVal qConstructDisk(qqueue_t *pThis)
 	CHKiRet(strm.SetiMaxFileSize(pThis->tVars.disk.pWrite, pThis->iMaxFileSize));
 	CHKiRet(strm.SetiMaxFileSize(pThis->tVars.disk.pReadDeq, pThis->iMaxFileSize));
 	CHKiRet(strm.SetiMaxFileSize(pThis->tVars.disk.pReadDel, pThis->iMaxFileSize));
+	if(pThis->bGroupCommit) {
+		strmSetGroupSync(pThis->tVars.disk.pWrite, 1);
+		strmSetPrealloc(pThis->tVars.disk.pWrite, 1);
+	}
+	if(pThis->bReadAhead)
+		strmSetReadAhead(pThis->tVars.disk.pReadDeq, 1);
 
 finalize_it:
 	RETiRet;
@@ -941,6 +1137,126 @@ static rsRetVal qDestructDisk(qqueue_t *pThis)
 	RETiRet;
 }
 
+/* group commit: wait until the first seq messages written to the queue
+ * file are on stable storage. If no sync is in progress, the caller becomes
+ * the leader: it waits up to queue.groupcommitdelay us for more writes to
+ * arrive and then syncs everything written so far with a single fdatasync()
+ * on a dup of the current write fd (so a concurrent rollover cannot close it
+ * under us; rolled-over files are synced by the stream on close). If the
+ * write file was created since the last group sync, the spool directory is
+ * fsync()ed as well, so that the new directory entry is durable. Everyone
+ * else just waits for a leader to cover their seq. A seq of 0 means "all
+ * messages written so far".
+ * If the sync fails, nSeqSynced is not advanced and the leader as well as
+ * everyone waiting for a seq covered by that sync receive RS_RET_IO_ERROR.
+ * Must be called WITHOUT the queue mutex held.
+ */
+#ifdef HAVE_FDATASYNC
+#	define GROUPSYNCCALL(x) fdatasync(x)
+#else
+#	define GROUPSYNCCALL(x) fsync(x)
+#endif
+static rsRetVal
+qqueueGroupSync(qqueue_t *const pThis, uint64_t seq)
+{
+	uint64_t target;
+	uint64_t tStart;
+	uint64_t nMsgs;
+	int fd;
+	int fdDir;
+	int64_t iFNum;
+	int bSyncFailed;
+	DEFiRet;
+
+	if(seq == 0) {
+		d_pthread_mutex_lock(pThis->mut);
+		seq = pThis->nSeqWritten;
+		d_pthread_mutex_unlock(pThis->mut);
+	}
+
+	pthread_mutex_lock(&pThis->mutSync);
+	while(pThis->nSeqSynced < seq) {
+		if(seq <= pThis->nSeqSyncFailed) {
+			iRet = RS_RET_IO_ERROR; /* the sync covering our write failed */
+			break;
+		}
+		if(pThis->bSyncRunning) {
+			pthread_cond_wait(&pThis->condSync, &pThis->mutSync);
+			continue;
+		}
+		pThis->bSyncRunning = 1;
+		pthread_mutex_unlock(&pThis->mutSync);
+
+		if(pThis->iGroupCommitDelay > 0)
+			srSleep(pThis->iGroupCommitDelay / 1000000, pThis->iGroupCommitDelay % 1000000);
+
+		d_pthread_mutex_lock(pThis->mut);
+		target = pThis->nSeqWritten;
+		fd = (pThis->tVars.disk.pWrite == NULL || pThis->tVars.disk.pWrite->fd == -1)
+			? -1 : dup(pThis->tVars.disk.pWrite->fd);
+		fdDir = -1;
+		iFNum = -1;
+		if(fd != -1) {
+			iFNum = strmGetCurrFileNum(pThis->tVars.disk.pWrite);
+			/* iSyncedFNum is only written by the leader, so reading it here is safe */
+			if(iFNum != pThis->iSyncedFNum && pThis->tVars.disk.pWrite->fdDir != -1)
+				fdDir = dup(pThis->tVars.disk.pWrite->fdDir);
+		}
+		d_pthread_mutex_unlock(pThis->mut);
+
+		tStart = statsHistNowNs();
+		bSyncFailed = 0;
+		if(fd != -1) {
+			if(GROUPSYNCCALL(fd) != 0) {
+				errmsg.LogError(errno, RS_RET_IO_ERROR, "%s: group commit: sync of queue "
+					"file failed, %llu messages may not be on stable storage",
+					obj.GetName((obj_t*) pThis),
+					(long long unsigned) (target - pThis->nSeqSynced));
+				bSyncFailed = 1;
+			}
+			close(fd);
+		}
+		if(fdDir != -1) {
+			if(!bSyncFailed && fsync(fdDir) != 0) {
+				errmsg.LogError(errno, RS_RET_IO_ERROR, "%s: group commit: sync of queue "
+					"directory failed, %llu messages may not be on stable storage",
+					obj.GetName((obj_t*) pThis),
+					(long long unsigned) (target - pThis->nSeqSynced));
+				bSyncFailed = 1;
+			}
+			close(fdDir);
+		}
+
+		pthread_mutex_lock(&pThis->mutSync);
+		pThis->bSyncRunning = 0;
+		pthread_cond_broadcast(&pThis->condSync);
+		if(bSyncFailed) {
+			if(target > pThis->nSeqSyncFailed)
+				pThis->nSeqSyncFailed = target;
+			continue; /* loop top hands out the error */
+		}
+		nMsgs = target - pThis->nSeqSynced;
+		pThis->nSeqSynced = target;
+		if(iFNum != -1)
+			pThis->iSyncedFNum = iFNum;
+		if(pThis->pHistSync != NULL) {
+			statsHistRecord(pThis->pHistSync, (statsHistNowNs() - tStart) / 1000);
+			STATSCOUNTER_INC(pThis->ctrSyncs, pThis->mutCtrSyncs);
+			STATSCOUNTER_ADD(pThis->ctrSyncMsgs, pThis->mutCtrSyncMsgs, nMsgs);
+		}
+	}
+	pthread_mutex_unlock(&pThis->mutSync);
+	RETiRet;
+}
+#undef GROUPSYNCCALL
+
+
+/* must we wait for a group commit after enqueueing to pThis? DA child queues
+ * are fed by ConsumerDA, which waits once per batch instead.
+ */
+#define qqueueNeedGroupSync(pThis) \
+	((pThis)->bGroupCommit && (pThis)->qType == QUEUETYPE_DISK && (pThis)->pqParent == NULL)
+
 static rsRetVal qAddDisk(qqueue_t *pThis, smsg_t* pMsg)
 {
 	DEFiRet;
@@ -955,6 +1271,9 @@ static rsRetVal qAddDisk(qqueue_t *pThis, smsg_t* pMsg)
 	CHKiRet(strm.SetWCntr(pThis->tVars.disk.pWrite, NULL)); /* no more counting for now... */
 
 	pThis->tVars.disk.sizeOnDisk += nWriteCount;
+	++pThis->nSeqWritten;
+	if(pThis->bRAThrdRunning)
+		pthread_cond_signal(&pThis->raCond); /* more to read ahead */
 
 	/* we have enqueued the user element to disk. So we now need to destruct
 	 * the in-memory representation. The instance will be re-created upon
@@ -982,15 +1301,455 @@ finalize_it:
 }
 
 
-static rsRetVal qDeqDisk(qqueue_t *pThis, smsg_t **ppMsg)
+static rsRetVal qDeqDisk(qqueue_t *pThis, smsg_t **ppMsg, uint64_t *pEnqNs)
 {
 	DEFiRet;
+	*pEnqNs = 0; /* not kept on disk */
 	iRet = objDeserializeWithMethods(ppMsg, (uchar*) "msg", 3, pThis->tVars.disk.pReadDeq, NULL,
 		NULL, msgConstructForDeserializer, NULL, MsgDeserialize);
 	RETiRet;
 }
 
 
+/* -------------------- journaled memory queues -------------------- */
+
+/* journal positions of consecutive appends to the same file are merged into
+ * one entry until it covers this many records. This bounds the memory needed
+ * for the position list; records done past the last usable entry are
+ * recorded as a skip count in the checkpoint.
+ */
+#define JRNL_POS_GRAN		1024
+/* checkpoint interval (in processed messages) if queue.checkpointinterval
+ * is not set.
+ */
+#define JRNL_CP_INTERVAL	1000
+
+#define qqueueIsJournaled(pThis) ((pThis)->pJrnlWrite != NULL)
+
+/* grow one of the journal bookkeeping rings, keeping its order */
+static rsRetVal
+jrnlRingGrow(void **ppRing, int *const pHead, const int cnt, int *const pMax, const size_t eltSize)
+{
+	uchar *pNew;
+	const uchar *const pOld = *ppRing;
+	const int newMax = (*pMax == 0) ? 16 : 2 * *pMax;
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pNew = malloc(newMax * eltSize));
+	for(i = 0 ; i < cnt ; ++i)
+		memcpy(pNew + i * eltSize, pOld + ((*pHead + i) % *pMax) * eltSize, eltSize);
+	free(*ppRing);
+	*ppRing = pNew;
+	*pHead = 0;
+	*pMax = newMax;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* a journal write failed. We can not make the enqueue fail (the message is
+ * already in memory), so we stop journaling. The journal files are left
+ * alone, so nothing that was journaled so far is lost.
+ */
+static void
+qqueueJrnlDisable(qqueue_t *const pThis, const rsRetVal iErr)
+{
+	errmsg.LogError(0, iErr, "queue \"%s\": error writing journal '%s' - journaling "
+		"disabled, new messages are only kept in memory", obj.GetName((obj_t*) pThis),
+		pThis->pszJrnlPrefix);
+	strm.Destruct(&pThis->pJrnlWrite);
+}
+
+
+/* remember that all records written so far end at the given journal position */
+static rsRetVal
+qqueueJrnlNotePos(qqueue_t *const pThis, const int fileNum, const int64 offs)
+{
+	qJrnlPos_t *pPos;
+	DEFiRet;
+
+	if(pThis->jrnlPosCnt > 0) {
+		pPos = &pThis->jrnlPos[(pThis->jrnlPosHead + pThis->jrnlPosCnt - 1) % pThis->jrnlPosMax];
+		if(pPos->fileNum == fileNum && pThis->nJrnlWritten - pPos->begSeq < JRNL_POS_GRAN) {
+			pPos->endSeq = pThis->nJrnlWritten;
+			pPos->offs = offs;
+			FINALIZE;
+		}
+	}
+
+	if(pThis->jrnlPosCnt == pThis->jrnlPosMax)
+		CHKiRet(jrnlRingGrow((void**) &pThis->jrnlPos, &pThis->jrnlPosHead, pThis->jrnlPosCnt,
+			&pThis->jrnlPosMax, sizeof(qJrnlPos_t)));
+	pPos = &pThis->jrnlPos[(pThis->jrnlPosHead + pThis->jrnlPosCnt) % pThis->jrnlPosMax];
+	pPos->begSeq = pPos->endSeq = pThis->nJrnlWritten;
+	pPos->fileNum = fileNum;
+	pPos->offs = offs;
+	++pThis->jrnlPosCnt;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* append a message to the journal. This is only buffered, qqueueJrnlFlush()
+ * writes out the whole batch.
+ */
+static rsRetVal
+qqueueJrnlAppend(qqueue_t *const pThis, smsg_t *const pMsg)
+{
+	DEFiRet;
+
+	CHKiRet((objSerialize(pMsg))(pMsg, pThis->pJrnlWrite));
+	++pThis->nJrnlWritten;
+
+finalize_it:
+	if(iRet != RS_RET_OK)
+		qqueueJrnlDisable(pThis, iRet);
+	RETiRet;
+}
+
+
+/* write the records appended since the last call to the journal file, in one
+ * sequential write (as far as the stream buffer permits).
+ * Must be called with the queue mutex locked, before it is released.
+ */
+static rsRetVal
+qqueueJrnlFlush(qqueue_t *const pThis)
+{
+	int64 offs;
+	DEFiRet;
+
+	if(!qqueueIsJournaled(pThis) || pThis->nJrnlFlushed == pThis->nJrnlWritten)
+		FINALIZE;
+
+	CHKiRet(strm.Flush(pThis->pJrnlWrite));
+	CHKiRet(strm.GetCurrOffset(pThis->pJrnlWrite, &offs));
+	CHKiRet(qqueueJrnlNotePos(pThis, strmGetCurrFileNum(pThis->pJrnlWrite), offs));
+	pThis->nJrnlFlushed = pThis->nJrnlWritten;
+	STATSCOUNTER_INC(pThis->ctrJrnlWrites, pThis->mutCtrJrnlWrites);
+
+finalize_it:
+	if(iRet != RS_RET_OK && qqueueIsJournaled(pThis))
+		qqueueJrnlDisable(pThis, iRet);
+	RETiRet;
+}
+
+
+/* write the journal checkpoint file. Like the .qi file, it is written to a
+ * temporary file first and then renamed, so a crash leaves either the old or
+ * the new checkpoint.
+ */
+static rsRetVal
+qqueueJrnlPersist(qqueue_t *const pThis)
+{
+	uchar pszTmpNam[MAXFNAME];
+	size_t lenTmpNam;
+	strm_t *psCP = NULL;
+	DEFiRet;
+
+	lenTmpNam = snprintf((char*)pszTmpNam, sizeof(pszTmpNam), "%s.tmp", (char*)pThis->pszJrnlCPNam);
+
+	CHKiRet(strm.Construct(&psCP));
+	CHKiRet(strm.SettOperationsMode(psCP, STREAMMODE_WRITE_TRUNC));
+	CHKiRet(strm.SetbSync(psCP, pThis->bSyncQueueFiles));
+	CHKiRet(strm.SetsType(psCP, STREAMTYPE_FILE_SINGLE));
+	CHKiRet(strm.SetFName(psCP, pszTmpNam, lenTmpNam));
+	CHKiRet(strm.ConstructFinalize(psCP));
+
+	CHKiRet(obj.BeginSerializePropBag(psCP, (obj_t*) pThis));
+	objSerializeSCALAR(psCP, iJrnlSkip, INT);
+	CHKiRet(obj.EndSerialize(psCP));
+	CHKiRet(strm.Serialize(pThis->pJrnlDel, psCP));
+
+	strm.Destruct(&psCP);
+	if(rename((char*)pszTmpNam, (char*)pThis->pszJrnlCPNam) != 0) {
+		DBGOPRINT((obj_t*) pThis, "renaming journal checkpoint file failed, errno %d\n", errno);
+		ABORT_FINALIZE(RS_RET_RENAME_TMP_QI_ERROR);
+	}
+
+finalize_it:
+	if(psCP != NULL)
+		strm.Destruct(&psCP);
+	RETiRet;
+}
+
+
+/* checkpoint the journal: advance the checkpoint position to the last known
+ * journal position all of whose records are processed, delete the journal
+ * files before it, and persist the position plus the number of records after
+ * it that are also done already.
+ */
+static rsRetVal
+qqueueJrnlCheckpoint(qqueue_t *const pThis)
+{
+	qJrnlPos_t *pPos;
+	int fileNum = -1;
+	int64 offs = 0;
+	uint64_t seq = 0;
+	off64_t bytesDel;
+	DEFiRet;
+
+	while(pThis->jrnlPosCnt > 0) {
+		pPos = &pThis->jrnlPos[pThis->jrnlPosHead];
+		if(pPos->endSeq > pThis->nJrnlDone)
+			break;
+		fileNum = pPos->fileNum;
+		offs = pPos->offs;
+		seq = pPos->endSeq;
+		pThis->jrnlPosHead = (pThis->jrnlPosHead + 1) % pThis->jrnlPosMax;
+		--pThis->jrnlPosCnt;
+	}
+
+	if(fileNum != -1) {
+		while(strmGetCurrFileNum(pThis->pJrnlDel) < (unsigned) fileNum) {
+			CHKiRet(strmMultiFileSeek(pThis->pJrnlDel, strmGetCurrFileNum(pThis->pJrnlDel) + 1,
+				0, &bytesDel));
+		}
+		CHKiRet(strmMultiFileSeek(pThis->pJrnlDel, fileNum, offs, &bytesDel));
+		pThis->nJrnlCPSeq = seq;
+	}
+	pThis->iJrnlSkip = (int) (pThis->nJrnlDone - pThis->nJrnlCPSeq);
+	CHKiRet(qqueueJrnlPersist(pThis));
+	pThis->nJrnlCPDone = pThis->nJrnlDone;
+	STATSCOUNTER_INC(pThis->ctrJrnlCheckpoints, pThis->mutCtrJrnlCheckpoints);
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* a batch of nElemDeq records has been dequeued. As memory queues dequeue in
+ * enqueue order, it covers the next nElemDeq journal records.
+ * Must be called with the queue mutex locked.
+ */
+static rsRetVal
+qqueueJrnlBatchDeq(qqueue_t *const pThis, const qDeqID deqID, const int nElemDeq)
+{
+	qJrnlBatch_t *pEnt;
+	DEFiRet;
+
+	if(pThis->jrnlBatchCnt == pThis->jrnlBatchMax)
+		CHKiRet(jrnlRingGrow((void**) &pThis->jrnlBatches, &pThis->jrnlBatchHead,
+			pThis->jrnlBatchCnt, &pThis->jrnlBatchMax, sizeof(qJrnlBatch_t)));
+	pThis->nJrnlDeq += nElemDeq;
+	pEnt = &pThis->jrnlBatches[(pThis->jrnlBatchHead + pThis->jrnlBatchCnt) % pThis->jrnlBatchMax];
+	pEnt->deqID = deqID;
+	pEnt->endSeq = pThis->nJrnlDeq;
+	pEnt->bDone = 0;
+	++pThis->jrnlBatchCnt;
+
+finalize_it:
+	if(iRet != RS_RET_OK)
+		qqueueJrnlDisable(pThis, iRet); /* we lost track of the record numbers */
+	RETiRet;
+}
+
+
+/* a batch has been processed. Batches of several workers complete in any
+ * order, so the done mark only advances over the done prefix of the batches
+ * in flight. Checkpoints are taken every queue.checkpointinterval messages.
+ * Must be called with the queue mutex locked.
+ */
+static void
+qqueueJrnlBatchDone(qqueue_t *const pThis, batch_t *const pBatch)
+{
+	qJrnlBatch_t *pEnt;
+	const int iInterval = (pThis->iPersistUpdCnt > 0) ? pThis->iPersistUpdCnt : JRNL_CP_INTERVAL;
+	int i;
+
+	for(i = 0 ; i < pThis->jrnlBatchCnt ; ++i) {
+		pEnt = &pThis->jrnlBatches[(pThis->jrnlBatchHead + i) % pThis->jrnlBatchMax];
+		if(pEnt->deqID == pBatch->deqID) {
+			pEnt->bDone = 1;
+			break;
+		}
+	}
+
+	while(pThis->jrnlBatchCnt > 0 && pThis->jrnlBatches[pThis->jrnlBatchHead].bDone) {
+		pThis->nJrnlDone = pThis->jrnlBatches[pThis->jrnlBatchHead].endSeq;
+		pThis->jrnlBatchHead = (pThis->jrnlBatchHead + 1) % pThis->jrnlBatchMax;
+		--pThis->jrnlBatchCnt;
+	}
+
+	if(pThis->nJrnlDone - pThis->nJrnlCPDone >= (uint64_t) iInterval) {
+		if(qqueueJrnlCheckpoint(pThis) != RS_RET_OK) {
+			DBGOPRINT((obj_t*) pThis, "journal checkpoint failed, retrying later\n");
+		}
+	}
+}
+
+
+/* open the journal of a memory queue: load the checkpoint (if any), replay
+ * all records after it into the (still empty) queue, cut off a partially
+ * written record at the end, and start appending in a new journal file.
+ * Must be called after qConstruct() and before workers are started.
+ */
+static rsRetVal
+qqueueJrnlOpen(qqueue_t *const pThis)
+{
+	uchar pszCPNam[MAXFNAME];
+	struct stat stat_buf;
+	strm_t *psCP = NULL;
+	strm_t *pRead = NULL;
+	smsg_t *pMsg;
+	int goodFNum;
+	int64 goodOffs;
+	int nSkip;
+	int nReplayed = 0;
+	int nDropped = 0;
+	rsRetVal localRet;
+	DEFiRet;
+
+	snprintf((char*)pszCPNam, sizeof(pszCPNam), "%s/%s.jcp",
+		(char*) pThis->pszSpoolDir, (char*) pThis->pszJrnlPrefix);
+	CHKmalloc(pThis->pszJrnlCPNam = ustrdup(pszCPNam));
+
+	if(stat((char*) pThis->pszJrnlCPNam, &stat_buf) == 0) {
+		CHKiRet(strm.Construct(&psCP));
+		CHKiRet(strm.SettOperationsMode(psCP, STREAMMODE_READ));
+		CHKiRet(strm.SetsType(psCP, STREAMTYPE_FILE_SINGLE));
+		CHKiRet(strm.SetFName(psCP, pThis->pszJrnlCPNam, ustrlen(pThis->pszJrnlCPNam)));
+		CHKiRet(strm.ConstructFinalize(psCP));
+		CHKiRet(obj.DeserializePropBag((obj_t*) pThis, psCP));
+		CHKiRet(obj.Deserialize(&pThis->pJrnlDel, (uchar*) "strm", psCP,
+				       (rsRetVal(*)(obj_t*,void*))qqueueLoadPersStrmInfoFixup, pThis));
+	} else {
+		CHKiRet(strm.Construct(&pThis->pJrnlDel));
+		CHKiRet(strm.SetbDeleteOnClose(pThis->pJrnlDel, 0));
+		CHKiRet(strm.SetDir(pThis->pJrnlDel, pThis->pszSpoolDir, pThis->lenSpoolDir));
+		CHKiRet(strm.SetiMaxFiles(pThis->pJrnlDel, 10000000));
+		CHKiRet(strm.SettOperationsMode(pThis->pJrnlDel, STREAMMODE_READ));
+		CHKiRet(strm.SetsType(pThis->pJrnlDel, STREAMTYPE_FILE_CIRCULAR));
+		CHKiRet(strm.SetFName(pThis->pJrnlDel, pThis->pszJrnlPrefix, pThis->lenJrnlPrefix));
+		CHKiRet(strm.ConstructFinalize(pThis->pJrnlDel));
+		pThis->iJrnlSkip = 0;
+	}
+	CHKiRet(strm.SetiMaxFileSize(pThis->pJrnlDel, pThis->iMaxFileSize));
+
+	goodFNum = strmGetCurrFileNum(pThis->pJrnlDel);
+	CHKiRet(strm.GetCurrOffset(pThis->pJrnlDel, &goodOffs));
+	CHKiRet(strm.Dup(pThis->pJrnlDel, &pRead));
+	CHKiRet(strm.SetbDeleteOnClose(pRead, 0));
+	CHKiRet(strm.ConstructFinalize(pRead));
+	if(goodOffs > 0)
+		CHKiRet(strm.SeekCurrOffs(pRead));
+
+	/* records are numbered from the checkpoint position on; the ones that
+	 * were already done at checkpoint time are skipped.
+	 */
+	nSkip = pThis->iJrnlSkip;
+	pThis->nJrnlCPSeq = 0;
+	pThis->nJrnlWritten = pThis->nJrnlDeq = pThis->nJrnlDone = pThis->nJrnlCPDone = nSkip;
+	while(1) {
+		localRet = objDeserializeWithMethods(&pMsg, (uchar*) "msg", 3, pRead, NULL,
+			NULL, msgConstructForDeserializer, NULL, MsgDeserialize);
+		if(localRet == RS_RET_FILE_NOT_FOUND || localRet == RS_RET_EOF || localRet == RS_RET_IO_ERROR)
+			break; /* past the last journal file */
+		if(localRet != RS_RET_OK) {
+			DBGOPRINT((obj_t*) pThis, "journal replay: unreadable record (%d) skipped\n", localRet);
+			continue;
+		}
+		goodFNum = strmGetCurrFileNum(pRead);
+		CHKiRet(strm.GetCurrOffset(pRead, &goodOffs));
+		if(nSkip > 0) {
+			--nSkip;
+			msgDestruct(&pMsg);
+			continue;
+		}
+		if(pThis->iMaxQueueSize > 0 && pThis->iQueueSize >= pThis->iMaxQueueSize) {
+			++nDropped;
+			msgDestruct(&pMsg);
+			continue;
+		}
+		CHKiRet(pThis->qAdd(pThis, pMsg));
+		ATOMIC_INC(&pThis->iQueueSize, &pThis->mutQueueSize);
+#		ifdef ENABLE_IMDIAG
+#			ifdef HAVE_ATOMIC_BUILTINS
+				ATOMIC_INC(&iOverallQueueSize, &NULL);
+#			else
+				++iOverallQueueSize;
+#			endif
+#		endif
+		++pThis->nJrnlWritten;
+		++nReplayed;
+		CHKiRet(qqueueJrnlNotePos(pThis, goodFNum, goodOffs));
+	}
+	pThis->nJrnlFlushed = pThis->nJrnlWritten;
+
+	/* a crash may have left a partial record behind; remove it, as readers
+	 * would otherwise continue parsing it in the next file.
+	 */
+	CHKiRet(strmTruncFile(pRead, goodFNum, goodOffs));
+
+	/* new records go to the first file after the ones we have read */
+	CHKiRet(strm.Dup(pRead, &pThis->pJrnlWrite));
+	CHKiRet(strm.SettOperationsMode(pThis->pJrnlWrite, STREAMMODE_WRITE_APPEND));
+	CHKiRet(strm.SetbDeleteOnClose(pThis->pJrnlWrite, 0));
+	CHKiRet(strm.SetbSync(pThis->pJrnlWrite, pThis->bSyncQueueFiles));
+	CHKiRet(strm.ConstructFinalize(pThis->pJrnlWrite));
+
+	pThis->ctrJrnlReplayed = nReplayed;
+	if(nReplayed > 0) {
+		errmsg.LogMsg(0, RS_RET_OK, LOG_INFO, "queue \"%s\": %d messages recovered from "
+			"journal '%s'", obj.GetName((obj_t*) pThis), nReplayed, pThis->pszJrnlPrefix);
+	}
+	if(nDropped > 0) {
+		errmsg.LogError(0, RS_RET_QUEUE_FULL, "queue \"%s\": journal '%s' holds more messages "
+			"than fit into the queue, %d messages discarded", obj.GetName((obj_t*) pThis),
+			pThis->pszJrnlPrefix, nDropped);
+	}
+
+finalize_it:
+	if(psCP != NULL)
+		strm.Destruct(&psCP);
+	if(pRead != NULL)
+		strm.Destruct(&pRead);
+	if(iRet != RS_RET_OK) {
+		if(pThis->pJrnlWrite != NULL)
+			strm.Destruct(&pThis->pJrnlWrite);
+		if(pThis->pJrnlDel != NULL)
+			strm.Destruct(&pThis->pJrnlDel);
+		errmsg.LogError(0, iRet, "queue \"%s\": can not open journal '%s' - running "
+			"without journal", obj.GetName((obj_t*) pThis), pThis->pszJrnlPrefix);
+	}
+	RETiRet;
+}
+
+
+/* close the journal on shutdown. If everything was processed, the journal is
+ * removed, otherwise a final checkpoint makes sure the remaining messages are
+ * replayed on the next start.
+ */
+static void
+qqueueJrnlClose(qqueue_t *const pThis)
+{
+	off64_t bytesDel;
+
+	if(qqueueIsJournaled(pThis)) {
+		qqueueJrnlFlush(pThis);
+	}
+	if(qqueueIsJournaled(pThis)) {
+		if(pThis->nJrnlDone == pThis->nJrnlWritten) {
+			while(strmGetCurrFileNum(pThis->pJrnlDel) < strmGetCurrFileNum(pThis->pJrnlWrite)) {
+				if(strmMultiFileSeek(pThis->pJrnlDel, strmGetCurrFileNum(pThis->pJrnlDel) + 1,
+					0, &bytesDel) != RS_RET_OK)
+					break;
+			}
+			strm.SetbDeleteOnClose(pThis->pJrnlWrite, 1);
+			unlink((char*) pThis->pszJrnlCPNam);
+		} else if(qqueueJrnlCheckpoint(pThis) != RS_RET_OK) {
+			DBGOPRINT((obj_t*) pThis, "final journal checkpoint failed, messages may be "
+				"replayed twice\n");
+		}
+		strm.Destruct(&pThis->pJrnlWrite);
+	}
+	if(pThis->pJrnlDel != NULL)
+		strm.Destruct(&pThis->pJrnlDel);
+}
+
+
 /* -------------------- direct (no queueing) -------------------- */
 static rsRetVal qConstructDirect(qqueue_t __attribute__((unused)) *pThis)
 {
@@ -1078,9 +1837,12 @@ qqueueAdd(qqueue_t *pThis, smsg_t *pMsg)
 	}
 
 	CHKiRet(pThis->qAdd(pThis, pMsg));
+	if(qqueueIsJournaled(pThis))
+		qqueueJrnlAppend(pThis, pMsg);
 
 	if(pThis->qType != QUEUETYPE_DIRECT) {
 		ATOMIC_INC(&pThis->iQueueSize, &pThis->mutQueueSize);
+		shardSetSizeInc(pThis);
 #		ifdef ENABLE_IMDIAG
 #			ifdef HAVE_ATOMIC_BUILTINS
 				/* mutex is never used due to conditional compilation */
@@ -1098,10 +1860,11 @@ finalize_it:
 }
 
 
-/* generic code to dequeue a queue entry
+/* generic code to dequeue a queue entry. *pEnqNs receives the time the
+ * entry was enqueued (0 if unknown or latency stats are off).
  */
 static rsRetVal
-qqueueDeq(qqueue_t *pThis, smsg_t **ppMsg)
+qqueueDeq(qqueue_t *pThis, smsg_t **ppMsg, uint64_t *pEnqNs)
 {
 	DEFiRet;
 
@@ -1112,7 +1875,7 @@ qqueueDeq(qqueue_t *pThis, smsg_t **ppMsg)
 	 * If we decrement, however, we may lose a message. But that is better than
 	 * losing the whole process because it loops... -- rgerhards, 2008-01-03
 	 */
-	iRet = pThis->qDeq(pThis, ppMsg);
+	iRet = pThis->qDeq(pThis, ppMsg, pEnqNs);
 	ATOMIC_INC(&pThis->nLogDeq, &pThis->mutLogDeq);
 
 //	DBGOPRINT((obj_t*) pThis, "entry deleted, size now log %d, phys %d entries\n",
@@ -1396,6 +2159,8 @@ rsRetVal qqueueConstruct(qqueue_t **ppThis, queueType_t qType, int iWorkerThread
 	pThis->iNumWorkerThreads = iWorkerThreads;
 	pThis->iDeqtWinToHr = 25; /* disable time-windowed dequeuing by default */
 	pThis->iDeqBatchSize = 8; /* conservative default, should still provide good performance */
+	pThis->iTargetLatency = 100; /* ms, only used with adaptive worker scaling */
+	pThis->iBatchMaxLatency = 100; /* ms, only used with adaptive batch sizing */
 
 	pThis->pszFilePrefix = NULL;
 	pThis->qType = qType;
@@ -1403,6 +2168,12 @@ rsRetVal qqueueConstruct(qqueue_t **ppThis, queueType_t qType, int iWorkerThread
 
 	INIT_ATOMIC_HELPER_MUT(pThis->mutQueueSize);
 	INIT_ATOMIC_HELPER_MUT(pThis->mutLogDeq);
+	INIT_ATOMIC_HELPER_MUT(pThis->mutStealsActive);
+	INIT_ATOMIC_HELPER_MUT(pThis->mutShardSetSize);
+	pthread_mutex_init(&pThis->mutSync, NULL);
+	pthread_cond_init(&pThis->condSync, NULL);
+	pThis->iSyncedFNum = -1;
+	pthread_cond_init(&pThis->raCond, NULL);
 
 finalize_it:
 	OBJCONSTRUCT_CHECK_SUCCESS_AND_CLEANUP
@@ -1519,7 +2290,7 @@ finalize_it:
 /* Finally remove n elements from the queue store.
  */
 static rsRetVal
-DoDeleteBatchFromQStore(qqueue_t *pThis, int nElem)
+DoDeleteBatchFromQStore(qqueue_t *pThis, int nElem, const int deqFileNum, const int64 deqOffs)
 {
 	int i;
 	off64_t bytesDel = 0; /* keep CLANG static anaylzer happy */
@@ -1529,8 +2300,7 @@ DoDeleteBatchFromQStore(qqueue_t *pThis, int nElem)
 
 	/* now send delete request to storage driver */
 	if(pThis->qType == QUEUETYPE_DISK) {
-		strmMultiFileSeek(pThis->tVars.disk.pReadDel, pThis->tVars.disk.deqFileNumOut,
-				  pThis->tVars.disk.deqOffs, &bytesDel);
+		strmMultiFileSeek(pThis->tVars.disk.pReadDel, deqFileNum, deqOffs, &bytesDel);
 		/* We need to correct the on-disk file size. This time it is a bit tricky:
 		 * we free disk space only upon file deletion. So we need to keep track of what we
 		 * have read until we get an out-offset that is lower than the in-offset (which
@@ -1552,6 +2322,7 @@ DoDeleteBatchFromQStore(qqueue_t *pThis, int nElem)
 
 	/* iQueueSize is not decremented by qDel(), so we need to do it ourselves */
 	ATOMIC_SUB(&pThis->iQueueSize, nElem, &pThis->mutQueueSize);
+	shardSetSizeSub(pThis, nElem);
 #	ifdef ENABLE_IMDIAG
 #		ifdef HAVE_ATOMIC_BUILTINS
 			/* mutex is never used due to conditional compilation */
@@ -1573,6 +2344,50 @@ DoDeleteBatchFromQStore(qqueue_t *pThis, int nElem)
 }
 
 
+/* read-ahead version of DeleteBatchFromQStore(): batches of many workers
+ * complete in any order, but the on-disk delete position (which is what the
+ * .qi file persists) must never pass a batch that is still being processed.
+ * So we mark the batch done and then delete all done batches from the head
+ * of the in-flight list in one go, up to the end of the last of them.
+ */
+static rsRetVal
+raDeleteBatch(qqueue_t *pThis, batch_t *pBatch)
+{
+	qRABatch_t *pEnt;
+	int i;
+	int nElem = 0;
+	int deqFileNum = 0;
+	int64 deqOffs = 0;
+	DEFiRet;
+
+	if(pBatch->nElemDeq == 0)
+		FINALIZE;
+
+	for(i = 0 ; i < pThis->raBatchCnt ; ++i) {
+		pEnt = &pThis->raBatches[(pThis->raBatchHead + i) % pThis->raBatchMax];
+		if(pEnt->deqID == pBatch->deqID) {
+			pEnt->bDone = 1;
+			break;
+		}
+	}
+
+	while(pThis->raBatchCnt > 0 && pThis->raBatches[pThis->raBatchHead].bDone) {
+		pEnt = &pThis->raBatches[pThis->raBatchHead];
+		nElem += pEnt->nElemDeq;
+		deqFileNum = pEnt->fileNum;
+		deqOffs = pEnt->offs;
+		pThis->raBatchHead = (pThis->raBatchHead + 1) % pThis->raBatchMax;
+		--pThis->raBatchCnt;
+	}
+
+	if(nElem > 0)
+		CHKiRet(DoDeleteBatchFromQStore(pThis, nElem, deqFileNum, deqOffs));
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* remove messages from the physical queue store that are fully processed. This is
  * controlled via the to-delete list.
  */
@@ -1586,20 +2401,31 @@ DeleteBatchFromQStore(qqueue_t *pThis, batch_t *pBatch)
 	ISOBJ_TYPE_assert(pThis, qqueue);
 	assert(pBatch != NULL);
 
+	if(qqueueIsJournaled(pThis))
+		qqueueJrnlBatchDone(pThis, pBatch);
+
+	if(pThis->bReadAhead) {
+		iRet = raDeleteBatch(pThis, pBatch);
+		FINALIZE;
+	}
+
 	pTdl = tdlPeek(pThis); /* get current head element */
 	if(pTdl == NULL) { /* to-delete list empty */
-		DoDeleteBatchFromQStore(pThis, pBatch->nElem);
+		DoDeleteBatchFromQStore(pThis, pBatch->nElem, pThis->tVars.disk.deqFileNumOut,
+					pThis->tVars.disk.deqOffs);
 	} else if(pBatch->deqID == pThis->deqIDDel) {
 		deqIDDel = pThis->deqIDDel;
 		pTdl = tdlPeek(pThis);
 		while(pTdl != NULL && deqIDDel == pTdl->deqID) {
-			DoDeleteBatchFromQStore(pThis, pTdl->nElemDeq);
+			DoDeleteBatchFromQStore(pThis, pTdl->nElemDeq, pThis->tVars.disk.deqFileNumOut,
+						pThis->tVars.disk.deqOffs);
 			tdlPop(pThis);
 			++deqIDDel;
 			pTdl = tdlPeek(pThis);
 		}
 		/* old entries deleted, now delete current ones... */
-		DoDeleteBatchFromQStore(pThis, pBatch->nElem);
+		DoDeleteBatchFromQStore(pThis, pBatch->nElem, pThis->tVars.disk.deqFileNumOut,
+					pThis->tVars.disk.deqOffs);
 	} else {
 		/* can not delete, insert into to-delete list */
 		DBGPRINTF("not at head of to-delete list, enqueue %d\n", (int) pBatch->deqID);
@@ -1628,61 +2454,138 @@ DeleteProcessedBatch(qqueue_t *pThis, batch_t *pBatch)
 	ISOBJ_TYPE_assert(pThis, qqueue);
 	assert(pBatch != NULL);
 
-	for(i = 0 ; i < pBatch->nElem ; ++i) {
-		pMsg = pBatch->pElem[i].pMsg;
-		if(   pBatch->eltState[i] == BATCH_STATE_RDY
-		   || pBatch->eltState[i] == BATCH_STATE_SUB) {
-			localRet = doEnqSingleObj(pThis, eFLOWCTL_NO_DELAY, MsgAddRef(pMsg));
-			++nEnqueued;
-			if(localRet != RS_RET_OK) {
-				DBGPRINTF("DeleteProcessedBatch: error %d re-enqueuing unprocessed data element - discarded\n", localRet);
-			}
+	for(i = 0 ; i < pBatch->nElem ; ++i) {
+		pMsg = pBatch->pElem[i].pMsg;
+		if(   pBatch->eltState[i] == BATCH_STATE_RDY
+		   || pBatch->eltState[i] == BATCH_STATE_SUB) {
+			localRet = doEnqSingleObj(pThis, eFLOWCTL_NO_DELAY, MsgAddRef(pMsg));
+			++nEnqueued;
+			if(localRet != RS_RET_OK) {
+				DBGPRINTF("DeleteProcessedBatch: error %d re-enqueuing unprocessed data element - discarded\n", localRet);
+			}
+		}
+		msgDestruct(&pMsg);
+	}
+
+	DBGPRINTF("DeleteProcessedBatch: we deleted %d objects and enqueued %d objects\n", i-nEnqueued, nEnqueued); 
+
+	if(nEnqueued > 0) {
+		qqueueJrnlFlush(pThis);
+		qqueueChkPersist(pThis, nEnqueued);
+	}
+
+	iRet = DeleteBatchFromQStore(pThis, pBatch);
+
+	pBatch->nElem = pBatch->nElemDeq = 0; /* reset batch */ // TODO: more fine init, new fields! 2010-06-14
+
+	RETiRet;
+}
+
+
+/* read-ahead version of DequeueConsumableElements(): hand out messages the
+ * read-ahead thread has already deserialized and remember where the batch
+ * ends in the queue files, so raDeleteBatch() can delete it in order.
+ * This must only be called when the queue mutex is LOOKED.
+ */
+static rsRetVal
+DequeueStagedElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSize, const int iBatchSize,
+	const int nDeleted)
+{
+	int nDequeued;
+	int nDiscarded;
+	qRAMsg_t *pStaged;
+	qRABatch_t *pEnt;
+	smsg_t *pMsg;
+	rsRetVal localRet;
+	DEFiRet;
+
+	nDequeued = nDiscarded = 0;
+	pStaged = NULL;
+	while(pThis->raCnt > 0 && nDequeued < iBatchSize
+	      && pThis->raBatchCnt < pThis->raBatchMax) {
+		pStaged = &pThis->raMsgs[pThis->raHead];
+		pThis->raHead = (pThis->raHead + 1) % pThis->iReadAheadSize;
+		--pThis->raCnt;
+		ATOMIC_INC(&pThis->nLogDeq, &pThis->mutLogDeq);
+
+		pMsg = pStaged->pMsg;
+		pStaged->pMsg = NULL;
+		if(pMsg == NULL) { /* unreadable record, already reported */
+			++nDiscarded;
+			continue;
 		}
-		msgDestruct(&pMsg);
-	}
 
-	DBGPRINTF("DeleteProcessedBatch: we deleted %d objects and enqueued %d objects\n", i-nEnqueued, nEnqueued); 
+		localRet = qqueueChkDiscardMsg(pThis, pThis->iQueueSize, pMsg);
+		if(localRet == RS_RET_QUEUE_FULL) {
+			++nDiscarded;
+			continue;
+		} else if(localRet != RS_RET_OK) {
+			ABORT_FINALIZE(localRet);
+		}
 
-	if(nEnqueued > 0)
-		qqueueChkPersist(pThis, nEnqueued);
+		pWti->batch.pElem[nDequeued].pMsg = pMsg;
+		pWti->batch.eltState[nDequeued] = BATCH_STATE_RDY;
+		++nDequeued;
+	}
 
-	iRet = DeleteBatchFromQStore(pThis, pBatch);
+	/* there is room in the staging ring again */
+	if(pStaged != NULL)
+		pthread_cond_signal(&pThis->raCond);
 
-	pBatch->nElem = pBatch->nElemDeq = 0; /* reset batch */ // TODO: more fine init, new fields! 2010-06-14
+	qqueueChkPersist(pThis, nDequeued+nDiscarded+nDeleted);
 
+	pWti->batch.nElem = nDequeued;
+	pWti->batch.nElemDeq = nDequeued + nDiscarded;
+	pWti->batch.deqID = getNextDeqID(pThis);
+	pThis->nCtlDeq += nDequeued + nDiscarded;
+	if(pStaged != NULL) {
+		pEnt = &pThis->raBatches[(pThis->raBatchHead + pThis->raBatchCnt) % pThis->raBatchMax];
+		pEnt->deqID = pWti->batch.deqID;
+		pEnt->nElemDeq = nDequeued + nDiscarded;
+		pEnt->fileNum = pStaged->fileNum;
+		pEnt->offs = pStaged->offs;
+		pEnt->bDone = 0;
+		++pThis->raBatchCnt;
+	}
+	*piRemainingQueueSize = getLogicalQueueSize(pThis);
+finalize_it:
 	RETiRet;
 }
 
 
 /* dequeue as many user pointers as are available, until we hit the configured
- * upper limit of pointers. Note that this function also deletes all processed
- * objects from the previous batch. However, it is perfectly valid that the
- * previous batch contained NO objects at all. For example, this happens
- * immediately after system startup or when a queue was exhausted and the queue
- * worker needed to wait for new data.
+ * upper limit of pointers. The caller must already have deleted the objects
+ * of the previous batch (nDeleted is their number, used for persisting).
  * This must only be called when the queue mutex is LOOKED, otherwise serious
  * malfunction will happen.
  */
 static rsRetVal
-DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSize, int *const pSkippedMsgs)
+DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSize, int *const pSkippedMsgs,
+	const int nDeleted)
 {
 	int nDequeued;
 	int nDiscarded;
-	int nDeleted;
 	int iQueueSize;
 	smsg_t *pMsg;
+	uint64_t tEnqNs;
 	rsRetVal localRet;
+	const uint64_t tNow = (pThis->pHistLatency == NULL) ? 0 : statsHistNowNs();
+	/* the DA worker just moves messages to disk, it always takes full batches */
+	const int iBatchSize = (pThis->bAdaptiveBatch && pWti->pWtp == pThis->pWtpReg)
+				? pThis->iDeqBatchSizeEff : pThis->iDeqBatchSize;
 	DEFiRet;
 
-	nDeleted = pWti->batch.nElemDeq;
-	DeleteProcessedBatch(pThis, &pWti->batch);
+	if(pThis->bReadAhead) {
+		iRet = DequeueStagedElements(pThis, pWti, piRemainingQueueSize, iBatchSize, nDeleted);
+		FINALIZE;
+	}
 
 	nDequeued = nDiscarded = 0;
 	if(pThis->qType == QUEUETYPE_DISK) {
 		pThis->tVars.disk.deqFileNumIn = strmGetCurrFileNum(pThis->tVars.disk.pReadDeq);
 	}
 
-	while((iQueueSize = getLogicalQueueSize(pThis)) > 0 && nDequeued < pThis->iDeqBatchSize) {
+	while((iQueueSize = getLogicalQueueSize(pThis)) > 0 && nDequeued < iBatchSize) {
 		int rd_fd = -1;
 		int64_t rd_offs = 0;
 		int wr_fd = -1;
@@ -1710,7 +2613,7 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 			break;
 		}
 
-		localRet = qqueueDeq(pThis, &pMsg);
+		localRet = qqueueDeq(pThis, &pMsg, &tEnqNs);
 		if(localRet == RS_RET_FILE_NOT_FOUND) {
 			DBGPRINTF("fatal error on disk queue '%s': file '%s' "
 				"not found, queue size said to be %d",
@@ -1719,7 +2622,7 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 		CHKiRet(localRet);
 
 		/* check if we should discard this element */
-		localRet = qqueueChkDiscardMsg(pThis, pThis->iQueueSize, pMsg);
+		localRet = qqueueChkDiscardMsg(pThis, getMarkQueueSize(pThis), pMsg);
 		if(localRet == RS_RET_QUEUE_FULL) {
 			++nDiscarded;
 			continue;
@@ -1728,6 +2631,8 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 		}
 
 		/* all well, use this element */
+		if(tNow != 0 && tEnqNs != 0 && tEnqNs <= tNow)
+			statsHistRecord(pThis->pHistLatency, (tNow - tEnqNs) / 1000);
 		pWti->batch.pElem[nDequeued].pMsg = pMsg;
 		pWti->batch.eltState[nDequeued] = BATCH_STATE_RDY;
 		++nDequeued;
@@ -1744,13 +2649,46 @@ DequeueConsumableElements(qqueue_t *pThis, wti_t *pWti, int *piRemainingQueueSiz
 	pWti->batch.nElem = nDequeued;
 	pWti->batch.nElemDeq = nDequeued + nDiscarded;
 	pWti->batch.deqID = getNextDeqID(pThis);
+	pThis->nCtlDeq += nDequeued + nDiscarded;
+	if(qqueueIsJournaled(pThis) && nDequeued + nDiscarded > 0)
+		qqueueJrnlBatchDeq(pThis, pWti->batch.deqID, nDequeued + nDiscarded);
 	*piRemainingQueueSize = iQueueSize;
 finalize_it:
 	RETiRet;
 }
 
 
-/* dequeue the queued object for the queue consumers.
+/* awake flow-controlled sources after a dequeue, if we can do this right now.
+ * Must be called with the queue mutex locked.
+ */
+static void
+wakeFlowControlledSources(qqueue_t *pThis, int iQueueSize)
+{
+	/* TODO: this could be done better from a performance point of view -- do it only if
+	 * we have someone waiting for the condition (or only when we hit the watermark right
+	 * on the nail [exact value]) -- rgerhards, 2008-03-14
+	 * now that we dequeue batches of pointers, this is much less an issue...
+	 * rgerhards, 2009-04-22
+	 */
+	if(qqueueIsSharded(pThis))
+		iQueueSize = getMarkQueueSize(pThis); /* the marks apply to the shard set */
+	if(iQueueSize < pThis->iFullDlyMrk / 2 || glbl.GetGlobalInputTermState() == 1) {
+		pthread_cond_broadcast(&pThis->belowFullDlyWtrMrk);
+	}
+
+	if(iQueueSize < pThis->iLightDlyMrk / 2) {
+		pthread_cond_broadcast(&pThis->belowLightDlyWtrMrk);
+	}
+
+	pthread_cond_signal(&pThis->notFull);
+}
+
+
+/* dequeue the queued object for the queue consumers. Note that this function
+ * also deletes all processed objects from the previous batch. However, it is
+ * perfectly valid that the previous batch contained NO objects at all. For
+ * example, this happens immediately after system startup or when a queue was
+ * exhausted and the queue worker needed to wait for new data.
  * rgerhards, 2008-10-21
  * I made a radical change - we now dequeue multiple elements, and store these objects in
  * an array of user pointers. We expect that this increases performance.
@@ -1761,31 +2699,19 @@ DequeueConsumable(qqueue_t *pThis, wti_t *pWti, int *const pSkippedMsgs)
 {
 	DEFiRet;
 	int iQueueSize = 0; /* keep the compiler happy... */
+	const int nDeleted = pWti->batch.nElemDeq;
+
+	DeleteProcessedBatch(pThis, &pWti->batch);
 
 	*pSkippedMsgs = 0;
 	/* dequeue element batch (still protected from mutex) */
-	iRet = DequeueConsumableElements(pThis, pWti, &iQueueSize, pSkippedMsgs);
+	iRet = DequeueConsumableElements(pThis, pWti, &iQueueSize, pSkippedMsgs, nDeleted);
 	if(*pSkippedMsgs > 0) {
 		DBGOPRINT((obj_t*) pThis, "lost %d messages from diskqueue (invalid .qi file)",
 			*pSkippedMsgs);
 	}
 
-	/* awake some flow-controlled sources if we can do this right now */
-	/* TODO: this could be done better from a performance point of view -- do it only if
-	 * we have someone waiting for the condition (or only when we hit the watermark right
-	 * on the nail [exact value]) -- rgerhards, 2008-03-14
-	 * now that we dequeue batches of pointers, this is much less an issue...
-	 * rgerhards, 2009-04-22
-	 */
-	if(iQueueSize < pThis->iFullDlyMrk / 2 || glbl.GetGlobalInputTermState() == 1) {
-		pthread_cond_broadcast(&pThis->belowFullDlyWtrMrk);
-	}
-
-	if(iQueueSize < pThis->iLightDlyMrk / 2) {
-		pthread_cond_broadcast(&pThis->belowLightDlyWtrMrk);
-	}
-
-	pthread_cond_signal(&pThis->notFull);
+	wakeFlowControlledSources(pThis, iQueueSize);
 	/* WE ARE NO LONGER PROTECTED BY THE MUTEX */
 
 	if(iRet != RS_RET_OK && iRet != RS_RET_DISCARDMSG) {
@@ -1956,6 +2882,101 @@ batchProcessed(qqueue_t *pThis, wti_t *pWti)
 }
 
 
+/* work stealing for sharded queues. This is called by a worker that found
+ * its own shard empty. We look for a sibling shard that has at least a full
+ * batch pending (so its own workers are behind) and process one batch from
+ * it. The stolen batch is deleted from the sibling's store before we return,
+ * so the caller's batch (and to-delete bookkeeping) is left untouched.
+ * Must be called with our own queue mutex NOT locked. Cancellation must be
+ * disabled, as the cancel cleanup handler would delete the batch from the
+ * wrong queue. Returns 1 if a batch was processed, 0 otherwise.
+ */
+static int
+StealFromShard(qqueue_t *const pThis, wti_t *const pWti)
+{
+	qqueue_t *const pRoot = (pThis->pShardRoot == NULL) ? pThis : pThis->pShardRoot;
+	qqueue_t *pVictim;
+	const qDeqID ownDeqID = pWti->batch.deqID;
+	int *const pbOwnShutdownImmediate = pWti->pbShutdownImmediate;
+	int iQueueSize;
+	int skippedMsgs;
+	int bStolen = 0;
+	int i;
+
+	ATOMIC_INC(&pRoot->nStealsActive, &pRoot->mutStealsActive);
+	if(!pRoot->bStealOK)
+		goto done;
+
+	for(i = 1 ; i < pThis->nShards && !bStolen ; ++i) {
+		pVictim = pThis->ppShards[(pThis->iShard + i) % pThis->nShards];
+		if(pVictim->bShutdownImmediate
+		   || getLogicalQueueSize(pVictim) < pVictim->iDeqBatchSize)
+			continue;
+		if(pthread_mutex_trylock(pVictim->mut) != 0)
+			continue; /* victim busy - do not contend for its lock */
+		skippedMsgs = 0;
+		iQueueSize = 0;
+		DequeueConsumableElements(pVictim, pWti, &iQueueSize, &skippedMsgs, 0);
+		wakeFlowControlledSources(pVictim, iQueueSize);
+		d_pthread_mutex_unlock(pVictim->mut);
+
+		if(pWti->batch.nElem > 0) {
+			DBGOPRINT((obj_t*) pThis, "stealing batch of %d messages from shard %d\n",
+				  pWti->batch.nElem, pVictim->iShard);
+			pWti->pbShutdownImmediate = &pVictim->bShutdownImmediate;
+			pThis->pConsumer(pThis->pAction, &pWti->batch, pWti);
+			STATSCOUNTER_ADD(pThis->ctrStolen, pThis->mutCtrStolen, pWti->batch.nElem);
+			bStolen = 1;
+		}
+
+		d_pthread_mutex_lock(pVictim->mut);
+		DeleteProcessedBatch(pVictim, &pWti->batch);
+		d_pthread_mutex_unlock(pVictim->mut);
+	}
+	pWti->batch.deqID = ownDeqID;
+	pWti->pbShutdownImmediate = pbOwnShutdownImmediate;
+
+done:
+	ATOMIC_DEC(&pRoot->nStealsActive, &pRoot->mutStealsActive);
+	return bStolen;
+}
+
+
+/* adapt the effective dequeue batch size after a batch of nElem messages
+ * took tSvc ns to process (AIMD):
+ *  - processing took longer than queue.batchmaxlatency: halve it,
+ *  - batch was full and at least another full batch is waiting: grow it
+ *    by the minimum batch size,
+ *  - batch was less than half full (light load): shrink it by the same step.
+ * Must be called with the queue mutex locked.
+ */
+static void
+qqueueAdaptBatchSize(qqueue_t *const pThis, const int nElem, const uint64_t tSvc)
+{
+	const int iOld = pThis->iDeqBatchSizeEff;
+	const int iStep = pThis->iDeqBatchSizeMin;
+	int iNew = iOld;
+
+	if(tSvc > (uint64_t) pThis->iBatchMaxLatency * 1000000) {
+		iNew = iOld / 2;
+	} else if(nElem >= iOld && getLogicalQueueSize(pThis) >= iOld) {
+		iNew = iOld + iStep;
+	} else if(nElem < iOld / 2) {
+		iNew = iOld - iStep;
+	}
+
+	if(iNew > pThis->iDeqBatchSize)
+		iNew = pThis->iDeqBatchSize;
+	if(iNew < pThis->iDeqBatchSizeMin)
+		iNew = pThis->iDeqBatchSizeMin;
+	if(iNew != iOld) {
+		DBGOPRINT((obj_t*) pThis, "adaptive batch size: %d -> %d (batch %d, %llu us)\n",
+			iOld, iNew, nElem, (unsigned long long) tSvc / 1000);
+		pThis->iDeqBatchSizeEff = iNew;
+	}
+}
+
+
 /* This is the queue consumer in the regular (non-DA) case. It is 
  * protected by the queue mutex, but MUST release it as soon as possible.
  * rgerhards, 2008-01-21
@@ -1967,6 +2988,8 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 	int bNeedReLock = 0;	/**< do we need to lock the mutex again? */
 	int skippedMsgs = 0;	/**< did the queue loose any messages (can happen with 
 	                         ** disk queue if .qi file is corrupt */
+	uint64_t tSvcStart = 0;	/**< consumer start time, for adaptive worker scaling */
+	uint64_t tSvc = 0;
 	DEFiRet;
 
 	ISOBJ_TYPE_assert(pThis, qqueue);
@@ -1981,6 +3004,14 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 		// TODO: think about what to return as iRet -- keep RS_RET_FILE_NOT_FOUND?
 		d_pthread_mutex_lock(pThis->mut);
 	}
+	if(iRet == RS_RET_IDLE && pThis->nShards > 1 && pWti->batch.nElemDeq == 0) {
+		/* nothing to do in our own shard, try to help a busy sibling */
+		d_pthread_mutex_unlock(pThis->mut);
+		if(StealFromShard(pThis, pWti))
+			iRet = RS_RET_OK;
+		d_pthread_mutex_lock(pThis->mut);
+		FINALIZE;
+	}
 	if (iRet != RS_RET_OK) {
 		FINALIZE;
 	}
@@ -2002,7 +3033,11 @@ ConsumerReg(qqueue_t *pThis, wti_t *pWti)
 
 
 	pWti->pbShutdownImmediate = &pThis->bShutdownImmediate;
+	if(pThis->bAdaptiveWrkrs || pThis->bAdaptiveBatch)
+		tSvcStart = statsHistNowNs();
 	CHKiRet(pThis->pConsumer(pThis->pAction, &pWti->batch, pWti));
+	if(tSvcStart != 0)
+		tSvc = statsHistNowNs() - tSvcStart;
 
 	/* we now need to check if we should deliberately delay processing a bit
 	 * and, if so, do that. -- rgerhards, 2008-01-30
@@ -2022,8 +3057,16 @@ finalize_it:
 	          getLogicalQueueSize(pThis), getPhysicalQueueSize(pThis));
 
 	/* now we are done, but potentially need to re-aquire the mutex */
-	if(bNeedReLock)
+	if(bNeedReLock) {
 		d_pthread_mutex_lock(pThis->mut);
+		STATSCOUNTER_SETMAX_NOMUT(pThis->ctrArenaMaxUsed, (int) pWti->arena.maxUsed);
+		if(tSvc != 0) {
+			pThis->nCtlSvcNs += tSvc;
+			pThis->nCtlSvcMsgs += pWti->batch.nElem;
+			if(pThis->bAdaptiveBatch)
+				qqueueAdaptBatchSize(pThis, pWti->batch.nElem, tSvc);
+		}
+	}
 
 	RETiRet;
 }
@@ -2073,6 +3116,8 @@ ConsumerDA(qqueue_t *pThis, wti_t *pWti)
 		}
 		pWti->batch.eltState[i] = BATCH_STATE_COMM; /* commited to other queue! */
 	}
+	if(pThis->pqDA->bGroupCommit)
+		iRet = qqueueGroupSync(pThis->pqDA, 0); /* one sync for the whole batch */
 
 	/* but now cancellation is no longer permitted */
 	pthread_setcancelstate(iCancelStateSave, NULL);
@@ -2107,8 +3152,10 @@ finalize_it:
 	}
 
 	/* now we are done, but potentially need to re-aquire the mutex */
-	if(bNeedReLock)
+	if(bNeedReLock) {
 		d_pthread_mutex_lock(pThis->mut);
+		STATSCOUNTER_SETMAX_NOMUT(pThis->ctrArenaMaxUsed, (int) pWti->arena.maxUsed);
+	}
 
 	RETiRet;
 }
@@ -2150,6 +3197,17 @@ ChkStopWrkrReg(qqueue_t *pThis)
 		iRet = RS_RET_TERMINATE_NOW;
 	} else if(pThis->pqParent != NULL) {
 		iRet = RS_RET_TERMINATE_WHEN_IDLE;
+	} else if(pThis->bAdaptiveWrkrs && getLogicalQueueSize(pThis) == 0) {
+		/* retire surplus workers, but only one per control window: the
+		 * worker count is decremented asynchronously when the thread exits.
+		 */
+		qqueueAdaptWorkers(pThis);
+		if(ATOMIC_FETCH_32BIT(&pThis->pWtpReg->iCurNumWrkThrd, &pThis->pWtpReg->mutCurNumWrkThrd)
+		     > pThis->iWrkrTarget
+		   && pThis->tCtlLast - pThis->tLastRetire >= WRKR_CTL_INTERVAL_NS) {
+			pThis->tLastRetire = pThis->tCtlLast;
+			iRet = RS_RET_TERMINATE_WHEN_IDLE;
+		}
 	}
 
 	RETiRet;
@@ -2171,6 +3229,242 @@ if(pThis->pqParent != NULL) // TODO: check why we actually do this!
 }
 
 
+/* return the home shard of the calling thread within the shard set of pThis.
+ * Threads are assigned a fixed index on first enqueue, so each input thread
+ * keeps hitting the same shard (and the same queue mutex).
+ */
+static qqueue_t *
+qqueueHomeShard(qqueue_t *const pThis)
+{
+	uintptr_t idx;
+
+	idx = (uintptr_t) pthread_getspecific(thrd_shard_key);
+	if(idx == 0) {
+		idx = ATOMIC_INC_AND_FETCH_unsigned(&nextHomeShard, &mutNextHomeShard) + 1;
+		pthread_setspecific(thrd_shard_key, (void*) idx);
+	}
+	return pThis->ppShards[(idx - 1) % pThis->nShards];
+}
+
+
+/* if the home shard is backlogged, make sure an idle sibling has a running
+ * worker, so that it can steal from us. We only trylock the sibling, this is
+ * purely advisory. Must be called with no queue mutex held.
+ */
+static void
+qqueueWakeSiblingShard(qqueue_t *const pHome)
+{
+	qqueue_t *pSib;
+	int i;
+
+	if(getLogicalQueueSize(pHome) < pHome->iDeqBatchSize)
+		return;
+	for(i = 1 ; i < pHome->nShards ; ++i) {
+		pSib = pHome->ppShards[(pHome->iShard + i) % pHome->nShards];
+		if(getLogicalQueueSize(pSib) != 0 || pSib->bEnqOnly)
+			continue;
+		if(pthread_mutex_trylock(pSib->mut) == 0) {
+			wtpAdviseMaxWorkers(pSib->pWtpReg, 1);
+			d_pthread_mutex_unlock(pSib->mut);
+			break;
+		}
+	}
+}
+
+
+/* multi-enqueue entry point of a sharded queue: submit to the home shard */
+static rsRetVal
+qqueueMultiEnqObjSharded(qqueue_t *pThis, multi_submit_t *pMultiSub)
+{
+	qqueue_t *const pHome = qqueueHomeShard(pThis);
+	DEFiRet;
+
+	iRet = qqueueMultiEnqObjNonDirect(pHome, pMultiSub);
+	qqueueWakeSiblingShard(pHome);
+	RETiRet;
+}
+
+
+/* the disk queue read-ahead thread: reads and deserializes messages that are
+ * on disk but not yet staged into the staging ring, outside of the queue
+ * mutex. Only this thread uses the dequeue stream, and it only reads records
+ * that are already counted in the queue size (and thus completely written).
+ */
+static void *
+qqueueReadAheadThrd(void *arg)
+{
+	qqueue_t *const pThis = (qqueue_t*) arg;
+	qRAMsg_t *pBuf;
+	uint64_t tEnqNs; /* unused, disk queues do not keep it */
+	rsRetVal localRet;
+	int nUnread;
+	int nRead;
+	int i;
+	int idx;
+
+	dbgSetThrdName((uchar*)"queue read-ahead");
+	if((pBuf = calloc(pThis->iReadAheadSize, sizeof(qRAMsg_t))) == NULL) {
+		errmsg.LogError(0, RS_RET_OUT_OF_MEMORY, "queue \"%s\": cannot run read-ahead thread",
+			obj.GetName((obj_t*) pThis));
+		return NULL;
+	}
+
+	d_pthread_mutex_lock(pThis->mut);
+	while(!pThis->bRAStop) {
+		nUnread = getLogicalQueueSize(pThis) - pThis->raCnt;
+		if(nUnread > pThis->iReadAheadSize - pThis->raCnt)
+			nUnread = pThis->iReadAheadSize - pThis->raCnt;
+		if(nUnread <= 0) {
+			pthread_cond_wait(&pThis->raCond, pThis->mut);
+			continue;
+		}
+		d_pthread_mutex_unlock(pThis->mut);
+
+		for(nRead = 0 ; nRead < nUnread && !pThis->bRAStop ; ++nRead) {
+			localRet = qDeqDisk(pThis, &pBuf[nRead].pMsg, &tEnqNs);
+			if(localRet != RS_RET_OK) {
+				DBGOPRINT((obj_t*) pThis, "read-ahead: error %d reading queue file, "
+					"record skipped\n", localRet);
+				pBuf[nRead].pMsg = NULL;
+			}
+			pBuf[nRead].fileNum = strmGetCurrFileNum(pThis->tVars.disk.pReadDeq);
+			strm.GetCurrOffset(pThis->tVars.disk.pReadDeq, &pBuf[nRead].offs);
+		}
+
+		d_pthread_mutex_lock(pThis->mut);
+		for(i = 0 ; i < nRead ; ++i) {
+			idx = (pThis->raHead + pThis->raCnt) % pThis->iReadAheadSize;
+			pThis->raMsgs[idx] = pBuf[i];
+			++pThis->raCnt;
+		}
+		qqueueAdviseMaxWorkers(pThis); /* wake workers for the staged data */
+	}
+	d_pthread_mutex_unlock(pThis->mut);
+
+	free(pBuf);
+	return NULL;
+}
+
+
+/* start the read-ahead thread of a disk queue. Must be called after the
+ * disk queue store has been constructed.
+ */
+static rsRetVal
+qqueueStartReadAhead(qqueue_t *const pThis)
+{
+	int r;
+	DEFiRet;
+
+	if(pThis->iReadAheadSize <= 0)
+		pThis->iReadAheadSize = 4 * pThis->iDeqBatchSize;
+	/* every worker holds at most one batch, and the current one is always
+	 * deleted before the next one is dequeued.
+	 */
+	pThis->raBatchMax = pThis->iNumWorkerThreads + 1;
+	CHKmalloc(pThis->raMsgs = calloc(pThis->iReadAheadSize, sizeof(qRAMsg_t)));
+	CHKmalloc(pThis->raBatches = calloc(pThis->raBatchMax, sizeof(qRABatch_t)));
+
+	r = pthread_create(&pThis->raThrdID, NULL, qqueueReadAheadThrd, pThis);
+	if(r != 0) {
+		errmsg.LogError(r, RS_RET_ERR, "queue \"%s\": cannot start read-ahead thread",
+			obj.GetName((obj_t*) pThis));
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	pThis->bRAThrdRunning = 1;
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* stop the read-ahead thread and discard the staged messages. They are
+ * still in the queue files and accounted in the queue size, so nothing is
+ * lost: they will be read again on the next start.
+ */
+static void
+qqueueStopReadAhead(qqueue_t *const pThis)
+{
+	int i;
+
+	if(!pThis->bRAThrdRunning)
+		return;
+	d_pthread_mutex_lock(pThis->mut);
+	pThis->bRAStop = 1;
+	pthread_cond_signal(&pThis->raCond);
+	d_pthread_mutex_unlock(pThis->mut);
+	pthread_join(pThis->raThrdID, NULL);
+	pThis->bRAThrdRunning = 0;
+
+	for(i = 0 ; i < pThis->raCnt ; ++i) {
+		smsg_t *pMsg = pThis->raMsgs[(pThis->raHead + i) % pThis->iReadAheadSize].pMsg;
+		if(pMsg != NULL)
+			msgDestruct(&pMsg);
+	}
+	pThis->raCnt = 0;
+}
+
+
+/* create the sibling shards of a sharded root queue. Each shard is a
+ * complete queue with its own mutex, workers and statistics; the
+ * parameters (already scaled down to the per-shard share) are copied from
+ * the root, which itself acts as shard 0.
+ */
+static rsRetVal
+qqueueStartShards(qqueue_t *const pThis)
+{
+	qqueue_t *pShard;
+	uchar pszName[128];
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pThis->ppShards = calloc(pThis->iNumShards, sizeof(qqueue_t*)));
+	pThis->ppShards[0] = pThis;
+	for(i = 1 ; i < pThis->iNumShards ; ++i) {
+		CHKiRet(qqueueConstruct(&pThis->ppShards[i], pThis->qType, pThis->iNumWorkerThreads,
+			pThis->iMaxQueueSize, pThis->pConsumer));
+		pShard = pThis->ppShards[i];
+		snprintf((char*) pszName, sizeof(pszName), "%s[%d]", obj.GetName((obj_t*) pThis), i);
+		obj.SetName((obj_t*) pShard, pszName);
+		pShard->iDeqBatchSize = pThis->iDeqBatchSize;
+		pShard->iHighWtrMrk = pThis->iHighWtrMrk;
+		pShard->iLowWtrMrk = pThis->iLowWtrMrk;
+		pShard->iFullDlyMrk = pThis->iFullDlyMrk;
+		pShard->iLightDlyMrk = pThis->iLightDlyMrk;
+		pShard->iDiscardMrk = pThis->iDiscardMrk;
+		pShard->iDiscardSeverity = pThis->iDiscardSeverity;
+		pShard->iMinMsgsPerWrkr = pThis->iMinMsgsPerWrkr;
+		pShard->toQShutdown = pThis->toQShutdown;
+		pShard->toActShutdown = pThis->toActShutdown;
+		pShard->toEnq = pThis->toEnq;
+		pShard->toWrkShutdown = pThis->toWrkShutdown;
+		pShard->iDeqSlowdown = pThis->iDeqSlowdown;
+		pShard->iDeqtWinFromHr = pThis->iDeqtWinFromHr;
+		pShard->iDeqtWinToHr = pThis->iDeqtWinToHr;
+		pShard->iSmpInterval = pThis->iSmpInterval;
+		pShard->bAdaptiveWrkrs = pThis->bAdaptiveWrkrs;
+		pShard->iTargetLatency = pThis->iTargetLatency;
+		pShard->bAdaptiveBatch = pThis->bAdaptiveBatch;
+		pShard->iDeqBatchSizeMin = pThis->iDeqBatchSizeMin;
+		pShard->iBatchMaxLatency = pThis->iBatchMaxLatency;
+		pShard->pAction = pThis->pAction;
+		pShard->nShards = pThis->iNumShards;
+		pShard->iShard = i;
+		pShard->ppShards = pThis->ppShards;
+		pShard->pShardRoot = pThis;
+		CHKiRet(qqueueStart(pShard));
+	}
+
+	/* only now that all shards are up, enable routing and stealing */
+	pThis->nShards = pThis->iNumShards;
+	pThis->MultiEnq = qqueueMultiEnqObjSharded;
+	pThis->bStealOK = 1;
+	DBGOPRINT((obj_t*) pThis, "started %d queue shards\n", pThis->nShards);
+
+finalize_it:
+	RETiRet;
+}
+
+
 /* start up the queue - it must have been constructed and parameters defined
  * before.
  */
@@ -2246,6 +3540,87 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 			break;
 	}
 
+	if(pThis->iNumShards > 1) {
+		if(   (pThis->qType != QUEUETYPE_LINKEDLIST && pThis->qType != QUEUETYPE_FIXED_ARRAY)
+		   || pThis->pszFilePrefix != NULL || pThis->pAction != NULL) {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.shards is only "
+				"supported for in-memory ruleset queues without queue.filename - "
+				"sharding disabled", obj.GetName((obj_t*) pThis));
+			pThis->iNumShards = 0;
+		} else {
+			/* size, watermarks and workers are for the shard set as a whole,
+			 * so each shard gets its share of them.
+			 */
+			pThis->iMaxQueueSize /= pThis->iNumShards;
+			if(pThis->iHighWtrMrk > 0) pThis->iHighWtrMrk /= pThis->iNumShards;
+			if(pThis->iLowWtrMrk > 0) pThis->iLowWtrMrk /= pThis->iNumShards;
+			if(pThis->iFullDlyMrk > 0) pThis->iFullDlyMrk /= pThis->iNumShards;
+			if(pThis->iLightDlyMrk > 0) pThis->iLightDlyMrk /= pThis->iNumShards;
+			if(pThis->iDiscardMrk > 0) pThis->iDiscardMrk /= pThis->iNumShards;
+			if(pThis->iMinMsgsPerWrkr > 0) pThis->iMinMsgsPerWrkr /= pThis->iNumShards;
+			pThis->iNumWorkerThreads = (pThis->iNumWorkerThreads + pThis->iNumShards - 1)
+						   / pThis->iNumShards;
+			if(pThis->iNumWorkerThreads < 1)
+				pThis->iNumWorkerThreads = 1;
+		}
+	}
+
+	if(pThis->bAdaptiveWrkrs) {
+		if(pThis->qType == QUEUETYPE_DISK || pThis->qType == QUEUETYPE_DIRECT) {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.workerscaling=\"adaptive\" "
+				"is only supported for in-memory queues - using size-based scaling",
+				obj.GetName((obj_t*) pThis));
+			pThis->bAdaptiveWrkrs = 0;
+		} else {
+			pThis->iWrkrTarget = 1;
+		}
+	}
+
+	if(pThis->bGroupCommit) {
+		if(!pThis->bSyncQueueFiles) {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.groupcommit has no "
+				"effect without queue.syncqueuefiles=\"on\" - ignored",
+				obj.GetName((obj_t*) pThis));
+			pThis->bGroupCommit = 0;
+		} else if(pThis->qType != QUEUETYPE_DISK && pThis->pszFilePrefix == NULL) {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.groupcommit is only "
+				"supported for disk and disk-assisted queues - ignored",
+				obj.GetName((obj_t*) pThis));
+			pThis->bGroupCommit = 0;
+		}
+	}
+
+	if(pThis->pszJrnlPrefix != NULL) {
+		if(   (pThis->qType != QUEUETYPE_LINKEDLIST && pThis->qType != QUEUETYPE_FIXED_ARRAY)
+		   || pThis->pszFilePrefix != NULL || pThis->iNumShards > 1 || pThis->useCryprov) {
+			errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.journalfile is only "
+				"supported for unsharded in-memory queues without queue.filename and "
+				"encryption - ignored", obj.GetName((obj_t*) pThis));
+			free(pThis->pszJrnlPrefix);
+			pThis->pszJrnlPrefix = NULL;
+		}
+	}
+
+	if(pThis->bReadAhead && (pThis->qType != QUEUETYPE_DISK || pThis->pqParent != NULL)) {
+		errmsg.LogError(0, RS_RET_PARAM_ERROR, "queue \"%s\": queue.readahead is only "
+			"supported for disk-only queues - ignored", obj.GetName((obj_t*) pThis));
+		pThis->bReadAhead = 0;
+	}
+
+	if(pThis->bAdaptiveBatch) {
+		if(pThis->qType == QUEUETYPE_DIRECT) {
+			pThis->bAdaptiveBatch = 0; /* nothing is dequeued, so nothing to adapt */
+		} else {
+			if(pThis->iDeqBatchSizeMin <= 0)
+				pThis->iDeqBatchSizeMin = pThis->iDeqBatchSize / 16;
+			if(pThis->iDeqBatchSizeMin < 1)
+				pThis->iDeqBatchSizeMin = 1;
+			if(pThis->iDeqBatchSizeMin > pThis->iDeqBatchSize)
+				pThis->iDeqBatchSizeMin = pThis->iDeqBatchSize;
+			pThis->iDeqBatchSizeEff = pThis->iDeqBatchSizeMin;
+		}
+	}
+
 	if(pThis->iMaxQueueSize < 100
 	   && (pThis->qType == QUEUETYPE_LINKEDLIST || pThis->qType == QUEUETYPE_FIXED_ARRAY)) {
 		errmsg.LogMsg(0, RS_RET_OK_WARN, LOG_WARNING, "Note: queue.size=\"%d\" is very "
@@ -2369,6 +3744,10 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	/* call type-specific constructor */
 	CHKiRet(pThis->qConstruct(pThis)); /* this also sets bIsDA */
 
+	/* replay the journal, if any; on failure, we just run without one */
+	if(pThis->pszJrnlPrefix != NULL)
+		qqueueJrnlOpen(pThis);
+
 	/* re-adjust some params if required */
 	if(pThis->bIsDA) {
 		/* if we are in DA mode, we must make sure full delayable messages do not
@@ -2414,6 +3793,11 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	if(pThis->bIsDA)
 		InitDA(pThis, LOCK_MUTEX); /* initiate DA mode */
 
+	if(pThis->bReadAhead) {
+		if(qqueueStartReadAhead(pThis) != RS_RET_OK)
+			pThis->bReadAhead = 0; /* fall back to reading in the workers */
+	}
+
 	DBGOPRINT((obj_t*) pThis, "queue finished initialization\n");
 
 	/* if the queue already contains data, we need to start the correct number of worker threads. This can be
@@ -2450,8 +3834,78 @@ qqueueStart(qqueue_t *pThis) /* this is the ConstructionFinalizer */
 	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("maxqsize"),
 		ctrType_Int, CTR_FLAG_NONE, &pThis->ctrMaxqsize));
 
+	pThis->ctrArenaMaxUsed = 0; /* guarded by queue mutex, thus no init call */
+	CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("arena.maxused"),
+		ctrType_Int, CTR_FLAG_NONE, &pThis->ctrArenaMaxUsed));
+
+	if(glblLatencyStats) {
+		CHKiRet(statsHistConstruct(&pThis->pHistLatency));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("latency.enqdeq.us"),
+			ctrType_Histogram, CTR_FLAG_RESETTABLE, pThis->pHistLatency));
+	}
+
+	if(pThis->bGroupCommit && pThis->qType == QUEUETYPE_DISK) {
+		CHKiRet(statsHistConstruct(&pThis->pHistSync));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("sync.latency.us"),
+			ctrType_Histogram, CTR_FLAG_RESETTABLE, pThis->pHistSync));
+		STATSCOUNTER_INIT(pThis->ctrSyncs, pThis->mutCtrSyncs);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("syncs"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrSyncs));
+		STATSCOUNTER_INIT(pThis->ctrSyncMsgs, pThis->mutCtrSyncMsgs);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("syncs.msgs"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrSyncMsgs));
+	}
+
+	if(pThis->bReadAhead) {
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("readahead.staged"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->raCnt));
+	}
+
+	if(pThis->pJrnlDel != NULL) {
+		STATSCOUNTER_INIT(pThis->ctrJrnlWrites, pThis->mutCtrJrnlWrites);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("journal.writes"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrJrnlWrites));
+		STATSCOUNTER_INIT(pThis->ctrJrnlCheckpoints, pThis->mutCtrJrnlCheckpoints);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("journal.checkpoints"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrJrnlCheckpoints));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("journal.replayed"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->ctrJrnlReplayed));
+	}
+
+	if(pThis->bAdaptiveBatch) {
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("batchsize.effective"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->iDeqBatchSizeEff));
+	}
+
+	if(pThis->bAdaptiveWrkrs) {
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("workers.target"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->iWrkrTarget));
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("workers.active"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->pWtpReg->iCurNumWrkThrd));
+		STATSCOUNTER_INIT(pThis->ctrScaleUp, pThis->mutCtrScaleUp);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("workers.scaleup"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrScaleUp));
+		STATSCOUNTER_INIT(pThis->ctrScaleDown, pThis->mutCtrScaleDown);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("workers.scaledown"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrScaleDown));
+	}
+
+	if(qqueueIsSharded(pThis)) {
+		STATSCOUNTER_INIT(pThis->ctrStolen, pThis->mutCtrStolen);
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("stolen"),
+			ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrStolen));
+	}
+	if(pThis->iNumShards > 1) {
+		/* iShardSetSize is a dual-use counter just like iQueueSize */
+		CHKiRet(statsobj.AddCounter(pThis->statsobj, UCHAR_CONSTANT("size.shards"),
+			ctrType_Int, CTR_FLAG_NONE, &pThis->iShardSetSize));
+	}
+
 	CHKiRet(statsobj.ConstructFinalize(pThis->statsobj));
 
+	if(pThis->iNumShards > 1)
+		CHKiRet(qqueueStartShards(pThis));
+
 finalize_it:
 	if(iRet != RS_RET_OK) {
 		/* note: a child uses it's parent mutex, so do not delete it! */
@@ -2643,8 +4097,24 @@ DoSaveOnShutdown(qqueue_t *pThis)
 
 /* destructor for the queue object */
 BEGINobjDestruct(qqueue) /* be sure to specify the object type also in END and CODESTART macros! */
+	int i;
 CODESTARTobjDestruct(qqueue)
 	DBGOPRINT((obj_t*) pThis, "shutdown: begin to destruct queue\n");
+	if(pThis->pShardRoot == NULL && pThis->ppShards != NULL) {
+		/* stop work stealing and wait until no stolen batch is in flight;
+		 * after that, the shards can be shut down independently.
+		 */
+		pThis->bStealOK = 0;
+		while(ATOMIC_FETCH_32BIT(&pThis->nStealsActive, &pThis->mutStealsActive) > 0)
+			srSleep(0, 10000);
+		for(i = 1 ; i < pThis->nShards ; ++i) {
+			if(pThis->ppShards[i] != NULL)
+				qqueueDestruct(&pThis->ppShards[i]);
+		}
+		free(pThis->ppShards);
+		pThis->ppShards = NULL;
+		pThis->nShards = 0;
+	}
 	if(pThis->bQueueStarted) {
 		/* shut down all workers
 		 * We do not need to shutdown workers when we are in enqueue-only mode or we are a
@@ -2654,6 +4124,7 @@ CODESTARTobjDestruct(qqueue)
 		if(pThis->qType != QUEUETYPE_DIRECT && !pThis->bEnqOnly && pThis->pqParent == NULL
 		   && pThis->pWtpReg != NULL)
 			ShutdownWorkers(pThis);
+		qqueueStopReadAhead(pThis);
 
 		if(pThis->bIsDA && getPhysicalQueueSize(pThis) > 0 && pThis->bSaveOnShutdown) {
 			CHKiRet(DoSaveOnShutdown(pThis));
@@ -2669,6 +4140,7 @@ CODESTARTobjDestruct(qqueue)
 		if(pThis->qType != QUEUETYPE_DIRECT && pThis->pWtpReg != NULL) {
 			wtpDestruct(&pThis->pWtpReg);
 		}
+		qqueueJrnlClose(pThis);
 
 		/* Now check if we actually have a DA queue and, if so, destruct it.
 		 * Note that the wtp must be destructed first, it may be in cancel cleanup handler
@@ -2709,6 +4181,8 @@ CODESTARTobjDestruct(qqueue)
 
 		DESTROY_ATOMIC_HELPER_MUT(pThis->mutQueueSize);
 		DESTROY_ATOMIC_HELPER_MUT(pThis->mutLogDeq);
+		DESTROY_ATOMIC_HELPER_MUT(pThis->mutStealsActive);
+		DESTROY_ATOMIC_HELPER_MUT(pThis->mutShardSetSize);
 
 		/* type-specific destructor */
 		iRet = pThis->qDestruct(pThis);
@@ -2716,6 +4190,7 @@ CODESTARTobjDestruct(qqueue)
 
 	free(pThis->pszFilePrefix);
 	free(pThis->pszSpoolDir);
+	free(pThis->pszPartitionKey);
 	if(pThis->useCryprov) {
 		pThis->cryprov.Destruct(&pThis->cryprovData);
 		obj.ReleaseObj(__FILE__, pThis->cryprovNameFull+2, pThis->cryprovNameFull,
@@ -2727,6 +4202,17 @@ CODESTARTobjDestruct(qqueue)
 	/* some queues do not provide stats and thus have no statsobj! */
 	if(pThis->statsobj != NULL)
 		statsobj.Destruct(&pThis->statsobj);
+	statsHistDestruct(&pThis->pHistLatency);
+	statsHistDestruct(&pThis->pHistSync);
+	pthread_mutex_destroy(&pThis->mutSync);
+	pthread_cond_destroy(&pThis->condSync);
+	pthread_cond_destroy(&pThis->raCond);
+	free(pThis->raMsgs);
+	free(pThis->raBatches);
+	free(pThis->pszJrnlPrefix);
+	free(pThis->pszJrnlCPNam);
+	free(pThis->jrnlPos);
+	free(pThis->jrnlBatches);
 ENDobjDestruct(qqueue)
 
 
@@ -2808,7 +4294,7 @@ doEnqSingleObj(qqueue_t *pThis, flowControl_t flowCtlType, smsg_t *pMsg)
 	STATSCOUNTER_INC(pThis->ctrEnqueued, pThis->mutCtrEnqueued);
 	/* first check if we need to discard this message (which will cause CHKiRet() to exit)
 	 */
-	CHKiRet(qqueueChkDiscardMsg(pThis, pThis->iQueueSize, pMsg));
+	CHKiRet(qqueueChkDiscardMsg(pThis, getMarkQueueSize(pThis), pMsg));
 
 	/* handle flow control
 	 * There are two different flow control mechanisms: basic and advanced flow control.
@@ -2831,7 +4317,7 @@ doEnqSingleObj(qqueue_t *pThis, flowControl_t flowCtlType, smsg_t *pMsg)
 	 * It's a side effect, but a good one ;) -- rgerhards, 2008-03-14
 	 */
 	if(flowCtlType == eFLOWCTL_FULL_DELAY) {
-		while(pThis->iQueueSize >= pThis->iFullDlyMrk&& ! glbl.GetGlobalInputTermState()) {
+		while(getMarkQueueSize(pThis) >= pThis->iFullDlyMrk&& ! glbl.GetGlobalInputTermState()) {
 			/* We have a problem during shutdown if we block eternally. In that
 			 * case, the the input thread cannot be terminated. So we wake up
 			 * from time to time to check for termination.
@@ -2859,7 +4345,7 @@ doEnqSingleObj(qqueue_t *pThis, flowControl_t flowCtlType, smsg_t *pMsg)
 			DBGPRINTF("wti worker in full delay timed out, checking termination...\n");
 		}
 	} else if(flowCtlType == eFLOWCTL_LIGHT_DELAY && !glbl.GetGlobalInputTermState()) {
-		if(pThis->iQueueSize >= pThis->iLightDlyMrk) {
+		if(getMarkQueueSize(pThis) >= pThis->iLightDlyMrk) {
 			DBGOPRINT((obj_t*) pThis, "doEnqSingleObject: LightDelay mark reached for light "
 			          "delayable message - blocking a bit.\n");
 			timeoutComp(&t, 1000); /* 1000 millisconds = 1 second TODO: make configurable */
@@ -2909,6 +4395,7 @@ doEnqSingleObj(qqueue_t *pThis, flowControl_t flowCtlType, smsg_t *pMsg)
 	/* and finally enqueue the message */
 	CHKiRet(qqueueAdd(pThis, pMsg));
 	STATSCOUNTER_SETMAX_NOMUT(pThis->ctrMaxqsize, pThis->iQueueSize);
+	++pThis->nCtlEnq;
 
 	/* check if we had a file rollover and need to persist
 	 * the .qi file for robustness reasons.
@@ -2945,6 +4432,7 @@ qqueueMultiEnqObjNonDirect(qqueue_t *pThis, multi_submit_t *pMultiSub)
 	int iCancelStateSave;
 	int i;
 	rsRetVal localRet;
+	uint64_t seq;
 	DEFiRet;
 
 	ISOBJ_TYPE_assert(pThis, qqueue);
@@ -2960,10 +4448,14 @@ qqueueMultiEnqObjNonDirect(qqueue_t *pThis, multi_submit_t *pMultiSub)
 	qqueueChkPersist(pThis, pMultiSub->nElem);
 
 finalize_it:
+	qqueueJrnlFlush(pThis); /* one journal write for the whole batch */
+	seq = pThis->nSeqWritten;
 	/* make sure at least one worker is running. */
 	qqueueAdviseMaxWorkers(pThis);
 	/* and release the mutex */
 	d_pthread_mutex_unlock(pThis->mut);
+	if(iRet == RS_RET_OK && qqueueNeedGroupSync(pThis))
+		iRet = qqueueGroupSync(pThis, seq); /* whole batch is covered by one sync */
 	pthread_setcancelstate(iCancelStateSave, NULL);
 	DBGOPRINT((obj_t*) pThis, "MultiEnqObj advised worker start\n");
 
@@ -2999,8 +4491,11 @@ qqueueEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, smsg_t *pMsg)
 {
 	DEFiRet;
 	int iCancelStateSave;
+	uint64_t seq = 0;
 	ISOBJ_TYPE_assert(pThis, qqueue);
 
+	if(pThis->nShards > 1 && pThis->pShardRoot == NULL)
+		pThis = qqueueHomeShard(pThis);
 	const int isNonDirectQ = pThis->qType != QUEUETYPE_DIRECT;
 
 	if(isNonDirectQ) {
@@ -3009,17 +4504,23 @@ qqueueEnqMsg(qqueue_t *pThis, flowControl_t flowCtlType, smsg_t *pMsg)
 	}
 
 	CHKiRet(doEnqSingleObj(pThis, flowCtlType, pMsg));
+	seq = pThis->nSeqWritten;
 
 	qqueueChkPersist(pThis, 1);
 
 finalize_it:
 	if(isNonDirectQ) {
+		qqueueJrnlFlush(pThis);
 		/* make sure at least one worker is running. */
 		qqueueAdviseMaxWorkers(pThis);
 		/* and release the mutex */
 		d_pthread_mutex_unlock(pThis->mut);
+		if(iRet == RS_RET_OK && seq != 0 && qqueueNeedGroupSync(pThis))
+			iRet = qqueueGroupSync(pThis, seq);
 		pthread_setcancelstate(iCancelStateSave, NULL);
 		DBGOPRINT((obj_t*) pThis, "EnqueueMsg advised worker start\n");
+		if(pThis->nShards > 1)
+			qqueueWakeSiblingShard(pThis);
 	}
 
 	RETiRet;
@@ -3170,6 +4671,47 @@ qqueueApplyCnfParam(qqueue_t *pThis, struct nvlst *lst)
 			pThis->iDeqtWinToHr = pvals[i].val.d.n;
 		} else if(!strcmp(pblk.descr[i].name, "queue.samplinginterval")) {
 			pThis->iSmpInterval = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.partitions")) {
+			pThis->iNumPartitions = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.partitionkey")) {
+			free(pThis->pszPartitionKey);
+			pThis->pszPartitionKey = (uchar*) es_str2cstr(pvals[i].val.d.estr, NULL);
+		} else if(!strcmp(pblk.descr[i].name, "queue.shards")) {
+			pThis->iNumShards = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.workerscaling")) {
+			if(!es_strbufcmp(pvals[i].val.d.estr, (uchar*)"adaptive", sizeof("adaptive")-1)) {
+				pThis->bAdaptiveWrkrs = 1;
+			} else if(!es_strbufcmp(pvals[i].val.d.estr, (uchar*)"size", sizeof("size")-1)) {
+				pThis->bAdaptiveWrkrs = 0;
+			} else {
+				parser_errmsg("queue.workerscaling must be \"size\" or \"adaptive\"");
+			}
+		} else if(!strcmp(pblk.descr[i].name, "queue.targetlatency")) {
+			pThis->iTargetLatency = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.batchsizing")) {
+			if(!es_strbufcmp(pvals[i].val.d.estr, (uchar*)"adaptive", sizeof("adaptive")-1)) {
+				pThis->bAdaptiveBatch = 1;
+			} else if(!es_strbufcmp(pvals[i].val.d.estr, (uchar*)"static", sizeof("static")-1)) {
+				pThis->bAdaptiveBatch = 0;
+			} else {
+				parser_errmsg("queue.batchsizing must be \"static\" or \"adaptive\"");
+			}
+		} else if(!strcmp(pblk.descr[i].name, "queue.mindequeuebatchsize")) {
+			pThis->iDeqBatchSizeMin = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.batchmaxlatency")) {
+			pThis->iBatchMaxLatency = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.groupcommit")) {
+			pThis->bGroupCommit = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.groupcommitdelay")) {
+			pThis->iGroupCommitDelay = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.readahead")) {
+			pThis->bReadAhead = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.readaheadsize")) {
+			pThis->iReadAheadSize = pvals[i].val.d.n;
+		} else if(!strcmp(pblk.descr[i].name, "queue.journalfile")) {
+			free(pThis->pszJrnlPrefix);
+			pThis->pszJrnlPrefix = (uchar*) es_str2cstr(pvals[i].val.d.estr, NULL);
+			pThis->lenJrnlPrefix = es_strlen(pvals[i].val.d.estr);
 		} else {
 			DBGPRINTF("queue: program error, non-handled "
 			  "param '%s'\n", pblk.descr[i].name);
@@ -3245,6 +4787,8 @@ static rsRetVal qqueueSetProperty(qqueue_t *pThis, var_t *pProp)
 #		endif
  	} else if(isProp("tVars.disk.sizeOnDisk")) {
 		pThis->tVars.disk.sizeOnDisk = pProp->val.num;
+ 	} else if(isProp("iJrnlSkip")) {
+		pThis->iJrnlSkip = pProp->val.num;
  	} else if(isProp("qType")) {
 		if(pThis->qType != pProp->val.num)
 			ABORT_FINALIZE(RS_RET_QTYPE_MISMATCH);
@@ -3270,6 +4814,12 @@ BEGINObjClassInit(qqueue, 1, OBJ_IS_CORE_MODULE)
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 
+	if(pthread_key_create(&thrd_shard_key, NULL) != 0) {
+		DBGPRINTF("queue.c: pthread_key_create failed\n");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+	INIT_ATOMIC_HELPER_MUT(mutNextHomeShard);
+
 	/* now set our own handlers */
 	OBJSetMethodHandler(objMethod_SETPROPERTY, qqueueSetProperty);
 ENDObjClassInit(qqueue)
@@ -49,10 +49,52 @@ typedef enum {
 	QUEUETYPE_DIRECT = 3 	  /* no queuing happens, consumer is directly called */
 } queueType_t;
 
+/* disk queue read-ahead: a staged (already deserialized) message and the
+ * queue file position right after it. pMsg is NULL if it could not be read.
+ */
+typedef struct qRAMsg_s {
+	smsg_t *pMsg;
+	int fileNum;
+	int64 offs;
+} qRAMsg_t;
+
+/* disk queue read-ahead: a dequeued batch whose data must not be deleted
+ * from the queue files before all batches dequeued ahead of it are done.
+ */
+typedef struct qRABatch_s {
+	qDeqID deqID;
+	int nElemDeq;
+	int fileNum;		/* position after the batch */
+	int64 offs;
+	sbool bDone;
+} qRABatch_t;
+
+/* journaled memory queue: journal position after all records with a
+ * sequence number below endSeq. begSeq is where the entry was started, as
+ * consecutive appends to the same file are coalesced into one entry.
+ */
+typedef struct qJrnlPos_s {
+	uint64_t begSeq;
+	uint64_t endSeq;
+	int fileNum;
+	int64 offs;
+} qJrnlPos_t;
+
+/* journaled memory queue: a dequeued batch, covering all records up to
+ * endSeq. The journal may only be checkpointed up to the first batch that
+ * is not yet done.
+ */
+typedef struct qJrnlBatch_s {
+	qDeqID deqID;
+	uint64_t endSeq;
+	sbool bDone;
+} qJrnlBatch_t;
+
 /* list member definition for linked list types of queues: */
 typedef struct qLinkedList_S {
 	struct qLinkedList_S *pNext;
 	smsg_t *pMsg;
+	uint64_t tEnqNs;	/* enqueue time (ns) for latency stats, 0 if off */
 } qLinkedList_t;
 
 
@@ -112,7 +154,7 @@ struct queue_s {
 	rsRetVal (*qConstruct)(struct queue_s *pThis);
 	rsRetVal (*qDestruct)(struct queue_s *pThis);
 	rsRetVal (*qAdd)(struct queue_s *pThis, smsg_t *pMsg);
-	rsRetVal (*qDeq)(struct queue_s *pThis, smsg_t **ppMsg);
+	rsRetVal (*qDeq)(struct queue_s *pThis, smsg_t **ppMsg, uint64_t *pEnqNs);
 	rsRetVal (*qDel)(struct queue_s *pThis);
 	/* end type-specific handler */
 	/* public entry points (set during construction, permit to set best algorithm for params selected) */
@@ -152,6 +194,7 @@ struct queue_s {
 		struct {
 			long deqhead, head, tail;
 			void** pBuf;		/* the queued user data structure */
+			uint64_t *pEnqNs;	/* per slot enqueue time, NULL if latency stats are off */
 		} farray;
 		struct {
 			qLinkedList_t *pDeqRoot;
@@ -183,7 +226,112 @@ struct queue_s {
 	STATSCOUNTER_DEF(ctrFDscrd, mutCtrFDscrd)
 	STATSCOUNTER_DEF(ctrNFDscrd, mutCtrNFDscrd)
 	int ctrMaxqsize; /* NOT guarded by a mutex */
+	int ctrArenaMaxUsed; /* peak worker arena usage, guarded by queue mutex */
 	int iSmpInterval; /* line interval of sampling logs */
+	int iNumPartitions; /* action queues: number of key-partitioned sub-queues (0/1 = off) */
+	uchar *pszPartitionKey; /* action queues: property that selects the partition */
+	/* sharded main queues: inputs enqueue into their home shard, idle
+	 * workers steal batches from busy sibling shards.
+	 */
+	int iNumShards;		/* configured number of shards (0/1 = off) */
+	int nShards;		/* number of active shards, 0 if not sharded */
+	int iShard;		/* index of this queue in its shard set */
+	struct queue_s **ppShards; /* shard set, [0] is the root queue */
+	struct queue_s *pShardRoot;/* root queue of the shard set, NULL for the root itself */
+	sbool bStealOK;		/* root only: work stealing permitted (cleared on shutdown) */
+	int nStealsActive;	/* root only: stolen batches currently being processed */
+	DEF_ATOMIC_HELPER_MUT(mutStealsActive)
+	int iShardSetSize;	/* root only: number of messages in all shards together */
+	DEF_ATOMIC_HELPER_MUT(mutShardSetSize)
+	STATSCOUNTER_DEF(ctrStolen, mutCtrStolen)
+	statshist_t *pHistLatency; /* enqueue-to-dequeue latency (us), NULL if latency stats are off */
+	/* adaptive worker scaling (queue.workerscaling="adaptive"): the worker
+	 * target is derived from measured rates and service time instead of
+	 * queue size. All members are guarded by the queue mutex.
+	 */
+	sbool bAdaptiveWrkrs;	/* use the adaptive controller? */
+	int iTargetLatency;	/* latency target in ms for adaptive workers */
+	int iWrkrTarget;	/* current worker target (also exported as stats) */
+	int nScaleDownVotes;	/* consecutive control windows asking for fewer workers */
+	int nCtlEnq;		/* msgs enqueued in current control window */
+	int nCtlDeq;		/* msgs dequeued in current control window */
+	int nCtlSvcMsgs;	/* msgs processed by consumers in current control window */
+	uint64_t nCtlSvcNs;	/* consumer time spent on them */
+	uint64_t tCtlLast;	/* start of current control window */
+	uint64_t tLastRetire;	/* when a worker was last asked to retire */
+	uint64_t enqRate;	/* smoothed enqueue rate (msgs/s) */
+	uint64_t deqRate;	/* smoothed dequeue rate (msgs/s) */
+	uint64_t svcNsPerMsg;	/* smoothed consumer service time per msg */
+	STATSCOUNTER_DEF(ctrScaleUp, mutCtrScaleUp)
+	STATSCOUNTER_DEF(ctrScaleDown, mutCtrScaleDown)
+	/* adaptive dequeue batch sizing (queue.batchsizing="adaptive"), AIMD
+	 * between iDeqBatchSizeMin and iDeqBatchSize. Guarded by the queue mutex.
+	 */
+	sbool bAdaptiveBatch;	/* use adaptive batch sizing? */
+	int iDeqBatchSizeMin;	/* lower bound, also the additive step */
+	int iBatchMaxLatency;	/* max ms to process one batch before it is halved */
+	int iDeqBatchSizeEff;	/* effective batch size (also exported as stats) */
+	/* group commit for disk queues (queue.groupcommit): enqueuers wait until
+	 * their write is covered by a shared fdatasync instead of syncing each
+	 * write. nSeqWritten is guarded by the queue mutex, the rest by mutSync.
+	 */
+	sbool bGroupCommit;	/* share syncs between enqueuers? */
+	int iGroupCommitDelay;	/* max us a sync leader waits for more writes to join */
+	uint64_t nSeqWritten;	/* nbr of msgs written to the queue file */
+	uint64_t nSeqSynced;	/* nbr of msgs known to be on stable storage */
+	uint64_t nSeqSyncFailed;	/* highest seq covered by a failed sync */
+	int64_t iSyncedFNum;	/* write file covered by the last good sync, -1 if none */
+	sbool bSyncRunning;	/* a leader is currently syncing */
+	pthread_mutex_t mutSync;
+	pthread_cond_t condSync;
+	statshist_t *pHistSync;	/* sync latency (us) */
+	STATSCOUNTER_DEF(ctrSyncs, mutCtrSyncs)
+	STATSCOUNTER_DEF(ctrSyncMsgs, mutCtrSyncMsgs)
+	/* read-ahead for disk queues (queue.readahead): a separate thread reads
+	 * and deserializes messages into a staging ring, from which any number
+	 * of workers dequeue. Guarded by the queue mutex.
+	 */
+	sbool bReadAhead;	/* read-ahead enabled? */
+	int iReadAheadSize;	/* staging capacity in msgs */
+	sbool bRAThrdRunning;
+	sbool bRAStop;		/* tell the read-ahead thread to terminate */
+	pthread_t raThrdID;
+	pthread_cond_t raCond;	/* read-ahead thread waits for data or room */
+	qRAMsg_t *raMsgs;	/* staging ring */
+	int raHead;
+	int raCnt;		/* msgs staged */
+	qRABatch_t *raBatches;	/* batches in flight, in dequeue order */
+	int raBatchHead;
+	int raBatchCnt;
+	int raBatchMax;
+	/* write-ahead journal for memory queues (queue.journal): every enqueued
+	 * message is appended to a sequential journal, which is checkpointed
+	 * as batches are deleted and replayed on startup. Records are numbered
+	 * in enqueue (== dequeue) order. Guarded by the queue mutex.
+	 */
+	uchar *pszJrnlPrefix;	/* journal file name prefix, NULL if not journaled */
+	size_t lenJrnlPrefix;
+	uchar *pszJrnlCPNam;	/* full checkpoint file name */
+	strm_t *pJrnlWrite;	/* appends new records */
+	strm_t *pJrnlDel;	/* checkpoint position, deletes processed files */
+	int iJrnlSkip;		/* records after pJrnlDel position that are done */
+	uint64_t nJrnlWritten;	/* records appended (seq of next record) */
+	uint64_t nJrnlFlushed;	/* records handed to the OS */
+	uint64_t nJrnlDeq;	/* records dequeued */
+	uint64_t nJrnlDone;	/* all records below are processed */
+	uint64_t nJrnlCPSeq;	/* seq at pJrnlDel position */
+	uint64_t nJrnlCPDone;	/* nJrnlDone at last checkpoint */
+	qJrnlPos_t *jrnlPos;	/* journal positions, in seq order */
+	int jrnlPosHead;
+	int jrnlPosCnt;
+	int jrnlPosMax;
+	qJrnlBatch_t *jrnlBatches; /* batches in flight, in dequeue order */
+	int jrnlBatchHead;
+	int jrnlBatchCnt;
+	int jrnlBatchMax;
+	STATSCOUNTER_DEF(ctrJrnlWrites, mutCtrJrnlWrites)
+	STATSCOUNTER_DEF(ctrJrnlCheckpoints, mutCtrJrnlCheckpoints)
+	int ctrJrnlReplayed;	/* msgs recovered at startup, set once */
 };
 
 
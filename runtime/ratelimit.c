@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "rsyslog.h"
 #include "errmsg.h"
@@ -34,6 +38,9 @@
 #include "msg.h"
 #include "rsconf.h"
 #include "dirty.h"
+#include "atomic.h"
+#include "hashmap.h"
+#include "statsobj.h"
 
 /* definitions for objects we access */
 DEFobjStaticHelpers
@@ -41,6 +48,7 @@ DEFobjCurrIf(errmsg)
 DEFobjCurrIf(glbl)
 DEFobjCurrIf(datetime)
 DEFobjCurrIf(parser)
+DEFobjCurrIf(statsobj)
 
 /* static data */
 
@@ -182,6 +190,447 @@ finalize_it:
 	return ret;
 }
 
+/* token-bucket rate limiting
+ * Buckets hold milli-tokens, so a rate of r tokens/second refills exactly
+ * r milli-tokens per millisecond and no fractional state is needed. The
+ * global bucket is packed into a single 64 bit word (milli-tokens in the
+ * upper half, a millisecond timestamp in the lower half) and updated via
+ * CAS, so the common case does not lock. Per-key buckets live in a sharded
+ * hash map; each shard has its own mutex and an LRU list that bounds the
+ * number of keys we track, so a flood of spoofed senders can only evict
+ * old entries, but not exhaust memory.
+ */
+#define TBRL_NSHARDS 16
+#define TBRL_MILLI 1000
+#define TBRL_MAXKEYLEN 64	/* longer keys are truncated */
+#define TBRL_MAXBURST 4000000	/* must fit into the upper half of the global state */
+#define TBRL_MAXSKEW 1000	/* ms a concurrent caller's clock may be ahead of ours */
+
+typedef struct tbrl_key_s {
+	unsigned hash;
+	unsigned len;
+	uchar data[];
+} tbrl_key_t;
+
+typedef struct tbrl_bucket_s {
+	tbrl_key_t *key;	/* owned by the hash map */
+	uint64 tokens;		/* milli-tokens */
+	uint64 tLast;		/* ms timestamp of last refill */
+	sbool bDropping;	/* are we currently dropping for this key? */
+	struct tbrl_bucket_s *lruPrev;
+	struct tbrl_bucket_s *lruNext;
+} tbrl_bucket_t;
+
+typedef struct tbrl_shard_s {
+	pthread_mutex_t mut;
+	hashmap_t *map;
+	tbrl_bucket_t *lruHead; /* most recently used */
+	tbrl_bucket_t *lruTail;
+	unsigned nKeys;
+} tbrl_shard_t;
+
+struct tbratelimit_s {
+	char *name;
+	unsigned rate;		/* per key, tokens per second */
+	unsigned burst;
+	unsigned maxKeysShard;
+	unsigned globalRate;
+	unsigned globalBurst;
+	uint64 globalState;	/* milli-tokens << 32 | ms timestamp */
+	DEF_ATOMIC_HELPER_MUT64(mutGlobalState)
+	time_t tLastDropMsg;	/* throttles "begin to drop" messages */
+	DEF_ATOMIC_HELPER_MUT(mutLastDropMsg)
+	tbrl_shard_t shards[TBRL_NSHARDS];
+	statsobj_t *stats;
+	STATSCOUNTER_DEF(ctrPassed, mutCtrPassed)
+	STATSCOUNTER_DEF(ctrDroppedKey, mutCtrDroppedKey)
+	STATSCOUNTER_DEF(ctrDroppedGlobal, mutCtrDroppedGlobal)
+	STATSCOUNTER_DEF(ctrEvicted, mutCtrEvicted)
+	int nKeys;
+	DEF_ATOMIC_HELPER_MUT(mutNKeys)
+};
+
+static uint64
+tbrlNow(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* add the tokens earned in elapsed ms, up to the bucket's capacity */
+static uint64
+tbrlAddTokens(uint64 tokens, const uint64 elapsed, const unsigned rate, const unsigned burst)
+{
+	const uint64 cap = (uint64) burst * TBRL_MILLI;
+
+	if(elapsed >= cap) /* full at any rate, also keeps the product in range */
+		return cap;
+	tokens += elapsed * rate;
+	return (tokens > cap) ? cap : tokens;
+}
+
+/* refill a per-key bucket. The caller took its time before locking the
+ * shard, so another caller may already have stored a newer one; in that
+ * case we do not refill.
+ */
+static uint64
+tbrlRefill(uint64 tokens, uint64 *const pLast, const uint64 now,
+	const unsigned rate, const unsigned burst)
+{
+	if(now <= *pLast)
+		return tokens;
+	tokens = tbrlAddTokens(tokens, now - *pLast, rate, burst);
+	*pLast = now;
+	return tokens;
+}
+
+/* refill the global bucket, whose timestamp is only the lower 32 bits of
+ * the ms clock and wraps after ~49 days. A concurrent caller may have
+ * stored a slightly newer time than ours, in which case we do not refill.
+ * A larger negative difference means the bucket was idle for more than
+ * ~24.8 days, so it is full by now.
+ */
+static uint64
+tbrlRefillGlobal(uint64 tokens, uint32_t *const pLast, const uint32_t now,
+	const unsigned rate, const unsigned burst)
+{
+	const uint32_t elapsed = now - *pLast;
+
+	if((int32_t) elapsed <= 0) {
+		if((int32_t) elapsed >= -TBRL_MAXSKEW)
+			return tokens;
+		*pLast = now;
+		return (uint64) burst * TBRL_MILLI;
+	}
+	*pLast = now;
+	return tbrlAddTokens(tokens, elapsed, rate, burst);
+}
+
+/* take one token from the global bucket, returns 1 if we got it */
+static int
+tbrlTakeGlobal(tbratelimit_t *const pThis, const uint64 now)
+{
+	uint64 oldState, newState, tokens;
+	uint32_t tLast;
+
+	do {
+		oldState = pThis->globalState;
+		tLast = (uint32_t) oldState;
+		tokens = tbrlRefillGlobal(oldState >> 32, &tLast, (uint32_t) now,
+			pThis->globalRate, pThis->globalBurst);
+		if(tokens < TBRL_MILLI)
+			return 0;
+		newState = ((tokens - TBRL_MILLI) << 32) | tLast;
+	} while(!ATOMIC_CAS_uint64(&pThis->globalState, oldState, newState, &pThis->mutGlobalState));
+	return 1;
+}
+
+/* give back a global token if the message was dropped at the key level */
+static void
+tbrlReturnGlobal(tbratelimit_t *const pThis)
+{
+	ATOMIC_ADD_uint64(&pThis->globalState, &pThis->mutGlobalState, (uint64) TBRL_MILLI << 32);
+}
+
+static unsigned
+tbrlHashKey(void *k)
+{
+	return ((tbrl_key_t*) k)->hash;
+}
+
+static int
+tbrlEqKey(void *k1, void *k2)
+{
+	tbrl_key_t *const key1 = (tbrl_key_t*) k1;
+	tbrl_key_t *const key2 = (tbrl_key_t*) k2;
+	return key1->len == key2->len && !memcmp(key1->data, key2->data, key1->len);
+}
+
+/* LRU list handling, the shard mutex must be locked */
+static void
+tbrlLruUnlink(tbrl_shard_t *const shard, tbrl_bucket_t *const bucket)
+{
+	if(bucket->lruPrev == NULL)
+		shard->lruHead = bucket->lruNext;
+	else
+		bucket->lruPrev->lruNext = bucket->lruNext;
+	if(bucket->lruNext == NULL)
+		shard->lruTail = bucket->lruPrev;
+	else
+		bucket->lruNext->lruPrev = bucket->lruPrev;
+	bucket->lruPrev = bucket->lruNext = NULL;
+}
+
+static void
+tbrlLruPushHead(tbrl_shard_t *const shard, tbrl_bucket_t *const bucket)
+{
+	bucket->lruPrev = NULL;
+	bucket->lruNext = shard->lruHead;
+	if(shard->lruHead == NULL)
+		shard->lruTail = bucket;
+	else
+		shard->lruHead->lruPrev = bucket;
+	shard->lruHead = bucket;
+}
+
+/* add a bucket for a key not yet known, evicting the least recently used
+ * ones if the shard is full. Shard mutex must be locked. Returns NULL if
+ * out of memory.
+ */
+static tbrl_bucket_t *
+tbrlAddBucket(tbratelimit_t *const pThis, tbrl_shard_t *const shard,
+	const tbrl_key_t *const lookupKey, const uint64 now)
+{
+	tbrl_bucket_t *bucket;
+	tbrl_bucket_t *victim;
+	tbrl_key_t *key;
+
+	while(shard->nKeys >= pThis->maxKeysShard && shard->lruTail != NULL) {
+		victim = shard->lruTail;
+		tbrlLruUnlink(shard, victim);
+		hashmapRemove(shard->map, victim->key);
+		free(victim);
+		--shard->nKeys;
+		ATOMIC_DEC(&pThis->nKeys, &pThis->mutNKeys);
+		STATSCOUNTER_INC(pThis->ctrEvicted, pThis->mutCtrEvicted);
+	}
+
+	if((bucket = calloc(1, sizeof(tbrl_bucket_t))) == NULL)
+		return NULL;
+	if((key = malloc(sizeof(tbrl_key_t) + lookupKey->len)) == NULL) {
+		free(bucket);
+		return NULL;
+	}
+	memcpy(key, lookupKey, sizeof(tbrl_key_t) + lookupKey->len);
+	if(!hashmapInsert(shard->map, key, bucket)) {
+		free(key);
+		free(bucket);
+		return NULL;
+	}
+	bucket->key = key;
+	bucket->tokens = (uint64) pThis->burst * TBRL_MILLI;
+	bucket->tLast = now;
+	tbrlLruPushHead(shard, bucket);
+	++shard->nKeys;
+	ATOMIC_INC(&pThis->nKeys, &pThis->mutNKeys);
+	return bucket;
+}
+
+/* take one token from the bucket for the given key, returns 1 if we got
+ * it. *pbBeginDrop is set if this is the first drop for the key after it
+ * was in rate.
+ */
+static int
+tbrlTakeKey(tbratelimit_t *const pThis, const void *const keyData, size_t lenKey,
+	const uint64 now, int *const pbBeginDrop)
+{
+	union {
+		tbrl_key_t key;
+		uchar buf[sizeof(tbrl_key_t) + TBRL_MAXKEYLEN];
+	} lookup;
+	tbrl_shard_t *shard;
+	tbrl_bucket_t *bucket;
+	const uchar *p;
+	unsigned hash = 2166136261u; /* FNV-1a */
+	unsigned i;
+	int bAllow;
+
+	if(lenKey > TBRL_MAXKEYLEN)
+		lenKey = TBRL_MAXKEYLEN;
+	p = (const uchar*) keyData;
+	for(i = 0 ; i < lenKey ; ++i)
+		hash = (hash ^ p[i]) * 16777619u;
+	lookup.key.hash = hash;
+	lookup.key.len = lenKey;
+	memcpy(lookup.key.data, keyData, lenKey);
+
+	shard = &pThis->shards[hash % TBRL_NSHARDS];
+	pthread_mutex_lock(&shard->mut);
+	bucket = hashmapSearch(shard->map, &lookup.key);
+	if(bucket == NULL) {
+		bucket = tbrlAddBucket(pThis, shard, &lookup.key, now);
+		if(bucket == NULL) {
+			/* out of memory: we cannot track this key, so let it pass
+			 * (the global bucket still applies)
+			 */
+			bAllow = 1;
+			goto done;
+		}
+	} else if(bucket != shard->lruHead) {
+		tbrlLruUnlink(shard, bucket);
+		tbrlLruPushHead(shard, bucket);
+	}
+
+	bucket->tokens = tbrlRefill(bucket->tokens, &bucket->tLast, now, pThis->rate, pThis->burst);
+	if(bucket->tokens >= TBRL_MILLI) {
+		bucket->tokens -= TBRL_MILLI;
+		bucket->bDropping = 0;
+		bAllow = 1;
+	} else {
+		*pbBeginDrop = !bucket->bDropping;
+		bucket->bDropping = 1;
+		bAllow = 0;
+	}
+done:
+	pthread_mutex_unlock(&shard->mut);
+	return bAllow;
+}
+
+/* emit an internal message when a source begins to be limited. As a flood
+ * from many sources would otherwise flood us with these messages as well,
+ * we emit at most one per limiter and 10 seconds.
+ */
+static void
+tbrlTellBeginDrop(tbratelimit_t *const pThis, const char *const what)
+{
+	uchar msgbuf[1024];
+	time_t tLast;
+	time_t tt;
+
+	datetime.GetTime(&tt);
+	tLast = pThis->tLastDropMsg;
+	if(tt < tLast + 10 || !ATOMIC_CAS_time_t(&pThis->tLastDropMsg, tLast, tt, &pThis->mutLastDropMsg))
+		return;
+	snprintf((char*)msgbuf, sizeof(msgbuf),
+		 "%s: begin to drop messages due to %s rate-limiting", pThis->name, what);
+	logmsgInternal(RS_RET_RATE_LIMITED, LOG_SYSLOG|LOG_INFO, msgbuf, 0);
+}
+
+/* check if a message for the given key is within rate. key may be NULL,
+ * in which case only the global limit is checked. Returns 1 if the message
+ * shall be processed, 0 if it must be dropped.
+ */
+int
+tbratelimitAllow(tbratelimit_t *const pThis, const void *const key, const size_t lenKey)
+{
+	const uint64 now = tbrlNow();
+	int bBeginDrop = 0;
+
+	if(pThis->globalRate != 0 && !tbrlTakeGlobal(pThis, now)) {
+		STATSCOUNTER_INC(pThis->ctrDroppedGlobal, pThis->mutCtrDroppedGlobal);
+		tbrlTellBeginDrop(pThis, "global");
+		return 0;
+	}
+	if(pThis->rate != 0 && key != NULL && !tbrlTakeKey(pThis, key, lenKey, now, &bBeginDrop)) {
+		if(pThis->globalRate != 0)
+			tbrlReturnGlobal(pThis);
+		STATSCOUNTER_INC(pThis->ctrDroppedKey, pThis->mutCtrDroppedKey);
+		if(bBeginDrop)
+			tbrlTellBeginDrop(pThis, "per-source");
+		return 0;
+	}
+	STATSCOUNTER_INC(pThis->ctrPassed, pThis->mutCtrPassed);
+	return 1;
+}
+
+rsRetVal
+tbratelimitNew(tbratelimit_t **ppThis, const char *name, unsigned rate, unsigned burst,
+	unsigned maxKeys, unsigned globalRate, unsigned globalBurst)
+{
+	tbratelimit_t *pThis = NULL;
+	char statsname[256];
+	int i;
+	DEFiRet;
+
+	CHKmalloc(pThis = calloc(1, sizeof(tbratelimit_t)));
+	CHKmalloc(pThis->name = strdup(name));
+	pThis->rate = rate;
+	pThis->burst = (burst == 0) ? rate : burst;
+	pThis->globalRate = globalRate;
+	pThis->globalBurst = (globalBurst == 0) ? globalRate : globalBurst;
+	if(pThis->globalBurst > TBRL_MAXBURST)
+		pThis->globalBurst = TBRL_MAXBURST;
+	pThis->maxKeysShard = (maxKeys + TBRL_NSHARDS - 1) / TBRL_NSHARDS;
+	if(pThis->maxKeysShard == 0)
+		pThis->maxKeysShard = 1;
+	pThis->globalState = ((uint64) pThis->globalBurst * TBRL_MILLI << 32) | (uint32_t) tbrlNow();
+	INIT_ATOMIC_HELPER_MUT64(pThis->mutGlobalState);
+	INIT_ATOMIC_HELPER_MUT(pThis->mutNKeys);
+	INIT_ATOMIC_HELPER_MUT(pThis->mutLastDropMsg);
+	for(i = 0 ; i < TBRL_NSHARDS ; ++i) {
+		pthread_mutex_init(&pThis->shards[i].mut, NULL);
+		CHKmalloc(pThis->shards[i].map = hashmapNew(64, tbrlHashKey, tbrlEqKey, NULL));
+	}
+
+	snprintf(statsname, sizeof(statsname), "%s.ratelimit", name);
+	statsname[sizeof(statsname)-1] = '\0';
+	CHKiRet(statsobj.Construct(&pThis->stats));
+	CHKiRet(statsobj.SetName(pThis->stats, (uchar*)statsname));
+	CHKiRet(statsobj.SetOrigin(pThis->stats, (uchar*)"core.ratelimit"));
+	STATSCOUNTER_INIT(pThis->ctrPassed, pThis->mutCtrPassed);
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("passed"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrPassed));
+	STATSCOUNTER_INIT(pThis->ctrDroppedKey, pThis->mutCtrDroppedKey);
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("dropped.source"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrDroppedKey));
+	STATSCOUNTER_INIT(pThis->ctrDroppedGlobal, pThis->mutCtrDroppedGlobal);
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("dropped.global"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrDroppedGlobal));
+	STATSCOUNTER_INIT(pThis->ctrEvicted, pThis->mutCtrEvicted);
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("evicted"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &pThis->ctrEvicted));
+	CHKiRet(statsobj.AddCounter(pThis->stats, UCHAR_CONSTANT("sources"),
+		ctrType_Int, CTR_FLAG_NONE, &pThis->nKeys));
+	CHKiRet(statsobj.ConstructFinalize(pThis->stats));
+
+	DBGPRINTF("ratelimit:%s: token bucket rate %u burst %u maxkeys %u, global rate %u burst %u\n",
+		  pThis->name, pThis->rate, pThis->burst, maxKeys, pThis->globalRate, pThis->globalBurst);
+	*ppThis = pThis;
+finalize_it:
+	if(iRet != RS_RET_OK && pThis != NULL)
+		tbratelimitDestruct(pThis);
+	RETiRet;
+}
+
+void
+tbratelimitDestruct(tbratelimit_t *pThis)
+{
+	int i;
+
+	if(pThis->stats != NULL)
+		statsobj.Destruct(&pThis->stats);
+	for(i = 0 ; i < TBRL_NSHARDS ; ++i) {
+		if(pThis->shards[i].map != NULL)
+			hashmapDestroy(pThis->shards[i].map, 1);
+		pthread_mutex_destroy(&pThis->shards[i].mut);
+	}
+	DESTROY_ATOMIC_HELPER_MUT64(pThis->mutGlobalState);
+	DESTROY_ATOMIC_HELPER_MUT(pThis->mutNKeys);
+	DESTROY_ATOMIC_HELPER_MUT(pThis->mutLastDropMsg);
+	free(pThis->name);
+	free(pThis);
+}
+
+
+/* obtain the per-source key of a message. For unresolved senders (imudp),
+ * this is the raw address, otherwise the fromhost-ip string. The message
+ * is still owned by the input, so no locking is needed.
+ */
+static const void *
+getSenderKey(smsg_t *const pMsg, size_t *const pLenKey)
+{
+	struct sockaddr_storage *addr;
+
+	if(pMsg->msgFlags & NEEDS_DNSRESOL) {
+		addr = pMsg->rcvFrom.pfrominet;
+		if(addr == NULL)
+			return NULL;
+		if(addr->ss_family == AF_INET) {
+			*pLenKey = sizeof(struct in_addr);
+			return &((struct sockaddr_in*) addr)->sin_addr;
+		} else if(addr->ss_family == AF_INET6) {
+			*pLenKey = sizeof(struct in6_addr);
+			return &((struct sockaddr_in6*) addr)->sin6_addr;
+		}
+		return NULL;
+	}
+	if(pMsg->pRcvFromIP == NULL)
+		return NULL;
+	*pLenKey = pMsg->pRcvFromIP->len;
+	return propGetSzStr(pMsg->pRcvFromIP);
+}
+
 
 /* ratelimit a message, that means:
  * - handle "last message repeated n times" logic
@@ -202,6 +651,8 @@ ratelimitMsg(ratelimit_t *ratelimit, smsg_t *pMsg, smsg_t **ppRepMsg)
 {
 	DEFiRet;
 	rsRetVal localRet;
+	const void *key;
+	size_t lenKey = 0;
 
 	*ppRepMsg = NULL;
 
@@ -214,6 +665,13 @@ ratelimitMsg(ratelimit_t *ratelimit, smsg_t *pMsg, smsg_t **ppRepMsg)
 
 	/* Only the messages having severity level at or below the
 	 * treshold (the value is >=) are subject to ratelimiting. */
+	if(ratelimit->tb != NULL && (pMsg->iSeverity >= ratelimit->severity)) {
+		key = getSenderKey(pMsg, &lenKey);
+		if(tbratelimitAllow(ratelimit->tb, key, lenKey) == 0) {
+			msgDestruct(&pMsg);
+			ABORT_FINALIZE(RS_RET_DISCARDMSG);
+		}
+	}
 	if(ratelimit->interval && (pMsg->iSeverity >= ratelimit->severity)) {
 		if(withinRatelimit(ratelimit, pMsg->ttGenTime) == 0) {
 			msgDestruct(&pMsg);
@@ -235,7 +693,7 @@ finalize_it:
 int
 ratelimitChecked(ratelimit_t *ratelimit)
 {
-	return ratelimit->interval || ratelimit->bReduceRepeatMsgs;
+	return ratelimit->interval || ratelimit->bReduceRepeatMsgs || ratelimit->tb != NULL;
 }
 
 
@@ -322,6 +780,24 @@ ratelimitSetLinuxLike(ratelimit_t *ratelimit, unsigned short interval, unsigned
 }
 
 
+/* enable token-bucket ratelimiting per sender (rate/burst/maxSources) and/or
+ * for the ratelimiter as a whole (globalRate, burst of one second worth of
+ * messages). A rate of 0 disables the respective level.
+ */
+rsRetVal
+ratelimitSetTokenBucket(ratelimit_t *ratelimit, unsigned rate, unsigned burst,
+	unsigned maxSources, unsigned globalRate)
+{
+	DEFiRet;
+	if(rate == 0 && globalRate == 0)
+		FINALIZE;
+	CHKiRet(tbratelimitNew(&ratelimit->tb, ratelimit->name, rate, burst,
+		maxSources, globalRate, 0));
+finalize_it:
+	RETiRet;
+}
+
+
 /* enable thread-safe operations mode. This make sure that
  * a single ratelimiter can be called from multiple threads. As
  * this causes some overhead and is not always required, it needs
@@ -363,6 +839,8 @@ ratelimitDestruct(ratelimit_t *ratelimit)
 		msgDestruct(&ratelimit->pMsg);
 	}
 	tellLostCnt(ratelimit);
+	if(ratelimit->tb != NULL)
+		tbratelimitDestruct(ratelimit->tb);
 	if(ratelimit->bThreadSafe)
 		pthread_mutex_destroy(&ratelimit->mut);
 	free(ratelimit->name);
@@ -376,6 +854,7 @@ ratelimitModExit(void)
 	objRelease(glbl, CORE_COMPONENT);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(parser, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 }
 
 rsRetVal
@@ -387,6 +866,7 @@ ratelimitModInit(void)
 	CHKiRet(objUse(datetime, CORE_COMPONENT));
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
 	CHKiRet(objUse(parser, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
 finalize_it:
 	RETiRet;
 }
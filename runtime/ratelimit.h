@@ -37,6 +37,7 @@ struct ratelimit_s {
 	sbool bThreadSafe;	/**< do we need to operate in Thread-Safe mode? */
 	sbool bNoTimeCache;	/**< if we shall not used cached reception time */
 	pthread_mutex_t mut;	/**< mutex if thread-safe operation desired */
+	tbratelimit_t *tb;	/**< token-bucket limiter keyed by sender, NULL if not in use */
 };
 
 /* prototypes */
@@ -49,7 +50,19 @@ rsRetVal ratelimitMsg(ratelimit_t *ratelimit, smsg_t *pMsg, smsg_t **ppRep);
 rsRetVal ratelimitAddMsg(ratelimit_t *ratelimit, multi_submit_t *pMultiSub, smsg_t *pMsg);
 void ratelimitDestruct(ratelimit_t *pThis);
 int ratelimitChecked(ratelimit_t *ratelimit);
+rsRetVal ratelimitSetTokenBucket(ratelimit_t *ratelimit, unsigned rate, unsigned burst,
+	unsigned maxSources, unsigned globalRate);
 rsRetVal ratelimitModInit(void);
 void ratelimitModExit(void);
 
+/* token-bucket rate limiter. Each key (sender IP, PID, ...) has its own
+ * bucket of "burst" tokens refilled at "rate" tokens per second, and all
+ * keys together are additionally capped by a global bucket. Either level
+ * is disabled by a rate of 0. Thread-safe.
+ */
+rsRetVal tbratelimitNew(tbratelimit_t **ppThis, const char *name, unsigned rate, unsigned burst,
+	unsigned maxKeys, unsigned globalRate, unsigned globalBurst);
+int tbratelimitAllow(tbratelimit_t *pThis, const void *key, size_t lenKey);
+void tbratelimitDestruct(tbratelimit_t *pThis);
+
 #endif /* #ifndef INCLUDED_RATELIMIT_H */
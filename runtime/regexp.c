@@ -25,11 +25,18 @@
 #include "config.h"
 #include <regex.h>
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
 
 #include "rsyslog.h"
 #include "module-template.h"
 #include "obj.h"
+#include "glbl.h"
 #include "regexp.h"
 
 MODULE_TYPE_LIB
@@ -38,9 +45,108 @@ MODULE_TYPE_NOKEEP
 /* static data */
 DEFobjStaticHelpers
 
+/* a compiled yes/no matcher. Basic (non-extended) regexes always use
+ * POSIX, as PCRE2 syntax is not compatible with them.
+ */
+struct rsRegex_s {
+	int engine;
+	regex_t posix;
+#ifdef HAVE_PCRE2
+	pcre2_code *code;
+#endif
+};
+
+#ifdef HAVE_PCRE2
+/* pcre2 match data must not be shared between threads, so each thread
+ * keeps its own (we only need room for the overall match).
+ */
+static pthread_key_t keyMatchData;
+
+static void
+freeMatchData(void *md)
+{
+	pcre2_match_data_free(md);
+}
+#endif
+
 
 /* ------------------------------ methods ------------------------------ */
 
+static rsRetVal
+compileMatcher(rsRegex_t **ppRe, const char *regex, int bExtended)
+{
+	rsRegex_t *pRe;
+#ifdef HAVE_PCRE2
+	int errcode;
+	PCRE2_SIZE erroffs;
+#endif
+	DEFiRet;
+
+	CHKmalloc(pRe = calloc(1, sizeof(rsRegex_t)));
+	pRe->engine = bExtended ? glblRegexEngine : REGEX_ENGINE_POSIX;
+#ifdef HAVE_PCRE2
+	if(pRe->engine == REGEX_ENGINE_PCRE2) {
+		pRe->code = pcre2_compile((PCRE2_SPTR) regex, PCRE2_ZERO_TERMINATED, 0,
+					  &errcode, &erroffs, NULL);
+		if(pRe->code == NULL) {
+			DBGPRINTF("regexp: pcre2 error %d at offset %zu in '%s'\n",
+				  errcode, (size_t) erroffs, regex);
+			ABORT_FINALIZE(RS_RET_ERR);
+		}
+		/* JIT is an optimization only, the interpreter is used if it fails */
+		if(pcre2_jit_compile(pRe->code, PCRE2_JIT_COMPLETE) != 0)
+			DBGPRINTF("regexp: pcre2 JIT not available for '%s'\n", regex);
+		FINALIZE;
+	}
+#endif
+	if(regcomp(&pRe->posix, regex, (bExtended ? REG_EXTENDED : 0) | REG_NOSUB) != 0)
+		ABORT_FINALIZE(RS_RET_ERR);
+
+finalize_it:
+	if(iRet == RS_RET_OK) {
+		*ppRe = pRe;
+	} else {
+		free(pRe);
+	}
+	RETiRet;
+}
+
+/* returns 1 if str matches, 0 otherwise */
+static int
+match(rsRegex_t *pRe, const char *str)
+{
+#ifdef HAVE_PCRE2
+	pcre2_match_data *md;
+
+	if(pRe->engine == REGEX_ENGINE_PCRE2) {
+		if((md = pthread_getspecific(keyMatchData)) == NULL) {
+			if((md = pcre2_match_data_create(1, NULL)) == NULL)
+				return 0;
+			pthread_setspecific(keyMatchData, md);
+		}
+		return pcre2_match(pRe->code, (PCRE2_SPTR) str, PCRE2_ZERO_TERMINATED,
+				   0, 0, md, NULL) >= 0;
+	}
+#endif
+	return regexec(&pRe->posix, str, 0, NULL, 0) == 0;
+}
+
+static void
+freeMatcher(rsRegex_t *pRe)
+{
+	if(pRe == NULL)
+		return;
+#ifdef HAVE_PCRE2
+	if(pRe->engine == REGEX_ENGINE_PCRE2) {
+		pcre2_code_free(pRe->code);
+		free(pRe);
+		return;
+	}
+#endif
+	regfree(&pRe->posix);
+	free(pRe);
+}
+
 
 
 /* queryInterface function
@@ -61,6 +167,9 @@ CODESTARTobjQueryInterface(regexp)
 	pIf->regexec = regexec;
 	pIf->regerror = regerror;
 	pIf->regfree = regfree;
+	pIf->compileMatcher = compileMatcher;
+	pIf->match = match;
+	pIf->freeMatcher = freeMatcher;
 finalize_it:
 ENDobjQueryInterface(regexp)
 
@@ -71,6 +180,9 @@ ENDobjQueryInterface(regexp)
  */
 BEGINAbstractObjClassInit(regexp, 1, OBJ_IS_LOADABLE_MODULE) /* class, version */
 	/* request objects we use */
+#ifdef HAVE_PCRE2
+	pthread_key_create(&keyMatchData, freeMatchData);
+#endif
 
 	/* set our own handlers */
 ENDObjClassInit(regexp)
@@ -81,6 +193,9 @@ ENDObjClassInit(regexp)
 
 BEGINmodExit
 CODESTARTmodExit
+#ifdef HAVE_PCRE2
+	pthread_key_delete(keyMatchData);
+#endif
 ENDmodExit
 
 
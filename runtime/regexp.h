@@ -31,8 +31,14 @@ BEGINinterface(regexp) /* name must also be changed in ENDinterface macro! */
 	int (*regexec)(const regex_t *preg, const char *string, size_t nmatch, regmatch_t pmatch[], int eflags);
 	size_t (*regerror)(int errcode, const regex_t *preg, char *errbuf, size_t errbuf_size);
 	void (*regfree)(regex_t *preg);
+	/* v2: engine-neutral yes/no matcher, backed by the engine selected
+	 * via the global regex.engine parameter (POSIX or PCRE2).
+	 */
+	rsRetVal (*compileMatcher)(rsRegex_t **ppRe, const char *regex, int bExtended);
+	int (*match)(rsRegex_t *pRe, const char *str);
+	void (*freeMatcher)(rsRegex_t *pRe);
 ENDinterface(regexp)
-#define regexpCURR_IF_VERSION 1 /* increment whenever you change the interface structure! */
+#define regexpCURR_IF_VERSION 2 /* increment whenever you change the interface structure! */
 
 
 /* prototypes */
@@ -31,6 +31,7 @@
  */
 #include "config.h"
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <ctype.h>
 
@@ -49,6 +50,7 @@
 #include "srUtils.h"
 #include "modules.h"
 #include "wti.h"
+#include "statsobj.h"
 #include "dirty.h" /* for main ruleset queue creation */
 
 
@@ -56,6 +58,11 @@
 DEFobjStaticHelpers
 DEFobjCurrIf(errmsg)
 DEFobjCurrIf(parser)
+DEFobjCurrIf(statsobj)
+
+/* rule engine statistics */
+static statsobj_t *ruleEngineStats;
+STATSCOUNTER_DEF(ctrPritableLookups, mutCtrPritableLookups)
 
 /* tables for interfacing with the v6 config system (as far as we need to) */
 static struct cnfparamdescr rspdescr[] = {
@@ -129,6 +136,10 @@ scriptIterateAllActions(struct cnfstmt *root, rsRetVal (*pFunc)(void*, void*), v
 			scriptIterateAllActions(stmt->d.s_propfilt.t_then,
 						pFunc, pParam);
 			break;
+		case S_PRITABLE:
+			scriptIterateAllActions(stmt->d.s_pritable.stmts,
+						pFunc, pParam);
+			break;
 		case S_RELOAD_LOOKUP_TABLE: /* this is a NOP */
 			break;
 		default:
@@ -433,11 +444,70 @@ finalize_it:
 }
 
 
-/* helper to execPROPFILT(), as the evaluation itself is quite lengthy */
+/* execute a PRITABLE, which is the optimizer's replacement for a sequence
+ * of PRIFILTs. We only look at the filters which match the message's PRI.
+ * The then-part of a filter may modify the PRI (via message modification
+ * modules), in which case we continue with the remaining filters that
+ * match the new PRI - just like the sequence of PRIFILTs would do.
+ */
+static rsRetVal
+execPRITABLE(struct cnfstmt *stmt, smsg_t *pMsg, wti_t *pWti)
+{
+	struct cnfpritable *const table = stmt->d.s_pritable.table;
+	struct cnfstmt *filt;
+	int slot;
+	unsigned i;
+	DEFiRet;
+
+	STATSCOUNTER_INC(ctrPritableLookups, mutCtrPritableLookups);
+	slot = PRITABLE_SLOT(pMsg->iFacility, pMsg->iSeverity);
+	i = table->slotOff[slot];
+	while(i < table->slotOff[slot+1]) {
+		filt = table->filt[table->filtIdx[i]];
+		DBGPRINTF("PRITABLE: filter %d matches\n", table->filtIdx[i]);
+		if(filt->d.s_prifilt.t_then != NULL)
+			CHKiRet(scriptExec(filt->d.s_prifilt.t_then, pMsg, pWti));
+		if(PRITABLE_SLOT(pMsg->iFacility, pMsg->iSeverity) != slot) {
+			const unsigned short iDone = table->filtIdx[i];
+			slot = PRITABLE_SLOT(pMsg->iFacility, pMsg->iSeverity);
+			DBGPRINTF("PRITABLE: PRI modified, switching to slot %d\n", slot);
+			for(i = table->slotOff[slot] ; i < table->slotOff[slot+1]
+			    && table->filtIdx[i] <= iDone ; ++i)
+				/* just skip */;
+		} else {
+			++i;
+		}
+	}
+finalize_it:
+	RETiRet;
+}
+
+
+/* property value for PROPFILTs. It is kept while a sequence of filters on
+ * the same property is evaluated, so that we need to fetch it only once.
+ */
+typedef struct propfiltVal_s {
+	uchar *pszVal;
+	rs_size_t len;
+	unsigned short bMustBeFreed;
+	sbool bValid;
+} propfiltVal_t;
+
+static void
+propfiltValRelease(propfiltVal_t *const pVal)
+{
+	if(pVal->bValid && pVal->bMustBeFreed)
+		free(pVal->pszVal);
+	pVal->bValid = 0;
+}
+
+/* helper to execPROPFILT(), as the evaluation itself is quite lengthy.
+ * The property value from pVal is re-used if the optimizer found that the
+ * previous filter checked the same property, otherwise it is fetched.
+ */
 static int
-evalPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg)
+evalPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg, propfiltVal_t *const pVal)
 {
-	unsigned short pbMustBeFreed;
 	uchar *pszPropVal;
 	int bRet = 0;
 	rs_size_t propLen;
@@ -445,8 +515,25 @@ evalPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg)
 	if(stmt->d.s_propfilt.prop.id == PROP_INVALID)
 		goto done;
 
-	pszPropVal = MsgGetProp(pMsg, NULL, &stmt->d.s_propfilt.prop,
-				&propLen, &pbMustBeFreed, NULL);
+	/* fromhost(-ip) isequal: the message usually carries the interned
+	 * compare value itself, then we do not need to fetch and compare.
+	 */
+	if(stmt->d.s_propfilt.pCompProp != NULL
+	   && MsgRcvFromPropIs(pMsg, stmt->d.s_propfilt.prop.id, stmt->d.s_propfilt.pCompProp)) {
+		propfiltValRelease(pVal); /* not fetched, so next filter must do so */
+		pszPropVal = propGetSzStr(stmt->d.s_propfilt.pCompProp);
+		bRet = 1;
+		goto check_negate;
+	}
+
+	if(!(pVal->bValid && stmt->d.s_propfilt.bSamePropAsPrev)) {
+		propfiltValRelease(pVal);
+		pVal->pszVal = MsgGetProp(pMsg, NULL, &stmt->d.s_propfilt.prop,
+					  &pVal->len, &pVal->bMustBeFreed, NULL);
+		pVal->bValid = 1;
+	}
+	pszPropVal = pVal->pszVal;
+	propLen = pVal->len;
 
 	/* Now do the compares (short list currently ;)) */
 	switch(stmt->d.s_propfilt.operation ) {
@@ -486,6 +573,7 @@ evalPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg)
 		break;
 	}
 
+check_negate:
 	/* now check if the value must be negated */
 	if(stmt->d.s_propfilt.isNegated)
 		bRet = (bRet == 1) ?  0 : 1;
@@ -518,23 +606,22 @@ evalPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg)
 		}
 	}
 
-	/* cleanup */
-	if(pbMustBeFreed)
-		free(pszPropVal);
 done:
 	return bRet;
 }
 
 static rsRetVal
-execPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg, wti_t *pWti)
+execPROPFILT(struct cnfstmt *stmt, smsg_t *pMsg, wti_t *pWti, propfiltVal_t *const pVal)
 {
 	sbool bRet;
 	DEFiRet;
 
-	bRet = evalPROPFILT(stmt, pMsg);
+	bRet = evalPROPFILT(stmt, pMsg, pVal);
 	DBGPRINTF("PROPFILT condition result is %d\n", bRet);
-	if(bRet)
+	if(bRet) {
+		propfiltValRelease(pVal); /* the then-part may modify the message */
 		CHKiRet(scriptExec(stmt->d.s_propfilt.t_then, pMsg, pWti));
+	}
 finalize_it:
 	RETiRet;
 }
@@ -557,6 +644,62 @@ finalize_it:
 	RETiRet;
 }
 
+/* execute a single statement for a single message. pPropVal is the
+ * message's PROPFILT property value cache.
+ */
+static rsRetVal
+execStmt(struct cnfstmt *stmt, smsg_t *pMsg, wti_t *pWti, propfiltVal_t *const pPropVal)
+{
+	DEFiRet;
+
+	switch(stmt->nodetype) {
+	case S_NOP:
+		break;
+	case S_STOP:
+		ABORT_FINALIZE(RS_RET_DISCARDMSG);
+		break;
+	case S_ACT:
+		CHKiRet(execAct(stmt, pMsg, pWti));
+		break;
+	case S_SET:
+		CHKiRet(execSet(stmt, pMsg));
+		break;
+	case S_UNSET:
+		CHKiRet(execUnset(stmt, pMsg));
+		break;
+	case S_CALL:
+		CHKiRet(execCall(stmt, pMsg, pWti));
+		break;
+	case S_CALL_INDIRECT:
+		CHKiRet(execCallIndirect(stmt, pMsg, pWti));
+		break;
+	case S_IF:
+		CHKiRet(execIf(stmt, pMsg, pWti));
+		break;
+	case S_FOREACH:
+		CHKiRet(execForeach(stmt, pMsg, pWti));
+		break;
+	case S_PRIFILT:
+		CHKiRet(execPRIFILT(stmt, pMsg, pWti));
+		break;
+	case S_PROPFILT:
+		CHKiRet(execPROPFILT(stmt, pMsg, pWti, pPropVal));
+		break;
+	case S_PRITABLE:
+		CHKiRet(execPRITABLE(stmt, pMsg, pWti));
+		break;
+        case S_RELOAD_LOOKUP_TABLE:
+		CHKiRet(execReloadLookupTable(stmt));
+		break;
+	default:
+		dbgprintf("error: unknown stmt type %u during exec\n",
+			(unsigned) stmt->nodetype);
+		break;
+	}
+finalize_it:
+	RETiRet;
+}
+
 /* The rainerscript execution engine. It is debatable if that would be better
  * contained in grammer/rainerscript.c, HOWEVER, that file focusses primarily
  * on the parsing and object creation part. So as an actual executor, it is
@@ -567,8 +710,10 @@ static rsRetVal
 scriptExec(struct cnfstmt *root, smsg_t *pMsg, wti_t *pWti)
 {
 	struct cnfstmt *stmt;
+	propfiltVal_t propVal;
 	DEFiRet;
 
+	propVal.bValid = 0;
 	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
 		if(*pWti->pbShutdownImmediate) {
 			DBGPRINTF("scriptExec: ShutdownImmediate set, "
@@ -578,48 +723,405 @@ scriptExec(struct cnfstmt *root, smsg_t *pMsg, wti_t *pWti)
 		if(Debug) {
 			cnfstmtPrintOnly(stmt, 2, 0);
 		}
+		CHKiRet(execStmt(stmt, pMsg, pWti, &propVal));
+	}
+finalize_it:
+	propfiltValRelease(&propVal);
+	RETiRet;
+}
+
+
+/* Batch execution engine. Instead of running the whole script for one
+ * message after the other, each statement is run for all messages of the
+ * batch which are still active at this point of the script. Each message
+ * still sees its statements in script order, but the statement dispatch
+ * as well as the action and filter state stay hot in cache. This can only
+ * be done for scripts that do not depend on the order in which messages
+ * are processed, see scriptIsBatchSafe().
+ *
+ * The set of active messages is an ascending list of batch indexes. For
+ * conditionals, the list is (stably) partitioned into the "then" and "else"
+ * part, each of which is processed recursively, and merged back afterwards.
+ */
+typedef struct batchExecState_s {
+	batch_t *pBatch;
+	wti_t *pWti;
+	int *scratch;		/* work space for partitioning/merging the active list */
+	rsRetVal *msgRet;	/* per message result of script execution */
+	sbool *cond;		/* per message result of the current condition */
+	uint8_t *prevSusp;	/* per message "previous action was suspended" state */
+	propfiltVal_t *propVals;/* per message PROPFILT property value cache */
+} batchExecState_t;
+
+/* max nesting of CALLs for which we still check if a ruleset is batch-safe.
+ * This also protects us against (invalid) recursive calls.
+ */
+#define MAX_BATCH_EXEC_CALL_NESTING 100
+
+/* check if a script can be executed by the batch engine. This is not the
+ * case if it accesses global variables (their values depend on message
+ * order) or uses call_indirect (the called ruleset is not known in advance).
+ */
+static int
+scriptIsBatchSafe(struct cnfstmt *root, const int depth)
+{
+	struct cnfstmt *stmt;
+
+	if(depth > MAX_BATCH_EXEC_CALL_NESTING)
+		return 0;
+	for(stmt = root ; stmt != NULL ; stmt = stmt->next) {
 		switch(stmt->nodetype) {
 		case S_NOP:
-			break;
 		case S_STOP:
-			ABORT_FINALIZE(RS_RET_DISCARDMSG);
-			break;
 		case S_ACT:
-			CHKiRet(execAct(stmt, pMsg, pWti));
+		case S_RELOAD_LOOKUP_TABLE:
 			break;
 		case S_SET:
-			CHKiRet(execSet(stmt, pMsg));
+			if(stmt->d.s_set.varname[0] == '/'
+			   || cnfexprUsesGlobalVar(stmt->d.s_set.expr))
+				return 0;
 			break;
 		case S_UNSET:
-			CHKiRet(execUnset(stmt, pMsg));
+			if(stmt->d.s_unset.varname[0] == '/')
+				return 0;
 			break;
 		case S_CALL:
-			CHKiRet(execCall(stmt, pMsg, pWti));
-			break;
-		case S_CALL_INDIRECT:
-			CHKiRet(execCallIndirect(stmt, pMsg, pWti));
+			if(stmt->d.s_call.ruleset == NULL
+			   && !scriptIsBatchSafe(stmt->d.s_call.stmt, depth + 1))
+				return 0;
 			break;
 		case S_IF:
-			CHKiRet(execIf(stmt, pMsg, pWti));
+			if(cnfexprUsesGlobalVar(stmt->d.s_if.expr)
+			   || !scriptIsBatchSafe(stmt->d.s_if.t_then, depth)
+			   || !scriptIsBatchSafe(stmt->d.s_if.t_else, depth))
+				return 0;
 			break;
 		case S_FOREACH:
-			CHKiRet(execForeach(stmt, pMsg, pWti));
+			if(cnfexprUsesGlobalVar(stmt->d.s_foreach.iter->collection)
+			   || !scriptIsBatchSafe(stmt->d.s_foreach.body, depth))
+				return 0;
 			break;
 		case S_PRIFILT:
-			CHKiRet(execPRIFILT(stmt, pMsg, pWti));
+			if(!scriptIsBatchSafe(stmt->d.s_prifilt.t_then, depth)
+			   || !scriptIsBatchSafe(stmt->d.s_prifilt.t_else, depth))
+				return 0;
+			break;
+		case S_PRITABLE:
+			if(!scriptIsBatchSafe(stmt->d.s_pritable.stmts, depth))
+				return 0;
 			break;
 		case S_PROPFILT:
-			CHKiRet(execPROPFILT(stmt, pMsg, pWti));
+			if(stmt->d.s_propfilt.prop.id == PROP_GLOBAL_VAR
+			   || !scriptIsBatchSafe(stmt->d.s_propfilt.t_then, depth))
+				return 0;
 			break;
-        case S_RELOAD_LOOKUP_TABLE:
-			CHKiRet(execReloadLookupTable(stmt));
+		case S_CALL_INDIRECT:
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* remove all messages from the active list whose script execution is done */
+static int
+batchExecCompact(batchExecState_t *const pState, int *const active, const int nActive)
+{
+	int i;
+	int nNew = 0;
+
+	for(i = 0 ; i < nActive ; ++i) {
+		if(pState->msgRet[active[i]] == RS_RET_OK)
+			active[nNew++] = active[i];
+	}
+	return nNew;
+}
+
+/* stable partition of the active list by the per message condition. Returns
+ * the number of "true" messages, which are at the start of the list.
+ */
+static int
+batchExecPartition(batchExecState_t *const pState, int *const active, const int nActive)
+{
+	int i;
+	int nTrue = 0;
+	int nFalse = 0;
+
+	for(i = 0 ; i < nActive ; ++i) {
+		if(pState->cond[active[i]])
+			active[nTrue++] = active[i];
+		else
+			pState->scratch[nFalse++] = active[i];
+	}
+	memcpy(active + nTrue, pState->scratch, nFalse * sizeof(int));
+	return nTrue;
+}
+
+/* merge the two ascending lists a[0..nA) and b[0..nB), which are both part
+ * of the active list, back into active[], so that messages are again
+ * processed in batch order. Returns the new number of active messages.
+ */
+static int
+batchExecMerge(batchExecState_t *const pState, int *const active,
+	const int *const a, const int nA, const int *const b, const int nB)
+{
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	while(i < nA && j < nB)
+		pState->scratch[k++] = (a[i] < b[j]) ? a[i++] : b[j++];
+	while(i < nA)
+		pState->scratch[k++] = a[i++];
+	while(j < nB)
+		pState->scratch[k++] = b[j++];
+	memcpy(active, pState->scratch, k * sizeof(int));
+	return k;
+}
+
+static int scriptExecBatch(batchExecState_t *pState, struct cnfstmt *root, int *active, int nActive);
+
+/* run the "then" and "else" part of a conditional statement, based on the
+ * per message condition results. Each part compacts its share of the active
+ * list, so only the messages still active at the end of their branch are
+ * merged back. Returns the new number of active messages.
+ */
+static int
+batchExecBranches(batchExecState_t *const pState, struct cnfstmt *const t_then,
+	struct cnfstmt *const t_else, int *const active, const int nActive)
+{
+	const int nTrue = batchExecPartition(pState, active, nActive);
+	int nThen = nTrue;
+	int nElse = nActive - nTrue;
+
+	if(t_then != NULL && nThen > 0)
+		nThen = scriptExecBatch(pState, t_then, active, nThen);
+	if(t_else != NULL && nElse > 0)
+		nElse = scriptExecBatch(pState, t_else, active + nTrue, nElse);
+	return batchExecMerge(pState, active, active, nThen, active + nTrue, nElse);
+}
+
+/* batch version of execPRITABLE(). The messages are processed filter by
+ * filter: in each round, we take the lowest filter index which is next on
+ * the slot list of any active message and run its then-part for all
+ * messages waiting on it. So each message still visits the filters for
+ * its PRI in config order, and a PRI modified by a then-part is handled
+ * just like execPRITABLE() does. The rounds are bounded by the number of
+ * filters the messages of the batch actually match, not by the number of
+ * merged filters.
+ */
+static int
+batchExecPRITABLE(batchExecState_t *const pState, struct cnfstmt *const stmt,
+	int *const active, const int nActive)
+{
+	struct cnfpritable *const table = stmt->d.s_pritable.table;
+	wti_t *const pWti = pState->pWti;
+	struct cnfstmt *filt;
+	smsg_t *pMsg;
+	unsigned *pos;	/* per active[] entry: current position in filtIdx */
+	int *slot;	/* per active[] entry: current slot */
+	int *waiting;	/* messages waiting on the current filter */
+	int nWaiting;
+	int iFilt;
+	int newSlot;
+	int i;
+
+	pos = wtiArenaAlloc(&pWti->arena, nActive * sizeof(unsigned));
+	slot = wtiArenaAlloc(&pWti->arena, nActive * sizeof(int));
+	waiting = wtiArenaAlloc(&pWti->arena, nActive * sizeof(int));
+	if(pos == NULL || slot == NULL || waiting == NULL) {
+		/* no work space, so do it message by message */
+		for(i = 0 ; i < nActive ; ++i) {
+			pMsg = pState->pBatch->pElem[active[i]].pMsg;
+			pState->msgRet[active[i]] = execPRITABLE(stmt, pMsg, pWti);
+		}
+		return batchExecCompact(pState, active, nActive);
+	}
+
+	STATSCOUNTER_ADD(ctrPritableLookups, mutCtrPritableLookups, nActive);
+	for(i = 0 ; i < nActive ; ++i) {
+		pMsg = pState->pBatch->pElem[active[i]].pMsg;
+		slot[i] = PRITABLE_SLOT(pMsg->iFacility, pMsg->iSeverity);
+		pos[i] = table->slotOff[slot[i]];
+	}
+
+	while(1) {
+		iFilt = table->nFilt;
+		for(i = 0 ; i < nActive ; ++i) {
+			if(pState->msgRet[active[i]] == RS_RET_OK
+			   && pos[i] < table->slotOff[slot[i]+1]
+			   && table->filtIdx[pos[i]] < iFilt)
+				iFilt = table->filtIdx[pos[i]];
+		}
+		if(iFilt == table->nFilt)
+			break; /* all messages are through */
+
+		nWaiting = 0;
+		for(i = 0 ; i < nActive ; ++i) {
+			if(pState->msgRet[active[i]] == RS_RET_OK
+			   && pos[i] < table->slotOff[slot[i]+1]
+			   && table->filtIdx[pos[i]] == iFilt)
+				waiting[nWaiting++] = active[i];
+		}
+		DBGPRINTF("PRITABLE: filter %d matches %d messages\n", iFilt, nWaiting);
+		filt = table->filt[iFilt];
+		if(filt->d.s_prifilt.t_then != NULL)
+			scriptExecBatch(pState, filt->d.s_prifilt.t_then, waiting, nWaiting);
+
+		/* move the messages which were waiting on this filter ahead */
+		for(i = 0 ; i < nActive ; ++i) {
+			if(pos[i] >= table->slotOff[slot[i]+1] || table->filtIdx[pos[i]] != iFilt)
+				continue;
+			pMsg = pState->pBatch->pElem[active[i]].pMsg;
+			newSlot = PRITABLE_SLOT(pMsg->iFacility, pMsg->iSeverity);
+			if(newSlot != slot[i]) {
+				slot[i] = newSlot;
+				for(pos[i] = table->slotOff[newSlot] ; pos[i] < table->slotOff[newSlot+1]
+				    && table->filtIdx[pos[i]] <= iFilt ; ++pos[i])
+					/* just skip */;
+			} else {
+				++pos[i];
+			}
+		}
+	}
+	return batchExecCompact(pState, active, nActive);
+}
+
+/* execute a script for the messages on the active list. Results are
+ * recorded in pState->msgRet. Returns the number of messages still
+ * active when the script ends.
+ */
+static int
+scriptExecBatch(batchExecState_t *const pState, struct cnfstmt *root, int *const active, int nActive)
+{
+	struct cnfstmt *stmt;
+	smsg_t *pMsg;
+	wti_t *const pWti = pState->pWti;
+	int i;
+
+	for(stmt = root ; stmt != NULL && nActive > 0 ; stmt = stmt->next) {
+		if(*pWti->pbShutdownImmediate) {
+			DBGPRINTF("scriptExecBatch: ShutdownImmediate set, "
+				  "force terminating\n");	
+			for(i = 0 ; i < nActive ; ++i)
+				pState->msgRet[active[i]] = RS_RET_FORCE_TERM;
+			return 0;
+		}
+		if(Debug) {
+			cnfstmtPrintOnly(stmt, 2, 0);
+		}
+		switch(stmt->nodetype) {
+		case S_NOP:
+			break;
+		case S_STOP:
+			for(i = 0 ; i < nActive ; ++i)
+				pState->msgRet[active[i]] = RS_RET_DISCARDMSG;
+			nActive = 0;
+			break;
+		case S_ACT:
+			/* "execute only when previous is suspended" must see the state
+			 * of the previous action for this very message.
+			 */
+			for(i = 0 ; i < nActive ; ++i) {
+				pMsg = pState->pBatch->pElem[active[i]].pMsg;
+				pWti->execState.bPrevWasSuspended = pState->prevSusp[active[i]];
+				pState->msgRet[active[i]] = execAct(stmt, pMsg, pWti);
+				pState->prevSusp[active[i]] = pWti->execState.bPrevWasSuspended;
+			}
+			nActive = batchExecCompact(pState, active, nActive);
+			break;
+		case S_IF:
+			for(i = 0 ; i < nActive ; ++i) {
+				pMsg = pState->pBatch->pElem[active[i]].pMsg;
+				pState->cond[active[i]] = cnfexprEvalBool(stmt->d.s_if.expr, pMsg);
+			}
+			nActive = batchExecBranches(pState, stmt->d.s_if.t_then,
+				stmt->d.s_if.t_else, active, nActive);
+			break;
+		case S_PRIFILT:
+			for(i = 0 ; i < nActive ; ++i) {
+				pMsg = pState->pBatch->pElem[active[i]].pMsg;
+				pState->cond[active[i]] =
+					(stmt->d.s_prifilt.pmask[pMsg->iFacility] != TABLE_NOPRI)
+					&& (stmt->d.s_prifilt.pmask[pMsg->iFacility] & (1<<pMsg->iSeverity));
+			}
+			nActive = batchExecBranches(pState, stmt->d.s_prifilt.t_then,
+				stmt->d.s_prifilt.t_else, active, nActive);
 			break;
+		case S_PROPFILT:
+			for(i = 0 ; i < nActive ; ++i) {
+				pMsg = pState->pBatch->pElem[active[i]].pMsg;
+				pState->cond[active[i]] = evalPROPFILT(stmt, pMsg,
+					&pState->propVals[active[i]]);
+				if(pState->cond[active[i]]) /* the then-part may modify the message */
+					propfiltValRelease(&pState->propVals[active[i]]);
+			}
+			nActive = batchExecBranches(pState, stmt->d.s_propfilt.t_then,
+				NULL, active, nActive);
+			break;
+		case S_PRITABLE:
+			nActive = batchExecPRITABLE(pState, stmt, active, nActive);
+			break;
+		case S_CALL:
+			if(stmt->d.s_call.ruleset == NULL) {
+				nActive = scriptExecBatch(pState, stmt->d.s_call.stmt, active, nActive);
+				break;
+			}
+			/* async call: per message, FALLTHROUGH */
 		default:
-			dbgprintf("error: unknown stmt type %u during exec\n",
-				(unsigned) stmt->nodetype);
+			for(i = 0 ; i < nActive ; ++i) {
+				pMsg = pState->pBatch->pElem[active[i]].pMsg;
+				pState->msgRet[active[i]] = execStmt(stmt, pMsg, pWti,
+					&pState->propVals[active[i]]);
+			}
+			nActive = batchExecCompact(pState, active, nActive);
 			break;
 		}
 	}
+	return nActive;
+}
+
+/* process the messages iStart..iEnd-1 of a batch, which all use the same
+ * ruleset, with the batch execution engine. Returns RS_RET_OUT_OF_MEMORY
+ * without having processed any message if the work space could not be
+ * allocated, in which case the caller needs to use scriptExec().
+ */
+static rsRetVal
+processBatchRun(batch_t *const pBatch, const int iStart, const int iEnd,
+	ruleset_t *const pRuleset, wti_t *const pWti)
+{
+	batchExecState_t state;
+	const int nMsgs = iEnd - iStart;
+	int *active;
+	int i;
+	DEFiRet;
+
+	/* all work space is transient, so it goes to the worker's arena */
+	CHKmalloc(active = wtiArenaAlloc(&pWti->arena, nMsgs * sizeof(int)));
+	CHKmalloc(state.scratch = wtiArenaAlloc(&pWti->arena, nMsgs * sizeof(int)));
+	CHKmalloc(state.msgRet = wtiArenaAlloc(&pWti->arena, pBatch->nElem * sizeof(rsRetVal)));
+	CHKmalloc(state.cond = wtiArenaAlloc(&pWti->arena, pBatch->nElem * sizeof(sbool)));
+	CHKmalloc(state.prevSusp = wtiArenaAlloc(&pWti->arena, pBatch->nElem * sizeof(uint8_t)));
+	CHKmalloc(state.propVals = wtiArenaAlloc(&pWti->arena, pBatch->nElem * sizeof(propfiltVal_t)));
+	state.pBatch = pBatch;
+	state.pWti = pWti;
+
+	DBGPRINTF("processBATCH: executing msgs %d..%d as a batch\n", iStart, iEnd - 1);
+	for(i = 0 ; i < nMsgs ; ++i) {
+		active[i] = iStart + i;
+		state.msgRet[iStart + i] = RS_RET_OK;
+		state.prevSusp[iStart + i] = pWti->execState.bPrevWasSuspended;
+		state.propVals[iStart + i].bValid = 0;
+	}
+	scriptExecBatch(&state, pRuleset->root, active, nMsgs);
+
+	/* see processBatch() for why only messages with RS_RET_OK are committed */
+	for(i = iStart ; i < iEnd ; ++i) {
+		propfiltValRelease(&state.propVals[i]);
+		if(state.msgRet[i] == RS_RET_OK)
+			batchSetElemState(pBatch, i, BATCH_STATE_COMM);
+	}
+
 finalize_it:
 	RETiRet;
 }
@@ -632,6 +1134,7 @@ static rsRetVal
 processBatch(batch_t *pBatch, wti_t *pWti)
 {
 	int i;
+	int iEnd;
 	smsg_t *pMsg;
 	ruleset_t *pRuleset;
 	rsRetVal localRet;
@@ -644,8 +1147,22 @@ processBatch(batch_t *pBatch, wti_t *pWti)
 	/* execution phase */
 	for(i = 0 ; i < batchNumMsgs(pBatch) && !*(pWti->pbShutdownImmediate) ; ++i) {
 		pMsg = pBatch->pElem[i].pMsg;
-		DBGPRINTF("processBATCH: next msg %d: %.128s\n", i, pMsg->pszRawMsg);
 		pRuleset = (pMsg->pRuleset == NULL) ? ourConf->rulesets.pDflt : pMsg->pRuleset;
+		if(pRuleset->bBatchExec) {
+			/* find the run of messages bound to this ruleset */
+			for(iEnd = i + 1 ; iEnd < batchNumMsgs(pBatch) ; ++iEnd) {
+				pMsg = pBatch->pElem[iEnd].pMsg;
+				if(((pMsg->pRuleset == NULL) ? ourConf->rulesets.pDflt : pMsg->pRuleset)
+				   != pRuleset)
+					break;
+			}
+			if(iEnd - i > 1 && processBatchRun(pBatch, i, iEnd, pRuleset, pWti) == RS_RET_OK) {
+				i = iEnd - 1;
+				continue;
+			}
+			pMsg = pBatch->pElem[i].pMsg;
+		}
+		DBGPRINTF("processBATCH: next msg %d: %.128s\n", i, pMsg->pszRawMsg);
 		localRet = scriptExec(pRuleset->root, pMsg, pWti);
 		/* the most important case here is that processing may be aborted
 		 * due to pbShutdownImmediate, in which case we MUST NOT flag this
@@ -660,6 +1177,7 @@ processBatch(batch_t *pBatch, wti_t *pWti)
 	DBGPRINTF("END batch execution phase, entering to commit phase "
 		"[processed %d of %d messages]\n", i, batchNumMsgs(pBatch));
 	actionCommitAllDirect(pWti);
+	wtiArenaReset(pWti);
 
 	DBGPRINTF("processBATCH: batch of %d elements has been processed\n", pBatch->nElem);
 	RETiRet;
@@ -892,6 +1410,9 @@ rulesetOptimize(ruleset_t *pRuleset)
 		rulesetDebugPrint((ruleset_t*) pRuleset);
 	}
 	cnfstmtOptimize(pRuleset->root);
+	pRuleset->bBatchExec = scriptIsBatchSafe(pRuleset->root, 0);
+	DBGPRINTF("ruleset '%s' %s be executed a batch at a time\n", pRuleset->pszName,
+		  pRuleset->bBatchExec ? "can" : "can NOT");
 	if(Debug) {
 		dbgprintf("ruleset '%s' after optimization:\n",
 			  pRuleset->pszName);
@@ -1113,8 +1634,11 @@ ENDobjQueryInterface(ruleset)
  * rgerhards, 2009-04-06
  */
 BEGINObjClassExit(ruleset, OBJ_IS_CORE_MODULE) /* class, version */
+	if(ruleEngineStats != NULL)
+		statsobj.Destruct(&ruleEngineStats);
 	objRelease(errmsg, CORE_COMPONENT);
 	objRelease(parser, CORE_COMPONENT);
+	objRelease(statsobj, CORE_COMPONENT);
 ENDObjClassExit(ruleset)
 
 
@@ -1125,6 +1649,16 @@ ENDObjClassExit(ruleset)
 BEGINObjClassInit(ruleset, 1, OBJ_IS_CORE_MODULE) /* class, version */
 	/* request objects we use */
 	CHKiRet(objUse(errmsg, CORE_COMPONENT));
+	CHKiRet(objUse(statsobj, CORE_COMPONENT));
+
+	/* rule engine statistics */
+	CHKiRet(statsobj.Construct(&ruleEngineStats));
+	CHKiRet(statsobj.SetName(ruleEngineStats, UCHAR_CONSTANT("rule-engine")));
+	CHKiRet(statsobj.SetOrigin(ruleEngineStats, UCHAR_CONSTANT("core.ruleset")));
+	STATSCOUNTER_INIT(ctrPritableLookups, mutCtrPritableLookups);
+	CHKiRet(statsobj.AddCounter(ruleEngineStats, UCHAR_CONSTANT("pritable.lookups"),
+		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &ctrPritableLookups));
+	CHKiRet(statsobj.ConstructFinalize(ruleEngineStats));
 
 	/* set our own handlers */
 	OBJSetMethodHandler(objMethod_DEBUGPRINT, rulesetDebugPrint);
@@ -35,6 +35,7 @@ struct ruleset_s {
 	struct cnfstmt *root;
 	struct cnfstmt *last;
 	parserList_t *pParserLst;/* list of parsers to use for this ruleset */
+	sbool bBatchExec;	/* can the ruleset be executed a statement at a time for a whole batch? */
 };
 
 /* interfaces */
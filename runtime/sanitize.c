@@ -0,0 +1,216 @@
+/* sanitize.c
+ * Control and 8-bit character escaping of received messages. Kept separate
+ * from parser.c so that it can be used by the testbench without the rest
+ * of the parser class.
+ *
+ * Copyright 2008-2016 Rainer Gerhards and Adiscon GmbH.
+ *
+This file is part of the rsyslog runtime library.
+ *
+ * The rsyslog runtime library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The rsyslog runtime library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the rsyslog runtime library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ * A copy of the LGPL can be found in the file "COPYING.LESSER" in this distribution.
+ */
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "rsyslog.h"
+#include "sanitize.h"
+
+static const char hexdigit[16] =
+	{'0', '1', '2', '3', '4', '5', '6', '7', '8',
+	 '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+/* Word-at-a-time helpers. We check eight bytes at once
+ * whether any of them is a control character (< 32) or, if highMask is
+ * set, has the high bit set. This is exact as a yes/no answer, which is
+ * all we need to skip over clean parts of the message quickly.
+ */
+#define SANITIZE_ONES  0x0101010101010101ULL
+#define SANITIZE_HIGHS 0x8080808080808080ULL
+
+static inline uint64_t
+sanitizeLoadWord(const uchar *const p)
+{
+	uint64_t w;
+	memcpy(&w, p, sizeof(w)); /* alignment-safe, compiles to a single load */
+	return w;
+}
+
+static inline int
+sanitizeWordIsClean(const uint64_t w, const uint64_t highMask)
+{
+	return (((w - SANITIZE_ONES * 32) & ~w & SANITIZE_HIGHS) | (w & highMask)) == 0;
+}
+
+
+/* check whether the message needs sanitation. LFs are replaced by spaces
+ * in place if so configured. Returns the index of the first character that
+ * must be escaped, or lenMsg if the message is clean.
+ */
+size_t
+sanitizeCheck(uchar *const pszMsg, const size_t lenMsg, const sanitizeOpts_t *const opts)
+{
+	size_t iSrc;
+	size_t iFirstDirty;
+	int bNeedSanitize;
+	/* with 8-bit escaping, bytes with the high bit set are also candidates */
+	const uint64_t highMask = opts->bEscape8Bit ? SANITIZE_HIGHS : 0;
+
+	bNeedSanitize = 0;
+	iFirstDirty = lenMsg;
+	iSrc = 0;
+	while(iSrc < lenMsg) {
+		if(iSrc + sizeof(uint64_t) <= lenMsg
+		   && sanitizeWordIsClean(sanitizeLoadWord(pszMsg + iSrc), highMask)) {
+			iSrc += sizeof(uint64_t);
+			continue;
+		}
+		if(pszMsg[iSrc] < 32) {
+			if(opts->bSpaceLF && pszMsg[iSrc] == '\n') {
+				pszMsg[iSrc] = ' ';
+			} else if(pszMsg[iSrc] == '\0' || opts->bEscapeCC) {
+				if(!bNeedSanitize)
+					iFirstDirty = iSrc;
+				bNeedSanitize = 1;
+				if(!opts->bSpaceLF) {
+					break;
+				}
+			}
+		} else if(pszMsg[iSrc] > 127 && opts->bEscape8Bit) {
+			if(!bNeedSanitize)
+				iFirstDirty = iSrc;
+			bNeedSanitize = 1;
+			break;
+		}
+		++iSrc;
+	}
+
+	return iFirstDirty;
+}
+
+
+/* copy the message to pDst, escaping as configured. Up to iFirstDirty,
+ * the message is known to be clean. pDst must have room for maxDest+1
+ * bytes. Returns the length of the escaped string, which is NUL-terminated.
+ */
+size_t
+sanitizeEscape(const uchar *const pszMsg, const size_t lenMsg, const size_t iFirstDirty,
+	uchar *const pDst, const size_t maxDest, const sanitizeOpts_t *const opts)
+{
+	size_t iSrc;
+	size_t iDst;
+	uchar pc;
+	const uint64_t highMask = opts->bEscape8Bit ? SANITIZE_HIGHS : 0;
+
+	iSrc = iFirstDirty;
+	if(iSrc > maxDest - 3)
+		iSrc = maxDest - 3;
+	memcpy(pDst, pszMsg, iSrc); /* fast copy known good */
+	iDst = iSrc;
+	while(iSrc < lenMsg && iDst < maxDest - 3) { /* leave some space if last char must be escaped */
+		/* copy runs of clean characters a word at a time */
+		if(iSrc + sizeof(uint64_t) <= lenMsg && iDst + sizeof(uint64_t) < maxDest - 3
+		   && sanitizeWordIsClean(sanitizeLoadWord(pszMsg + iSrc), highMask)) {
+			memcpy(pDst + iDst, pszMsg + iSrc, sizeof(uint64_t));
+			iSrc += sizeof(uint64_t);
+			iDst += sizeof(uint64_t);
+			continue;
+		}
+		if((pszMsg[iSrc] < 32) && (pszMsg[iSrc] != '\t' || opts->bEscapeTab)) {
+			/* note: \0 must always be escaped, the rest of the code currently
+			 * can not handle it! -- rgerhards, 2009-08-26
+			 */
+			if(pszMsg[iSrc] == '\0' || opts->bEscapeCC) {
+				/* we are configured to escape control characters. Please note
+				 * that this most probably break non-western character sets like
+				 * Japanese, Korean or Chinese. rgerhards, 2007-07-17
+				 */
+				if (opts->bCStyle) {
+					pDst[iDst++] = '\\';
+
+					switch (pszMsg[iSrc]) {
+					case '\0':
+						pDst[iDst++] = '0';
+						break;
+					case '\a':
+						pDst[iDst++] = 'a';
+						break;
+					case '\b':
+						pDst[iDst++] = 'b';
+						break;
+					case '\e':
+						pDst[iDst++] = 'e';
+						break;
+					case '\f':
+						pDst[iDst++] = 'f';
+						break;
+					case '\n':
+						pDst[iDst++] = 'n';
+						break;
+					case '\r':
+						pDst[iDst++] = 'r';
+						break;
+					case '\t':
+						pDst[iDst++] = 't';
+						break;
+					case '\v':
+						pDst[iDst++] = 'v';
+						break;
+					default:
+						pDst[iDst++] = 'x';
+
+						pc = pszMsg[iSrc];
+						pDst[iDst++] = hexdigit[(pc & 0xF0) >> 4];
+						pDst[iDst++] = hexdigit[pc & 0xF];
+
+						break;
+					}
+
+				} else {
+					pDst[iDst++] = opts->cEscapePrefix;
+					pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0300) >> 6);
+					pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0070) >> 3);
+					pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0007));
+				}
+			}
+
+		} else if(pszMsg[iSrc] > 127 && opts->bEscape8Bit) {
+			if (opts->bCStyle) {
+				pDst[iDst++] = '\\';
+				pDst[iDst++] = 'x';
+
+				pc = pszMsg[iSrc];
+				pDst[iDst++] = hexdigit[(pc & 0xF0) >> 4];
+				pDst[iDst++] = hexdigit[pc & 0xF];
+
+			} else {
+				/* In this case, we also do the conversion. Note that this most
+				 * probably breaks European languages. -- rgerhards, 2010-01-27
+				 */
+				pDst[iDst++] = opts->cEscapePrefix;
+				pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0300) >> 6);
+				pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0070) >> 3);
+				pDst[iDst++] = '0' + ((pszMsg[iSrc] & 0007));
+			}
+		} else {
+			pDst[iDst++] = pszMsg[iSrc];
+		}
+		++iSrc;
+	}
+	pDst[iDst] = '\0';
+	return iDst;
+}
@@ -0,0 +1,42 @@
+/* sanitize.h
+ * Control and 8-bit character escaping of received messages, as done by
+ * the parser before the message is handed to the parser modules.
+ *
+ * Copyright 2008-2016 Rainer Gerhards and Adiscon GmbH.
+ *
+This file is part of the rsyslog runtime library.
+ *
+ * The rsyslog runtime library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The rsyslog runtime library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with the rsyslog runtime library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A copy of the GPL can be found in the file "COPYING" in this distribution.
+ * A copy of the LGPL can be found in the file "COPYING.LESSER" in this distribution.
+ */
+#ifndef INCLUDED_SANITIZE_H
+#define INCLUDED_SANITIZE_H
+
+/* the escape settings, fetched once per message from glbl */
+typedef struct sanitizeOpts_s {
+	int bEscapeCC;		/* escape control characters */
+	int bEscape8Bit;	/* escape characters with the high bit set */
+	int bSpaceLF;		/* replace LF by space instead of escaping it */
+	int bEscapeTab;		/* escape tab, too (if bEscapeCC) */
+	int bCStyle;		/* use C-style escapes ("\n", "\x1B") */
+	uchar cEscapePrefix;	/* prefix for octal escapes ("#012") */
+} sanitizeOpts_t;
+
+size_t sanitizeCheck(uchar *pszMsg, size_t lenMsg, const sanitizeOpts_t *opts);
+size_t sanitizeEscape(const uchar *pszMsg, size_t lenMsg, size_t iFirstDirty,
+	uchar *pDst, size_t maxDest, const sanitizeOpts_t *opts);
+
+#endif /* #ifndef INCLUDED_SANITIZE_H */
@@ -0,0 +1,163 @@
+/* startregex.c
+ * Start-of-message regex for multi-line reads (imfile startmsg.regex).
+ * Kept separate from stream.c so that it can be used by the testbench
+ * without the rest of the stream class.
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+
+#include "rsyslog.h"
+#include "unicode-helper.h"
+#include "startregex.h"
+
+/* check if the regex has an alternation at top level. A '|' inside a
+ * group does not affect the prefix. Bracket expressions are skipped, so
+ * that "[|]" is not taken for an alternation. Inside them, "[:...:]",
+ * "[=...=]" and "[. ... .]" may contain a ']' that does not end the
+ * bracket expression (e.g. "[[:punct:](]"), so these are skipped as a whole.
+ */
+static int
+hasTopLevelAlternation(const uchar *p)
+{
+	int depth = 0;
+
+	for( ; *p != '\0' ; ++p) {
+		if(*p == '\\' && p[1] != '\0') {
+			++p;
+		} else if(*p == '[') {
+			++p;
+			if(*p == '^')
+				++p;
+			if(*p == ']')
+				++p;
+			while(*p != '\0' && *p != ']') {
+				if(*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+					const uchar delim = p[1];
+					for(p += 2 ; *p != '\0' && !(*p == delim && p[1] == ']') ; ++p)
+						/* just skip */;
+					if(*p == '\0')
+						return 1; /* malformed, be conservative */
+					++p; /* now on the closing ']' of the class */
+				}
+				++p;
+			}
+			if(*p == '\0')
+				return 1; /* malformed, be conservative */
+		} else if(*p == '(') {
+			++depth;
+		} else if(*p == ')') {
+			if(depth > 0)
+				--depth;
+		} else if(*p == '|' && depth == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* compile a start-of-message regex (Posix ERE) for use with
+ * strmReadMultiLine(). We also extract the literal prefix, if any, that
+ * a line must start with in order to match. This is only possible if the
+ * regex is anchored via '^' and has no top-level alternation. Extraction stops at
+ * the first character with special meaning. If a literal character is
+ * followed by a quantifier that permits zero occurences, it is not part
+ * of the prefix. Non-ASCII characters also end the prefix, because a
+ * quantifier would apply to the full multibyte character.
+ */
+rsRetVal
+strmStartRegexCompile(strmStartRegex_t *const pStartRe, const uchar *const regex)
+{
+	const uchar *p;
+	size_t lenPrefix = 0;
+	sbool bPrefixOnly = 0;
+	DEFiRet;
+
+	pStartRe->prefix = NULL;
+	pStartRe->lenPrefix = 0;
+	pStartRe->bPrefixOnly = 0;
+	if(regcomp(&pStartRe->preg, (char*) regex, REG_EXTENDED | REG_NOSUB) != 0) {
+		DBGPRINTF("startregex: error compiling start regex '%s'\n", regex);
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
+
+	if(regex[0] != '^' || hasTopLevelAlternation(regex))
+		FINALIZE; /* no usable prefix */
+
+	CHKmalloc(pStartRe->prefix = malloc(ustrlen(regex)));
+	for(p = regex + 1 ; ; ++p) {
+		if(*p == '\0') {
+			bPrefixOnly = 1;
+			break;
+		} else if(*p == '*' || *p == '?' || *p == '{') {
+			/* previous char is optional */
+			if(lenPrefix > 0)
+				--lenPrefix;
+			break;
+		} else if(*p == '\\' && p[1] != '\0' && strchr(".[]{}()\\*+?^$|/", p[1]) != NULL) {
+			++p;
+			pStartRe->prefix[lenPrefix++] = *p;
+		} else if(*p >= 0x80 || strchr(".[]{}()\\*+?^$|", *p) != NULL) {
+			break;
+		} else {
+			pStartRe->prefix[lenPrefix++] = *p;
+		}
+	}
+
+	if(lenPrefix == 0 && !bPrefixOnly) {
+		free(pStartRe->prefix);
+		pStartRe->prefix = NULL;
+		FINALIZE;
+	}
+	pStartRe->lenPrefix = lenPrefix;
+	pStartRe->bPrefixOnly = bPrefixOnly;
+	DBGPRINTF("startregex: start regex '%s' has literal prefix of length %zu%s\n",
+		regex, lenPrefix, bPrefixOnly ? " (regex is prefix only)" : "");
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* free resources held by a start regex compiled via strmStartRegexCompile() */
+void
+strmStartRegexFree(strmStartRegex_t *const pStartRe)
+{
+	regfree(&pStartRe->preg);
+	free(pStartRe->prefix);
+	pStartRe->prefix = NULL;
+}
+
+
+/* check if a line matches the start regex. The prefix check is done
+ * first, as it permits to reject (and often accept) most lines without
+ * calling into the regex engine.
+ */
+int
+strmStartRegexMatch(const strmStartRegex_t *const pStartRe, uchar *const line, const size_t lenLine)
+{
+	if(pStartRe->prefix != NULL) {
+		if(lenLine < pStartRe->lenPrefix || memcmp(line, pStartRe->prefix, pStartRe->lenPrefix))
+			return 0;
+		if(pStartRe->bPrefixOnly)
+			return 1;
+	}
+	return !regexec(&pStartRe->preg, (char*)line, 0, NULL, 0);
+}
@@ -0,0 +1,40 @@
+/* startregex.h
+ * Start-of-message regex for multi-line reads (imfile startmsg.regex).
+ *
+ * This file is part of the rsyslog runtime library.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *       -or-
+ *       see COPYING.ASL20 in the source distribution
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef INCLUDED_STARTREGEX_H
+#define INCLUDED_STARTREGEX_H
+#include <regex.h>
+
+/* compiled start-of-message regex for strmReadMultiLine(). In addition to
+ * the regex itself, we keep the literal text every matching line must begin
+ * with (if the regex is anchored). That way, most lines can be classified by
+ * a simple memcmp() without invoking the regex engine.
+ */
+typedef struct strmStartRegex_s {
+	regex_t preg;		/* compiled regex */
+	uchar *prefix;		/* literal prefix of any match, NULL if none */
+	size_t lenPrefix;
+	sbool bPrefixOnly;	/* regex is just "^prefix", no need to call regexec() */
+} strmStartRegex_t;
+
+rsRetVal strmStartRegexCompile(strmStartRegex_t *const pStartRe, const uchar *const regex);
+void strmStartRegexFree(strmStartRegex_t *const pStartRe);
+int strmStartRegexMatch(const strmStartRegex_t *const pStartRe, uchar *const line, const size_t lenLine);
+
+#endif /* #ifndef INCLUDED_STARTREGEX_H */
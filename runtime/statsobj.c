@@ -225,6 +225,9 @@ addManagedCounter(statsobj_t *pThis, const uchar *ctrName, statsCtrType_t ctrTyp
 	case ctrType_Int:
 		ctr->val.pInt = (int*) pCtr;
 		break;
+	case ctrType_Histogram:
+		ctr->val.pHist = (statshist_t*) pCtr;
+		break;
 	}
 	if (linked) {
 		addCtrToList(pThis, ctr);
@@ -297,10 +300,60 @@ resetResettableCtr(ctr_t *pCtr, int8_t bResetCtrs)
 		case ctrType_Int:
 			*(pCtr->val.pInt) = 0;
 			break;
+		case ctrType_Histogram:
+			memset(pCtr->val.pHist->buckets, 0, sizeof(pCtr->val.pHist->buckets));
+			break;
 		}
 	}
 }
 
+/* values reported for a histogram counter, in this order */
+#define HIST_NVALS 6
+static const char *const histValNames[HIST_NVALS] =
+	{ ".count", ".p50", ".p95", ".p99", ".p999", ".max" };
+
+/* upper bound of the values that fall into histogram bucket b */
+static intctr_t
+histBucketUpper(const int b)
+{
+	int shift;
+	if(b < STATSHIST_SUB)
+		return b;
+	shift = b / STATSHIST_SUB - 1;
+	return ((intctr_t) (STATSHIST_SUB + b % STATSHIST_SUB + 1) << shift) - 1;
+}
+
+/* compute the reported values of a histogram. The buckets may be updated
+ * concurrently, so we work on a snapshot of them.
+ */
+static void
+histGetValues(statshist_t *const pHist, intctr_t vals[HIST_NVALS])
+{
+	static const int pct[] = { 500, 950, 990, 999 }; /* per mille */
+	intctr_t buckets[STATSHIST_NBUCKETS];
+	intctr_t total = 0;
+	intctr_t sum;
+	int b, i;
+
+	memcpy(buckets, pHist->buckets, sizeof(buckets));
+	for(b = 0 ; b < STATSHIST_NBUCKETS ; ++b)
+		total += buckets[b];
+	memset(vals, 0, sizeof(intctr_t) * HIST_NVALS);
+	vals[0] = total;
+	if(total == 0)
+		return;
+
+	for(i = 0, b = 0, sum = 0 ; i < 4 ; ++i) {
+		const intctr_t rank = (total * pct[i] + 999) / 1000;
+		while(b < STATSHIST_NBUCKETS && sum + buckets[b] < rank)
+			sum += buckets[b++];
+		vals[i+1] = histBucketUpper(b);
+	}
+	for(b = STATSHIST_NBUCKETS - 1 ; b > 0 && buckets[b] == 0 ; --b)
+		/* just search */;
+	vals[HIST_NVALS-1] = histBucketUpper(b);
+}
+
 static rsRetVal
 addCtrForReporting(json_object *to, const uchar* field_name, intctr_t value) {
 	json_object *v = NULL;
@@ -345,11 +398,38 @@ accumulatedValue(ctr_t *pCtr) {
 		return *(pCtr->val.pIntCtr);
 	case ctrType_Int:
 		return *(pCtr->val.pInt);
+	case ctrType_Histogram:
+		break; /* reported via histGetValues() */
 	}
 	return -1;
 }
 
 
+/* add a counter to a JSON stats object, optionally with ES-compatible name */
+static rsRetVal
+addNamedCtrForReporting(json_object *to, const uchar *name, intctr_t value, const statsFmtType_t fmt)
+{
+	uchar esbuf[256];
+	DEFiRet;
+
+	if (fmt == statsFmt_JSON_ES) {
+		/* work-around for broken Elasticsearch JSON implementation:
+		 * we need to replace dots by a different char, we use bang.
+		 * Note: ES 2.0 does not longer accept dot in name
+		 */
+		strncpy((char*)esbuf, (char*)name, sizeof(esbuf)-1);
+		esbuf[sizeof(esbuf)-1] = '\0';
+		for(uchar *c = esbuf ; *c ; ++c) {
+			if(*c == '.')
+				*c = '!';
+		}
+		name = esbuf;
+	}
+	iRet = addCtrForReporting(to, name, value);
+	RETiRet;
+}
+
+
 /* get all the object's countes together as CEE. */
 static rsRetVal
 getStatsLineCEE(statsobj_t *pThis, cstr_t **ppcstr, const statsFmtType_t fmt, const int8_t bResetCtrs)
@@ -384,21 +464,16 @@ getStatsLineCEE(statsobj_t *pThis, cstr_t **ppcstr, const statsFmtType_t fmt, co
 	/* now add all counters to this line */
 	pthread_mutex_lock(&pThis->mutCtr);
 	for(pCtr = pThis->ctrRoot ; pCtr != NULL ; pCtr = pCtr->next) {
-		if (fmt == statsFmt_JSON_ES) {
-			/* work-around for broken Elasticsearch JSON implementation:
-			 * we need to replace dots by a different char, we use bang.
-			 * Note: ES 2.0 does not longer accept dot in name
-			 */
-			uchar esbuf[256];
-			strncpy((char*)esbuf, (char*)pCtr->name, sizeof(esbuf)-1);
-			esbuf[sizeof(esbuf)-1] = '\0';
-			for(uchar *c = esbuf ; *c ; ++c) {
-				if(*c == '.')
-					*c = '!';
+		if(pCtr->ctrType == ctrType_Histogram) {
+			intctr_t hvals[HIST_NVALS];
+			uchar hname[256];
+			histGetValues(pCtr->val.pHist, hvals);
+			for(int i = 0 ; i < HIST_NVALS ; ++i) {
+				snprintf((char*)hname, sizeof(hname), "%s%s", pCtr->name, histValNames[i]);
+				CHKiRet(addNamedCtrForReporting(values, hname, hvals[i], fmt));
 			}
-			CHKiRet(addCtrForReporting(values, esbuf, accumulatedValue(pCtr)));
 		} else {
-			CHKiRet(addCtrForReporting(values, pCtr->name, accumulatedValue(pCtr)));
+			CHKiRet(addNamedCtrForReporting(values, pCtr->name, accumulatedValue(pCtr), fmt));
 		}
 		resetResettableCtr(pCtr, bResetCtrs);
 	}
@@ -441,6 +516,19 @@ getStatsLine(statsobj_t *pThis, cstr_t **ppcstr, int8_t bResetCtrs)
 	/* now add all counters to this line */
 	pthread_mutex_lock(&pThis->mutCtr);
 	for(pCtr = pThis->ctrRoot ; pCtr != NULL ; pCtr = pCtr->next) {
+		if(pCtr->ctrType == ctrType_Histogram) {
+			intctr_t hvals[HIST_NVALS];
+			histGetValues(pCtr->val.pHist, hvals);
+			for(int i = 0 ; i < HIST_NVALS ; ++i) {
+				rsCStrAppendStr(pcstr, pCtr->name);
+				rsCStrAppendStr(pcstr, (uchar*) histValNames[i]);
+				cstrAppendChar(pcstr, '=');
+				rsCStrAppendInt(pcstr, hvals[i]);
+				cstrAppendChar(pcstr, ' ');
+			}
+			resetResettableCtr(pCtr, bResetCtrs);
+			continue;
+		}
 		rsCStrAppendStr(pcstr, pCtr->name);
 		cstrAppendChar(pcstr, '=');
 		switch(pCtr->ctrType) {
@@ -450,6 +538,8 @@ getStatsLine(statsobj_t *pThis, cstr_t **ppcstr, int8_t bResetCtrs)
 		case ctrType_Int:
 			rsCStrAppendInt(pcstr, *(pCtr->val.pInt));
 			break;
+		case ctrType_Histogram:
+			break; /* handled above */
 		}
 		cstrAppendChar(pcstr, ' ');
 		resetResettableCtr(pCtr, bResetCtrs);
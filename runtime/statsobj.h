@@ -21,6 +21,7 @@
 #ifndef INCLUDED_STATSOBJ_H
 #define INCLUDED_STATSOBJ_H
 
+#include <time.h>
 #include "atomic.h"
 
 /* The following data item is somewhat dirty, in that it does not follow
@@ -40,9 +41,25 @@ typedef uint64 intctr_t;
 /* counter types */
 typedef enum statsCtrType_e {
 	ctrType_IntCtr,
-	ctrType_Int
+	ctrType_Int,
+	ctrType_Histogram
 } statsCtrType_t;
 
+/* log-linear histogram, used for latencies. Each power of two is split
+ * into STATSHIST_SUB linear sub-buckets, so the relative error of a
+ * reported value is at most 1/STATSHIST_SUB. Recording is a single atomic
+ * increment, so histograms can be updated from any thread without locking.
+ * The stats line reports count, a few percentiles and the max (the upper
+ * bound of the highest non-empty bucket).
+ */
+#define STATSHIST_SUBBITS 3
+#define STATSHIST_SUB (1 << STATSHIST_SUBBITS)
+#define STATSHIST_NBUCKETS ((64 - STATSHIST_SUBBITS + 1) * STATSHIST_SUB)
+typedef struct statshist_s {
+	intctr_t buckets[STATSHIST_NBUCKETS];
+	DEF_ATOMIC_HELPER_MUT64(mut)
+} statshist_t;
+
 /* stats line format types */
 typedef enum statsFmtType_e {
 	statsFmt_Legacy,
@@ -67,6 +84,7 @@ typedef struct ctr_s {
 	union {
 		intctr_t *pIntCtr;
 		int *pInt;
+		statshist_t *pHist;
 	} val;
 	int8_t flags;
 	struct ctr_s *next, *prev;
@@ -198,4 +216,53 @@ void checkGoneAwaySenders(time_t);
 	if(GatherStats && ((newmax) > (ctr))) \
 		ctr = newmax;
 
+/* histogram helpers. Values are unsigned 64 bit; for latencies we use
+ * microseconds derived from the monotonic clock.
+ */
+static inline uint64_t
+statsHistNowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int
+statsHistBucket(const uint64_t val)
+{
+	int msb;
+	if(val < STATSHIST_SUB)
+		return (int) val;
+	msb = 63 - __builtin_clzll(val);
+	return (msb - STATSHIST_SUBBITS + 1) * STATSHIST_SUB
+		+ (int) ((val >> (msb - STATSHIST_SUBBITS)) & (STATSHIST_SUB - 1));
+}
+
+static inline rsRetVal
+statsHistConstruct(statshist_t **ppHist)
+{
+	DEFiRet;
+	CHKmalloc(*ppHist = calloc(1, sizeof(statshist_t)));
+	INIT_ATOMIC_HELPER_MUT64((*ppHist)->mut);
+finalize_it:
+	RETiRet;
+}
+
+static inline void
+statsHistDestruct(statshist_t **ppHist)
+{
+	if(*ppHist == NULL)
+		return;
+	DESTROY_ATOMIC_HELPER_MUT64((*ppHist)->mut);
+	free(*ppHist);
+	*ppHist = NULL;
+}
+
+static inline void
+statsHistRecord(statshist_t *const pHist, const uint64_t val)
+{
+	if(GatherStats)
+		ATOMIC_INC_uint64(&pHist->buckets[statsHistBucket(val)], &pHist->mut);
+}
+
 #endif /* #ifndef INCLUDED_STATSOBJ_H */
@@ -86,6 +86,7 @@ static void *asyncWriterThread(void *pPtr);
 static rsRetVal doZipWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf, int bFlush);
 static rsRetVal doZipFinish(strm_t *pThis);
 static rsRetVal strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf);
+static rsRetVal syncFile(strm_t *pThis);
 static rsRetVal strmSeekCurrOffs(strm_t *pThis);
 
 
@@ -355,6 +356,22 @@ static rsRetVal strmOpenFile(strm_t *pThis)
 
 	pThis->iCurrOffs = 0;
 	CHKiRet(getFileSize(pThis->pszCurrFName, &offset));
+#	if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	if(pThis->bPrealloc && pThis->tOperationsMode != STREAMMODE_READ
+	   && pThis->sType == STREAMTYPE_FILE_CIRCULAR && pThis->iMaxFileSize > offset) {
+		/* keep the file size, readers rely on it to find the end of data */
+		if(fallocate(pThis->fd, FALLOC_FL_KEEP_SIZE, offset, pThis->iMaxFileSize - offset) != 0) {
+			DBGPRINTF("fallocate failed for '%s', errno %d - ignored\n",
+				pThis->pszCurrFName, errno);
+		}
+	}
+#	endif
+#	ifdef HAVE_POSIX_FADVISE
+	if(pThis->bReadAhead && pThis->tOperationsMode == STREAMMODE_READ) {
+		posix_fadvise(pThis->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		posix_fadvise(pThis->fd, 0, 0, POSIX_FADV_WILLNEED);
+	}
+#	endif
 	if(pThis->tOperationsMode == STREAMMODE_WRITE_APPEND) {
 		pThis->iCurrOffs = offset;
 	} else if(pThis->tOperationsMode == STREAMMODE_WRITE) {
@@ -446,6 +463,14 @@ static rsRetVal strmCloseFile(strm_t *pThis)
 	 * against this. -- rgerhards, 2010-03-19
 	 */
 	if(pThis->fd != -1) {
+		if(pThis->bGroupSync && pThis->tOperationsMode != STREAMMODE_READ) {
+			/* the owner only syncs the current file, so this one must be done now */
+			if(syncFile(pThis) != RS_RET_OK) {
+				errmsg.LogError(0, RS_RET_IO_ERROR, "file '%s': sync on close failed, "
+					"data written to it may not be on stable storage",
+					getFileDebugName(pThis));
+			}
+		}
 		currOffs = lseek64(pThis->fd, 0, SEEK_CUR);
 		close(pThis->fd);
 		pThis->fd = -1;
@@ -878,11 +903,12 @@ strmReadMultiLine_isTimedOut(const strm_t *const __restrict__ pThis)
 /* read a multi-line message from a strm file.
  * The multi-line message is terminated based on the user-provided
  * startRegex (Posix ERE). For performance reasons, the regex
- * must already have been compiled by the user.
+ * must already have been compiled by the user via
+ * strmStartRegexCompile().
  * added 2015-05-12 rgerhards
  */
 rsRetVal
-strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, const sbool bEscapeLF)
+strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, strmStartRegex_t *pStartRe, const sbool bEscapeLF)
 {
         uchar c;
 	uchar finished = 0;
@@ -912,7 +938,8 @@ strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, const sbool bEs
 		cstrFinalize(thisLine);
 
 		/* we have a line, now let's assemble the message */
-		const int isMatch = !regexec(preg, (char*)rsCStrGetSzStrNoNULL(thisLine), 0, NULL, 0);
+		const int isMatch = strmStartRegexMatch(pStartRe, rsCStrGetSzStrNoNULL(thisLine),
+							cstrLen(thisLine));
 
 		if(isMatch) {
 			/* in this case, the *previous* message is complete and we are
@@ -1432,10 +1459,12 @@ finalize_it:
 
 /* sync the file to disk, so that any unwritten data is persisted. This
  * also syncs the directory and thus makes sure that the file survives
- * fatal failure. Note that we do NOT return an error status if the
+ * fatal failure. Note that the write path does NOT fail if the
  * sync fails. Doing so would probably cause more trouble than it
  * is worth (read: data loss may occur where we otherwise might not
  * have it). -- rgerhards, 2009-06-08
+ * A failed sync is still reported as RS_RET_IO_ERROR, so that the
+ * group sync on close can tell the user about it.
  */
 #undef SYNCCALL
 #ifdef HAVE_FDATASYNC
@@ -1460,11 +1489,14 @@ syncFile(strm_t *pThis)
 		rs_strerror_r(err, errStr, sizeof(errStr));
 		DBGPRINTF("sync failed for file %d with error (%d): %s - ignoring\n",
 			   pThis->fd, err, errStr);
+		iRet = RS_RET_IO_ERROR;
 	}
 	
 	if(pThis->fdDir != -1) {
-		if(fsync(pThis->fdDir) != 0)
+		if(fsync(pThis->fdDir) != 0) {
 			DBGPRINTF("stream/syncFile: fsync returned error, ignoring\n");
+			iRet = RS_RET_IO_ERROR;
+		}
 	}
 
 finalize_it:
@@ -1503,8 +1535,8 @@ strmPhysWrite(strm_t *pThis, uchar *pBuf, size_t lenBuf)
 	if(pThis->pUsrWCntr != NULL)
 		*pThis->pUsrWCntr += iWritten;
 
-	if(pThis->bSync) {
-		CHKiRet(syncFile(pThis));
+	if(pThis->bSync && !pThis->bGroupSync) {
+		syncFile(pThis); /* sync errors are ignored here, as they always were */
 	}
 
 	if(pThis->sType == STREAMTYPE_FILE_CIRCULAR) {
@@ -1745,6 +1777,35 @@ finalize_it:
 }
 
 
+/* cut file number FNum of a circular stream back to offs octets, if it is
+ * longer. This is used to drop a partially written record at the end of a
+ * file after a crash, so that readers do not run into the next file while
+ * still parsing it. The stream itself is not modified.
+ */
+rsRetVal
+strmTruncFile(strm_t *pThis, unsigned int FNum, off64_t offs)
+{
+	uchar *pszName = NULL;
+	struct stat statBuf;
+	DEFiRet;
+
+	ISOBJ_TYPE_assert(pThis, strm);
+
+	CHKiRet(genFileName(&pszName, pThis->pszDir, pThis->lenDir,
+			    pThis->pszFName, pThis->lenFName, FNum, pThis->iFileNumDigits));
+	if(stat((char*)pszName, &statBuf) == -1 || statBuf.st_size <= offs)
+		FINALIZE;
+	DBGPRINTF("strmTruncFile: truncating '%s' from %lld to %lld bytes\n", pszName,
+		  (long long) statBuf.st_size, (long long) offs);
+	if(truncate((char*)pszName, offs) != 0)
+		ABORT_FINALIZE(RS_RET_IO_ERROR);
+
+finalize_it:
+	free(pszName);
+	RETiRet;
+}
+
+
 /* seek to current offset. This is primarily a helper to readjust the OS file
  * pointer after a strm object has been deserialized.
  */
@@ -1919,6 +1980,34 @@ strmSetReadTimeout(strm_t *const __restrict__ pThis, const int val)
 	pThis->readTimeout = val;
 }
 
+/* enable group sync: the owner syncs (a dup of) our fd for many writes
+ * at once, we only sync when a file is closed (e.g. on rollover).
+ */
+void
+strmSetGroupSync(strm_t *const __restrict__ pThis, const int val)
+{
+	pThis->bGroupSync = val;
+}
+
+/* preallocate each new circular output file to iMaxFileSize, so that
+ * appending does not need block allocation (and the metadata syncs that
+ * come with it).
+ */
+void
+strmSetPrealloc(strm_t *const __restrict__ pThis, const int val)
+{
+	pThis->bPrealloc = val;
+}
+
+/* have the kernel read ahead every input file we open as a whole, for
+ * readers that will consume it sequentially (e.g. disk queue read-ahead).
+ */
+void
+strmSetReadAhead(strm_t *const __restrict__ pThis, const int val)
+{
+	pThis->bReadAhead = val;
+}
+
 static rsRetVal strmSetbDeleteOnClose(strm_t *pThis, int val)
 {
 	pThis->bDeleteOnClose = val;
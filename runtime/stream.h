@@ -74,6 +74,7 @@
 #include "stream.h"
 #include "zlibw.h"
 #include "cryprov.h"
+#include "startregex.h"
 
 /* stream types */
 typedef enum {
@@ -112,6 +113,9 @@ typedef struct strm_s {
 	/* dynamic properties, valid only during file open, not to be persistet */
 	sbool bDisabled; /* should file no longer be written to? (currently set only if omfile file size limit fails) */
 	sbool bSync;	/* sync this file after every write? */
+	sbool bGroupSync; /* writes are synced by the owner in groups, we only sync on close */
+	sbool bPrealloc; /* preallocate circular output files to iMaxFileSize */
+	sbool bReadAhead; /* ask the kernel to read ahead each input file as a whole */
 	sbool bReopenOnTruncate;
 	size_t sIOBufSize;/* size of IO buffer */
 	uchar *pszDir; /* Directory */
@@ -217,9 +221,13 @@ ENDinterface(strm)
 /* prototypes */
 PROTOTYPEObjClassInit(strm);
 rsRetVal strmMultiFileSeek(strm_t *pThis, unsigned int fileNum, off64_t offs, off64_t *bytesDel);
-rsRetVal strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, regex_t *preg, sbool bEscapeLF);
+rsRetVal strmTruncFile(strm_t *pThis, unsigned int FNum, off64_t offs);
+rsRetVal strmReadMultiLine(strm_t *pThis, cstr_t **ppCStr, strmStartRegex_t *pStartRe, sbool bEscapeLF);
 int strmReadMultiLine_isTimedOut(const strm_t *const __restrict__ pThis);
 void strmDebugOutBuf(const strm_t *const pThis);
 void strmSetReadTimeout(strm_t *const __restrict__ pThis, const int val);
+void strmSetGroupSync(strm_t *const __restrict__ pThis, const int val);
+void strmSetPrealloc(strm_t *const __restrict__ pThis, const int val);
+void strmSetReadAhead(strm_t *const __restrict__ pThis, const int val);
 
 #endif /* #ifndef STREAM_H_INCLUDED */
@@ -577,30 +577,47 @@ rsCStrSzStrStartsWithCStr(cstr_t *const __restrict__ pCS1,
  * Note that the function returns -1 if regexp functionality is not available.
  * rgerhards: 2009-03-04: ERE support added, via parameter iType: 0 - BRE, 1 - ERE
  * Arnaud Cornet/rgerhards: 2009-04-02: performance improvement by caching compiled regex
- * If a caller does not need the cached version, it must still provide memory for it
- * and must call rsCStrRegexDestruct() afterwards.
+ * The cache must have been filled by rsCStrRegexCompile() during config load;
+ * it is never written here, as this runs concurrently on all workers. If it is
+ * empty (the regex did not compile), nothing matches.
  */
 rsRetVal rsCStrSzStrMatchRegex(cstr_t *pCS1, uchar *psz, int iType, void *rc)
 {
-	regex_t **cache = (regex_t**) rc;
-	int ret;
+	rsRegex_t **cache = (rsRegex_t**) rc;
 	DEFiRet;
 
 	assert(pCS1 != NULL);
 	assert(psz != NULL);
 	assert(cache != NULL);
 
-	if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
-		if (*cache == NULL) {
-			*cache = calloc(sizeof(regex_t), 1);
-			regexp.regcomp(*cache, (char*) rsCStrGetSzStrNoNULL(pCS1), (iType == 1 ? REG_EXTENDED : 0) | REG_NOSUB);
-		}
-		ret = regexp.regexec(*cache, (char*) psz, 0, NULL, 0);
-		if(ret != 0)
-			ABORT_FINALIZE(RS_RET_NOT_FOUND);
-	} else {
+	if(*cache == NULL || !regexp.match(*cache, (char*) psz))
 		ABORT_FINALIZE(RS_RET_NOT_FOUND);
-	}
+
+finalize_it:
+	RETiRet;
+}
+
+
+/* compile the regex contained in pCS1 into the cache used by
+ * rsCStrSzStrMatchRegex(). This is intended to be called during config
+ * load, so that no compilation needs to be done while messages are
+ * processed. If the regex is already compiled, nothing is done.
+ * Returns RS_RET_ERR if the regex is invalid.
+ */
+rsRetVal
+rsCStrRegexCompile(cstr_t *pCS1, int iType, void *rc)
+{
+	rsRegex_t **cache = (rsRegex_t**) rc;
+	DEFiRet;
+
+	assert(pCS1 != NULL);
+	assert(cache != NULL);
+
+	if(*cache != NULL)
+		FINALIZE;
+
+	CHKiRet(objUse(regexp, LM_REGEXP_FILENAME));
+	CHKiRet(regexp.compileMatcher(cache, (char*) rsCStrGetSzStrNoNULL(pCS1), iType == 1));
 
 finalize_it:
 	RETiRet;
@@ -613,14 +630,13 @@ finalize_it:
  */
 void rsCStrRegexDestruct(void *rc)
 {
-	regex_t **cache = rc;
+	rsRegex_t **cache = rc;
 	
 	assert(cache != NULL);
 	assert(*cache != NULL);
 
 	if(objUse(regexp, LM_REGEXP_FILENAME) == RS_RET_OK) {
-		regexp.regfree(*cache);
-		free(*cache);
+		regexp.freeMatcher(*cache);
 		*cache = NULL;
 	}
 }
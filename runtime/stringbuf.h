@@ -127,6 +127,7 @@ int rsCStrLocateSzStr(cstr_t *pCStr, uchar *sz);
 int rsCStrLocateInSzStr(cstr_t *pThis, uchar *sz);
 int rsCStrSzStrStartsWithCStr(cstr_t *pCS1, uchar *psz, size_t iLenSz);
 rsRetVal rsCStrSzStrMatchRegex(cstr_t *pCS1, uchar *psz, int iType, void *cache);
+rsRetVal rsCStrRegexCompile(cstr_t *pCS1, int iType, void *cache);
 void rsCStrRegexDestruct(void *rc);
 
 /* new calling interface */
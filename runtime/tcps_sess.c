@@ -128,10 +128,11 @@ SetHost(tcps_sess_t *pThis, uchar *pszHost)
 
 	ISOBJ_TYPE_assert(pThis, tcps_sess);
 
-	if(pThis->fromHost == NULL)
-		CHKiRet(prop.Construct(&pThis->fromHost));
+	if(pThis->fromHost != NULL)
+		prop.Destruct(&pThis->fromHost);
 
-	CHKiRet(prop.SetString(pThis->fromHost, pszHost, ustrlen(pszHost)));
+	/* many sessions share few peers, so share the prop, too */
+	CHKiRet(prop.CreateInternedStringProp(&pThis->fromHost, pszHost, ustrlen(pszHost)));
 
 finalize_it:
 	free(pszHost); /* we must free according to our (old) calling conventions */
@@ -174,9 +174,11 @@ addNewLstnPort(tcpsrv_t *pThis, uchar *pszPort, int bSuppOctetFram, uchar *pszAd
 	statname[sizeof(statname)-1] = '\0'; /* just to be on the save side... */
 	CHKiRet(statsobj.SetName(pEntry->stats, statname));
 	CHKiRet(statsobj.SetOrigin(pEntry->stats, pThis->pszOrigin));
-	CHKiRet(ratelimitNew(&pEntry->ratelimiter, "tcperver", NULL));
+	CHKiRet(ratelimitNew(&pEntry->ratelimiter, "tcperver", (char*)statname));
 	ratelimitSetLinuxLike(pEntry->ratelimiter, pThis->ratelimitInterval, pThis->ratelimitBurst);
 	ratelimitSetThreadSafe(pEntry->ratelimiter);
+	CHKiRet(ratelimitSetTokenBucket(pEntry->ratelimiter, pThis->ratelimitTokenRate,
+		pThis->ratelimitTokenBurst, pThis->ratelimitMaxSources, pThis->ratelimitGlobalRate));
 	STATSCOUNTER_INIT(pEntry->ctrSubmit, pEntry->mutCtrSubmit);
 	CHKiRet(statsobj.AddCounter(pEntry->stats, UCHAR_CONSTANT("submitted"),
 		ctrType_IntCtr, CTR_FLAG_RESETTABLE, &(pEntry->ctrSubmit)));
@@ -970,6 +972,10 @@ BEGINobjConstruct(tcpsrv) /* be sure to specify the object type also in END macr
 	pThis->bSPFramingFix = 0;
 	pThis->ratelimitInterval = 0;
 	pThis->ratelimitBurst = 10000;
+	pThis->ratelimitTokenRate = 0;
+	pThis->ratelimitTokenBurst = 0;
+	pThis->ratelimitMaxSources = 10000;
+	pThis->ratelimitGlobalRate = 0;
 	pThis->bUseFlowControl = 1;
 	pThis->pszDrvrName = NULL;
 ENDobjConstruct(tcpsrv)
@@ -1253,6 +1259,19 @@ SetLinuxLikeRatelimiters(tcpsrv_t *pThis, int ratelimitInterval, int ratelimitBu
 }
 
 
+/* Set the token-bucket ratelimiter settings, rate 0 means off */
+static rsRetVal
+SetTokenBucketRatelimiters(tcpsrv_t *pThis, int rate, int burst, int maxSources, int globalRate)
+{
+	DEFiRet;
+	pThis->ratelimitTokenRate = rate;
+	pThis->ratelimitTokenBurst = burst;
+	pThis->ratelimitMaxSources = maxSources;
+	pThis->ratelimitGlobalRate = globalRate;
+	RETiRet;
+}
+
+
 /* Set the ruleset (ptr) to use */
 static rsRetVal
 SetRuleset(tcpsrv_t *pThis, ruleset_t *pRuleset)
@@ -1421,6 +1440,7 @@ CODESTARTobjQueryInterface(tcpsrv)
 	pIf->SetOnMsgReceive = SetOnMsgReceive;
 	pIf->SetRuleset = SetRuleset;
 	pIf->SetLinuxLikeRatelimiters = SetLinuxLikeRatelimiters;
+	pIf->SetTokenBucketRatelimiters = SetTokenBucketRatelimiters;
 	pIf->SetNotificationOnRemoteClose = SetNotificationOnRemoteClose;
 
 finalize_it:
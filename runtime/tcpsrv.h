@@ -83,6 +83,10 @@ struct tcpsrv_s {
 	int bDisableLFDelim;	/**< if 1, standard LF frame delimiter is disabled (*very dangerous*) */
 	int ratelimitInterval;
 	int ratelimitBurst;
+	int ratelimitTokenRate;	/**< per-source token bucket, 0 = off */
+	int ratelimitTokenBurst;
+	int ratelimitMaxSources;
+	int ratelimitGlobalRate;	/**< token bucket for each listener as a whole, 0 = off */
 	tcps_sess_t **pSessions;/**< array of all of our sessions */
 	void *pUsr;		/**< a user-settable pointer (provides extensibility for "derived classes")*/
 	/* callbacks */
@@ -168,8 +172,10 @@ BEGINinterface(tcpsrv) /* name must also be changed in ENDinterface macro! */
 	rsRetVal (*SetKeepAliveTime)(tcpsrv_t*, int);
 	/* added v18 */
 	rsRetVal (*SetbSPFramingFix)(tcpsrv_t*, sbool);
+	/* added v19 */
+	rsRetVal (*SetTokenBucketRatelimiters)(tcpsrv_t *pThis, int rate, int burst, int maxSources, int globalRate);
 ENDinterface(tcpsrv)
-#define tcpsrvCURR_IF_VERSION 18 /* increment whenever you change the interface structure! */
+#define tcpsrvCURR_IF_VERSION 19 /* increment whenever you change the interface structure! */
 /* change for v4:
  * - SetAddtlFrameDelim() added -- rgerhards, 2008-12-10
  * - SetInputName() added -- rgerhards, 2008-12-10
@@ -105,6 +105,7 @@ typedef struct outchannels_s outchannels_t;
 typedef struct modConfData_s modConfData_t;
 typedef struct instanceConf_s instanceConf_t;
 typedef struct ratelimit_s ratelimit_t;
+typedef struct tbratelimit_s tbratelimit_t;
 typedef struct lookup_string_tab_entry_s lookup_string_tab_entry_t;
 typedef struct lookup_string_tab_s lookup_string_tab_t;
 typedef struct lookup_array_tab_s lookup_array_tab_t;
@@ -127,6 +128,7 @@ typedef struct actWrkrIParams actWrkrIParams_t;
 typedef struct dynstats_bucket_s dynstats_bucket_t;
 typedef struct dynstats_buckets_s dynstats_buckets_t;
 typedef struct dynstats_ctr_s dynstats_ctr_t;
+typedef struct rsRegex_s rsRegex_t;
 
 /* under Solaris (actually only SPARC), we need to redefine some types
  * to be void, so that we get void* pointers. Otherwise, we will see
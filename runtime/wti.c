@@ -52,6 +52,7 @@ DEFobjStaticHelpers
 DEFobjCurrIf(glbl)
 
 pthread_key_t thrd_wti_key;
+static pthread_key_t thrd_arena_key; /* arena of the wti currently active on this thread */
 
 
 /* forward-definitions */
@@ -187,6 +188,11 @@ wtiNewIParam(wti_t *const pWti, action_t *const pAction, actWrkrIParams_t **pipa
 		memset(iparams + (wrkrInfo->p.tx.currIParam * pAction->iNumTpls), 0,
 		       sizeof(actWrkrIParams_t) * pAction->iNumTpls * (newMax - wrkrInfo->p.tx.maxIParams));
 		wrkrInfo->p.tx.iparams = iparams;
+		if(pAction->pHistLatency != NULL) {
+			uint64_t *ingressNs;
+			CHKmalloc(ingressNs = realloc(wrkrInfo->p.tx.ingressNs, sizeof(uint64_t) * newMax));
+			wrkrInfo->p.tx.ingressNs = ingressNs;
+		}
 		wrkrInfo->p.tx.maxIParams = newMax;
 	}
 	*piparams = wrkrInfo->p.tx.iparams + wrkrInfo->p.tx.currIParam * pAction->iNumTpls;
@@ -198,11 +204,98 @@ finalize_it:
 
 
 
+/* allocate len bytes of transient memory from the arena. The memory
+ * remains valid until the owning wti resets the arena (after the current
+ * batch has been processed) and must NOT be free()ed by the caller.
+ * Returns NULL if we are out of memory.
+ */
+void *
+wtiArenaAlloc(wtiArena_t *const pArena, const size_t len)
+{
+	wtiArenaChunk_t *chunk = pArena->chunks;
+	const size_t alignedLen = (len + 7) & ~((size_t) 7);
+	size_t newSize;
+	void *p;
+
+	if(chunk == NULL || chunk->size - chunk->used < alignedLen) {
+		newSize = (alignedLen > WTI_ARENA_CHUNK_SIZE) ? alignedLen : WTI_ARENA_CHUNK_SIZE;
+		if((chunk = malloc(sizeof(wtiArenaChunk_t) + newSize)) == NULL)
+			return NULL;
+		chunk->size = newSize;
+		chunk->used = 0;
+		chunk->next = pArena->chunks;
+		pArena->chunks = chunk;
+	}
+	p = chunk->data + chunk->used;
+	chunk->used += alignedLen;
+	pArena->used += alignedLen;
+	if(pArena->used > pArena->maxUsed)
+		pArena->maxUsed = pArena->used;
+	return p;
+}
+
+
+/* release all memory handed out by the arena. This is called when a batch
+ * has been processed. If the batch needed more than one chunk, we replace
+ * the chunk chain by a single chunk that is large enough for such a batch,
+ * so that in steady state resetting the arena is just a matter of
+ * resetting two counters.
+ */
+void
+wtiArenaReset(wti_t *const pThis)
+{
+	wtiArena_t *const pArena = &pThis->arena;
+	wtiArenaChunk_t *chunk;
+	wtiArenaChunk_t *next;
+	size_t newSize = 0;
+
+	pArena->used = 0;
+	if(pArena->chunks == NULL)
+		return;
+	if(pArena->chunks->next == NULL) {
+		pArena->chunks->used = 0;
+		return;
+	}
+
+	for(chunk = pArena->chunks ; chunk != NULL ; chunk = next) {
+		next = chunk->next;
+		newSize += chunk->size;
+		free(chunk);
+	}
+	pArena->chunks = NULL;
+	if(newSize > WTI_ARENA_MAX_SIZE)
+		newSize = WTI_ARENA_MAX_SIZE;
+	if((chunk = malloc(sizeof(wtiArenaChunk_t) + newSize)) != NULL) {
+		chunk->next = NULL;
+		chunk->size = newSize;
+		chunk->used = 0;
+		pArena->chunks = chunk;
+	}
+}
+
+
+/* return the arena of the worker instance that is active on the calling
+ * thread or NULL if there is none (e.g. during config processing). In the
+ * later case, callers must fall back to regular malloc().
+ */
+wtiArena_t *
+wtiGetArena(void)
+{
+	return (wtiArena_t*) pthread_getspecific(thrd_arena_key);
+}
+
+
 /* Destructor */
 BEGINobjDestruct(wti) /* be sure to specify the object type also in END and CODESTART macros! */
+	wtiArenaChunk_t *chunk;
+	wtiArenaChunk_t *nextChunk;
 CODESTARTobjDestruct(wti)
 	/* actual destruction */
 	batchFree(&pThis->batch);
+	for(chunk = pThis->arena.chunks ; chunk != NULL ; chunk = nextChunk) {
+		nextChunk = chunk->next;
+		free(chunk);
+	}
 	free(pThis->actWrkrInfo);
 	pthread_cond_destroy(&pThis->pcondBusy);
 	DESTROY_ATOMIC_HELPER_MUT(pThis->mutIsRunning);
@@ -331,6 +424,7 @@ wtiWorker(wti_t *__restrict__ const pThis)
 	pthread_cleanup_push(wtiWorkerCancelCleanup, pThis);
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &iCancelStateSave);
 	DBGPRINTF("wti %p: worker starting\n", pThis);
+	pthread_setspecific(thrd_arena_key, &pThis->arena);
 	/* now we have our identity, on to real processing */
 
 	/* note: in this loop, the mutex is "never" unlocked. Of course,
@@ -390,6 +484,7 @@ wtiWorker(wti_t *__restrict__ const pThis)
 			actionRemoveWorker(pAction, wrkrInfo->actWrkrData);
 			pAction->pMod->mod.om.freeWrkrInstance(wrkrInfo->actWrkrData);
 			if(pAction->isTransactional) {
+				actionReleaseTxParams(pAction, pThis);
 				/* free iparam "cache" - we need to go through to max! */
 				for(j = 0 ; j < wrkrInfo->p.tx.maxIParams ; ++j) {
 					for(k = 0 ; k < pAction->iNumTpls ; ++k) {
@@ -399,6 +494,8 @@ wtiWorker(wti_t *__restrict__ const pThis)
 				}
 				free(wrkrInfo->p.tx.iparams);
 				wrkrInfo->p.tx.iparams = NULL;
+				free(wrkrInfo->p.tx.ingressNs);
+				wrkrInfo->p.tx.ingressNs = NULL;
 				wrkrInfo->p.tx.currIParam = 0;
 				wrkrInfo->p.tx.maxIParams = 0;
 			} else {
@@ -408,6 +505,8 @@ wtiWorker(wti_t *__restrict__ const pThis)
 		}
 	}
 
+	pthread_setspecific(thrd_arena_key, NULL);
+
 	/* indicate termination */
 	pthread_cleanup_pop(0); /* remove cleanup handler */
 	pthread_setcancelstate(iCancelStateSave, NULL);
@@ -477,6 +576,8 @@ wtiGetDummy(void)
 		if(pthread_setspecific(thrd_wti_key, pWti) != 0) {
 			DBGPRINTF("wtiGetDummy: error setspecific thrd_wti_key\n");
 		}
+		if(pWti != NULL && pthread_getspecific(thrd_arena_key) == NULL)
+			pthread_setspecific(thrd_arena_key, &pWti->arena);
 	}
 	return pWti;
 }
@@ -491,6 +592,7 @@ CODESTARTObjClassExit(nsdsel_gtls)
 	/* release objects we no longer need */
 	objRelease(glbl, CORE_COMPONENT);
 	pthread_key_delete(thrd_wti_key);
+	pthread_key_delete(thrd_arena_key);
 ENDObjClassExit(wti)
 
 
@@ -507,6 +609,11 @@ BEGINObjClassInit(wti, 1, OBJ_IS_CORE_MODULE) /* one is the object version (most
 		dbgprintf("wti.c: pthread_key_create failed\n");
 		ABORT_FINALIZE(RS_RET_ERR);
 	}
+	r = pthread_key_create(&thrd_arena_key, NULL);
+	if(r != 0) {
+		dbgprintf("wti.c: pthread_key_create for arena failed\n");
+		ABORT_FINALIZE(RS_RET_ERR);
+	}
 ENDObjClassInit(wti)
 
 /* vi:set ai:
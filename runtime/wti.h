@@ -52,6 +52,7 @@ typedef struct actWrkrInfo {
 			actWrkrIParams_t *iparams;/* dynamically sized array for transactional outputs */
 			int currIParam;
 			int maxIParams;	/* current max */
+			uint64_t *ingressNs;	/* msg ingress times for iparams (latency stats only) */
 		} tx;
 		struct {
 			actWrkrIParams_t actParams[CONF_OMOD_NUMSTRINGS_MAXSIZE];
@@ -59,6 +60,29 @@ typedef struct actWrkrInfo {
 	} p; /* short name for "parameters" */
 } actWrkrInfo_t;
 
+/* Bump arena for transient allocations done while processing a batch,
+ * most importantly RainerScript function call temporaries. Memory handed
+ * out by the arena must not be free()ed; it is reclaimed as a whole when
+ * the batch has been processed (wtiArenaReset()). The arena is strictly
+ * per worker thread, so no locking is needed.
+ */
+typedef struct wtiArenaChunk_s wtiArenaChunk_t;
+struct wtiArenaChunk_s {
+	wtiArenaChunk_t *next;	/* older chunks (only present after an overflow) */
+	size_t size;		/* usable size of data[] */
+	size_t used;		/* bytes handed out from this chunk */
+	uchar data[];
+};
+
+typedef struct wtiArena_s {
+	wtiArenaChunk_t *chunks;/* current chunk is always the first one */
+	size_t used;		/* bytes in use since last reset */
+	size_t maxUsed;		/* peak usage over lifetime (for stats) */
+} wtiArena_t;
+
+#define WTI_ARENA_CHUNK_SIZE (16 * 1024) /* default size of a new arena chunk */
+#define WTI_ARENA_MAX_SIZE (1024 * 1024) /* upper bound we keep across resets */
+
 /* the worker thread instance class */
 struct wti_s {
 	BEGINobjInstance;
@@ -73,6 +97,7 @@ struct wti_s {
 	actWrkrInfo_t *actWrkrInfo; /* *array* of action wrkr infos for all actions
 				      (sized for max nbr of actions in config!) */
 	pthread_cond_t pcondBusy; /* condition to wake up the worker, protected by pmutUsr in wtp */
+	wtiArena_t arena;	/* transient per-batch memory, see wtiArenaAlloc() */
 	DEF_ATOMIC_HELPER_MUT(mutIsRunning)
 	struct {
 		uint8_t bPrevWasSuspended;
@@ -96,6 +121,9 @@ rsRetVal wtiSetState(wti_t * const pThis, sbool bNew);
 rsRetVal wtiWakeupThrd(wti_t * const pThis);
 sbool wtiGetState(wti_t * const pThis);
 wti_t *wtiGetDummy(void);
+void *wtiArenaAlloc(wtiArena_t *const pArena, const size_t len);
+void wtiArenaReset(wti_t *const pThis);
+wtiArena_t *wtiGetArena(void);
 PROTOTYPEObjClassInit(wti);
 PROTOTYPEObjClassExit(wti);
 PROTOTYPEpropSetMeth(wti, pszDbgHdr, uchar*);
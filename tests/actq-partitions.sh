@@ -0,0 +1,22 @@
+#!/bin/bash
+# check that a key-partitioned action queue delivers all messages and
+# keeps the order of messages with the same key
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[actq-partitions.sh\]: test action queue with key partitions
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup actq-partitions.conf
+. $srcdir/diag.sh injectmsg  0 20000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+# seq-check sorts, so check the per key order on the unsorted output first
+awk -F, '{ n = $1 + 0; if(($2 in last) && n <= last[$2]) { print "key " $2 ": " n " after " last[$2]; bad = 1 } last[$2] = n }
+	END { exit bad }' rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "FAIL: messages with the same key are out of order"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh seq-check  0 19999
+. $srcdir/diag.sh exit
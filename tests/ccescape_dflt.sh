@@ -0,0 +1,18 @@
+#!/bin/bash
+echo ===============================================================================
+echo \[ccescape_dflt.sh\]: control character escaping at different offsets
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-HOSTNAME
+
+./nettester -tccescape_dflt -iudp
+if [ "$?" -ne "0" ]; then
+  echo erorr in udp run
+  exit 1
+fi
+
+echo test via tcp
+./nettester -tccescape_dflt -itcp
+if [ "$?" -ne "0" ]; then
+  echo erorr in tcp run
+  exit 1
+fi
@@ -0,0 +1,12 @@
+#!/bin/bash
+# Test for disk-only queue mode with fsync for queue files done
+# via group commit (shared syncs, preallocated queue files).
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[diskqueue-groupcommit.sh\]: testing queue disk-only mode, group commit case
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup diskqueue-groupcommit.conf
+. $srcdir/diag.sh injectmsg 0 10000
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 9999
+. $srcdir/diag.sh exit
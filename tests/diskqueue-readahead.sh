@@ -0,0 +1,12 @@
+#!/bin/bash
+# Test for disk-only queue mode with read-ahead: messages are staged by
+# the read-ahead thread and processed by multiple workers.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[diskqueue-readahead.sh\]: testing queue disk-only mode, read-ahead case
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup diskqueue-readahead.conf
+. $srcdir/diag.sh injectmsg 0 20000
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 19999
+. $srcdir/diag.sh exit
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Test for the asynchronous dnscache mode: messages must not be held up
+# by name resolution; until the resolver thread is done, the IP address
+# is used as hostname. A preload library (liboverride_getnameinfo.so)
+# simulates a DNS server that takes several seconds per reverse lookup,
+# so the test does not need network access. All messages of the first
+# batch must be processed long before that lookup completes; the second
+# batch, sent after it completed, must carry the resolved name. The
+# default dnscache settings (no expiry) are used.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[dnscache-async.sh\]: testing asynchronous dnscache
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+global(net.enableDNS="on" dnscache.async="on" dnscache.resolvers="1")
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+template(name="hostfmt" type="string" string="%fromhost%\n")
+:msg, contains, "msgnum:" {
+	action(type="omfile" template="outfmt" file="rsyslog.out.log")
+	action(type="omfile" template="hostfmt" file="rsyslog2.out.log")
+}
+'
+export RSYSLOG_PRELOAD=.libs/liboverride_getnameinfo.so
+export RS_SLOW_RESOLVER_DELAY=8
+. $srcdir/diag.sh startup
+start=$(date +%s)
+. $srcdir/diag.sh tcpflood -p13514 -m5000 -c4
+. $srcdir/diag.sh wait-queueempty
+end=$(date +%s)
+if [ $(( end - start )) -ge $RS_SLOW_RESOLVER_DELAY ]; then
+	echo "error: processing took $(( end - start ))s, input was stalled by the resolver"
+	. $srcdir/diag.sh error-exit 1
+fi
+if grep -qv '^127\.0\.0\.1$' rsyslog2.out.log; then
+	echo "error: fromhost was not the IP address while the lookup was pending:"
+	sort rsyslog2.out.log | uniq -c
+	. $srcdir/diag.sh error-exit 1
+fi
+./msleep $(( (RS_SLOW_RESOLVER_DELAY + 2) * 1000 )) # let the lookup complete
+. $srcdir/diag.sh tcpflood -p13514 -m5000 -c4 -i5000
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+unset RSYSLOG_PRELOAD RS_SLOW_RESOLVER_DELAY
+. $srcdir/diag.sh seq-check 0 9999
+if [ "$(tail -n 5000 rsyslog2.out.log | sort -u)" != "slow-resolver.example" ]; then
+	echo "error: resolved name not used after the lookup completed:"
+	tail -n 5000 rsyslog2.out.log | sort | uniq -c
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Functional check of the hashmap against the old hashtable, using the
+# microbenchmark with a small workload. Run ./hashmap_bench without
+# arguments for meaningful timings.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[hashmap.sh\]: testing hashmap
+./hashmap_bench -n 20000 -r 2
+if [ $? -ne 0 ]; then
+	echo "FAIL: hashmap results differ from hashtable"
+	exit 1
+fi
@@ -0,0 +1,189 @@
+/* microbenchmark for the hashmap (runtime/hashmap.c) against the chained
+ * hashtable (runtime/hashtable.c) it replaces on hot paths. Both are fed
+ * the same workloads; results are cross-checked, so this also serves as
+ * a functional test.
+ * usage: ./hashmap_bench [-n keys] [-r lookup-rounds]
+ * Part of rsyslog, licensed under ASL 2.0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include "hashtable.h"
+#include "hashmap.h"
+
+static int nKeys = 100000;
+static int nRounds = 10;
+static int errs = 0;
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned
+hash_from_pid(void *k)
+{
+	return (unsigned) *((pid_t*) k);
+}
+
+static int
+pid_equals(void *k1, void *k2)
+{
+	return *((pid_t*) k1) == *((pid_t*) k2);
+}
+
+static void
+report(const char *what, const char *impl, double t, long ops)
+{
+	printf("%-22s %-9s %8.3f s %10.1f ns/op\n", what, impl, t, t * 1e9 / ops);
+}
+
+static void
+check(const char *what, long got, long expected)
+{
+	if(got != expected) {
+		fprintf(stderr, "hashmap_bench: %s: got %ld, expected %ld\n", what, got, expected);
+		++errs;
+	}
+}
+
+/* the workload: insert all keys, look up each key nRounds times plus the
+ * same number of misses, then remove every second key and verify.
+ */
+#define WORKLOAD(IMPL, CREATE, INSERT, SEARCH, REMOVE, COUNT, DESTROY, MKKEY, PROBE, MISS) { \
+	double t; \
+	long found; \
+	int i, r; \
+	void *ht = CREATE; \
+	t = now(); \
+	for(i = 0 ; i < nKeys ; ++i) \
+		INSERT(ht, MKKEY(i), vals + i); \
+	report(what, IMPL " ins", now() - t, nKeys); \
+	t = now(); \
+	found = 0; \
+	for(r = 0 ; r < nRounds ; ++r) \
+		for(i = 0 ; i < nKeys ; ++i) \
+			found += (SEARCH(ht, PROBE(i)) == vals + i); \
+	report(what, IMPL " hit", now() - t, (long) nKeys * nRounds); \
+	check(IMPL " hits", found, (long) nKeys * nRounds); \
+	t = now(); \
+	found = 0; \
+	for(r = 0 ; r < nRounds ; ++r) \
+		for(i = 0 ; i < nKeys ; ++i) \
+			found += (SEARCH(ht, MISS(i)) != NULL); \
+	report(what, IMPL " miss", now() - t, (long) nKeys * nRounds); \
+	check(IMPL " misses", found, 0); \
+	for(i = 0 ; i < nKeys ; i += 2) \
+		REMOVE(ht, PROBE(i)); \
+	check(IMPL " count", COUNT(ht), nKeys / 2); \
+	found = 0; \
+	for(i = 0 ; i < nKeys ; ++i) \
+		found += (SEARCH(ht, PROBE(i)) != NULL); \
+	check(IMPL " after remove", found, nKeys / 2); \
+	DESTROY(ht, 0); \
+	}
+
+static char **strKeys;
+static char **strMiss;
+static pid_t *pidKeys;
+static pid_t *pidMiss;
+
+static char *
+mkStrKey(int i)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "host-%d.example.net|app%d", i, i % 97);
+	return strdup(buf);
+}
+#define STRKEY(i) mkStrKey(i)
+#define STRPROBE(i) strKeys[i]
+#define STRMISS(i) strMiss[i]
+
+static pid_t *
+mkPidKey(int i)
+{
+	pid_t *k = malloc(sizeof(pid_t));
+	*k = pidKeys[i];
+	return k;
+}
+#define PIDKEY(i) mkPidKey(i)
+#define PIDPROBE(i) (pidKeys + i)
+#define PIDMISS(i) (pidMiss + i)
+
+int main(int argc, char *argv[])
+{
+	int c, i;
+	int *vals;
+	const char *what;
+	char buf[64];
+
+	while((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch(c) {
+		case 'n':
+			nKeys = atoi(optarg);
+			break;
+		case 'r':
+			nRounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: hashmap_bench [-n keys] [-r lookup-rounds]\n");
+			exit(1);
+		}
+	}
+	if(nKeys < 2 || nRounds < 1) {
+		fprintf(stderr, "hashmap_bench: invalid parameters\n");
+		exit(1);
+	}
+
+	vals = calloc(nKeys, sizeof(int));
+	strKeys = malloc(nKeys * sizeof(char*));
+	strMiss = malloc(nKeys * sizeof(char*));
+	pidKeys = malloc(nKeys * sizeof(pid_t));
+	pidMiss = malloc(nKeys * sizeof(pid_t));
+	if(vals == NULL || strKeys == NULL || strMiss == NULL || pidKeys == NULL || pidMiss == NULL) {
+		fprintf(stderr, "hashmap_bench: out of memory\n");
+		exit(1);
+	}
+	for(i = 0 ; i < nKeys ; ++i) {
+		strKeys[i] = mkStrKey(i);
+		snprintf(buf, sizeof(buf), "host-%d.example.org|app%d", i, i % 97);
+		strMiss[i] = strdup(buf);
+		pidKeys[i] = (pid_t) (i * 3 + 1);  /* pids are dense-ish, like real ones */
+		pidMiss[i] = (pid_t) (i * 3 + 2);
+	}
+
+	what = "string keys";
+	WORKLOAD("hashtable", create_hashtable(nKeys, hash_from_string, key_equals_string, NULL),
+		hashtable_insert, hashtable_search, hashtable_remove, hashtable_count, hashtable_destroy,
+		STRKEY, STRPROBE, STRMISS);
+	WORKLOAD("hashmap", hashmapNewStr(nKeys, NULL),
+		hashmapInsert, hashmapSearch, hashmapRemove, hashmapCount, hashmapDestroy,
+		STRKEY, STRPROBE, STRMISS);
+
+	/* start small, so that growing is part of the measurement */
+	what = "pid keys";
+	WORKLOAD("hashtable", create_hashtable(100, hash_from_pid, pid_equals, NULL),
+		hashtable_insert, hashtable_search, hashtable_remove, hashtable_count, hashtable_destroy,
+		PIDKEY, PIDPROBE, PIDMISS);
+	WORKLOAD("hashmap", hashmapNew(100, hash_from_pid, pid_equals, NULL),
+		hashmapInsert, hashmapSearch, hashmapRemove, hashmapCount, hashmapDestroy,
+		PIDKEY, PIDPROBE, PIDMISS);
+
+	for(i = 0 ; i < nKeys ; ++i) {
+		free(strKeys[i]);
+		free(strMiss[i]);
+	}
+	free(strKeys);
+	free(strMiss);
+	free(pidKeys);
+	free(pidMiss);
+	free(vals);
+	return errs ? 1 : 0;
+}
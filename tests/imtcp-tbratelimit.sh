@@ -0,0 +1,26 @@
+#!/bin/bash
+# Test for the token-bucket ratelimiter: a single sender with a bucket of
+# 1000 tokens and a refill rate of 1 message per second must see roughly
+# the first 1000 of its messages pass, the rest is dropped.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[imtcp-tbratelimit.sh\]: testing per-source token-bucket ratelimiting
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514" ratelimit.tokenrate="1" ratelimit.tokenburst="1000")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -p13514 -m10000
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+NUMLINES=$(wc -l < rsyslog.out.log)
+if [ "$NUMLINES" -lt 1000 ] || [ "$NUMLINES" -gt 1100 ]; then
+	echo "FAIL: expected about 1000 messages to pass the ratelimiter, got $NUMLINES"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,28 @@
+#!/bin/bash
+# Test for batched (recvmmsg) reception in imuxsock: a burst of datagrams
+# must be received completely and in full, even when it spans many batches.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[imuxsock_batch.sh\]: test imuxsock batched reception
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imuxsock/.libs/imuxsock" sysSock.use="off" batchSize="4")
+input(type="imuxsock" Socket="testbench_socket")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:msg, contains, "msgnum:" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+# send in parallel, so that datagrams queue up on the socket
+for j in 0 1 2 3; do
+	for i in $(seq $((j * 250)) $((j * 250 + 249))); do
+		logger -d -u testbench_socket $(printf "msgnum:%8.8d:" $i)
+	done &
+done
+wait
+./msleep 500 # give rsyslogd time to pull the last datagrams
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 999
+. $srcdir/diag.sh exit
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Test that a statement which fails (here: insert into a non-existing table)
+# does not make ommysql retry its batch forever. The batch must be written
+# one by one, so that only the bad statements are discarded.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[mysql-batch-baddata.sh\]: test for mysql batch with bad statements
+. $srcdir/diag.sh init
+mysql --user=rsyslog --password=testbench < testsuites/mysql-truncate.sql
+. $srcdir/diag.sh startup mysql-batch-baddata.conf
+. $srcdir/diag.sh injectmsg  0 5000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown 
+# note "-s" is requried to suppress the select "field header"
+mysql -s --user=rsyslog --password=testbench < testsuites/mysql-select-msg.sql > rsyslog.out.log
+if [ "$(sort -u rsyslog.out.log | wc -l)" -ne 4950 ]; then
+	echo "error: expected 4950 distinct messages in the database, got $(sort -u rsyslog.out.log | wc -l)"
+	. $srcdir/diag.sh error-exit 1
+fi
+if grep -q '00$' rsyslog.out.log; then
+	echo "error: bad statements were written to the database"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
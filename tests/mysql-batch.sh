@@ -0,0 +1,14 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[mysql-batch.sh\]: test for mysql multi-row INSERT batching
+. $srcdir/diag.sh init
+mysql --user=rsyslog --password=testbench < testsuites/mysql-truncate.sql
+. $srcdir/diag.sh startup mysql-batch.conf
+. $srcdir/diag.sh injectmsg  0 50000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown 
+# note "-s" is requried to suppress the select "field header"
+mysql -s --user=rsyslog --password=testbench < testsuites/mysql-select-msg.sql > rsyslog.out.log
+. $srcdir/diag.sh seq-check  0 49999
+. $srcdir/diag.sh exit
@@ -0,0 +1,32 @@
+#!/bin/bash
+# test for omhiredis queue mode with multi-value pushes; needs
+# redis-server and redis-cli, a private server instance is started.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[omhiredis-queue.sh\]: test for omhiredis pipelined queue mode
+. $srcdir/diag.sh init
+rm -f rsyslog.redis.pid
+redis-server --port 13379 --save "" --daemonize yes --pidfile $(pwd)/rsyslog.redis.pid
+if [ $? -ne 0 ]; then
+	echo "could not start redis-server"
+	exit 1
+fi
+sleep 1
+. $srcdir/diag.sh startup omhiredis-queue.conf
+. $srcdir/diag.sh injectmsg  0 10000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+redis-cli -p 13379 LRANGE rsyslog-test 0 -1 > rsyslog.out.log
+redis-cli -p 13379 SHUTDOWN NOSAVE
+rm -f rsyslog.redis.pid
+# the list must hold the messages in exactly the order they were sent,
+# so compare unsorted
+printf '%08d\n' $(seq 0 9999) > rsyslog.expected.log
+cmp rsyslog.expected.log rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "error: redis list does not contain the messages in order"
+	diff rsyslog.expected.log rsyslog.out.log | head -20
+	. $srcdir/diag.sh error-exit 1
+fi
+rm -f rsyslog.expected.log
+. $srcdir/diag.sh exit
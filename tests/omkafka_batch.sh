@@ -0,0 +1,33 @@
+#!/bin/bash
+# Test for omkafka handing batches of messages to librdkafka, with the
+# partition being selected by a per-message key.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[omkafka_batch.sh\]: test for omkafka batched produce with key-based partitioning
+. $srcdir/diag.sh init
+. $srcdir/diag.sh download-kafka
+. $srcdir/diag.sh start-kafka
+. $srcdir/diag.sh create-kafka-topic 'batch'
+. $srcdir/diag.sh startup omkafka_batch.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh injectmsg  0 1000
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh dump-kafka-topic 'batch'
+. $srcdir/diag.sh stop-kafka
+. $srcdir/diag.sh custom-content-check 'msgnum:00000000' 'rsyslog.out.kafka.log'
+. $srcdir/diag.sh custom-content-check 'msgnum:00000500' 'rsyslog.out.kafka.log'
+. $srcdir/diag.sh custom-content-check 'msgnum:00000999' 'rsyslog.out.kafka.log'
+. $srcdir/diag.sh first-column-sum-check 's/.*submitted=\([0-9]\+\)/\1/g' 'omkafka' 'rsyslog.out.stats.log' 1000
+# the keys differ, so librdkafka's key partitioner must have used both
+# partitions; with partitions.bykey, the per-partition counters are taken
+# from the delivery reports
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/.*partition.0.produced=\([0-9]\+\).*/\1/g' 'omkafka(batch)' 'rsyslog.out.stats.log' 0
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/.*partition.1.produced=\([0-9]\+\).*/\1/g' 'omkafka(batch)' 'rsyslog.out.stats.log' 0
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/.*partition.0.acked=\([0-9]\+\).*/\1/g' 'omkafka(batch)' 'rsyslog.out.stats.log' 0
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/.*partition.1.acked=\([0-9]\+\).*/\1/g' 'omkafka(batch)' 'rsyslog.out.stats.log' 0
+. $srcdir/diag.sh exit
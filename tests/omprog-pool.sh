@@ -0,0 +1,11 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[omprog-pool.sh\]: test for omprog with a pool of processes and confirmed batches
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup omprog-pool.conf
+. $srcdir/diag.sh injectmsg  0 10000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check  0 9999
+. $srcdir/diag.sh exit
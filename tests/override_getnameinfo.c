@@ -0,0 +1,40 @@
+/* preload library that simulates a slow DNS server: reverse lookups
+ * (everything but NI_NUMERICHOST requests) take RS_SLOW_RESOLVER_DELAY
+ * seconds (default 5) and then return "slow-resolver.example". This lets
+ * the testbench check that name resolution does not hold up inputs,
+ * without needing network access.
+ * This is part of the rsyslog testbench, licensed under ASL 2.0
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+static int (*orig_getnameinfo)(const struct sockaddr *, socklen_t, char *, socklen_t,
+	char *, socklen_t, int);
+
+int getnameinfo(const struct sockaddr *sa, socklen_t salen, char *host, socklen_t hostlen,
+	char *serv, socklen_t servlen, int flags)
+{
+	const char *delay;
+
+	if(flags & NI_NUMERICHOST)
+		return orig_getnameinfo(sa, salen, host, hostlen, serv, servlen, flags);
+	delay = getenv("RS_SLOW_RESOLVER_DELAY");
+	sleep((delay == NULL) ? 5 : atoi(delay));
+	if(host != NULL)
+		snprintf(host, hostlen, "slow-resolver.example");
+	if(serv != NULL && servlen > 0)
+		*serv = '\0';
+	return 0;
+}
+
+static void __attribute__((constructor))
+my_init(void)
+{
+	orig_getnameinfo = dlsym(RTLD_NEXT, "getnameinfo");
+}
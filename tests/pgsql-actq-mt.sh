@@ -0,0 +1,16 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under GPLv3
+echo ===============================================================================
+echo \[pgsql-actq-mt.sh\]: test for postgres with multithread actionq
+. $srcdir/diag.sh init
+psql -h db -U postgres -d Syslog -f testsuites/pgsql-truncate.sql
+
+. $srcdir/diag.sh startup pgsql-actq-mt.conf
+. $srcdir/diag.sh injectmsg  0 50000
+. $srcdir/diag.sh shutdown-when-empty
+. $srcdir/diag.sh wait-shutdown 
+
+psql -h db -U postgres -d Syslog -f testsuites/pgsql-select-msg.sql -t -A > rsyslog.out.log 
+
+. $srcdir/diag.sh seq-check  0 49999
+. $srcdir/diag.sh exit
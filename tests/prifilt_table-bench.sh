@@ -0,0 +1,60 @@
+#!/bin/bash
+# Compare the PRI filter dispatch table against checking PRI filters one
+# by one. Both runs use the same 40 selector lines and 13 non-matching
+# property filters. In the first run, the selector lines are consecutive
+# and merged into a single table by the optimizer. In the second run,
+# every third selector line is followed by a property filter, so no run
+# is long enough to be merged. Both runs must write the same output, so
+# this also serves as a functional test. Elapsed times are printed; set
+# RS_BENCH_MSGS (e.g. to 1000000) for meaningful numbers.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[prifilt_table-bench.sh\]: PRI table vs. sequential PRI filters
+NUMMESSAGES=${RS_BENCH_MSGS:-20000}
+FACILITIES="kern user mail daemon auth syslog lpr news uucp cron authpriv ftp
+	local0 local1 local2 local3 local5 local6 local7"
+
+bench_run() {
+	. $srcdir/diag.sh generate-conf
+	. $srcdir/diag.sh add-conf 'main_queue(queue.workerthreads="1" queue.dequeuebatchsize="256")'
+	. $srcdir/diag.sh add-conf '$template outfmt,"%msg:F,58:2%\n"'
+	n=0
+	for fac in $FACILITIES; do
+		for sel in "$fac.=err" "$fac.info"; do
+			. $srcdir/diag.sh add-conf "$sel ./rsyslog.out.log;outfmt"
+			n=$((n + 1))
+			if [ "$1" == "sequential" ] && [ $((n % 3)) -eq 0 -o $n -eq 38 ]; then
+				. $srcdir/diag.sh add-conf ":msg, contains, \"xyzzy$n\" ./rsyslog2.out.log;outfmt"
+			fi
+		done
+	done
+	# local4.debug matches the injected messages
+	. $srcdir/diag.sh add-conf "local4.debug ./rsyslog.out.log;outfmt"
+	. $srcdir/diag.sh add-conf "*.=debug ./rsyslog.out.log;outfmt"
+	if [ "$1" == "table" ]; then
+		for n in 3 6 9 12 15 18 21 24 27 30 33 36 38; do
+			. $srcdir/diag.sh add-conf ":msg, contains, \"xyzzy$n\" ./rsyslog2.out.log;outfmt"
+		done
+	fi
+	. $srcdir/diag.sh startup
+	start=$(date +%s%N)
+	. $srcdir/diag.sh injectmsg 0 $NUMMESSAGES
+	. $srcdir/diag.sh wait-queueempty
+	end=$(date +%s%N)
+	echo "$1: $NUMMESSAGES messages in $(( (end - start) / 1000000 )) ms"
+	. $srcdir/diag.sh shutdown-when-empty
+	. $srcdir/diag.sh wait-shutdown
+}
+
+. $srcdir/diag.sh init
+bench_run table
+mv rsyslog.out.log rsyslog.out.table.log
+bench_run sequential
+cmp rsyslog.out.table.log rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "FAIL: PRI table and sequential filters differ"
+	. $srcdir/diag.sh error-exit 1
+fi
+# every message is written twice (local4.debug and *.=debug)
+. $srcdir/diag.sh seq-check 0 $((NUMMESSAGES - 1)) -d
+. $srcdir/diag.sh exit
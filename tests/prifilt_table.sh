@@ -0,0 +1,19 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[prifilt_table.sh\]: test PRI filter dispatch table
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup prifilt_table.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh injectmsg  0 5000
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh msleep 2100
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 4999
+. $srcdir/diag.sh seq-check2  0 4999
+# every injected message must have been dispatched through the table
+. $srcdir/diag.sh assert-first-column-sum-greater-than 's/.*pritable.lookups=\([0-9]*\).*/\1/g' 'rule-engine:' 'rsyslog.out.stats.log' 4999
+. $srcdir/diag.sh exit
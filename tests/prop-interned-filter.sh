@@ -0,0 +1,24 @@
+#!/bin/bash
+# Test for property filters on interned props: fromhost-ip of received
+# messages and the filter value share the same prop object, which the
+# filter checks by pointer. Non-matching values must still be rejected.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[prop-interned-filter.sh\]: testing isequal filter on interned props
+. $srcdir/diag.sh init
+. $srcdir/diag.sh generate-conf
+. $srcdir/diag.sh add-conf '
+module(load="../plugins/imtcp/.libs/imtcp")
+input(type="imtcp" port="13514")
+
+template(name="outfmt" type="string" string="%msg:F,58:2%\n")
+:fromhost-ip, isequal, "127.0.0.2" stop
+:fromhost-ip, !isequal, "127.0.0.1" stop
+:fromhost-ip, isequal, "127.0.0.1" action(type="omfile" template="outfmt"
+			         file="rsyslog.out.log")
+'
+. $srcdir/diag.sh startup
+. $srcdir/diag.sh tcpflood -p13514 -m10000 -c4
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check 0 9999
+. $srcdir/diag.sh exit
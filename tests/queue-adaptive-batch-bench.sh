@@ -0,0 +1,34 @@
+#!/bin/bash
+# Compare adaptive dequeue batch sizing against static small and large
+# batches under a burst load. Every run must deliver all messages, so this
+# also serves as a functional test. Elapsed times are printed; set
+# RS_BENCH_MSGS (e.g. to 1000000) for meaningful numbers. Latency under
+# light load is best compared through the latency.enqdeq.us and
+# batchsize.effective counters of impstats.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue-adaptive-batch-bench.sh\]: adaptive vs. static dequeue batch size
+NUMMESSAGES=${RS_BENCH_MSGS:-40000}
+
+bench_run() {
+	. $srcdir/diag.sh generate-conf
+	. $srcdir/diag.sh add-conf "main_queue(queue.type=\"linkedList\" queue.workerthreads=\"1\" $2)"
+	. $srcdir/diag.sh add-conf 'template(name="outfmt" type="string" string="%msg:F,58:2%\n")'
+	. $srcdir/diag.sh add-conf ':msg, contains, "msgnum:" action(type="omfile" file="./rsyslog.out.log" template="outfmt")'
+	. $srcdir/diag.sh startup
+	start=$(date +%s%N)
+	. $srcdir/diag.sh injectmsg 0 $NUMMESSAGES
+	. $srcdir/diag.sh wait-queueempty
+	end=$(date +%s%N)
+	echo "$1: $NUMMESSAGES messages in $(( (end - start) / 1000000 )) ms"
+	. $srcdir/diag.sh shutdown-when-empty
+	. $srcdir/diag.sh wait-shutdown
+	. $srcdir/diag.sh seq-check 0 $(( NUMMESSAGES - 1 ))
+	rm -f rsyslog.out.log
+}
+
+. $srcdir/diag.sh init
+bench_run static-16 'queue.dequeuebatchsize="16"'
+bench_run static-1024 'queue.dequeuebatchsize="1024"'
+bench_run adaptive 'queue.batchsizing="adaptive" queue.mindequeuebatchsize="16" queue.dequeuebatchsize="1024" queue.batchmaxlatency="20"'
+. $srcdir/diag.sh exit
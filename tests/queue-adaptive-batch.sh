@@ -0,0 +1,15 @@
+#!/bin/bash
+# check that a main queue using adaptive batch sizing delivers
+# all messages while the batch size grows and shrinks
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue-adaptive-batch.sh\]: test adaptive dequeue batch sizing
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue-adaptive-batch.conf
+. $srcdir/diag.sh injectmsg  0 40000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 39999
+. $srcdir/diag.sh exit
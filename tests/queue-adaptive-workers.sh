@@ -0,0 +1,15 @@
+#!/bin/bash
+# check that an action queue using adaptive worker scaling delivers
+# all messages while the controller starts and retires workers
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue-adaptive-workers.sh\]: test adaptive worker scaling
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue-adaptive-workers.conf
+. $srcdir/diag.sh injectmsg  0 40000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 39999
+. $srcdir/diag.sh exit
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Test for journaled in-memory queues: messages still in the queue when
+# rsyslogd is killed must be recovered from the journal on restart.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[queue-journal.sh\]: testing journaled memory queue crash recovery
+. $srcdir/diag.sh init
+
+# slow down processing, so that most messages are still queued
+echo "*.*     :omtesting:sleep 0 1000" > work-delay.conf
+. $srcdir/diag.sh startup queue-journal.conf
+. $srcdir/diag.sh injectmsg 0 5000
+. $srcdir/diag.sh kill-immediate
+. $srcdir/diag.sh wait-shutdown
+if ! ls test-spool/mainjrnl.0* > /dev/null 2>&1; then
+	echo "error: journal files do not exist where expected to do so!"
+	ls -l test-spool
+	. $srcdir/diag.sh error-exit 1
+fi
+
+# restart engine without delay and have the journal replayed
+echo "#" > work-delay.conf
+. $srcdir/diag.sh startup queue-journal.conf
+. $srcdir/diag.sh shutdown-when-empty # shut down rsyslogd when done processing messages
+. $srcdir/diag.sh wait-shutdown
+# messages processed after the last checkpoint are replayed once more
+. $srcdir/diag.sh seq-check 0 4999 -d
+. $srcdir/diag.sh exit
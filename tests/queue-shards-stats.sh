@@ -0,0 +1,25 @@
+#!/bin/bash
+# check that a sharded main queue reports the size of the whole shard
+# set, and that it is back at zero once all shards are drained
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue-shards-stats.sh\]: test size statistics of a sharded main queue
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue-shards-stats.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh injectmsg  0 40000
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh msleep 2100
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 39999
+. $srcdir/diag.sh custom-content-check 'size.shards=' 'rsyslog.out.stats.log'
+# the counter is updated by all shards, including dequeues of stolen batches
+last=$(grep 'size.shards=' rsyslog.out.stats.log | tail -1 | sed -e 's/.*size.shards=\([0-9-]*\).*/\1/')
+if [ "x$last" != "x0" ]; then
+	echo "FAIL: shard set size is $last after all messages were processed"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
@@ -0,0 +1,15 @@
+#!/bin/bash
+# check that a sharded main queue delivers all messages, including
+# those processed by workers stealing from the busy input shard
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[queue-shards.sh\]: test sharded main queue
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup queue-shards.conf
+. $srcdir/diag.sh injectmsg  0 40000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 39999
+. $srcdir/diag.sh exit
@@ -0,0 +1,194 @@
+/* microbenchmark for the regex engines behind regex.engine: POSIX regexec()
+ * against PCRE2 (JIT), as used for ereregex property filters and
+ * re_match(). The workload is a set of typical firewall-log filter rules
+ * run over generated iptables/ASA style lines. The match decisions of both
+ * engines are cross-checked, so this also serves as a functional test.
+ * Without PCRE2 support compiled in, only the POSIX numbers are reported.
+ * usage: ./regex_bench [-n lines] [-r rounds]
+ *
+ * Part of rsyslog, licensed under ASL 2.0
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <regex.h>
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+static int nLines = 20000;
+static int nRounds = 5;
+
+/* rules in the style of our firewall ruleset */
+static const char *rules[] = {
+	"SRC=10\\.1\\.[0-9]+\\.[0-9]+ DST=192\\.168\\.[0-9]+\\.[0-9]+",
+	"PROTO=(TCP|UDP) SPT=[0-9]+ DPT=(22|23|3389)\\b",
+	"%ASA-[0-9]-(106023|106100|302013):",
+	"(Deny|Drop|REJECT).*(icmp|ICMP)",
+	"IN=eth[0-9]+ OUT= MAC=([0-9a-f]{2}:){13}[0-9a-f]{2}",
+	"DPT=(1[0-9]{4}|[2-5][0-9]{4}|6[0-4][0-9]{3})",
+	"LEN=[0-9]{4,} TOS=0x[0-9A-F]{2}",
+	"[A-Za-z]+ ([0-9]{1,3}\\.){3}[0-9]{1,3}/[0-9]+ to outside",
+	NULL
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *
+mkLine(int i)
+{
+	char buf[512];
+	static const char *proto[] = { "TCP", "UDP", "ICMP" };
+	static const int dport[] = { 22, 80, 443, 3389, 53, 12345, 65000 };
+
+	if(i % 5 == 4) {
+		snprintf(buf, sizeof(buf), "%%ASA-%d-%s: %s icmp src outside:10.%d.%d.%d "
+			"dst inside:172.16.%d.%d (type 8, code 0) by access-group \"out\"",
+			i % 7, (i % 3) ? "106023" : "710003", (i % 2) ? "Deny" : "Permit",
+			i % 256, (i / 7) % 256, i % 253, (i / 3) % 256, i % 250);
+	} else {
+		snprintf(buf, sizeof(buf), "kernel: [%d.%03d] %s IN=eth%d OUT= "
+			"MAC=00:16:3e:%02x:%02x:%02x:00:16:3e:aa:bb:cc:08:00 SRC=10.%d.%d.%d "
+			"DST=192.168.%d.%d LEN=%d TOS=0x00 PREC=0x00 TTL=%d ID=%d DF "
+			"PROTO=%s SPT=%d DPT=%d WINDOW=29200 RES=0x00 SYN URGP=0",
+			i, i % 1000, (i % 4) ? "DROP" : "ACCEPT", i % 3,
+			i % 256, (i / 5) % 256, (i / 11) % 256,
+			i % 3, i % 256, (i / 13) % 256, i % 256, (i / 17) % 256,
+			40 + (i % 1500) * 3, 64 - i % 10, i % 65536, proto[i % 3],
+			1024 + i % 60000, dport[i % 7]);
+	}
+	return strdup(buf);
+}
+
+static void
+report(const char *impl, double t, long ops, long matches)
+{
+	printf("%-8s %8.3f s %10.1f ns/match-op %9ld matches\n", impl, t, t * 1e9 / ops, matches);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, i, j, r;
+	int nRules;
+	char **lines;
+	regex_t *posix;
+	char *resPosix;
+	long matches;
+	double t;
+#ifdef HAVE_PCRE2
+	pcre2_code **pcre;
+	pcre2_match_data *md;
+	int errcode;
+	PCRE2_SIZE erroffs;
+	long errs = 0;
+#endif
+
+	while((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch(c) {
+		case 'n':
+			nLines = atoi(optarg);
+			break;
+		case 'r':
+			nRounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: regex_bench [-n lines] [-r rounds]\n");
+			exit(1);
+		}
+	}
+	if(nLines < 1 || nRounds < 1) {
+		fprintf(stderr, "regex_bench: invalid parameters\n");
+		exit(1);
+	}
+
+	for(nRules = 0 ; rules[nRules] != NULL ; ++nRules)
+		/* just count */;
+	lines = malloc(nLines * sizeof(char*));
+	posix = malloc(nRules * sizeof(regex_t));
+	resPosix = malloc((size_t) nLines * nRules);
+	if(lines == NULL || posix == NULL || resPosix == NULL) {
+		fprintf(stderr, "regex_bench: out of memory\n");
+		exit(1);
+	}
+	for(i = 0 ; i < nLines ; ++i)
+		lines[i] = mkLine(i);
+
+	/* POSIX, compiled the way property filters do it */
+	for(j = 0 ; j < nRules ; ++j) {
+		if(regcomp(posix + j, rules[j], REG_EXTENDED | REG_NOSUB) != 0) {
+			fprintf(stderr, "regex_bench: POSIX cannot compile '%s'\n", rules[j]);
+			exit(1);
+		}
+	}
+	matches = 0;
+	t = now();
+	for(r = 0 ; r < nRounds ; ++r)
+		for(i = 0 ; i < nLines ; ++i)
+			for(j = 0 ; j < nRules ; ++j)
+				matches += (resPosix[(size_t) i * nRules + j] =
+					regexec(posix + j, lines[i], 0, NULL, 0) == 0);
+	report("posix", now() - t, (long) nRounds * nLines * nRules, matches / nRounds);
+	if(matches == 0) {
+		fprintf(stderr, "regex_bench: workload does not match anything\n");
+		exit(1);
+	}
+
+#ifdef HAVE_PCRE2
+	pcre = malloc(nRules * sizeof(pcre2_code*));
+	md = pcre2_match_data_create(1, NULL);
+	if(pcre == NULL || md == NULL) {
+		fprintf(stderr, "regex_bench: out of memory\n");
+		exit(1);
+	}
+	for(j = 0 ; j < nRules ; ++j) {
+		pcre[j] = pcre2_compile((PCRE2_SPTR) rules[j], PCRE2_ZERO_TERMINATED, 0,
+					&errcode, &erroffs, NULL);
+		if(pcre[j] == NULL) {
+			fprintf(stderr, "regex_bench: PCRE2 cannot compile '%s'\n", rules[j]);
+			exit(1);
+		}
+		pcre2_jit_compile(pcre[j], PCRE2_JIT_COMPLETE);
+	}
+	matches = 0;
+	t = now();
+	for(r = 0 ; r < nRounds ; ++r)
+		for(i = 0 ; i < nLines ; ++i)
+			for(j = 0 ; j < nRules ; ++j) {
+				const int m = pcre2_match(pcre[j], (PCRE2_SPTR) lines[i],
+					PCRE2_ZERO_TERMINATED, 0, 0, md, NULL) >= 0;
+				matches += m;
+				if(m != resPosix[(size_t) i * nRules + j] && r == 0) {
+					fprintf(stderr, "regex_bench: engines differ on rule '%s', "
+						"line '%s'\n", rules[j], lines[i]);
+					++errs;
+				}
+			}
+	report("pcre2", now() - t, (long) nRounds * nLines * nRules, matches / nRounds);
+	for(j = 0 ; j < nRules ; ++j)
+		pcre2_code_free(pcre[j]);
+	pcre2_match_data_free(md);
+	free(pcre);
+	if(errs)
+		return 1;
+#endif
+
+	for(j = 0 ; j < nRules ; ++j)
+		regfree(posix + j);
+	for(i = 0 ; i < nLines ; ++i)
+		free(lines[i]);
+	free(lines);
+	free(posix);
+	free(resPosix);
+	return 0;
+}
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Functional check of the regex engines (POSIX and, if compiled in, PCRE2)
+# on firewall-log rules, using the microbenchmark with a small workload.
+# Run ./regex_bench without arguments for meaningful timings.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[regex_bench.sh\]: testing regex engines
+./regex_bench -n 2000 -r 1
+if [ $? -ne 0 ]; then
+	echo "FAIL: regex engines disagree"
+	exit 1
+fi
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Compare the batch execution engine against the per-message executor on
+# a filter-heavy ruleset. The same ruleset is run twice; for the second
+# run, a global variable is set, which makes it non batch-safe and thus
+# forces per-message execution. Both runs must write the same output, so
+# this also serves as a functional test. Elapsed times are printed; set
+# RS_BENCH_MSGS (e.g. to 1000000) for meaningful numbers.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_batch_exec-bench.sh\]: batch vs. per-message script execution
+NUMMESSAGES=${RS_BENCH_MSGS:-20000}
+
+bench_run() {
+	. $srcdir/diag.sh generate-conf
+	. $srcdir/diag.sh add-conf 'main_queue(queue.workerthreads="1" queue.dequeuebatchsize="256")'
+	. $srcdir/diag.sh add-conf 'template(name="outfmt" type="string" string="%$!usr!msgnum% %$!usr!class%\n")'
+	if [ "$1" == "per-message" ]; then
+		. $srcdir/diag.sh add-conf 'set $/forcePerMessage = "1";'
+	fi
+	. $srcdir/diag.sh add-conf 'if not ($msg contains "msgnum") then stop'
+	. $srcdir/diag.sh add-conf 'set $!usr!msgnum = field($msg, 58, 2);'
+	. $srcdir/diag.sh add-conf 'if cnum($!usr!msgnum) % 7 == 0 then { set $!usr!class = "seven"; }'
+	. $srcdir/diag.sh add-conf 'else if cnum($!usr!msgnum) % 5 == 0 then { set $!usr!class = "five"; }'
+	. $srcdir/diag.sh add-conf 'else if cnum($!usr!msgnum) % 3 == 0 then { set $!usr!class = "three"; }'
+	. $srcdir/diag.sh add-conf 'else { set $!usr!class = "other"; }'
+	. $srcdir/diag.sh add-conf 'mail.* stop'
+	. $srcdir/diag.sh add-conf 'if $!usr!class == "other" and cnum($!usr!msgnum) % 2 == 0 then stop'
+	. $srcdir/diag.sh add-conf ':msg, contains, "msgnum:00" { set $!usr!lead = "1"; }'
+	. $srcdir/diag.sh add-conf 'action(type="omfile" file="./rsyslog.out.log" template="outfmt")'
+	. $srcdir/diag.sh startup
+	start=$(date +%s%N)
+	. $srcdir/diag.sh injectmsg 0 $NUMMESSAGES
+	. $srcdir/diag.sh wait-queueempty
+	end=$(date +%s%N)
+	echo "$1: $NUMMESSAGES messages in $(( (end - start) / 1000000 )) ms"
+	. $srcdir/diag.sh shutdown-when-empty
+	. $srcdir/diag.sh wait-shutdown
+}
+
+. $srcdir/diag.sh init
+bench_run batch
+mv rsyslog.out.log rsyslog.out.batch.log
+bench_run per-message
+cmp rsyslog.out.batch.log rsyslog.out.log
+if [ $? -ne 0 ]; then
+	echo "FAIL: batch and per-message execution differ"
+	. $srcdir/diag.sh error-exit 1
+fi
+. $srcdir/diag.sh exit
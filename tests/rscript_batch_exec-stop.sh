@@ -0,0 +1,19 @@
+#!/bin/bash
+# Batch execution: messages that leave an if/else branch early (nested
+# stop) must not be run again by the statements following the branch, and
+# a suspended action inside a branch must keep the per message
+# execOnlyWhenPreviousIsSuspended state.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_batch_exec-stop.sh\]: testing batch execution with nested stop
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup rscript_batch_exec-stop.conf
+. $srcdir/diag.sh injectmsg  0 10000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+# seq-check fails on duplicates, so this also catches messages run twice
+. $srcdir/diag.sh seq-check  2500 7499
+. $srcdir/diag.sh seq-check2  5001 7499
+. $srcdir/diag.sh exit
@@ -0,0 +1,14 @@
+#!/bin/bash
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[rscript_batch_exec.sh\]: testing batch execution of if/else, call and stop
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup rscript_batch_exec.conf
+. $srcdir/diag.sh injectmsg  0 10000
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown 
+. $srcdir/diag.sh seq-check  0 4999
+. $srcdir/diag.sh seq-check2  2500 9999
+. $srcdir/diag.sh exit
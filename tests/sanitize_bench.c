@@ -0,0 +1,257 @@
+/* microbenchmark for the received-message sanitizer (runtime/sanitize.c)
+ * against a byte-at-a-time check and escape loop, as SanitizeMsg() did
+ * before. Clean and dirty corpora are run with the default escaping
+ * settings and with 8-bit escaping turned on. The output of both
+ * implementations is compared, so this also serves as a functional test.
+ * usage: ./sanitize_bench [-n messages] [-r rounds]
+ *
+ * Part of rsyslog, licensed under ASL 2.0
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include "rsyslog.h"
+#include "sanitize.h"
+
+#define MAXDEST (8*1024)
+static int nMsgs = 20000;
+static int nRounds = 20;
+static int errs = 0;
+
+static const char hexdigit[16] =
+	{'0', '1', '2', '3', '4', '5', '6', '7', '8',
+	 '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the old byte-at-a-time check loop */
+static size_t
+baseCheck(uchar *pszMsg, size_t lenMsg, const sanitizeOpts_t *opts)
+{
+	size_t iSrc;
+	size_t iFirstDirty = lenMsg;
+
+	for(iSrc = 0 ; iSrc < lenMsg ; iSrc++) {
+		if(pszMsg[iSrc] < 32) {
+			if(opts->bSpaceLF && pszMsg[iSrc] == '\n') {
+				pszMsg[iSrc] = ' ';
+			} else if(pszMsg[iSrc] == '\0' || opts->bEscapeCC) {
+				if(iFirstDirty == lenMsg)
+					iFirstDirty = iSrc;
+				if(!opts->bSpaceLF)
+					break;
+			}
+		} else if(pszMsg[iSrc] > 127 && opts->bEscape8Bit) {
+			if(iFirstDirty == lenMsg)
+				iFirstDirty = iSrc;
+			break;
+		}
+	}
+	return iFirstDirty;
+}
+
+static size_t
+baseEscapeOctal(uchar *pDst, size_t iDst, uchar c, const sanitizeOpts_t *opts)
+{
+	pDst[iDst++] = opts->cEscapePrefix;
+	pDst[iDst++] = '0' + ((c & 0300) >> 6);
+	pDst[iDst++] = '0' + ((c & 0070) >> 3);
+	pDst[iDst++] = '0' + ((c & 0007));
+	return iDst;
+}
+
+/* the old byte-at-a-time escape loop */
+static size_t
+baseEscape(const uchar *pszMsg, size_t lenMsg, size_t iFirstDirty,
+	uchar *pDst, size_t maxDest, const sanitizeOpts_t *opts)
+{
+	static const char cstyle[32] = { '0', 0, 0, 0, 0, 0, 0, 'a', 'b', 't', 'n', 'v', 'f', 'r',
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 'e', 0, 0, 0, 0 };
+	size_t iSrc = iFirstDirty;
+	size_t iDst;
+
+	if(iSrc > maxDest - 3)
+		iSrc = maxDest - 3;
+	memcpy(pDst, pszMsg, iSrc);
+	iDst = iSrc;
+	while(iSrc < lenMsg && iDst < maxDest - 3) {
+		const uchar c = pszMsg[iSrc];
+		if(c < 32 && (c != '\t' || opts->bEscapeTab)) {
+			if(c == '\0' || opts->bEscapeCC) {
+				if(opts->bCStyle) {
+					pDst[iDst++] = '\\';
+					if(cstyle[c]) {
+						pDst[iDst++] = cstyle[c];
+					} else {
+						pDst[iDst++] = 'x';
+						pDst[iDst++] = hexdigit[(c & 0xF0) >> 4];
+						pDst[iDst++] = hexdigit[c & 0xF];
+					}
+				} else {
+					iDst = baseEscapeOctal(pDst, iDst, c, opts);
+				}
+			}
+		} else if(c > 127 && opts->bEscape8Bit) {
+			if(opts->bCStyle) {
+				pDst[iDst++] = '\\';
+				pDst[iDst++] = 'x';
+				pDst[iDst++] = hexdigit[(c & 0xF0) >> 4];
+				pDst[iDst++] = hexdigit[c & 0xF];
+			} else {
+				iDst = baseEscapeOctal(pDst, iDst, c, opts);
+			}
+		} else {
+			pDst[iDst++] = c;
+		}
+		++iSrc;
+	}
+	pDst[iDst] = '\0';
+	return iDst;
+}
+
+/* a typical syslog message body; dirty messages carry a tab, an escape
+ * sequence or UTF-8 text somewhere in the middle
+ */
+static uchar *
+mkMsg(int i, int bDirty, size_t *pLen)
+{
+	char buf[1024];
+	const char *extra = "";
+
+	if(bDirty) {
+		switch(i % 3) {
+		case 0: extra = "\tstatus=500"; break;
+		case 1: extra = " \033[31mERROR\033[0m"; break;
+		case 2: extra = " user=J\xc3\xbcrgen M\xc3\xbcller"; break;
+		}
+	}
+	*pLen = snprintf(buf, sizeof(buf), "<134>1 2017-03-%02d %02d:%02d:%02d.%03dZ web%02d.example.net "
+		"nginx %d - - 10.%d.%d.%d - - \"GET /api/v2/orders/%d?expand=items HTTP/1.1\"%s 200 %d "
+		"\"-\" \"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\"",
+		1 + i % 28, i % 24, i % 60, (i / 60) % 60, i % 1000, i % 32, 1000 + i % 30000,
+		i % 256, (i / 7) % 256, (i / 13) % 256, i, extra, 200 + i % 9000);
+	return (uchar*) strdup(buf);
+}
+
+static void
+runCorpus(const char *name, int bDirty, const sanitizeOpts_t *opts)
+{
+	uchar **msgs;
+	size_t *lens;
+	uchar *dstBase, *dstNew;
+	size_t lenBase, lenNew;
+	double t, tBase, tNew;
+	long bytes = 0, dirty = 0;
+	int i, r;
+
+	msgs = malloc(nMsgs * sizeof(uchar*));
+	lens = malloc(nMsgs * sizeof(size_t));
+	dstBase = malloc(MAXDEST + 1);
+	dstNew = malloc(MAXDEST + 1);
+	if(msgs == NULL || lens == NULL || dstBase == NULL || dstNew == NULL) {
+		fprintf(stderr, "sanitize_bench: out of memory\n");
+		exit(1);
+	}
+	for(i = 0 ; i < nMsgs ; ++i) {
+		msgs[i] = mkMsg(i, bDirty, &lens[i]);
+		bytes += lens[i];
+	}
+
+	/* functional cross-check */
+	for(i = 0 ; i < nMsgs ; ++i) {
+		const size_t dBase = baseCheck(msgs[i], lens[i], opts);
+		const size_t dNew = sanitizeCheck(msgs[i], lens[i], opts);
+		if(dBase != dNew) {
+			fprintf(stderr, "sanitize_bench: %s: first dirty char %zu vs %zu in '%s'\n",
+				name, dBase, dNew, msgs[i]);
+			++errs;
+			continue;
+		}
+		if(dNew == lens[i])
+			continue;
+		++dirty;
+		lenBase = baseEscape(msgs[i], lens[i], dBase, dstBase, MAXDEST, opts);
+		lenNew = sanitizeEscape(msgs[i], lens[i], dNew, dstNew, MAXDEST, opts);
+		if(lenBase != lenNew || memcmp(dstBase, dstNew, lenNew + 1)) {
+			fprintf(stderr, "sanitize_bench: %s: output differs: '%s' vs '%s'\n",
+				name, dstBase, dstNew);
+			++errs;
+		}
+	}
+	if(bDirty && dirty == 0) {
+		fprintf(stderr, "sanitize_bench: %s: no message needs sanitizing\n", name);
+		++errs;
+	}
+
+	t = now();
+	for(r = 0 ; r < nRounds ; ++r)
+		for(i = 0 ; i < nMsgs ; ++i) {
+			const size_t d = baseCheck(msgs[i], lens[i], opts);
+			if(d != lens[i])
+				baseEscape(msgs[i], lens[i], d, dstBase, MAXDEST, opts);
+		}
+	tBase = now() - t;
+
+	t = now();
+	for(r = 0 ; r < nRounds ; ++r)
+		for(i = 0 ; i < nMsgs ; ++i) {
+			const size_t d = sanitizeCheck(msgs[i], lens[i], opts);
+			if(d != lens[i])
+				sanitizeEscape(msgs[i], lens[i], d, dstNew, MAXDEST, opts);
+		}
+	tNew = now() - t;
+
+	printf("%-22s %6.1f ns/msg %5.2f GB/s  byte-wise %6.1f ns/msg %5.2f GB/s\n", name,
+		tNew * 1e9 / ((double) nRounds * nMsgs), (double) bytes * nRounds / tNew / 1e9,
+		tBase * 1e9 / ((double) nRounds * nMsgs), (double) bytes * nRounds / tBase / 1e9);
+
+	for(i = 0 ; i < nMsgs ; ++i)
+		free(msgs[i]);
+	free(msgs);
+	free(lens);
+	free(dstBase);
+	free(dstNew);
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	/* rsyslog defaults: escape control characters including tab, octal style */
+	sanitizeOpts_t dflt = { 1, 0, 0, 1, 0, '#' };
+	sanitizeOpts_t esc8 = { 1, 1, 0, 1, 1, '#' };
+
+	while((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch(c) {
+		case 'n':
+			nMsgs = atoi(optarg);
+			break;
+		case 'r':
+			nRounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: sanitize_bench [-n messages] [-r rounds]\n");
+			exit(1);
+		}
+	}
+	if(nMsgs < 3 || nRounds < 1) {
+		fprintf(stderr, "sanitize_bench: invalid parameters\n");
+		exit(1);
+	}
+
+	runCorpus("clean", 0, &dflt);
+	runCorpus("clean, 8bit+cstyle", 0, &esc8);
+	runCorpus("dirty", 1, &dflt);
+	runCorpus("dirty, 8bit+cstyle", 1, &esc8);
+	return errs ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Functional check of the word-at-a-time message sanitizer against a
+# byte-at-a-time implementation, using the microbenchmark with a small
+# workload. Run ./sanitize_bench without options for timings.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[sanitize_bench.sh\]: testing message sanitizer
+./sanitize_bench -n 3000 -r 1
+if [ $? -ne 0 ]; then
+	echo "FAIL: message sanitizer output differs"
+	exit 1
+fi
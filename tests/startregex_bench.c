@@ -0,0 +1,146 @@
+/* microbenchmark for the imfile startmsg.regex matcher (runtime/startregex.c)
+ * against calling regexec() on every line, as strmReadMultiLine() did
+ * before. The input is a synthetic Java application log where most lines
+ * are stack-trace continuations. Both matchers must classify every line
+ * the same way, so this also serves as a functional test.
+ * usage: ./startregex_bench [-s size-in-MB]
+ * Use -s 1024 for the 1 GB log; lines are generated from a pool and not
+ * kept in memory, so this does not need 1 GB of RAM.
+ *
+ * Part of rsyslog, licensed under ASL 2.0
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include "rsyslog.h"
+#include "startregex.h"
+
+/* satisfy the debug references of startregex.c */
+int Debug = 0;
+void dbgprintf(const char __attribute__((unused)) *fmt, ...) {}
+
+#define POOLSIZE 4096
+static long sizeMB = 64;
+static int errs = 0;
+
+/* start regexes as found in real configs, from "no usable prefix" over
+ * "prefix plus regex" to "prefix only"
+ */
+static const char *regexes[] = {
+	"^[0-9]{4}-[0-9]{2}-[0-9]{2}",
+	"^2017-[0-9]{2}-[0-9]{2} [0-9:,]+ (ERROR|WARN|INFO)",
+	"^2017-",
+	NULL
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* one message header followed by a stack trace of varying depth */
+static char *
+mkLine(int i)
+{
+	char buf[256];
+	const int pos = i % 24;
+
+	if(pos == 0) {
+		snprintf(buf, sizeof(buf), "2017-%02d-%02d %02d:%02d:%02d,%03d %s [worker-%d] "
+			"com.example.shop.OrderService - request %d failed",
+			1 + i % 12, 1 + i % 28, i % 24, i % 60, (i / 60) % 60, i % 1000,
+			(i % 3) ? "ERROR" : "WARN", i % 16, i);
+	} else if(pos == 12) {
+		snprintf(buf, sizeof(buf), "Caused by: java.sql.SQLTransientConnectionException: "
+			"pool-%d - Connection is not available, request timed out after %dms.",
+			i % 4, 30000 + i % 1000);
+	} else {
+		snprintf(buf, sizeof(buf), "\tat com.example.shop.%s.%s(%s.java:%d)",
+			(pos % 3) ? "OrderService" : "PaymentGateway", (pos % 2) ? "process" : "invoke",
+			(pos % 3) ? "OrderService" : "PaymentGateway", 100 + i % 900);
+	}
+	return strdup(buf);
+}
+
+static void
+report(const char *re, const char *impl, double t, long lines)
+{
+	printf("%-50s %-11s %8.3f s %7.1f ns/line\n", re, impl, t, t * 1e9 / lines);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, i, j;
+	char *pool[POOLSIZE];
+	size_t lenPool[POOLSIZE];
+	size_t poolBytes = 0;
+	long nLines, n;
+	long matchesRe, matchesStart;
+	regex_t preg;
+	strmStartRegex_t startRe;
+	double t;
+
+	while((c = getopt(argc, argv, "s:")) != -1) {
+		switch(c) {
+		case 's':
+			sizeMB = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: startregex_bench [-s size-in-MB]\n");
+			exit(1);
+		}
+	}
+	if(sizeMB < 1) {
+		fprintf(stderr, "startregex_bench: invalid parameters\n");
+		exit(1);
+	}
+
+	for(i = 0 ; i < POOLSIZE ; ++i) {
+		pool[i] = mkLine(i);
+		lenPool[i] = strlen(pool[i]);
+		poolBytes += lenPool[i] + 1;
+	}
+	nLines = (long) ((sizeMB * 1024 * 1024) / (poolBytes / POOLSIZE));
+	printf("%ld MB synthetic log, %ld lines\n", sizeMB, nLines);
+
+	for(j = 0 ; regexes[j] != NULL ; ++j) {
+		if(regcomp(&preg, regexes[j], REG_EXTENDED | REG_NOSUB) != 0
+		   || strmStartRegexCompile(&startRe, (uchar*) regexes[j]) != RS_RET_OK) {
+			fprintf(stderr, "startregex_bench: cannot compile '%s'\n", regexes[j]);
+			exit(1);
+		}
+
+		matchesRe = 0;
+		t = now();
+		for(n = 0 ; n < nLines ; ++n)
+			matchesRe += !regexec(&preg, pool[n % POOLSIZE], 0, NULL, 0);
+		report(regexes[j], "regexec", now() - t, nLines);
+
+		matchesStart = 0;
+		t = now();
+		for(n = 0 ; n < nLines ; ++n)
+			matchesStart += strmStartRegexMatch(&startRe, (uchar*) pool[n % POOLSIZE],
+							    lenPool[n % POOLSIZE]);
+		report(regexes[j], "startregex", now() - t, nLines);
+
+		if(matchesRe != matchesStart || matchesRe == 0) {
+			fprintf(stderr, "startregex_bench: '%s': regexec matched %ld lines, "
+				"startregex %ld\n", regexes[j], matchesRe, matchesStart);
+			++errs;
+		}
+		regfree(&preg);
+		strmStartRegexFree(&startRe);
+	}
+
+	for(i = 0 ; i < POOLSIZE ; ++i)
+		free(pool[i]);
+	return errs ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+#!/bin/bash
+# Functional check of the imfile start regex prefilter against plain
+# regexec(), using the microbenchmark with a small log. Run
+# ./startregex_bench -s 1024 for timings on a 1 GB log.
+# This file is part of the rsyslog project, released under ASL 2.0
+echo \[startregex_bench.sh\]: testing start regex prefilter
+./startregex_bench -s 8
+if [ $? -ne 0 ]; then
+	echo "FAIL: start regex prefilter differs from regexec"
+	exit 1
+fi
@@ -0,0 +1,21 @@
+#!/bin/bash
+# check that latency histograms are reported via impstats
+# This file is part of the rsyslog project, released under ASL 2.0
+echo ===============================================================================
+echo \[stats-latency.sh\]: test queue and action latency histograms
+. $srcdir/diag.sh init
+. $srcdir/diag.sh startup stats-latency.conf
+. $srcdir/diag.sh wait-for-stats-flush 'rsyslog.out.stats.log'
+. $srcdir/diag.sh injectmsg  0 1000
+. $srcdir/diag.sh wait-queueempty
+. $srcdir/diag.sh msleep 2100
+echo doing shutdown
+. $srcdir/diag.sh shutdown-when-empty
+echo wait on shutdown
+. $srcdir/diag.sh wait-shutdown
+. $srcdir/diag.sh seq-check  0 999
+. $srcdir/diag.sh custom-content-check 'latency.enqdeq.us.p99=' 'rsyslog.out.stats.log'
+. $srcdir/diag.sh custom-content-check 'latency.commit.us.p50=' 'rsyslog.out.stats.log'
+# every message is committed exactly once, so the counts must add up
+. $srcdir/diag.sh first-column-sum-check 's/.*latency.commit.us.count=\([0-9]*\).*/\1/g' 'latency_out:' 'rsyslog.out.stats.log' 1000
+. $srcdir/diag.sh exit
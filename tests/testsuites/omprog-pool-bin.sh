@@ -0,0 +1,12 @@
+#!/bin/bash
+# reads octet-counted batches from omprog and confirms each of them
+outfile=rsyslog.out.log
+
+while read -r count; do
+	for (( i = 0; i < count; i++ )); do
+		read -r -d ' ' len || exit 0
+		IFS= read -r -N $len msg || exit 0
+		printf '%s' "$msg" >> $outfile
+	done
+	echo OK
+done
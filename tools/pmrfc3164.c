@@ -160,13 +160,16 @@ ENDfreeParserInst
 
 /* parse a legay-formatted syslog message.
  */
-BEGINparse2
+static rsRetVal
+parseRFC3164(instanceConf_t *const pInst, smsg_t *const pMsg)
+{
 	uchar *p2parse;
 	int lenMsg;
 	int i;	/* general index for parsing */
 	uchar bufParseTAG[CONF_TAG_MAXSIZE];
 	uchar bufParseHOSTNAME[CONF_HOSTNAME_MAXSIZE];
-CODESTARTparse
+	DEFiRet;
+
 	DBGPRINTF("Message will now be parsed by the legacy syslog parser (one size fits all... ;)).\n");
 	assert(pMsg != NULL);
 	assert(pMsg->pszRawMsg != NULL);
@@ -330,9 +333,28 @@ CODESTARTparse
 
 finalize_it:
 	MsgSetMSGoffs(pMsg, p2parse - pMsg->pszRawMsg);
+	RETiRet;
+}
+
+
+BEGINparse2
+CODESTARTparse2
+	iRet = parseRFC3164(pInst, pMsg);
 ENDparse2
 
 
+/* the legacy parser never rejects a message, so for a batch we can
+ * simply run through all of them without any per-message dispatching.
+ */
+BEGINparseBatch
+	int i;
+CODESTARTparseBatch
+	assert(pInst != NULL);
+	for(i = 0 ; i < nMsgs ; ++i)
+		pRet[i] = parseRFC3164(pInst, ppMsg[i]);
+ENDparseBatch
+
+
 BEGINmodExit
 CODESTARTmodExit
 	/* release what we no longer need */
@@ -346,6 +368,7 @@ ENDmodExit
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
 CODEqueryEtryPt_STD_PMOD2_QUERIES
+CODEqueryEtryPt_parseBatch
 CODEqueryEtryPt_IsCompatibleWithFeature_IF_OMOD_QUERIES
 ENDqueryEtryPt
 
@@ -210,14 +210,20 @@ static int parseRFCStructuredData(uchar **pp2parse, uchar *pResult, int *pLenStr
  * <PRI> is already stripped when this function is entered. VERSION already
  * has been confirmed to be "1", but has NOT been stripped from the message.
  *
+ * pBuf is a work buffer which must be large enough to hold all of the
+ * message after the PRI. It is passed in by the caller, so that parseBatch()
+ * needs to allocate it only once per batch.
+ *
  * rger, 2005-11-24
  */
-BEGINparse
+static rsRetVal
+parseRFC5424(smsg_t *const pMsg, uchar *const pBuf)
+{
 	uchar *p2parse;
-	uchar *pBuf = NULL;
 	int lenMsg;
 	int bContParse = 1;
-CODESTARTparse
+	DEFiRet;
+
 	assert(pMsg != NULL);
 	assert(pMsg->pszRawMsg != NULL);
 	p2parse = pMsg->pszRawMsg + pMsg->offAfterPRI; /* point to start of text, after PRI */
@@ -232,13 +238,6 @@ CODESTARTparse
 	p2parse += 2;
 	lenMsg -= 2;
 
-	/* Now get us some memory we can use as a work buffer while parsing.
-	 * We simply allocated a buffer sufficiently large to hold all of the
-	 * message, so we can not run into any troubles. I think this is
-	 * wiser than to use individual buffers.
-	 */
-	CHKmalloc(pBuf = MALLOC(lenMsg + 1));
-		
 	/* IMPORTANT NOTE:
 	 * Validation is not actually done below nor are any errors handled. I have
 	 * NOT included this for the current proof of concept. However, it is strongly
@@ -294,12 +293,61 @@ CODESTARTparse
 	/* MSG */
 	MsgSetMSGoffs(pMsg, p2parse - pMsg->pszRawMsg);
 
+finalize_it:
+	RETiRet;
+}
+
+
+BEGINparse
+	uchar *pBuf = NULL;
+	int lenMsg;
+CODESTARTparse
+	assert(pMsg != NULL);
+	assert(pMsg->pszRawMsg != NULL);
+	lenMsg = pMsg->iLenRawMsg - pMsg->offAfterPRI;
+	if(lenMsg < 2) {
+		ABORT_FINALIZE(RS_RET_COULD_NOT_PARSE);
+	}
+
+	/* Now get us some memory we can use as a work buffer while parsing.
+	 * We simply allocated a buffer sufficiently large to hold all of the
+	 * message, so we can not run into any troubles. I think this is
+	 * wiser than to use individual buffers.
+	 */
+	CHKmalloc(pBuf = MALLOC(lenMsg + 1));
+	iRet = parseRFC5424(pMsg, pBuf);
+
 finalize_it:
 	if(pBuf != NULL)
 		free(pBuf);
 ENDparse
 
 
+/* batch version of parse(): one work buffer, sized for the largest
+ * message, is used for all messages of the batch.
+ */
+BEGINparseBatch
+	uchar *pBuf = NULL;
+	int lenMax = 0;
+	int i;
+CODESTARTparseBatch
+	for(i = 0 ; i < nMsgs ; ++i) {
+		if(ppMsg[i]->iLenRawMsg - ppMsg[i]->offAfterPRI > lenMax)
+			lenMax = ppMsg[i]->iLenRawMsg - ppMsg[i]->offAfterPRI;
+	}
+	if((pBuf = MALLOC(lenMax + 1)) == NULL) {
+		for(i = 0 ; i < nMsgs ; ++i)
+			pRet[i] = RS_RET_OUT_OF_MEMORY;
+		ABORT_FINALIZE(RS_RET_OUT_OF_MEMORY);
+	}
+	for(i = 0 ; i < nMsgs ; ++i)
+		pRet[i] = parseRFC5424(ppMsg[i], pBuf);
+
+finalize_it:
+	free(pBuf);
+ENDparseBatch
+
+
 BEGINmodExit
 CODESTARTmodExit
 	/* release what we no longer need */
@@ -313,6 +361,7 @@ ENDmodExit
 BEGINqueryEtryPt
 CODESTARTqueryEtryPt
 CODEqueryEtryPt_STD_PMOD_QUERIES
+CODEqueryEtryPt_parseBatch
 CODEqueryEtryPt_IsCompatibleWithFeature_IF_OMOD_QUERIES
 ENDqueryEtryPt
 
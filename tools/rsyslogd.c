@@ -663,13 +663,10 @@ preprocessBatch(batch_t *pBatch, int *pbShutdownImmediate) {
 				pMsg->msgFlags &= ~NEEDS_ACLCHK_U;
 			}
 		}
-		if((pMsg->msgFlags & NEEDS_PARSING) != 0) {
-			if((localRet = parser.ParseMsg(pMsg)) != RS_RET_OK)  {
-				DBGPRINTF("Message discarded, parsing error %d\n", localRet);
-				pBatch->eltState[i] = BATCH_STATE_DISC;
-			}
-		}
 	}
+	/* parse all messages in one go, so that parsers can work on the whole batch */
+	if((localRet = parser.ParseBatch(pBatch, pbShutdownImmediate)) != RS_RET_OK)
+		DBGPRINTF("preprocessBatch: batch parsing returned error %d\n", localRet);
 
 finalize_it:
 	if(propFromHost != NULL)